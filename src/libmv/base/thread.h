@@ -0,0 +1,118 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Thin wrappers around pthreads (pthreads-w32 on Windows) for the few places
+// that need a long-lived worker thread, which OpenMP does not provide. Users
+// must link against pthread.
+
+#ifndef LIBMV_BASE_THREAD_H
+#define LIBMV_BASE_THREAD_H
+
+#include <pthread.h>
+
+namespace libmv {
+
+class Mutex {
+ public:
+  Mutex() { pthread_mutex_init(&mutex_, NULL); }
+  ~Mutex() { pthread_mutex_destroy(&mutex_); }
+
+  void Lock() { pthread_mutex_lock(&mutex_); }
+  void Unlock() { pthread_mutex_unlock(&mutex_); }
+
+ private:
+  friend class ConditionVariable;
+  pthread_mutex_t mutex_;
+
+  Mutex(const Mutex &);
+  void operator=(const Mutex &);
+};
+
+// Holds a mutex for the lifetime of the object.
+class MutexLock {
+ public:
+  explicit MutexLock(Mutex *mutex) : mutex_(mutex) { mutex_->Lock(); }
+  ~MutexLock() { mutex_->Unlock(); }
+
+ private:
+  Mutex *mutex_;
+
+  MutexLock(const MutexLock &);
+  void operator=(const MutexLock &);
+};
+
+class ConditionVariable {
+ public:
+  ConditionVariable() { pthread_cond_init(&condition_, NULL); }
+  ~ConditionVariable() { pthread_cond_destroy(&condition_); }
+
+  // The mutex must be held; it is released while waiting. Wakeups may be
+  // spurious, so wait in a loop on the actual condition.
+  void Wait(Mutex *mutex) { pthread_cond_wait(&condition_, &mutex->mutex_); }
+  void Signal() { pthread_cond_signal(&condition_); }
+  void Broadcast() { pthread_cond_broadcast(&condition_); }
+
+ private:
+  pthread_cond_t condition_;
+
+  ConditionVariable(const ConditionVariable &);
+  void operator=(const ConditionVariable &);
+};
+
+// Subclass and implement Run(). Start() runs it on a new thread; Join() must
+// be called before the object is destroyed.
+class Thread {
+ public:
+  Thread() : started_(false) {}
+  virtual ~Thread() {}
+
+  bool Start() {
+    started_ = pthread_create(&thread_, NULL, &Thread::ThreadMain, this) == 0;
+    return started_;
+  }
+
+  void Join() {
+    if (started_) {
+      pthread_join(thread_, NULL);
+      started_ = false;
+    }
+  }
+
+  bool started() const { return started_; }
+
+ protected:
+  virtual void Run() = 0;
+
+ private:
+  static void *ThreadMain(void *thread) {
+    static_cast<Thread *>(thread)->Run();
+    return NULL;
+  }
+
+  pthread_t thread_;
+  bool started_;
+
+  Thread(const Thread &);
+  void operator=(const Thread &);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_BASE_THREAD_H
@@ -0,0 +1,419 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_CORRESPONDENCE_CSR_BIPARTITE_GRAPH_H_
+#define LIBMV_CORRESPONDENCE_CSR_BIPARTITE_GRAPH_H_
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace libmv {
+
+// A bipartite graph with labelled edges. It has the interface and iteration
+// order of BipartiteGraph, but answers neighbour queries without walking the
+// whole graph.
+//
+// Most edges live in a frozen compressed sparse row (CSR) adjacency: for each
+// side, the sorted node ids, where each node's row starts, and the sorted
+// neighbours in each row. The left rows hold the edge labels and the right
+// rows index into them. Edges inserted since the last Freeze() go to a sorted
+// delta buffer instead, and ranges merge the two. Once the delta buffer grows
+// past a fraction of the frozen edges, Insert() freezes it into the arrays.
+//
+// ToLeft(), ToRight(), NumLeftLeft() and NumLeftRight() cost O(log n) plus the
+// degree of the node. A frozen edge takes 20 bytes with int nodes and pointer
+// sized labels (such as the tagged features of Matches) on 64-bit systems,
+// against about 100 for the two std::maps of BipartiteGraph.
+//
+// Remove() only marks the edge, so it is safe while iterating; the space is
+// reclaimed by the next freeze. Insert() may freeze, which invalidates all
+// ranges and the pointers returned by Edge().
+template<typename T, typename EdgeT>
+class CsrBipartiteGraph {
+ private:
+  struct DeltaEdge {
+    DeltaEdge() : removed(false) {}
+    EdgeT edge;
+    bool removed;
+  };
+  // Keyed by (left, right).
+  typedef std::map<std::pair<T, T>, DeltaEdge> DeltaMap;
+  // The (right, left) keys of the delta edges, for the reversed ranges.
+  typedef std::set<std::pair<T, T> > DeltaKeys;
+
+  struct Adjacency {
+    // Returns the row of node, or -1 if it has no frozen edges.
+    int Row(T node) const {
+      typename std::vector<T>::const_iterator it =
+          std::lower_bound(nodes.begin(), nodes.end(), node);
+      if (it == nodes.end() || *it != node) {
+        return -1;
+      }
+      return it - nodes.begin();
+    }
+    void Clear() {
+      nodes.clear();
+      offsets.clear();
+      neighbours.clear();
+    }
+    void Swap(Adjacency *other) {
+      nodes.swap(other->nodes);
+      offsets.swap(other->offsets);
+      neighbours.swap(other->neighbours);
+    }
+
+    // The row of nodes[i] is [offsets[i], offsets[i + 1]) in neighbours.
+    std::vector<T> nodes;
+    std::vector<int> offsets;
+    std::vector<T> neighbours;
+  };
+
+ public:
+  CsrBipartiteGraph() : num_removed_(0) {}
+
+  void Insert(const T &left, const T &right, const EdgeT &edge) {
+    int index = FrozenIndex(left, right);
+    if (index >= 0) {
+      edges_[index] = edge;
+      if (removed_[index]) {
+        removed_[index] = false;
+        --num_removed_;
+      }
+      return;
+    }
+    std::pair<typename DeltaMap::iterator, bool> inserted =
+        delta_left_.insert(std::make_pair(std::make_pair(left, right),
+                                          DeltaEdge()));
+    DeltaEdge &delta = inserted.first->second;
+    delta.edge = edge;
+    if (delta.removed) {
+      delta.removed = false;
+      --num_removed_;
+    }
+    if (inserted.second) {
+      delta_right_.insert(std::make_pair(right, left));
+      if (delta_left_.size() + num_removed_ > FreezeThreshold()) {
+        Freeze();
+      }
+    }
+  }
+
+  void Remove(const T &left, const T &right) {
+    int index = FrozenIndex(left, right);
+    if (index >= 0) {
+      if (!removed_[index]) {
+        removed_[index] = true;
+        ++num_removed_;
+      }
+      return;
+    }
+    typename DeltaMap::iterator it =
+        delta_left_.find(std::make_pair(left, right));
+    if (it != delta_left_.end() && !it->second.removed) {
+      it->second.removed = true;
+      ++num_removed_;
+    }
+  }
+
+  int NumLeftLeft(T left) const {
+    int n = 0;
+    for (Range r = ToLeft(left); r; ++r) {
+      n++;
+    }
+    return n;
+  }
+
+  int NumLeftRight(T right) const {
+    int n = 0;
+    for (Range r = ToRight(right); r; ++r) {
+      n++;
+    }
+    return n;
+  }
+
+  // Erases all the elements.
+  // Note that this function does not desallocate pointers
+  void Clear() {
+    left_.Clear();
+    right_.Clear();
+    edges_.clear();
+    right_edges_.clear();
+    removed_.clear();
+    num_removed_ = 0;
+    delta_left_.clear();
+    delta_right_.clear();
+  }
+
+  // Merges the delta buffer into the CSR arrays and drops the removed edges.
+  // Insert() calls this as needed; calling it after loading many edges makes
+  // the queries that follow cheaper.
+  void Freeze() {
+    Adjacency left, right;
+    std::vector<EdgeT> edges;
+    left.neighbours.reserve(edges_.size() + delta_left_.size());
+    edges.reserve(edges_.size() + delta_left_.size());
+    for (Range r = All(); r; ++r) {
+      if (left.nodes.empty() || left.nodes.back() != r.left()) {
+        left.nodes.push_back(r.left());
+        left.offsets.push_back(left.neighbours.size());
+      }
+      left.neighbours.push_back(r.right());
+      edges.push_back(r.edge());
+    }
+    int num_edges = left.neighbours.size();
+    left.offsets.push_back(num_edges);
+
+    // Counting sort of the edges by right node. Walking them in left order
+    // leaves each right row sorted.
+    right.nodes = left.neighbours;
+    std::sort(right.nodes.begin(), right.nodes.end());
+    right.nodes.erase(std::unique(right.nodes.begin(), right.nodes.end()),
+                      right.nodes.end());
+    std::vector<int> rows(num_edges);
+    right.offsets.assign(right.nodes.size() + 1, 0);
+    for (int i = 0; i < num_edges; ++i) {
+      rows[i] = right.Row(left.neighbours[i]);
+      ++right.offsets[rows[i] + 1];
+    }
+    std::partial_sum(right.offsets.begin(), right.offsets.end(),
+                     right.offsets.begin());
+    std::vector<int> next(right.offsets.begin(), right.offsets.end() - 1);
+    std::vector<int> right_edges(num_edges);
+    right.neighbours.resize(num_edges);
+    for (int i = 0, row = 0; i < num_edges; ++i) {
+      while (left.offsets[row + 1] <= i) {
+        ++row;
+      }
+      int position = next[rows[i]]++;
+      right.neighbours[position] = left.nodes[row];
+      right_edges[position] = i;
+    }
+
+    left_.Swap(&left);
+    right_.Swap(&right);
+    edges_.swap(edges);
+    right_edges_.swap(right_edges);
+    removed_.assign(num_edges, false);
+    num_removed_ = 0;
+    delta_left_.clear();
+    delta_right_.clear();
+  }
+
+  class Range {
+   friend class CsrBipartiteGraph<T, EdgeT>;
+   public:
+    T left()  const { return reversed_ ? second_ : first_; }
+    T right() const { return reversed_ ? first_  : second_; }
+    EdgeT edge() const { return *edge_; }
+
+    void  operator++() {
+      if (in_frozen_) {
+        ++position_;
+      } else if (reversed_) {
+        ++reversed_it_;
+      } else {
+        ++delta_it_;
+      }
+      Settle();
+    }
+    EdgeT operator*()            { return *edge_; }
+    operator bool() const  { return edge_ != NULL; }
+
+   private:
+    Range(const CsrBipartiteGraph *graph, bool reversed,
+          int row, int position, int end,
+          typename DeltaMap::const_iterator delta_it,
+          typename DeltaMap::const_iterator delta_end,
+          typename DeltaKeys::const_iterator reversed_it,
+          typename DeltaKeys::const_iterator reversed_end)
+      : graph_(graph), reversed_(reversed),
+        row_(row), position_(position), end_(end),
+        delta_it_(delta_it), delta_end_(delta_end),
+        reversed_it_(reversed_it), reversed_end_(reversed_end),
+        edge_(NULL) {
+      Settle();
+    }
+
+    int EdgeIndex(int position) const {
+      return reversed_ ? graph_->right_edges_[position] : position;
+    }
+    bool DeltaLeft() const {
+      return reversed_ ? reversed_it_ != reversed_end_
+                       : delta_it_ != delta_end_;
+    }
+    // The key in the order of this range: (right, left) if reversed.
+    const std::pair<T, T> &DeltaKey() const {
+      return reversed_ ? *reversed_it_ : delta_it_->first;
+    }
+    const DeltaEdge &Delta() const {
+      if (!reversed_) {
+        return delta_it_->second;
+      }
+      return graph_->delta_left_.find(
+          std::make_pair(reversed_it_->second, reversed_it_->first))->second;
+    }
+
+    // Moves to the smaller of the next live frozen and delta edges.
+    void Settle() {
+      while (position_ < end_ && graph_->removed_[EdgeIndex(position_)]) {
+        ++position_;
+      }
+      while (DeltaLeft() && Delta().removed) {
+        if (reversed_) {
+          ++reversed_it_;
+        } else {
+          ++delta_it_;
+        }
+      }
+      bool frozen_left = position_ < end_;
+      if (!frozen_left && !DeltaLeft()) {
+        edge_ = NULL;
+        return;
+      }
+      if (frozen_left) {
+        const Adjacency &adjacency = reversed_ ? graph_->right_
+                                               : graph_->left_;
+        while (adjacency.offsets[row_ + 1] <= position_) {
+          ++row_;
+        }
+        first_ = adjacency.nodes[row_];
+        second_ = adjacency.neighbours[position_];
+        if (!DeltaLeft() || std::make_pair(first_, second_) < DeltaKey()) {
+          in_frozen_ = true;
+          edge_ = &graph_->edges_[EdgeIndex(position_)];
+          return;
+        }
+      }
+      in_frozen_ = false;
+      first_ = DeltaKey().first;
+      second_ = DeltaKey().second;
+      edge_ = &Delta().edge;
+    }
+
+    const CsrBipartiteGraph *graph_;
+    bool reversed_;
+    int row_, position_, end_;
+    typename DeltaMap::const_iterator delta_it_, delta_end_;
+    typename DeltaKeys::const_iterator reversed_it_, reversed_end_;
+    bool in_frozen_;
+    T first_, second_;
+    const EdgeT *edge_;
+  };
+
+  Range All() const {
+    return Range(this, false, 0, 0, edges_.size(),
+                 delta_left_.begin(), delta_left_.end(),
+                 delta_right_.end(), delta_right_.end());
+  }
+
+  Range AllReversed() const {
+    return Range(this, true, 0, 0, edges_.size(),
+                 delta_left_.end(), delta_left_.end(),
+                 delta_right_.begin(), delta_right_.end());
+  }
+
+  Range ToLeft(T left) const {
+    int row = left_.Row(left);
+    return Range(this, false, std::max(row, 0),
+                 row < 0 ? 0 : left_.offsets[row],
+                 row < 0 ? 0 : left_.offsets[row + 1],
+                 delta_left_.lower_bound(Lower(left)),
+                 delta_left_.upper_bound(Upper(left)),
+                 delta_right_.end(), delta_right_.end());
+  }
+
+  Range ToRight(T right) const {
+    int row = right_.Row(right);
+    return Range(this, true, std::max(row, 0),
+                 row < 0 ? 0 : right_.offsets[row],
+                 row < 0 ? 0 : right_.offsets[row + 1],
+                 delta_left_.end(), delta_left_.end(),
+                 delta_right_.lower_bound(Lower(right)),
+                 delta_right_.upper_bound(Upper(right)));
+  }
+
+  // Find a pointer to the edge, or NULL if not found.
+  const EdgeT *Edge(T left, T right) const {
+    int index = FrozenIndex(left, right);
+    if (index >= 0) {
+      return removed_[index] ? NULL : &edges_[index];
+    }
+    typename DeltaMap::const_iterator it =
+        delta_left_.find(std::make_pair(left, right));
+    if (it != delta_left_.end() && !it->second.removed) {
+      return &(it->second.edge);
+    }
+    return NULL;
+  }
+
+ private:
+  std::pair<T, T> Lower(T first) const {
+    return std::make_pair(first, std::numeric_limits<T>::min());
+  }
+  std::pair<T, T> Upper(T first) const {
+    return std::make_pair(first, std::numeric_limits<T>::max());
+  }
+
+  // Returns the index in edges_ of the frozen edge, or -1.
+  int FrozenIndex(T left, T right) const {
+    int row = left_.Row(left);
+    if (row < 0) {
+      return -1;
+    }
+    typename std::vector<T>::const_iterator begin =
+        left_.neighbours.begin() + left_.offsets[row];
+    typename std::vector<T>::const_iterator end =
+        left_.neighbours.begin() + left_.offsets[row + 1];
+    typename std::vector<T>::const_iterator it =
+        std::lower_bound(begin, end, right);
+    if (it == end || *it != right) {
+      return -1;
+    }
+    return it - left_.neighbours.begin();
+  }
+
+  // Freezing costs O(n log n), so let the delta buffer grow with the graph to
+  // keep the cost per insertion low.
+  size_t FreezeThreshold() const {
+    return std::max(static_cast<size_t>(1024), edges_.size() / 4);
+  }
+
+  Adjacency left_;
+  Adjacency right_;
+  // The labels of the frozen edges, in the order of left_.neighbours.
+  std::vector<EdgeT> edges_;
+  // For each entry of right_.neighbours, the index of its edge in edges_.
+  std::vector<int> right_edges_;
+  // Indexed like edges_.
+  std::vector<bool> removed_;
+  // Removed edges, frozen or not, that are still stored.
+  int num_removed_;
+  DeltaMap delta_left_;
+  DeltaKeys delta_right_;
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_CORRESPONDENCE_CSR_BIPARTITE_GRAPH_H_
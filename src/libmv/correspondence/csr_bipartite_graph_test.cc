@@ -0,0 +1,238 @@
+// Copyright (c) 2007, 2008 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cstdlib>
+
+#include "libmv/correspondence/bipartite_graph.h"
+#include "libmv/correspondence/csr_bipartite_graph.h"
+#include "testing/testing.h"
+
+using libmv::BipartiteGraph;
+using libmv::CsrBipartiteGraph;
+
+namespace {
+
+typedef CsrBipartiteGraph<int, char> TestGraph;
+
+struct Entry {
+  int left, right;
+  char edge;
+};
+
+void CheckIteratorOutput(TestGraph::Range it,
+                         const Entry *expected) {
+  int i = 0;
+  for (; it; ++it) {
+    ASSERT_TRUE(expected[i].left);
+    EXPECT_EQ(expected[i].left,  it.left());
+    EXPECT_EQ(expected[i].right, it.right());
+    EXPECT_EQ(expected[i].edge,  it.edge());
+    ++i;
+  }
+  EXPECT_EQ(0, expected[i].left);  // Zero terminated.
+}
+
+// Half of the edges frozen, the other half in the delta buffer.
+void InsertMixed(TestGraph *x) {
+  x->Insert(2, 2, 'd');
+  x->Insert(1, 1, 'a');
+  x->Insert(3, 2, 'f');
+  x->Freeze();
+  x->Insert(2, 3, 'e');
+  x->Insert(1, 2, 'c');
+  x->Insert(3, 5, 'g');
+}
+
+TEST(CsrBipartiteGraph, MultipleInsertions) {
+  TestGraph x;
+  x.Insert(1, 2, 'a');
+  x.Insert(2, 2, 'b');
+  x.Freeze();
+  x.Insert(1, 4, 'c');
+  x.Insert(2, 3, 'd');
+  EXPECT_EQ('a', *x.Edge(1, 2));
+  EXPECT_EQ('b', *x.Edge(2, 2));
+  EXPECT_EQ('c', *x.Edge(1, 4));
+  EXPECT_EQ('d', *x.Edge(2, 3));
+  EXPECT_EQ(NULL, x.Edge(1, 3));
+  EXPECT_EQ(NULL, x.Edge(5, 2));
+
+  // Replace a frozen and a delta edge.
+  x.Insert(1, 2, 'e');
+  x.Insert(1, 4, 'f');
+  EXPECT_EQ('e', *x.Edge(1, 2));
+  EXPECT_EQ('f', *x.Edge(1, 4));
+}
+
+TEST(CsrBipartiteGraph, MergesFrozenAndDeltaEdges) {
+  TestGraph x;
+  InsertMixed(&x);
+
+  Entry kAll[] = {
+    { 1, 1, 'a' },
+    { 1, 2, 'c' },
+    { 2, 2, 'd' },
+    { 2, 3, 'e' },
+    { 3, 2, 'f' },
+    { 3, 5, 'g' },
+    { 0, 0,  0  }
+  };
+  CheckIteratorOutput(x.All(), kAll);
+
+  Entry kAllReversed[] = {
+    { 1, 1, 'a' },
+    { 1, 2, 'c' },
+    { 2, 2, 'd' },
+    { 3, 2, 'f' },
+    { 2, 3, 'e' },
+    { 3, 5, 'g' },
+    { 0, 0,  0  }
+  };
+  CheckIteratorOutput(x.AllReversed(), kAllReversed);
+
+  Entry kToRight[] = {
+    { 1, 2, 'c' },
+    { 2, 2, 'd' },
+    { 3, 2, 'f' },
+    { 0, 0,  0  }
+  };
+  CheckIteratorOutput(x.ToRight(2), kToRight);
+
+  Entry kToLeft[] = {
+    { 2, 2, 'd' },
+    { 2, 3, 'e' },
+    { 0, 0,  0  }
+  };
+  CheckIteratorOutput(x.ToLeft(2), kToLeft);
+
+  // Freezing does not change the contents.
+  x.Freeze();
+  CheckIteratorOutput(x.All(), kAll);
+  CheckIteratorOutput(x.AllReversed(), kAllReversed);
+  CheckIteratorOutput(x.ToRight(2), kToRight);
+  CheckIteratorOutput(x.ToLeft(2), kToLeft);
+}
+
+TEST(CsrBipartiteGraph, Degrees) {
+  TestGraph x;
+  InsertMixed(&x);
+  EXPECT_EQ(2, x.NumLeftLeft(1));
+  EXPECT_EQ(2, x.NumLeftLeft(2));
+  EXPECT_EQ(2, x.NumLeftLeft(3));
+  EXPECT_EQ(0, x.NumLeftLeft(4));
+  EXPECT_EQ(1, x.NumLeftRight(1));
+  EXPECT_EQ(3, x.NumLeftRight(2));
+  EXPECT_EQ(0, x.NumLeftRight(4));
+
+  x.Remove(2, 2);
+  x.Remove(1, 2);
+  EXPECT_EQ(1, x.NumLeftLeft(1));
+  EXPECT_EQ(1, x.NumLeftLeft(2));
+  EXPECT_EQ(1, x.NumLeftRight(2));
+}
+
+TEST(CsrBipartiteGraph, RemoveWhileIterating) {
+  TestGraph x;
+  InsertMixed(&x);
+  for (TestGraph::Range r = x.ToRight(2); r; ++r) {
+    x.Remove(r.left(), r.right());
+  }
+  EXPECT_EQ(NULL, x.Edge(1, 2));
+  EXPECT_EQ(NULL, x.Edge(2, 2));
+  EXPECT_EQ(NULL, x.Edge(3, 2));
+  EXPECT_FALSE(x.ToRight(2));
+
+  Entry kAll[] = {
+    { 1, 1, 'a' },
+    { 2, 3, 'e' },
+    { 3, 5, 'g' },
+    { 0, 0,  0  }
+  };
+  CheckIteratorOutput(x.All(), kAll);
+
+  // Removed edges can come back.
+  x.Insert(2, 2, 'h');
+  x.Insert(1, 2, 'i');
+  EXPECT_EQ('h', *x.Edge(2, 2));
+  EXPECT_EQ('i', *x.Edge(1, 2));
+  EXPECT_EQ(2, x.NumLeftRight(2));
+
+  x.Freeze();
+  EXPECT_EQ(2, x.NumLeftRight(2));
+  EXPECT_EQ(NULL, x.Edge(3, 2));
+}
+
+TEST(CsrBipartiteGraph, Clear) {
+  TestGraph x;
+  InsertMixed(&x);
+  x.Clear();
+  EXPECT_FALSE(x.All());
+  EXPECT_FALSE(x.AllReversed());
+  EXPECT_EQ(NULL, x.Edge(1, 1));
+  x.Insert(1, 1, 'a');
+  EXPECT_EQ('a', *x.Edge(1, 1));
+}
+
+// Enough operations to freeze several times along the way.
+TEST(CsrBipartiteGraph, AgreesWithBipartiteGraph) {
+  CsrBipartiteGraph<int, int> csr;
+  BipartiteGraph<int, int> map;
+  srand(5);
+  for (int i = 0; i < 20000; ++i) {
+    int left = rand() % 50;
+    int right = rand() % 400;
+    if (rand() % 4 == 0) {
+      csr.Remove(left, right);
+      map.Remove(left, right);
+    } else {
+      csr.Insert(left, right, i);
+      map.Insert(left, right, i);
+    }
+  }
+
+  BipartiteGraph<int, int>::Range expected = map.All();
+  for (CsrBipartiteGraph<int, int>::Range r = csr.All(); r; ++r) {
+    ASSERT_TRUE(expected);
+    EXPECT_EQ(expected.left(), r.left());
+    EXPECT_EQ(expected.right(), r.right());
+    EXPECT_EQ(expected.edge(), r.edge());
+    ++expected;
+  }
+  EXPECT_FALSE(expected);
+
+  expected = map.AllReversed();
+  for (CsrBipartiteGraph<int, int>::Range r = csr.AllReversed(); r; ++r) {
+    ASSERT_TRUE(expected);
+    EXPECT_EQ(expected.left(), r.left());
+    EXPECT_EQ(expected.right(), r.right());
+    EXPECT_EQ(expected.edge(), r.edge());
+    ++expected;
+  }
+  EXPECT_FALSE(expected);
+
+  for (int left = 0; left < 50; ++left) {
+    EXPECT_EQ(map.NumLeftLeft(left), csr.NumLeftLeft(left));
+  }
+  for (int right = 0; right < 400; ++right) {
+    EXPECT_EQ(map.NumLeftRight(right), csr.NumLeftRight(right));
+  }
+}
+
+}  // namespace
@@ -18,30 +18,20 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
-#include <fstream>
-
 #include "libmv/correspondence/import_matches_txt.h"
+#include "libmv/correspondence/matches_file.h"
 
 namespace libmv {
 
-void ImportMatchesFromTxt(const std::string &input_file, 
+bool ImportMatchesFromTxt(const std::string &input_file, 
                           Matches *matches,
                           FeatureSet *feature_set) {
-  Matches::ImageID image_id = 0;
-  Matches::TrackID track_id = 0;
-  float x = 0, y = 0;
-  // Reserves 1e6 features to avoid problems during the resize
-  feature_set->features.reserve(1e6);
-  std::ifstream infile;
-  infile.open(input_file.c_str(), std::ios_base::in);
-  while (infile.good()) {
-    infile >> image_id >> track_id >> x >> y;
-    KeypointFeature pf;
-    pf.coords << x, y;
-    feature_set->features.push_back(pf);
-    matches->Insert(image_id, track_id, 
-                    &feature_set->features.back());
+  // Read all the markers first, so that the features are allocated once and
+  // the pointers given to matches stay valid.
+  MarkerColumns markers;
+  if (!ReadMarkersFromTxt(input_file, &markers)) {
+    return false;
   }
-  infile.close();
+  return MarkersToMatches(markers, matches, feature_set);
 }
 } // namespace libmv
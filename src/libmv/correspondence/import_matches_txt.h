@@ -29,7 +29,12 @@ namespace libmv {
 // Each line corresponds to a correspondence. 
 // The output format of point features is:
 // <ImageID> <TrackID> <x> <y>
-void ImportMatchesFromTxt(const std::string &input_file, 
+// The features are appended to feature_set, as in MarkersToMatches(); see
+// ImportMatchesFromBinary() in matches_file.h for a faster format.
+// Returns false, leaving matches and feature_set untouched, if the file can't
+// be read, has a line that doesn't parse, or its features don't fit in
+// feature_set.
+bool ImportMatchesFromTxt(const std::string &input_file, 
                           Matches *matches,
                           FeatureSet *feature_set);
 }  // namespace libmv
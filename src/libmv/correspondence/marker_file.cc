@@ -0,0 +1,475 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/correspondence/marker_file.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+namespace {
+
+const char kMagic[8] = { 'L', 'I', 'B', 'M', 'V', 'M', 'R', 'K' };
+const uint32_t kByteOrder = 0x01020304;
+
+// Readers size dense per image and per track tables by the largest id, so
+// ids in a file are bounded by its size in bytes, but allow at least this.
+const int64_t kMinimumIdBound = 1 << 20;
+
+int64_t Align8(int64_t offset) {
+  return (offset + 7) & ~static_cast<int64_t>(7);
+}
+
+// Orders marker positions by image, then track.
+struct ImageTrackLess {
+  explicit ImageTrackLess(const MarkerColumns &markers) : markers(markers) {}
+  bool operator()(int a, int b) const {
+    if (markers.images[a] != markers.images[b]) {
+      return markers.images[a] < markers.images[b];
+    }
+    return markers.tracks[a] < markers.tracks[b];
+  }
+  const MarkerColumns &markers;
+};
+
+template<typename T>
+bool WriteColumn(FILE *file,
+                 int64_t offset,
+                 const std::vector<T> &column,
+                 const std::vector<int> &order) {
+  if (fseek(file, offset, SEEK_SET) != 0) {
+    return false;
+  }
+  // Write in chunks, to keep the number of calls down without a copy of the
+  // whole column.
+  const int kChunkSize = 1 << 16;
+  std::vector<T> chunk;
+  chunk.reserve(std::min<size_t>(kChunkSize, order.size()));
+  for (size_t i = 0; i < order.size(); i += kChunkSize) {
+    size_t end = std::min(order.size(), i + kChunkSize);
+    chunk.clear();
+    for (size_t j = i; j < end; ++j) {
+      chunk.push_back(column[order[j]]);
+    }
+    if (fwrite(&chunk[0], sizeof(T), chunk.size(), file) != chunk.size()) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+void MarkerColumns::Clear() {
+  images.clear();
+  tracks.clear();
+  xs.clear();
+  ys.clear();
+}
+
+void MarkerColumns::Reserve(int size) {
+  images.reserve(size);
+  tracks.reserve(size);
+  xs.reserve(size);
+  ys.reserve(size);
+}
+
+void MarkerColumns::PushBack(int image, int track, double x, double y) {
+  images.push_back(image);
+  tracks.push_back(track);
+  xs.push_back(x);
+  ys.push_back(y);
+}
+
+bool WriteMarkerFile(const std::string &filename,
+                     const MarkerColumns &markers,
+                     bool image_index) {
+  int num_markers = markers.size();
+  std::vector<int> order(num_markers);
+  int max_image = -1;
+  for (int i = 0; i < num_markers; ++i) {
+    if (markers.images[i] < 0 || markers.tracks[i] < 0) {
+      LOG(ERROR) << "Negative image or track in marker " << i << ".";
+      return false;
+    }
+    order[i] = i;
+    max_image = std::max(max_image, static_cast<int>(markers.images[i]));
+  }
+  std::sort(order.begin(), order.end(), ImageTrackLess(markers));
+
+  MarkerFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kMarkerFileVersion;
+  header.byte_order = kByteOrder;
+  header.flags = image_index ? kMarkerFileImageIndex : 0;
+  header.num_markers = num_markers;
+  header.num_images = image_index ? max_image + 1 : 0;
+  header.images_offset = Align8(sizeof(header));
+  header.tracks_offset =
+      Align8(header.images_offset + num_markers * sizeof(int32_t));
+  header.xs_offset =
+      Align8(header.tracks_offset + num_markers * sizeof(int32_t));
+  header.ys_offset = header.xs_offset + num_markers * sizeof(double);
+  header.image_index_offset =
+      image_index ? header.ys_offset + num_markers * sizeof(double) : 0;
+
+  std::vector<int64_t> index;
+  if (image_index) {
+    index.resize(header.num_images + 1, 0);
+    for (int i = 0; i < num_markers; ++i) {
+      ++index[markers.images[i] + 1];
+    }
+    for (size_t i = 1; i < index.size(); ++i) {
+      index[i] += index[i - 1];
+    }
+  }
+
+  FILE *file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    LOG(ERROR) << "Couldn't open " << filename << " for writing: "
+               << strerror(errno);
+    return false;
+  }
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            WriteColumn(file, header.images_offset, markers.images, order) &&
+            WriteColumn(file, header.tracks_offset, markers.tracks, order) &&
+            WriteColumn(file, header.xs_offset, markers.xs, order) &&
+            WriteColumn(file, header.ys_offset, markers.ys, order);
+  if (ok && image_index) {
+    ok = fseek(file, header.image_index_offset, SEEK_SET) == 0 &&
+         fwrite(&index[0], sizeof(index[0]), index.size(), file) ==
+             index.size();
+  }
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    LOG(ERROR) << "Couldn't write " << filename << ".";
+  }
+  return ok;
+}
+
+MarkerFile::MarkerFile()
+    : data_(NULL),
+      size_(0),
+      mapped_(false),
+      header_(NULL),
+      images_(NULL),
+      tracks_(NULL),
+      xs_(NULL),
+      ys_(NULL),
+      image_index_(NULL) {}
+
+MarkerFile::~MarkerFile() {
+  Close();
+}
+
+bool MarkerFile::Open(const std::string &filename) {
+  Close();
+#ifndef _WIN32
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    LOG(ERROR) << "Couldn't open " << filename << ": " << strerror(errno);
+    return false;
+  }
+  struct stat status;
+  if (fstat(fd, &status) == 0 && status.st_size > 0) {
+    void *mapping = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapping != MAP_FAILED) {
+      data_ = static_cast<char *>(mapping);
+      size_ = status.st_size;
+      mapped_ = true;
+    }
+  }
+  // The mapping keeps the file alive.
+  close(fd);
+#else
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    LOG(ERROR) << "Couldn't open " << filename << ": " << strerror(errno);
+    return false;
+  }
+  if (fseek(file, 0, SEEK_END) == 0) {
+    long size = ftell(file);
+    if (size > 0 && fseek(file, 0, SEEK_SET) == 0) {
+      // new[] returns memory aligned for any of the column types.
+      data_ = new char[size];
+      size_ = size;
+      if (fread(data_, 1, size, file) != static_cast<size_t>(size)) {
+        delete [] data_;
+        data_ = NULL;
+      }
+    }
+  }
+  fclose(file);
+#endif
+  if (data_ == NULL || !Validate(size_)) {
+    LOG(ERROR) << filename << " is not a readable marker file.";
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MarkerFile::Close() {
+  if (data_ != NULL) {
+#ifndef _WIN32
+    if (mapped_) {
+      munmap(data_, size_);
+    }
+#else
+    delete [] data_;
+#endif
+  }
+  data_ = NULL;
+  size_ = 0;
+  mapped_ = false;
+  header_ = NULL;
+  images_ = tracks_ = NULL;
+  xs_ = ys_ = NULL;
+  image_index_ = NULL;
+}
+
+// Checks the header, that every column lies within the file, and that the
+// image index only holds positions of markers, so that MarkersInImage() stays
+// in range. The image and track numbers and the coordinates are trusted.
+bool MarkerFile::Validate(int64_t size) {
+  if (size < static_cast<int64_t>(sizeof(MarkerFileHeader))) {
+    return false;
+  }
+  header_ = reinterpret_cast<const MarkerFileHeader *>(data_);
+  if (memcmp(header_->magic, kMagic, sizeof(kMagic)) != 0) {
+    return false;
+  }
+  if (header_->byte_order != kByteOrder) {
+    LOG(ERROR) << "Marker file written on a machine of another byte order.";
+    return false;
+  }
+  if (header_->version > kMarkerFileVersion) {
+    LOG(ERROR) << "Marker file version " << header_->version
+               << " is newer than this reader.";
+    return false;
+  }
+  int64_t n = header_->num_markers;
+  if (n < 0 || n > 0x7fffffff || header_->num_images < 0) {
+    return false;
+  }
+  // The lengths can't overflow since n is bounded, but the offsets come
+  // straight from the file; compare against what is left after them.
+  struct Column {
+    int64_t offset;
+    int64_t length;
+  } columns[] = {
+    { header_->images_offset, n * static_cast<int64_t>(sizeof(int32_t)) },
+    { header_->tracks_offset, n * static_cast<int64_t>(sizeof(int32_t)) },
+    { header_->xs_offset, n * static_cast<int64_t>(sizeof(double)) },
+    { header_->ys_offset, n * static_cast<int64_t>(sizeof(double)) },
+  };
+  for (int i = 0; i < 4; ++i) {
+    if (columns[i].offset < static_cast<int64_t>(sizeof(MarkerFileHeader)) ||
+        columns[i].offset % 8 != 0 ||
+        columns[i].offset > size ||
+        columns[i].length > size - columns[i].offset) {
+      return false;
+    }
+  }
+  images_ = reinterpret_cast<const int32_t *>(data_ + header_->images_offset);
+  tracks_ = reinterpret_cast<const int32_t *>(data_ + header_->tracks_offset);
+  xs_ = reinterpret_cast<const double *>(data_ + header_->xs_offset);
+  ys_ = reinterpret_cast<const double *>(data_ + header_->ys_offset);
+
+  if (header_->flags & kMarkerFileImageIndex) {
+    int64_t offset = header_->image_index_offset;
+    if (offset < static_cast<int64_t>(sizeof(MarkerFileHeader)) ||
+        offset % 8 != 0 || offset > size ||
+        header_->num_images >=
+            (size - offset) / static_cast<int64_t>(sizeof(int64_t))) {
+      return false;
+    }
+    const int64_t *index = reinterpret_cast<const int64_t *>(data_ + offset);
+    int64_t num_images = header_->num_images;
+    if (index[0] != 0 || index[num_images] != n) {
+      return false;
+    }
+    for (int64_t i = 0; i < num_images; ++i) {
+      if (index[i + 1] < index[i]) {
+        return false;
+      }
+    }
+    image_index_ = index;
+  }
+
+  // The columns come from the file as well. Check that the ids are in range
+  // and the markers sorted by image then track, as the readers assume.
+  const int64_t max_id = std::max(size, kMinimumIdBound);
+  for (int64_t i = 0; i < n; ++i) {
+    if (images_[i] < 0 || images_[i] >= max_id ||
+        tracks_[i] < 0 || tracks_[i] >= max_id) {
+      LOG(ERROR) << "Marker file has an id out of range at marker " << i
+                 << ".";
+      return false;
+    }
+    if (i > 0 && (images_[i] < images_[i - 1] ||
+                  (images_[i] == images_[i - 1] &&
+                   tracks_[i] < tracks_[i - 1]))) {
+      LOG(ERROR) << "Marker file is not sorted at marker " << i << ".";
+      return false;
+    }
+  }
+  if (image_index_ != NULL) {
+    for (int64_t image = 0; image < header_->num_images; ++image) {
+      for (int64_t i = image_index_[image]; i < image_index_[image + 1]; ++i) {
+        if (images_[i] != image) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void MarkerFile::MarkersInImage(int image, int *begin, int *end) const {
+  *begin = *end = 0;
+  if (data_ == NULL || image < 0) {
+    return;
+  }
+  if (image_index_ != NULL) {
+    if (image < header_->num_images) {
+      *begin = image_index_[image];
+      *end = image_index_[image + 1];
+    }
+    return;
+  }
+  const int32_t *first = images_;
+  const int32_t *last = images_ + header_->num_markers;
+  std::pair<const int32_t *, const int32_t *> range =
+      std::equal_range(first, last, static_cast<int32_t>(image));
+  *begin = range.first - first;
+  *end = range.second - first;
+}
+
+void MarkerFile::ToColumns(MarkerColumns *markers) const {
+  int n = num_markers();
+  markers->images.assign(images_, images_ + n);
+  markers->tracks.assign(tracks_, tracks_ + n);
+  markers->xs.assign(xs_, xs_ + n);
+  markers->ys.assign(ys_, ys_ + n);
+}
+
+bool ReadMarkersFromTxt(const std::string &filename, MarkerColumns *markers) {
+  markers->Clear();
+  FILE *file = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    LOG(ERROR) << "Couldn't open " << filename << ": " << strerror(errno);
+    return false;
+  }
+  // Parse the whole file from memory; the streams are many times slower.
+  std::vector<char> text;
+  char buffer[1 << 16];
+  size_t num_read;
+  while ((num_read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    text.insert(text.end(), buffer, buffer + num_read);
+  }
+  fclose(file);
+  text.push_back('\0');
+
+  const char *p = &text[0];
+  int line = 1;
+  for (;;) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+      line += *p++ == '\n';
+    }
+    if (*p == '\0') {
+      return true;
+    }
+    char *end;
+    long image = strtol(p, &end, 10);
+    bool ok = end != p;
+    p = end;
+    long track = strtol(p, &end, 10);
+    ok = ok && end != p;
+    p = end;
+    double x = strtod(p, &end);
+    ok = ok && end != p;
+    p = end;
+    double y = strtod(p, &end);
+    ok = ok && end != p;
+    p = end;
+    if (!ok) {
+      LOG(ERROR) << filename << ":" << line << ": expected "
+                 << "<image> <track> <x> <y>.";
+      return false;
+    }
+    markers->PushBack(image, track, x, y);
+  }
+}
+
+bool WriteMarkersToTxt(const std::string &filename,
+                       const MarkerColumns &markers) {
+  FILE *file = fopen(filename.c_str(), "w");
+  if (file == NULL) {
+    LOG(ERROR) << "Couldn't open " << filename << " for writing: "
+               << strerror(errno);
+    return false;
+  }
+  bool ok = true;
+  for (int i = 0; ok && i < markers.size(); ++i) {
+    ok = fprintf(file, "%d %d %.17g %.17g\n",
+                 markers.images[i], markers.tracks[i],
+                 markers.xs[i], markers.ys[i]) > 0;
+  }
+  ok = fclose(file) == 0 && ok;
+  if (!ok) {
+    LOG(ERROR) << "Couldn't write " << filename << ".";
+  }
+  return ok;
+}
+
+bool ConvertMarkersTxtToBinary(const std::string &txt_filename,
+                               const std::string &binary_filename,
+                               bool image_index) {
+  MarkerColumns markers;
+  return ReadMarkersFromTxt(txt_filename, &markers) &&
+         WriteMarkerFile(binary_filename, markers, image_index);
+}
+
+bool ConvertMarkersBinaryToTxt(const std::string &binary_filename,
+                               const std::string &txt_filename) {
+  MarkerFile file;
+  if (!file.Open(binary_filename)) {
+    return false;
+  }
+  MarkerColumns markers;
+  file.ToColumns(&markers);
+  return WriteMarkersToTxt(txt_filename, markers);
+}
+
+}  // namespace libmv
@@ -0,0 +1,156 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_CORRESPONDENCE_MARKER_FILE_H_
+#define LIBMV_CORRESPONDENCE_MARKER_FILE_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+namespace libmv {
+
+// Markers (an image, a track and a position each) as parallel columns. This is
+// what marker files store, whether the markers come from Matches or Tracks.
+struct MarkerColumns {
+  void Clear();
+  void Reserve(int size);
+  void PushBack(int image, int track, double x, double y);
+  int size() const { return images.size(); }
+
+  std::vector<int32_t> images;
+  std::vector<int32_t> tracks;
+  std::vector<double> xs;
+  std::vector<double> ys;
+};
+
+// A marker file is a versioned binary container of markers, laid out so that
+// a reader can map it and use the columns in place, without parsing:
+//
+//   MarkerFileHeader  (magic, version, flags, counts and column offsets)
+//   int32_t images[num_markers]
+//   int32_t tracks[num_markers]
+//   double  xs[num_markers]
+//   double  ys[num_markers]
+//   int64_t image_index[num_images + 1]  (only with kMarkerFileImageIndex)
+//
+// Columns start at multiples of 8 bytes and are in the byte order of the
+// machine that wrote them; readers refuse files of the other byte order. The
+// markers are sorted by image, then by track. The optional image index holds,
+// for each image from 0 to the largest one, the position of its first marker,
+// followed by num_markers; the markers in image i are then
+// [image_index[i], image_index[i + 1]).
+enum {
+  kMarkerFileVersion = 1,
+  kMarkerFileImageIndex = 1,
+};
+
+struct MarkerFileHeader {
+  char magic[8];  // "LIBMVMRK"
+  uint32_t version;
+  uint32_t byte_order;  // 0x01020304 as written.
+  uint32_t flags;
+  uint32_t reserved;
+  int64_t num_markers;
+  int64_t num_images;  // Entries in the image index minus one, or 0.
+  int64_t images_offset;
+  int64_t tracks_offset;
+  int64_t xs_offset;
+  int64_t ys_offset;
+  int64_t image_index_offset;  // 0 without an index.
+};
+
+// Writes the markers to filename, sorted by image then track, with an image
+// index if image_index is set. Images and tracks must not be negative.
+// Returns false on error.
+bool WriteMarkerFile(const std::string &filename,
+                     const MarkerColumns &markers,
+                     bool image_index = true);
+
+// A marker file mapped read-only; the columns point into the mapping and stay
+// valid until the file is closed. On Windows the file is read into memory
+// instead.
+class MarkerFile {
+ public:
+  MarkerFile();
+  ~MarkerFile();
+
+  // Returns false, with the file closed, if it cannot be read or is not a
+  // valid marker file of this byte order and a supported version. Every
+  // marker is checked: ids must not be negative nor much larger than the
+  // file, the markers must be sorted, and the image index must agree with
+  // the images.
+  bool Open(const std::string &filename);
+  void Close();
+  bool IsOpen() const { return data_ != NULL; }
+
+  int num_markers() const {
+    return header_ != NULL ? header_->num_markers : 0;
+  }
+  const int32_t *images() const { return images_; }
+  const int32_t *tracks() const { return tracks_; }
+  const double *xs() const { return xs_; }
+  const double *ys() const { return ys_; }
+
+  bool HasImageIndex() const { return image_index_ != NULL; }
+
+  // Sets [*begin, *end) to the positions of the markers in image, which is
+  // empty for images the file does not have. Uses the image index if there
+  // is one, and a binary search otherwise.
+  void MarkersInImage(int image, int *begin, int *end) const;
+
+  // Copies all the markers.
+  void ToColumns(MarkerColumns *markers) const;
+
+ private:
+  bool Validate(int64_t size);
+
+  char *data_;
+  int64_t size_;
+  bool mapped_;
+  const MarkerFileHeader *header_;
+  const int32_t *images_;
+  const int32_t *tracks_;
+  const double *xs_;
+  const double *ys_;
+  const int64_t *image_index_;
+
+  MarkerFile(const MarkerFile &);
+  void operator=(const MarkerFile &);
+};
+
+// Reads or writes markers in the text format of ExportMatchesToTxt(), one
+// "<image> <track> <x> <y>" line per marker. Returns false on error, or if a
+// line of the file cannot be parsed.
+bool ReadMarkersFromTxt(const std::string &filename, MarkerColumns *markers);
+bool WriteMarkersToTxt(const std::string &filename,
+                       const MarkerColumns &markers);
+
+// Converters between the text format and marker files.
+bool ConvertMarkersTxtToBinary(const std::string &txt_filename,
+                               const std::string &binary_filename,
+                               bool image_index = true);
+bool ConvertMarkersBinaryToTxt(const std::string &binary_filename,
+                               const std::string &txt_filename);
+
+}  // namespace libmv
+
+#endif  // LIBMV_CORRESPONDENCE_MARKER_FILE_H_
@@ -0,0 +1,323 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "libmv/correspondence/import_matches_txt.h"
+#include "libmv/correspondence/marker_file.h"
+#include "libmv/correspondence/matches_file.h"
+#include "testing/testing.h"
+
+namespace {
+
+using namespace libmv;
+
+std::string TempFile(const char *name) {
+  const char *directory = getenv("TMPDIR");
+  return std::string(directory ? directory : "/tmp") + "/" + name;
+}
+
+// Markers in no particular order, with a gap in the images.
+void MakeMarkers(MarkerColumns *markers) {
+  markers->Clear();
+  markers->PushBack(3, 1, 0.5, 1.25);
+  markers->PushBack(0, 2, 10, 20);
+  markers->PushBack(3, 0, -1.0 / 3, 1e-9);
+  markers->PushBack(0, 1, 7, 8);
+  markers->PushBack(1, 2, 11, 21);
+}
+
+TEST(MarkerFile, RoundTripSortedByImageThenTrack) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  for (int image_index = 0; image_index < 2; ++image_index) {
+    std::string filename = TempFile("markers.bin");
+    ASSERT_TRUE(WriteMarkerFile(filename, markers, image_index));
+
+    MarkerFile file;
+    ASSERT_TRUE(file.Open(filename));
+    EXPECT_EQ(image_index != 0, file.HasImageIndex());
+    ASSERT_EQ(5, file.num_markers());
+    const int kImages[] = { 0, 0, 1, 3, 3 };
+    const int kTracks[] = { 1, 2, 2, 0, 1 };
+    for (int i = 0; i < 5; ++i) {
+      EXPECT_EQ(kImages[i], file.images()[i]);
+      EXPECT_EQ(kTracks[i], file.tracks()[i]);
+    }
+    EXPECT_EQ(7, file.xs()[0]);
+    EXPECT_EQ(-1.0 / 3, file.xs()[3]);
+    EXPECT_EQ(1e-9, file.ys()[3]);
+
+    int begin, end;
+    file.MarkersInImage(3, &begin, &end);
+    EXPECT_EQ(3, begin);
+    EXPECT_EQ(5, end);
+    file.MarkersInImage(2, &begin, &end);
+    EXPECT_EQ(begin, end);
+    file.MarkersInImage(9, &begin, &end);
+    EXPECT_EQ(begin, end);
+
+    file.Close();
+    EXPECT_FALSE(file.IsOpen());
+    remove(filename.c_str());
+  }
+}
+
+TEST(MarkerFile, RejectsBadFiles) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  std::string filename = TempFile("markers.bin");
+  ASSERT_TRUE(WriteMarkerFile(filename, markers));
+
+  // Cut short in the middle of the columns.
+  std::string truncated = TempFile("truncated.bin");
+  FILE *in = fopen(filename.c_str(), "rb");
+  FILE *out = fopen(truncated.c_str(), "wb");
+  char buffer[120];
+  ASSERT_EQ(sizeof(buffer), fread(buffer, 1, sizeof(buffer), in));
+  fwrite(buffer, 1, sizeof(buffer), out);
+  fclose(in);
+  fclose(out);
+
+  MarkerFile file;
+  EXPECT_FALSE(file.Open(truncated));
+  EXPECT_FALSE(file.Open(TempFile("missing.bin")));
+
+  // Not a marker file at all.
+  out = fopen(truncated.c_str(), "wb");
+  fprintf(out, "0 1 2.5 3.5\n");
+  fclose(out);
+  EXPECT_FALSE(file.Open(truncated));
+  EXPECT_FALSE(file.IsOpen());
+
+  markers.PushBack(-1, 0, 0, 0);
+  EXPECT_FALSE(WriteMarkerFile(filename, markers));
+
+  remove(filename.c_str());
+  remove(truncated.c_str());
+}
+
+// Writes a copy of the marker file from with the int64 at offset replaced.
+void PatchInt64(const std::string &from, const std::string &to,
+                size_t offset, int64_t value) {
+  FILE *in = fopen(from.c_str(), "rb");
+  std::vector<char> bytes;
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    bytes.push_back(c);
+  }
+  fclose(in);
+  memcpy(&bytes[offset], &value, sizeof(value));
+  FILE *out = fopen(to.c_str(), "wb");
+  fwrite(&bytes[0], 1, bytes.size(), out);
+  fclose(out);
+}
+
+TEST(MarkerFile, RejectsCorruptHeadersAndIndex) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  std::string filename = TempFile("markers.bin");
+  std::string corrupt = TempFile("corrupt.bin");
+  ASSERT_TRUE(WriteMarkerFile(filename, markers));
+  MarkerFileHeader header;
+  FILE *in = fopen(filename.c_str(), "rb");
+  ASSERT_EQ(1, fread(&header, sizeof(header), 1, in));
+  fclose(in);
+  int64_t index_offset = header.image_index_offset;
+
+  MarkerFile file;
+  ASSERT_TRUE(file.Open(filename));
+  file.Close();
+  EXPECT_EQ(0, file.num_markers());
+
+  // Offsets and lengths that overflow when added.
+  const int64_t kHuge = 0x7ffffffffffffff8LL;
+  PatchInt64(filename, corrupt, offsetof(MarkerFileHeader, ys_offset), kHuge);
+  EXPECT_FALSE(file.Open(corrupt));
+  EXPECT_EQ(0, file.num_markers());
+  PatchInt64(filename, corrupt,
+             offsetof(MarkerFileHeader, image_index_offset), kHuge);
+  EXPECT_FALSE(file.Open(corrupt));
+  PatchInt64(filename, corrupt, offsetof(MarkerFileHeader, num_images),
+             kHuge / 8);
+  EXPECT_FALSE(file.Open(corrupt));
+
+  // The images are 0, 0, 1, 3, 3, so the index is 0, 2, 3, 3, 5. An entry
+  // past the next one, and a last entry other than the number of markers.
+  PatchInt64(filename, corrupt, index_offset + 1 * sizeof(int64_t), 4);
+  EXPECT_FALSE(file.Open(corrupt));
+  PatchInt64(filename, corrupt, index_offset + 4 * sizeof(int64_t), 6);
+  EXPECT_FALSE(file.Open(corrupt));
+  // Still monotonic, but puts the marker of image 1 into image 2.
+  PatchInt64(filename, corrupt, index_offset + 2 * sizeof(int64_t), 2);
+  EXPECT_FALSE(file.Open(corrupt));
+
+  remove(filename.c_str());
+  remove(corrupt.c_str());
+}
+
+// Writes a copy of the marker file from with the int32 at offset replaced.
+void PatchInt32(const std::string &from, const std::string &to,
+                size_t offset, int32_t value) {
+  FILE *in = fopen(from.c_str(), "rb");
+  std::vector<char> bytes;
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    bytes.push_back(c);
+  }
+  fclose(in);
+  memcpy(&bytes[offset], &value, sizeof(value));
+  FILE *out = fopen(to.c_str(), "wb");
+  fwrite(&bytes[0], 1, bytes.size(), out);
+  fclose(out);
+}
+
+TEST(MarkerFile, RejectsCorruptMarkers) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  std::string filename = TempFile("markers.bin");
+  std::string corrupt = TempFile("corrupt.bin");
+  for (int image_index = 0; image_index < 2; ++image_index) {
+    ASSERT_TRUE(WriteMarkerFile(filename, markers, image_index));
+    MarkerFileHeader header;
+    FILE *in = fopen(filename.c_str(), "rb");
+    ASSERT_EQ(1, fread(&header, sizeof(header), 1, in));
+    fclose(in);
+    size_t images = header.images_offset;
+    size_t tracks = header.tracks_offset;
+
+    // The images are 0, 0, 1, 3, 3 and the tracks 1, 2, 2, 0, 1.
+    MarkerFile file;
+    PatchInt32(filename, corrupt, images, -1);
+    EXPECT_FALSE(file.Open(corrupt));
+    PatchInt32(filename, corrupt, tracks + 4 * sizeof(int32_t), -5);
+    EXPECT_FALSE(file.Open(corrupt));
+    PatchInt32(filename, corrupt, tracks + 4 * sizeof(int32_t), 0x7fffffff);
+    EXPECT_FALSE(file.Open(corrupt));
+    PatchInt32(filename, corrupt, images + 4 * sizeof(int32_t), 0x7fffffff);
+    EXPECT_FALSE(file.Open(corrupt));
+
+    // Out of order, by image and by track within an image.
+    PatchInt32(filename, corrupt, images + 2 * sizeof(int32_t), 4);
+    EXPECT_FALSE(file.Open(corrupt));
+    PatchInt32(filename, corrupt, tracks + 1 * sizeof(int32_t), 0);
+    EXPECT_FALSE(file.Open(corrupt));
+    EXPECT_FALSE(file.IsOpen());
+
+    // Changes that keep the file consistent are fine.
+    PatchInt32(filename, corrupt, tracks + 2 * sizeof(int32_t), 7);
+    EXPECT_TRUE(file.Open(corrupt));
+  }
+
+  remove(filename.c_str());
+  remove(corrupt.c_str());
+}
+
+TEST(MarkerFile, ConvertsToAndFromText) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  std::string txt = TempFile("markers.txt");
+  std::string binary = TempFile("markers.bin");
+  std::string txt2 = TempFile("markers2.txt");
+  ASSERT_TRUE(WriteMarkersToTxt(txt, markers));
+  ASSERT_TRUE(ConvertMarkersTxtToBinary(txt, binary));
+  ASSERT_TRUE(ConvertMarkersBinaryToTxt(binary, txt2));
+
+  // Sorted, but otherwise exactly the same.
+  MarkerColumns read;
+  ASSERT_TRUE(ReadMarkersFromTxt(txt2, &read));
+  MarkerFile file;
+  ASSERT_TRUE(file.Open(binary));
+  MarkerColumns expected;
+  file.ToColumns(&expected);
+  EXPECT_TRUE(read.images == expected.images);
+  EXPECT_TRUE(read.tracks == expected.tracks);
+  EXPECT_TRUE(read.xs == expected.xs);
+  EXPECT_TRUE(read.ys == expected.ys);
+  EXPECT_EQ(-1.0 / 3, read.xs[3]);
+
+  FILE *out = fopen(txt.c_str(), "w");
+  fprintf(out, "0 1 2.5 3.5\n0 2 x 1\n");
+  fclose(out);
+  EXPECT_FALSE(ReadMarkersFromTxt(txt, &read));
+  Matches matches;
+  FeatureSet features;
+  EXPECT_FALSE(ImportMatchesFromTxt(txt, &matches, &features));
+  EXPECT_EQ(0, features.features.size());
+
+  remove(txt.c_str());
+  remove(txt2.c_str());
+  remove(binary.c_str());
+}
+
+TEST(MatchesFile, RoundTrip) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  Matches matches;
+  FeatureSet features;
+  MarkersToMatches(markers, &matches, &features);
+  EXPECT_EQ(3, matches.NumImages());
+  EXPECT_EQ(3, matches.NumTracks());
+
+  std::string filename = TempFile("matches.bin");
+  ASSERT_TRUE(ExportMatchesToBinary(matches, filename));
+  Matches loaded;
+  FeatureSet loaded_features;
+  ASSERT_TRUE(ImportMatchesFromBinary(filename, &loaded, &loaded_features));
+  EXPECT_EQ(5, loaded_features.features.size());
+  for (int i = 0; i < markers.size(); ++i) {
+    const PointFeature *feature = static_cast<const PointFeature *>(
+        loaded.Get(markers.images[i], markers.tracks[i]));
+    ASSERT_TRUE(feature != NULL);
+    EXPECT_EQ(static_cast<float>(markers.xs[i]), feature->x());
+    EXPECT_EQ(static_cast<float>(markers.ys[i]), feature->y());
+  }
+  remove(filename.c_str());
+}
+
+TEST(MatchesFile, RefusesImportsThatWouldMoveFeatures) {
+  MarkerColumns markers;
+  MakeMarkers(&markers);
+  Matches matches;
+  FeatureSet features;
+  ASSERT_TRUE(MarkersToMatches(markers, &matches, &features));
+  // Drop any spare capacity.
+  std::vector<KeypointFeature>(features.features).swap(features.features);
+  ASSERT_EQ(features.features.size(), features.features.capacity());
+  const KeypointFeature *first = &features.features[0];
+
+  Matches more;
+  EXPECT_FALSE(MarkersToMatches(markers, &more, &features));
+  EXPECT_EQ(5, features.features.size());
+  EXPECT_EQ(first, &features.features[0]);
+  EXPECT_EQ(0, more.NumTracks());
+
+  features.features.reserve(10);
+  Matches reserved;
+  EXPECT_TRUE(MarkersToMatches(markers, &reserved, &features));
+  EXPECT_EQ(10, features.features.size());
+}
+
+}  // namespace
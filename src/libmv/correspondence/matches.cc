@@ -23,8 +23,36 @@
 
 namespace libmv {
 
+Matches::Matches() : last_type_(NULL), last_type_index_(0) {}
+
 Matches::~Matches() {}
 
+// At most kTypeMask types get an index, so the scan is short; features are
+// mostly inserted in runs of one type, which skip it.
+int Matches::TypeOf(const Feature *feature) {
+  if (!feature) {
+    return 0;
+  }
+  const std::type_info &type = typeid(*feature);
+  if (&type == last_type_) {
+    return last_type_index_;
+  }
+  int index = 0;
+  for (size_t i = 0; i < types_.size(); ++i) {
+    if (types_[i] == &type || *types_[i] == type) {
+      index = i + 1;
+      break;
+    }
+  }
+  if (index == 0 && types_.size() < kTypeMask) {
+    types_.push_back(&type);
+    index = types_.size();
+  }
+  last_type_ = &type;
+  last_type_index_ = index;
+  return index;
+}
+
 void DeleteMatchFeatures(Matches *matches) {
   (void) matches;
   // XXX
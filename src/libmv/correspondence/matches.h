@@ -21,12 +21,14 @@
 #ifndef LIBMV_CORRESPONDENCE_MATCHES_H_
 #define LIBMV_CORRESPONDENCE_MATCHES_H_
 
+#include <stdint.h>
+
 #include <algorithm>
+#include <typeinfo>
 #include <vector>
 
 #include "libmv/base/vector.h"
-// TODO(julien) use the bipartite_graph_new.h now
-#include "libmv/correspondence/bipartite_graph.h"
+#include "libmv/correspondence/csr_bipartite_graph.h"
 #include "libmv/logging/logging.h"
 #include "libmv/correspondence/feature.h"
 #include "libmv/numeric/numeric.h"
@@ -37,8 +39,34 @@ class Matches {
  public:
   typedef int ImageID;
   typedef int TrackID;
-  typedef BipartiteGraph<int, const Feature *> Graph;
+  // Features have a vtable, so they are at least pointer aligned, and the
+  // low bits of their addresses are free for the type tag.
+  enum { kTypeMask = sizeof(void *) - 1 };
+
+  // The edge label: the feature, with the index of its dynamic type in types_
+  // in the low bits of the pointer, so that typed iteration can compare
+  // indices instead of casting every feature. Type 0 is a NULL feature, or
+  // one whose type did not get an index. Being no larger than a pointer, the
+  // label keeps a frozen edge of the graph at 20 bytes.
+  class TaggedFeature {
+   public:
+    TaggedFeature() : bits_(0) {}
+    TaggedFeature(const Feature *feature, int type)
+      : bits_(reinterpret_cast<uintptr_t>(feature) | type) {
+      CHECK((reinterpret_cast<uintptr_t>(feature) & kTypeMask) == 0)
+          << "Misaligned feature.";
+    }
+    const Feature *feature() const {
+      return reinterpret_cast<const Feature *>(bits_ & ~uintptr_t(kTypeMask));
+    }
+    int type() const { return bits_ & kTypeMask; }
+
+   private:
+    uintptr_t bits_;
+  };
+  typedef CsrBipartiteGraph<int, TaggedFeature> Graph;
 
+  Matches();
   ~Matches();
 
   // Iterate over features, silently skiping any that are not FeatureT or
@@ -49,17 +77,36 @@ class Matches {
     ImageID           image()    const { return r_.left();  }
     TrackID           track()    const { return r_.right(); }
     const FeatureT *feature()  const {
-      return static_cast<const FeatureT *>(r_.edge());
+      return static_cast<const FeatureT *>(r_.edge().feature());
     }
     operator bool() const { return r_; }
     void operator++() { ++r_; Skip(); }
-    Features(Graph::Range range) : r_(range) { Skip(); }
+    Features(Graph::Range range) : r_(range), known_(0), matching_(0) {
+      Skip();
+    }
 
    private:
+    // Only the first feature of each type goes through a dynamic_cast; the
+    // answer is kept in the known_ and matching_ bits of the type.
+    bool IsFeatureT(const TaggedFeature &edge) {
+      int type = edge.type();
+      if (type == 0) {
+        return dynamic_cast<const FeatureT *>(edge.feature()) != NULL;
+      }
+      unsigned int bit = 1u << type;
+      if (!(known_ & bit)) {
+        known_ |= bit;
+        if (dynamic_cast<const FeatureT *>(edge.feature())) {
+          matching_ |= bit;
+        }
+      }
+      return (matching_ & bit) != 0;
+    }
     void Skip() {
-      while (r_ && !dynamic_cast<const FeatureT *> (r_.edge())) ++r_;
+      while (r_ && !IsFeatureT(r_.edge())) ++r_;
     }
     Graph::Range r_;
+    unsigned int known_, matching_;
   };
   typedef Features<PointFeature> Points;
 
@@ -81,14 +128,21 @@ class Matches {
 
   // Does not take ownership of feature.
   void Insert(ImageID image, TrackID track, const Feature *feature) {
-    graph_.Insert(image, track, feature);
+    graph_.Insert(image, track, TaggedFeature(feature, TypeOf(feature)));
     images_.insert(image);
     tracks_.insert(track);
   }
 
+  // Safe while iterating; Insert() may invalidate the Features iterators.
   void Remove(ImageID image, TrackID track) {
     graph_.Remove(image, track);
   }
+
+  // Packs the features inserted so far for faster lookups and iteration; see
+  // CsrBipartiteGraph::Freeze(). Worth calling after a bulk load.
+  void Freeze() {
+    graph_.Freeze();
+  }
   
   // Erases all the elements.  
   // Note that this function does not desallocate features
@@ -127,7 +181,8 @@ class Matches {
         const Feature * feature = matches.Get(*iter_image, *iter_track);
         image_id = new_image_ids[*iter_image];
         track_id = new_track_ids[*iter_track];
-        graph_.Insert(image_id, track_id, feature);
+        graph_.Insert(image_id, track_id,
+                      TaggedFeature(feature, TypeOf(feature)));
       }
     }
   }
@@ -154,14 +209,15 @@ class Matches {
           tracks_.insert(*iter_track);
         }      
         const Feature * feature = matches.Get(*iter_image, *iter_track);
-        graph_.Insert(*iter_image, *iter_track, feature);
+        graph_.Insert(*iter_image, *iter_track,
+                      TaggedFeature(feature, TypeOf(feature)));
       }
     }
   }
   
   const Feature *Get(ImageID image, TrackID track) const {
-    const Feature *const *f = graph_.Edge(image, track);
-    return f ? *f : NULL;
+    const TaggedFeature *f = graph_.Edge(image, track);
+    return f ? f->feature() : NULL;
   }
   
   ImageID GetMaxImageID() const {
@@ -203,7 +259,16 @@ class Matches {
   size_t NumImages() const { return images_.size(); }
 
  private:
+  // Returns the index of the dynamic type of feature, adding it if new and
+  // there is room; 0 for NULL and for types beyond the first kTypeMask.
+  int TypeOf(const Feature *feature);
+
   Graph graph_;
+  // The dynamic types of the inserted features; type i is types_[i - 1].
+  std::vector<const std::type_info *> types_;
+  // The type of the last feature inserted, which the next is likely to have.
+  const std::type_info *last_type_;
+  int last_type_index_;
   std::set<ImageID> images_;
   std::set<TrackID> tracks_;
 };
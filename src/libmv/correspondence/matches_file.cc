@@ -0,0 +1,100 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/correspondence/matches_file.h"
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+namespace {
+
+bool InsertMarkers(int num_markers,
+                   const int32_t *images,
+                   const int32_t *tracks,
+                   const double *xs,
+                   const double *ys,
+                   Matches *matches,
+                   FeatureSet *feature_set) {
+  // Growing the vector past its capacity would move the features that
+  // earlier imports handed to matches.
+  size_t first = feature_set->features.size();
+  if (first != 0 &&
+      first + num_markers > feature_set->features.capacity()) {
+    LOG(ERROR) << "Importing " << num_markers << " markers into a feature "
+               << "set of " << first << " would move its features; reserve "
+               << "room for all imports up front, or use a new feature set "
+               << "per import.";
+    return false;
+  }
+  feature_set->features.resize(first + num_markers);
+  for (int i = 0; i < num_markers; ++i) {
+    KeypointFeature *feature = &feature_set->features[first + i];
+    feature->coords << xs[i], ys[i];
+    matches->Insert(images[i], tracks[i], feature);
+  }
+  matches->Freeze();
+  return true;
+}
+
+}  // namespace
+
+void MatchesToMarkers(const Matches &matches, MarkerColumns *markers) {
+  markers->Clear();
+  std::set<Matches::ImageID>::const_iterator image =
+      matches.get_images().begin();
+  for (; image != matches.get_images().end(); ++image) {
+    Matches::Features<PointFeature> features =
+        matches.InImage<PointFeature>(*image);
+    for (; features; ++features) {
+      markers->PushBack(*image, features.track(),
+                        features.feature()->x(), features.feature()->y());
+    }
+  }
+}
+
+bool MarkersToMatches(const MarkerColumns &markers,
+                      Matches *matches,
+                      FeatureSet *feature_set) {
+  if (markers.size() == 0) {
+    return true;
+  }
+  return InsertMarkers(markers.size(), &markers.images[0], &markers.tracks[0],
+                       &markers.xs[0], &markers.ys[0], matches, feature_set);
+}
+
+bool ExportMatchesToBinary(const Matches &matches,
+                           const std::string &out_file_name,
+                           bool image_index) {
+  MarkerColumns markers;
+  MatchesToMarkers(matches, &markers);
+  return WriteMarkerFile(out_file_name, markers, image_index);
+}
+
+bool ImportMatchesFromBinary(const std::string &input_file,
+                             Matches *matches,
+                             FeatureSet *feature_set) {
+  MarkerFile file;
+  if (!file.Open(input_file)) {
+    return false;
+  }
+  return InsertMarkers(file.num_markers(), file.images(), file.tracks(),
+                       file.xs(), file.ys(), matches, feature_set);
+}
+
+}  // namespace libmv
@@ -0,0 +1,57 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_CORRESPONDENCE_MATCHES_FILE_H_
+#define LIBMV_CORRESPONDENCE_MATCHES_FILE_H_
+
+#include <string>
+
+#include "libmv/correspondence/feature_matching.h"
+#include "libmv/correspondence/marker_file.h"
+#include "libmv/correspondence/matches.h"
+
+namespace libmv {
+
+// Collects the point features of matches as markers.
+void MatchesToMarkers(const Matches &matches, MarkerColumns *markers);
+
+// Adds the markers to matches, as new features appended to feature_set. The
+// feature set grows once, by the number of markers. Features already in it
+// must not move, so unless it is empty it needs the capacity for the new
+// ones: reserve room for all imports up front, or use one feature set per
+// import. Returns false, adding nothing, otherwise.
+bool MarkersToMatches(const MarkerColumns &markers,
+                      Matches *matches,
+                      FeatureSet *feature_set);
+
+// Saves the point features of matches as a marker file (see marker_file.h).
+bool ExportMatchesToBinary(const Matches &matches,
+                           const std::string &out_file_name,
+                           bool image_index = true);
+
+// Loads a marker file into matches, like MarkersToMatches(). Returns false if
+// the file can't be read or the features don't fit in feature_set.
+bool ImportMatchesFromBinary(const std::string &input_file,
+                             Matches *matches,
+                             FeatureSet *feature_set);
+
+}  // namespace libmv
+
+#endif  // LIBMV_CORRESPONDENCE_MATCHES_FILE_H_
@@ -63,6 +63,90 @@ TEST(Matches, Views) {
   EXPECT_EQ(2,  r.track());
 }
 
+struct MyPointFeature : public PointFeature {
+  MyPointFeature(float x, float y) : PointFeature(x, y) {}
+};
+
+TEST(Matches, ViewsMixedTypes) {
+  Matches matches;
+  matches.Insert(1, 1, new PointFeature(1, 10));
+  matches.Insert(1, 2, new MyPoint(20));
+  matches.Insert(1, 3, new MyPointFeature(3, 30));
+  matches.Insert(1, 4, NULL);
+  matches.Insert(2, 1, new MyPointFeature(4, 40));
+  matches.Insert(2, 2, new SiblingTestFeature);
+  matches.Insert(2, 3, new PointFeature(6, 60));
+
+  // Derived types are PointFeatures too; NULL features are always skipped.
+  int expected_points[][2] = { {1, 1}, {1, 3}, {2, 1}, {2, 3} };
+  int n = 0;
+  for (Matches::Points r = matches.All<PointFeature>(); r; ++r, ++n) {
+    ASSERT_LT(n, 4);
+    EXPECT_EQ(expected_points[n][0], r.image());
+    EXPECT_EQ(expected_points[n][1], r.track());
+    EXPECT_EQ(10 * r.feature()->x(), r.feature()->y());
+  }
+  EXPECT_EQ(4, n);
+
+  n = 0;
+  for (Matches::Features<MyPointFeature> r = matches.InTrack<MyPointFeature>(1);
+       r; ++r, ++n) {
+    EXPECT_EQ(2, r.image());
+    EXPECT_EQ(4, r.feature()->x());
+  }
+  EXPECT_EQ(1, n);
+
+  n = 0;
+  for (Matches::Features<Feature> r = matches.InImage<Feature>(1);
+       r; ++r, ++n) {
+    EXPECT_TRUE(r.feature() != NULL);
+  }
+  EXPECT_EQ(3, n);
+
+  Matches::Features<MyPoint> r = matches.AllReversed<MyPoint>();
+  ASSERT_TRUE(r);
+  EXPECT_EQ(20, r.feature()->tag);
+  ++r;
+  EXPECT_FALSE(r);
+}
+
+// One distinct PointFeature type per N.
+template<int N>
+struct NumberedPointFeature : public PointFeature {
+  NumberedPointFeature() : PointFeature(N, 10 * N) {}
+};
+
+// More types than fit in the tag bits; the rest are checked on every edge.
+TEST(Matches, ViewsManyTypes) {
+  EXPECT_EQ(sizeof(void *), sizeof(Matches::TaggedFeature));
+  Matches matches;
+  matches.Insert(1, 0, new NumberedPointFeature<0>);
+  matches.Insert(1, 1, new NumberedPointFeature<1>);
+  matches.Insert(1, 2, new NumberedPointFeature<2>);
+  matches.Insert(1, 3, new NumberedPointFeature<3>);
+  matches.Insert(1, 4, new NumberedPointFeature<4>);
+  matches.Insert(1, 5, new NumberedPointFeature<5>);
+  matches.Insert(1, 6, new NumberedPointFeature<6>);
+  matches.Insert(1, 7, new NumberedPointFeature<7>);
+  matches.Insert(1, 8, new NumberedPointFeature<8>);
+  matches.Insert(1, 9, new SiblingTestFeature);
+  matches.Insert(1, 10, new NumberedPointFeature<8>);
+
+  int n = 0;
+  for (Matches::Points r = matches.All<PointFeature>(); r; ++r, ++n) {
+    EXPECT_EQ(10 * r.feature()->x(), r.feature()->y());
+  }
+  EXPECT_EQ(10, n);
+
+  n = 0;
+  typedef NumberedPointFeature<8> Eighth;
+  for (Matches::Features<Eighth> r = matches.All<Eighth>(); r; ++r, ++n) {
+    EXPECT_EQ(8, r.feature()->x());
+  }
+  EXPECT_EQ(2, n);
+  EXPECT_EQ(7, static_cast<const PointFeature *>(matches.Get(1, 7))->x());
+}
+
 TEST(Matches, InsertMatches) {
   Matches matches_insert;
   matches_insert.Insert(1, 1, new PointFeature( 1,  10));
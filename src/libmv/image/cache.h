@@ -23,11 +23,14 @@
 
 // A generic cache interface.
 
+#include <stdint.h>
+
 namespace libmv {
 
 // Cache key / value pairs.  Pinned objects count toward maximum size
 // allowance, but do not prevent new pinned objects from being added (even if
-// maximum memory is exceeded). The units of size are deliberately unspecified.
+// maximum memory is exceeded). The units of size are deliberately unspecified;
+// they are 64 bits wide, so that byte counts of large caches do not overflow.
 template<typename K, typename V>
 class Cache {
  public:
@@ -35,13 +38,14 @@ class Cache {
   virtual void StoreAndPin(const K &key, V *value) {
     StoreAndPinSized(key, value, 1);
   }
-  virtual void StoreAndPinSized(const K &key, V *value, const int size) = 0;
+  virtual void StoreAndPinSized(const K &key, V *value,
+                                const int64_t size) = 0;
   virtual void Unpin(const K &key) = 0;
   virtual void MassUnpin() = 0;
   virtual bool ContainsKey(const K &key) = 0;
-  virtual void SetMaxSize(const int size) = 0;
-  virtual int MaxSize() const = 0;
-  virtual int Size() const = 0;
+  virtual void SetMaxSize(const int64_t size) = 0;
+  virtual int64_t MaxSize() const = 0;
+  virtual int64_t Size() const = 0;
   virtual ~Cache() {}
 };
 }  // namespace libmv
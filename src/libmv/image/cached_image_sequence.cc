@@ -0,0 +1,122 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/image/cached_image_sequence.h"
+
+namespace libmv {
+
+cv::Mat CachedImageSequence::GetRegion(int i, const cv::Rect &roi) {
+  int tile_size = RegionTileSize();
+  cv::Size image_size;
+  cv::Rect clipped, tiles;
+  if (!TilesFor(i, roi, tile_size, &image_size, &clipped, &tiles)) {
+    return ImageSequence::GetRegion(i, roi);
+  }
+  if (clipped.area() == 0) {
+    return cv::Mat();
+  }
+
+  if (tiles.area() == 1) {
+    cv::Mat *tile = FetchTile(i, tiles.x, tiles.y, tile_size, image_size);
+    if (tile == NULL) {
+      return cv::Mat();
+    }
+    cv::Point origin(tiles.x * tile_size, tiles.y * tile_size);
+    return (*tile)(cv::Rect(clipped.tl() - origin, clipped.size()));
+  }
+
+  cv::Mat region;
+  for (int tile_y = tiles.y; tile_y < tiles.y + tiles.height; ++tile_y) {
+    for (int tile_x = tiles.x; tile_x < tiles.x + tiles.width; ++tile_x) {
+      cv::Mat *tile = FetchTile(i, tile_x, tile_y, tile_size, image_size);
+      if (tile == NULL) {
+        return cv::Mat();
+      }
+      cv::Rect tile_rect(tile_x * tile_size, tile_y * tile_size,
+                         tile->cols, tile->rows);
+      cv::Rect part = clipped & tile_rect;
+      if (region.empty()) {
+        region.create(clipped.size(), tile->type());
+      }
+      cv::Mat source = (*tile)(cv::Rect(part.tl() - tile_rect.tl(),
+                                        part.size()));
+      cv::Mat destination = region(cv::Rect(part.tl() - clipped.tl(),
+                                            part.size()));
+      source.copyTo(destination);
+      cache_->Unpin(TileKey(i, tile_x, tile_y, tile_size, image_size));
+    }
+  }
+  return region;
+}
+
+void CachedImageSequence::UnpinRegion(int i, const cv::Rect &roi) {
+  int tile_size = RegionTileSize();
+  cv::Size image_size;
+  cv::Rect clipped, tiles;
+  if (!TilesFor(i, roi, tile_size, &image_size, &clipped, &tiles)) {
+    ImageSequence::UnpinRegion(i, roi);
+    return;
+  }
+  // Regions spanning several tiles are copies, and hold no pins.
+  if (clipped.area() > 0 && tiles.area() == 1) {
+    cache_->Unpin(TileKey(i, tiles.x, tiles.y, tile_size, image_size));
+  }
+}
+
+bool CachedImageSequence::TilesFor(int i, const cv::Rect &roi, int tile_size,
+                                   cv::Size *image_size, cv::Rect *clipped,
+                                   cv::Rect *tiles) {
+  if (tile_size <= 0) {
+    return false;
+  }
+  *image_size = ImageSize(i);
+  if (image_size->width <= 0 || image_size->height <= 0) {
+    return false;
+  }
+  *clipped = roi & cv::Rect(0, 0, image_size->width, image_size->height);
+  if (clipped->area() == 0) {
+    *tiles = cv::Rect();
+    return true;
+  }
+  tiles->x = clipped->x / tile_size;
+  tiles->y = clipped->y / tile_size;
+  tiles->width = (clipped->br().x - 1) / tile_size - tiles->x + 1;
+  tiles->height = (clipped->br().y - 1) / tile_size - tiles->y + 1;
+  return true;
+}
+
+TaggedImageKey CachedImageSequence::TileKey(int i, int tile_x, int tile_y,
+                                            int tile_size,
+                                            const cv::Size &image_size) {
+  int tiles_across = (image_size.width + tile_size - 1) / tile_size;
+  return TaggedImageKey(this, i, tile_y * tiles_across + tile_x);
+}
+
+cv::Mat *CachedImageSequence::FetchTile(int i, int tile_x, int tile_y,
+                                        int tile_size,
+                                        const cv::Size &image_size) {
+  cv::Rect tile(tile_x * tile_size, tile_y * tile_size, tile_size, tile_size);
+  tile &= cv::Rect(0, 0, image_size.width, image_size.height);
+  Loader loader(this, i, &tile);
+  return cache_->FetchOrLoadAndPin(
+      TileKey(i, tile_x, tile_y, tile_size, image_size), &loader);
+}
+
+}  // namespace libmv
@@ -21,39 +21,103 @@
 #ifndef LIBMV_IMAGE_CACHED_IMAGE_SEQUENCE_H_
 #define LIBMV_IMAGE_CACHED_IMAGE_SEQUENCE_H_
 
-#include "libmv/image/lru_cache.h"
+#include "libmv/image/concurrent_cache.h"
+#include "libmv/image/frame_spill_file.h"
 #include "libmv/image/image_sequence.h"
 
 namespace libmv {
 
-// A key for a shared image cache. Typically the void * will be a pointer to
-// the image sequence that is using the cache.
-typedef std::pair<void *, int> TaggedImageKey;
+// A key for a shared image cache. Typically the tag will be a pointer to the
+// image sequence that is using the cache. Keys of whole frames have no tile;
+// see CachedImageSequence::GetRegion() for the others.
+struct TaggedImageKey {
+  enum { kWholeFrame = -1 };
+
+  TaggedImageKey(void *tag, int frame, int tile = kWholeFrame)
+      : tag(tag), frame(frame), tile(tile) {}
+
+  bool operator==(const TaggedImageKey &other) const {
+    return tag == other.tag && frame == other.frame && tile == other.tile;
+  }
+
+  void *tag;
+  int frame;
+  int tile;
+};
+
+template<>
+struct CacheKeyHash<TaggedImageKey> {
+  size_t operator()(const TaggedImageKey &key) const {
+    size_t hash = CacheKeyHash<void *>()(key.tag);
+    hash ^= concurrent_cache::MixBits(
+        (static_cast<uint64_t>(static_cast<uint32_t>(key.tile)) << 32) |
+        static_cast<uint32_t>(key.frame));
+    return hash;
+  }
+};
+
+inline int CacheKeyFrame(const TaggedImageKey &key) {
+  return key.frame;
+}
 
 // A image cache that is shared among many image sequences (or anything that
-// produces images).
-class ImageCache : public LRUCache<TaggedImageKey, cv::Mat> {
+// produces images). It is thread safe, so the sequences using it can be read
+// from several threads. Sizes are in bytes.
+//
+// The policy picks which unpinned frames to drop first; it defaults to LRU.
+// When a tracker or a viewer moves through the frames in order,
+// NewSequenceWindowEvictionPolicy() keeps the neighborhood of the current
+// frame. Statistics() tells how well the cache and policy fit the workload.
+class ImageCache : public ConcurrentCache<TaggedImageKey, cv::Mat> {
  public:
-  typedef LRUCache<TaggedImageKey, cv::Mat> Base;
-  ImageCache() : Base(10*1024*1024) {}
-  ImageCache(int max_cache_size_in_bytes) : Base(max_cache_size_in_bytes) {}
+  typedef ConcurrentCache<TaggedImageKey, cv::Mat> Base;
+  ImageCache() : Base(10*1024*1024), spill_file_(NULL) {}
+  ImageCache(int64_t max_cache_size_in_bytes, EvictionPolicy *policy = NULL)
+      : Base(max_cache_size_in_bytes, policy), spill_file_(NULL) {}
+
+  // Write evicted frames to spill_file, from which CachedImageSequence reads
+  // them back instead of loading them again. Not owned, and must outlive the
+  // cache. NULL disables spilling. Set it before the cache is used. Only
+  // whole frames are spilled, not tiles.
+  void SetSpillFile(FrameSpillFile *spill_file) {
+    spill_file_ = spill_file;
+  }
+
+  FrameSpillFile *spill_file() const {
+    return spill_file_;
+  }
+
+ protected:
+  virtual void Evicted(const TaggedImageKey &key, const cv::Mat &image) {
+    if (spill_file_ != NULL && key.tile == TaggedImageKey::kWholeFrame) {
+      spill_file_->Store(key.tag, key.frame, image);
+    }
+  }
+
+ private:
+  FrameSpillFile *spill_file_;
 };
 
 class CachedImageSequence : public ImageSequence {
  public:
-  virtual ~CachedImageSequence() {}
+  // Frames spilled for this sequence are forgotten, since the spill file
+  // tells sequences apart by their address.
+  virtual ~CachedImageSequence() {
+    if (cache_ != NULL && cache_->spill_file() != NULL) {
+      cache_->spill_file()->Forget(this);
+    }
+  }
   CachedImageSequence(ImageCache *cache)
       : cache_(cache) {}
 
+  // Safe to call from several threads if LoadImage() is. A frame requested
+  // by several threads at once is only loaded once.
   virtual cv::Mat GetImage(int i) {
-    cv::Mat *image;
     TaggedImageKey cache_key(this, i);
-    if (!cache_->FetchAndPin(cache_key, &image)) {
-      image = new cv::Mat(LoadImage(i));
-      if (image->empty()) {
-        return cv::Mat();
-      }
-      cache_->StoreAndPinSized(cache_key, image, (image->dataend - image->data)*sizeof(unsigned char));
+    Loader loader(this, i, NULL);
+    cv::Mat *image = cache_->FetchOrLoadAndPin(cache_key, &loader);
+    if (image == NULL) {
+      return cv::Mat();
     }
     return *image;
   }
@@ -63,6 +127,20 @@ class CachedImageSequence : public ImageSequence {
     cache_->Unpin(cache_key);
   }
 
+  virtual void Prefetch(int i) {
+    Loader loader(this, i, NULL);
+    cache_->Prefetch(TaggedImageKey(this, i), &loader);
+  }
+
+  // If RegionTileSize() is positive, regions are assembled from square tiles
+  // of that size, each loaded with LoadRegion() and cached under its own key,
+  // so that only the tiles around the region are decoded and kept. A region
+  // within one tile is a view into the cached tile, and stays pinned until
+  // UnpinRegion(); larger ones are copied out of the tiles. Otherwise this
+  // falls back to a view into the whole frame.
+  virtual cv::Mat GetRegion(int i, const cv::Rect &roi);
+  virtual void UnpinRegion(int i, const cv::Rect &roi);
+
   virtual ImageCache *Cache() {
     return cache_;
   }
@@ -71,7 +149,68 @@ class CachedImageSequence : public ImageSequence {
   // of storing the generated
   virtual cv::Mat LoadImage(int i) = 0;
 
+  // Subclasses that can decode part of a frame (e.g. from scanline or tiled
+  // files) return the tile size to use in GetRegion(), and implement
+  // ImageSize() and LoadRegion(). An empty ImageSize() for some frame makes
+  // GetRegion() fall back to the whole frame.
+  virtual int RegionTileSize() { return 0; }
+  virtual cv::Size ImageSize(int i) { (void) i; return cv::Size(); }
+  virtual cv::Mat LoadRegion(int i, const cv::Rect &region) {
+    (void) i;
+    (void) region;
+    return cv::Mat();
+  }
+
+ protected:
+  // Load frame i to be cached. Set *shared if the frame shares its data with
+  // a frame that is cached (and charged) elsewhere, so the same bytes are not
+  // charged twice. By default this is LoadImage(), which shares nothing.
+  virtual cv::Mat LoadImageForCache(int i, bool *shared) {
+    *shared = false;
+    return LoadImage(i);
+  }
+
  private:
+  // Loads the whole frame if tile is NULL.
+  class Loader : public CacheLoader<cv::Mat> {
+   public:
+    Loader(CachedImageSequence *sequence, int i, const cv::Rect *tile)
+        : sequence_(sequence), i_(i), tile_(tile) {}
+
+    virtual cv::Mat *Load(int64_t *size) {
+      cv::Mat image;
+      bool shared = false;
+      if (tile_ != NULL) {
+        image = sequence_->LoadRegion(i_, *tile_);
+      } else {
+        FrameSpillFile *spill_file = sequence_->cache_->spill_file();
+        if (spill_file == NULL || !spill_file->Load(sequence_, i_, &image)) {
+          image = sequence_->LoadImageForCache(i_, &shared);
+        }
+      }
+      if (image.empty()) {
+        return NULL;
+      }
+      *size = shared ? 0 :
+          (image.dataend - image.datastart) * sizeof(unsigned char);
+      return new cv::Mat(image);
+    }
+
+   private:
+    CachedImageSequence *sequence_;
+    int i_;
+    const cv::Rect *tile_;
+  };
+
+  // Clip roi to frame i, and find the range of tiles covering it. Returns
+  // false if the frame cannot be loaded by regions.
+  bool TilesFor(int i, const cv::Rect &roi, int tile_size,
+                cv::Size *image_size, cv::Rect *clipped, cv::Rect *tiles);
+  TaggedImageKey TileKey(int i, int tile_x, int tile_y, int tile_size,
+                         const cv::Size &image_size);
+  cv::Mat *FetchTile(int i, int tile_x, int tile_y, int tile_size,
+                     const cv::Size &image_size);
+
   ImageCache *cache_;
 };
 
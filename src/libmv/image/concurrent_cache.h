@@ -0,0 +1,725 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// A thread-safe cache with the same pinning semantics as LRUCache, for sharing
+// decoded frames among tracking threads. LRUCache remains the simpler choice
+// when only one thread touches the cache.
+
+#ifndef LIBMV_IMAGE_CONCURRENT_CACHE_H_
+#define LIBMV_IMAGE_CONCURRENT_CACHE_H_
+
+#include <stdint.h>
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/cache.h"
+#include "libmv/image/eviction_policy.h"
+
+namespace libmv {
+
+// Hash functor for ConcurrentCache keys. Specialize it for other key types;
+// keys also need operator==.
+template<typename K>
+struct CacheKeyHash;
+
+namespace concurrent_cache {
+
+// Spread the bits of an integer, so that consecutive frame numbers land in
+// different shards and buckets.
+inline size_t MixBits(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return static_cast<size_t>(x);
+}
+
+}  // namespace concurrent_cache
+
+template<>
+struct CacheKeyHash<int> {
+  size_t operator()(int key) const {
+    return concurrent_cache::MixBits(static_cast<uint64_t>(key));
+  }
+};
+
+template<typename T>
+struct CacheKeyHash<T *> {
+  size_t operator()(T *key) const {
+    return concurrent_cache::MixBits(reinterpret_cast<uintptr_t>(key));
+  }
+};
+
+template<typename A, typename B>
+struct CacheKeyHash<std::pair<A, B> > {
+  size_t operator()(const std::pair<A, B> &key) const {
+    size_t a = CacheKeyHash<A>()(key.first);
+    size_t b = CacheKeyHash<B>()(key.second);
+    return a ^ (b + 0x9e3779b9 + (a << 6) + (a >> 2));
+  }
+};
+
+// The frame number of a key, for eviction policies that care about frame
+// order (see NewSequenceWindowEvictionPolicy()). Overload it for other keys;
+// keys without frames all count as frame 0.
+template<typename K>
+int CacheKeyFrame(const K &) {
+  return 0;
+}
+
+inline int CacheKeyFrame(int key) {
+  return key;
+}
+
+// Such as (sequence, frame) pairs.
+template<typename A>
+int CacheKeyFrame(const std::pair<A, int> &key) {
+  return key.second;
+}
+
+// Produces a value for ConcurrentCache::FetchOrLoadAndPin().
+template<typename V>
+class CacheLoader {
+ public:
+  virtual ~CacheLoader() {}
+
+  // Return a new value and set *size, or return NULL on failure.
+  virtual V *Load(int64_t *size) = 0;
+};
+
+struct CacheStatistics {
+  CacheStatistics()
+      : hits(0), misses(0), prefetches(0), evictions(0), evicted_size(0) {}
+
+  // Fetches that found the key (possibly after waiting for its load), and
+  // that did not.
+  int64_t hits;
+  int64_t misses;
+
+  // Values loaded by Prefetch(), which count as neither.
+  int64_t prefetches;
+
+  // Values dropped to stay under the size limit, and their total size.
+  int64_t evictions;
+  int64_t evicted_size;
+};
+
+// The keys are spread over independently locked shards by hash, each with a
+// hash table, so lookups of different keys rarely contend. Which unpinned
+// item to evict is decided by an EvictionPolicy (LRU by default) that sees
+// all items; it sits behind a single lock with the sizes and statistics,
+// which is only held for a few pointer updates per call.
+//
+// Two threads that miss the same key at the same time would both decode it.
+// FetchOrLoadAndPin() avoids this: the first one loads the value while the
+// others wait for it. FetchAndPin() also waits for a value being loaded.
+//
+// Storing a key that is already present replaces its value; the old value is
+// kept alive until the key is entirely unpinned, so pointers handed out
+// before stay valid. Unpinning a key that is not present does nothing.
+template<typename K, typename V, typename Hash = CacheKeyHash<K> >
+class ConcurrentCache : public Cache<K, V> {
+ private:
+  struct Item;
+
+ public:
+  // A pin on a cached value, released when the last copy of the handle goes
+  // away. Handles skip the key lookup that Unpin() needs.
+  class Handle {
+   public:
+    Handle() : cache_(NULL), item_(NULL), value_(NULL) {}
+    Handle(const Handle &other)
+        : cache_(other.cache_), item_(other.item_), value_(other.value_) {
+      if (item_ != NULL) {
+        cache_->PinItem(item_);
+      }
+    }
+    Handle &operator=(const Handle &other) {
+      if (this != &other) {
+        Handle copy(other);
+        Swap(&copy);
+      }
+      return *this;
+    }
+    ~Handle() { Reset(); }
+
+    void Reset() {
+      if (item_ != NULL) {
+        cache_->UnpinItem(item_);
+      }
+      cache_ = NULL;
+      item_ = NULL;
+      value_ = NULL;
+    }
+
+    V *get() const { return value_; }
+    V *operator->() const { return value_; }
+    V &operator*() const { return *value_; }
+    bool empty() const { return value_ == NULL; }
+
+   private:
+    friend class ConcurrentCache;
+
+    // Takes over a pin that the caller already holds.
+    Handle(ConcurrentCache *cache, Item *item, V *value)
+        : cache_(cache), item_(item), value_(value) {}
+
+    void Swap(Handle *other) {
+      std::swap(cache_, other->cache_);
+      std::swap(item_, other->item_);
+      std::swap(value_, other->value_);
+    }
+
+    ConcurrentCache *cache_;
+    Item *item_;
+    V *value_;
+  };
+
+  // Takes ownership of policy; NULL means NewLruEvictionPolicy().
+  explicit ConcurrentCache(int64_t max_size,
+                           EvictionPolicy *policy = NULL,
+                           int num_shards = 16)
+      : policy_(policy ? policy : NewLruEvictionPolicy()),
+        max_size_(max_size),
+        size_(0) {
+    policy_->SetMaxSize(max_size);
+    num_shards_ = 1;
+    while (num_shards_ < num_shards) {
+      num_shards_ *= 2;
+    }
+    shards_ = new Shard[num_shards_];
+  }
+
+  virtual ~ConcurrentCache() {
+    for (int s = 0; s < num_shards_; ++s) {
+      Shard &shard = shards_[s];
+      for (size_t b = 0; b < shard.buckets.size(); ++b) {
+        Item *item = shard.buckets[b];
+        while (item != NULL) {
+          Item *next = item->next_in_bucket;
+          DeleteItem(item);
+          item = next;
+        }
+      }
+    }
+    delete [] shards_;
+    delete policy_;
+  }
+
+  virtual bool FetchAndPin(const K &key, V **value) {
+    Item *item = FetchAndPinItem(key, false);
+    if (item == NULL) {
+      return false;
+    }
+    *value = item->value;
+    return true;
+  }
+
+  // Pinned handle for key, or an empty handle if the key is not present.
+  Handle Fetch(const K &key) {
+    Item *item = FetchAndPinItem(key, true);
+    return item ? Handle(this, item, item->value) : Handle();
+  }
+
+  // Return the value for key, pinned, calling loader outside of any lock if
+  // it is missing. Concurrent calls for the same key wait for the first one
+  // instead of loading it again. Returns NULL if the loader fails.
+  V *FetchOrLoadAndPin(const K &key, CacheLoader<V> *loader) {
+    Item *item = FetchOrLoadAndPinItem(key, loader, false);
+    return item ? item->value : NULL;
+  }
+
+  Handle FetchOrLoad(const K &key, CacheLoader<V> *loader) {
+    Item *item = FetchOrLoadAndPinItem(key, loader, true);
+    return item ? Handle(this, item, item->value) : Handle();
+  }
+
+  // Load the value for key ahead of use and leave it unpinned, unless it is
+  // present or being loaded already. Unlike a fetch, this is not a use of
+  // the key: it counts in the statistics as a prefetch rather than a hit or a
+  // miss, and the policy learns of it through Prefetched(). Fetches of the
+  // key wait for the load as they would for FetchOrLoad().
+  void Prefetch(const K &key, CacheLoader<V> *loader) {
+    size_t hash = hash_(key);
+    Shard &shard = ShardFor(hash);
+    Item *item;
+    {
+      MutexLock lock(&shard.mutex);
+      if (Find(shard, key, hash) != NULL) {
+        return;
+      }
+      item = NewItem(key, hash);
+      item->loading = true;
+      item->use_count = 1;
+      Insert(&shard, item);
+    }
+
+    int64_t size = 0;
+    V *value = loader->Load(&size);
+
+    {
+      MutexLock lock(&shard.mutex);
+      if (value == NULL) {
+        Remove(&shard, item);
+        delete item;
+        item = NULL;
+      } else {
+        MutexLock policy_lock(&policy_mutex_);
+        item->value = value;
+        item->size = size;
+        item->loading = false;
+        size_ += size;
+        statistics_.prefetches++;
+        policy_->Prefetched(item);
+      }
+      if (item != NULL) {
+        UnpinLocked(item);
+      }
+      shard.loaded.Broadcast();
+    }
+    if (item != NULL) {
+      EvictUnpinnedItemsIfNecessary();
+    }
+  }
+
+  virtual void StoreAndPinSized(const K &key, V *value,
+                                const int64_t size) {
+    size_t hash = hash_(key);
+    Shard &shard = ShardFor(hash);
+    {
+      MutexLock lock(&shard.mutex);
+      Item *item = FindOrWaitForLoad(&shard, key, hash);
+      MutexLock policy_lock(&policy_mutex_);
+      if (item == NULL) {
+        item = NewItem(key, hash);
+        item->size = size;
+        Insert(&shard, item);
+        policy_->Inserted(item);
+      } else {
+        if (item->use_count == 0) {
+          // Nobody can be using the old value.
+          policy_->Pinned(item);
+          delete item->value;
+          size_ -= item->size;
+        } else {
+          // Counted until the key is entirely unpinned.
+          item->retired.push_back(std::make_pair(item->value, item->size));
+        }
+        item->size = size;
+        policy_->Hit(item);
+      }
+      item->value = value;
+      item->use_count++;
+      size_ += size;
+    }
+    EvictUnpinnedItemsIfNecessary();
+  }
+
+  virtual void Unpin(const K &key) {
+    size_t hash = hash_(key);
+    Shard &shard = ShardFor(hash);
+    {
+      MutexLock lock(&shard.mutex);
+      // Only pins taken by key can be released by key; those of handles
+      // are released with the handles.
+      Item *item = Find(shard, key, hash);
+      if (item == NULL || item->loading ||
+          item->use_count <= item->num_handles ||
+          !UnpinLocked(item)) {
+        return;
+      }
+    }
+    EvictUnpinnedItemsIfNecessary();
+  }
+
+  // Releases every pin taken by key. Pins held by live handles stay, so their
+  // values are not evicted from under them.
+  virtual void MassUnpin() {
+    for (int s = 0; s < num_shards_; ++s) {
+      Shard &shard = shards_[s];
+      MutexLock lock(&shard.mutex);
+      for (size_t b = 0; b < shard.buckets.size(); ++b) {
+        for (Item *item = shard.buckets[b];
+             item != NULL;
+             item = item->next_in_bucket) {
+          if (item->use_count > item->num_handles && !item->loading) {
+            item->use_count = item->num_handles + 1;
+            UnpinLocked(item);
+          }
+        }
+      }
+    }
+    EvictUnpinnedItemsIfNecessary();
+  }
+
+  virtual bool ContainsKey(const K &key) {
+    size_t hash = hash_(key);
+    Shard &shard = ShardFor(hash);
+    MutexLock lock(&shard.mutex);
+    Item *item = Find(shard, key, hash);
+    return item != NULL && !item->loading;
+  }
+
+  virtual void SetMaxSize(const int64_t max_size) {
+    {
+      MutexLock lock(&policy_mutex_);
+      max_size_ = max_size;
+      policy_->SetMaxSize(max_size);
+    }
+    EvictUnpinnedItemsIfNecessary();
+  }
+
+  virtual int64_t MaxSize() const {
+    MutexLock lock(&policy_mutex_);
+    return max_size_;
+  }
+
+  virtual int64_t Size() const {
+    MutexLock lock(&policy_mutex_);
+    return size_;
+  }
+
+  CacheStatistics Statistics() const {
+    MutexLock lock(&policy_mutex_);
+    return statistics_;
+  }
+
+  void ResetStatistics() {
+    MutexLock lock(&policy_mutex_);
+    statistics_ = CacheStatistics();
+  }
+
+ protected:
+  // Called with each value evicted to stay under the size limit, just before
+  // it is deleted. No lock of the cache is held, so this may take its time
+  // (e.g. write the value out), but it may run on several threads at once.
+  virtual void Evicted(const K &key, const V &value) {
+    (void) key;
+    (void) value;
+  }
+
+ private:
+  // The policy sees the items through their CacheEntry base, which holds the
+  // hash and the size.
+  struct Item : public CacheEntry {
+    explicit Item(const K &key)
+        : key(key), value(NULL), use_count(0), num_handles(0),
+          loading(false), next_in_bucket(NULL) {}
+
+    K key;
+    V *value;
+    int use_count;
+
+    // How many of the pins belong to handles.
+    int num_handles;
+
+    // Set while FetchOrLoadAndPin() runs the loader; value is NULL.
+    bool loading;
+
+    Item *next_in_bucket;
+
+    // Values replaced while pinned, with their sizes.
+    std::vector<std::pair<V *, int64_t> > retired;
+  };
+
+  struct Shard {
+    Shard() : num_items(0), buckets(16, static_cast<Item *>(NULL)) {}
+
+    Mutex mutex;
+    ConditionVariable loaded;
+    int num_items;
+    std::vector<Item *> buckets;
+  };
+
+  Shard &ShardFor(size_t hash) {
+    // The low bits pick the bucket; use the high ones for the shard.
+    return shards_[(hash >> (sizeof(size_t) * 4)) & (num_shards_ - 1)];
+  }
+
+  static Item *NewItem(const K &key, size_t hash) {
+    Item *item = new Item(key);
+    item->hash = hash;
+    item->frame = CacheKeyFrame(key);
+    return item;
+  }
+
+  // The shard lock must be held for all of the following.
+  Item *Find(const Shard &shard, const K &key, size_t hash) const {
+    Item *item = shard.buckets[hash & (shard.buckets.size() - 1)];
+    while (item != NULL && !(item->hash == hash && item->key == key)) {
+      item = item->next_in_bucket;
+    }
+    return item;
+  }
+
+  Item *FindOrWaitForLoad(Shard *shard, const K &key, size_t hash) {
+    Item *item;
+    while ((item = Find(*shard, key, hash)) != NULL && item->loading) {
+      shard->loaded.Wait(&shard->mutex);
+    }
+    return item;
+  }
+
+  void Insert(Shard *shard, Item *item) {
+    if (shard->num_items >= static_cast<int>(shard->buckets.size())) {
+      std::vector<Item *> buckets(2 * shard->buckets.size(),
+                                  static_cast<Item *>(NULL));
+      for (size_t b = 0; b < shard->buckets.size(); ++b) {
+        Item *old = shard->buckets[b];
+        while (old != NULL) {
+          Item *next = old->next_in_bucket;
+          Item *&head = buckets[old->hash & (buckets.size() - 1)];
+          old->next_in_bucket = head;
+          head = old;
+          old = next;
+        }
+      }
+      shard->buckets.swap(buckets);
+    }
+    Item *&head = shard->buckets[item->hash & (shard->buckets.size() - 1)];
+    item->next_in_bucket = head;
+    head = item;
+    shard->num_items++;
+  }
+
+  void Remove(Shard *shard, Item *item) {
+    Item **cursor = &shard->buckets[item->hash & (shard->buckets.size() - 1)];
+    while (*cursor != item) {
+      cursor = &(*cursor)->next_in_bucket;
+    }
+    *cursor = item->next_in_bucket;
+    shard->num_items--;
+  }
+
+  // Delete the replaced values of an item; returns their total size.
+  static int64_t ReleaseRetired(Item *item) {
+    int64_t freed = 0;
+    for (size_t i = 0; i < item->retired.size(); ++i) {
+      delete item->retired[i].first;
+      freed += item->retired[i].second;
+    }
+    item->retired.clear();
+    return freed;
+  }
+
+  static void DeleteItem(Item *item) {
+    ReleaseRetired(item);
+    delete item->value;
+    delete item;
+  }
+
+  // With for_handle set, the pin is handed to a Handle.
+  Item *FetchAndPinItem(const K &key, bool for_handle) {
+    size_t hash = hash_(key);
+    Shard &shard = ShardFor(hash);
+    MutexLock lock(&shard.mutex);
+    Item *item = FindOrWaitForLoad(&shard, key, hash);
+    if (item != NULL) {
+      PinFetchedLocked(item, for_handle);
+    } else {
+      MutexLock policy_lock(&policy_mutex_);
+      statistics_.misses++;
+    }
+    return item;
+  }
+
+  // Pin an item found by a fetch. The shard lock must be held.
+  void PinFetchedLocked(Item *item, bool for_handle) {
+    MutexLock policy_lock(&policy_mutex_);
+    if (item->use_count == 0) {
+      policy_->Pinned(item);
+    }
+    policy_->Hit(item);
+    statistics_.hits++;
+    item->use_count++;
+    item->num_handles += for_handle;
+  }
+
+  Item *FetchOrLoadAndPinItem(const K &key, CacheLoader<V> *loader,
+                              bool for_handle) {
+    size_t hash = hash_(key);
+    Shard &shard = ShardFor(hash);
+    Item *item;
+    {
+      MutexLock lock(&shard.mutex);
+      item = FindOrWaitForLoad(&shard, key, hash);
+      if (item != NULL) {
+        PinFetchedLocked(item, for_handle);
+        return item;
+      }
+      // Leave a placeholder for other threads to wait on. The policy only
+      // learns about the item once it has a value.
+      item = NewItem(key, hash);
+      item->loading = true;
+      item->use_count = 1;
+      item->num_handles = for_handle;
+      Insert(&shard, item);
+    }
+
+    int64_t size = 0;
+    V *value = loader->Load(&size);
+
+    {
+      MutexLock lock(&shard.mutex);
+      MutexLock policy_lock(&policy_mutex_);
+      statistics_.misses++;
+      if (value == NULL) {
+        Remove(&shard, item);
+        delete item;
+        item = NULL;
+      } else {
+        item->value = value;
+        item->size = size;
+        item->loading = false;
+        size_ += size;
+        policy_->Inserted(item);
+      }
+      shard.loaded.Broadcast();
+    }
+    if (item != NULL) {
+      EvictUnpinnedItemsIfNecessary();
+    }
+    return item;
+  }
+
+  void PinItem(Item *item) {
+    Shard &shard = ShardFor(item->hash);
+    MutexLock lock(&shard.mutex);
+    assert(item->num_handles > 0);
+    item->use_count++;
+    item->num_handles++;
+  }
+
+  // Returns whether the item got entirely unpinned, and hands it to the
+  // policy if so. The shard lock must be held.
+  bool UnpinLocked(Item *item) {
+    assert(item->use_count > 0);
+    if (--item->use_count > 0) {
+      return false;
+    }
+    int64_t freed = ReleaseRetired(item);
+    MutexLock policy_lock(&policy_mutex_);
+    size_ -= freed;
+    policy_->Unpinned(item);
+    return true;
+  }
+
+  // Releases the pin of a handle.
+  void UnpinItem(Item *item) {
+    Shard &shard = ShardFor(item->hash);
+    {
+      MutexLock lock(&shard.mutex);
+      assert(item->num_handles > 0);
+      item->num_handles--;
+      if (!UnpinLocked(item)) {
+        return;
+      }
+    }
+    EvictUnpinnedItemsIfNecessary();
+  }
+
+  bool OverMaxSize() const {
+    MutexLock lock(&policy_mutex_);
+    return size_ > max_size_;
+  }
+
+  void EvictUnpinnedItemsIfNecessary() {
+    if (!OverMaxSize()) {
+      return;
+    }
+    // One evicting thread at a time, so two of them do not evict more than
+    // needed between them. The victims are only handed to Evicted() once the
+    // lock is released, so a slow Evicted() does not hold up other threads.
+    std::vector<Item *> evicted;
+    {
+      MutexLock eviction_lock(&eviction_mutex_);
+      EvictUnpinnedItemsLocked(&evicted);
+    }
+    for (size_t i = 0; i < evicted.size(); ++i) {
+      Evicted(evicted[i]->key, *evicted[i]->value);
+      DeleteItem(evicted[i]);
+    }
+  }
+
+  // Removes victims until under the size limit, and appends them to evicted.
+  // The eviction lock must be held.
+  void EvictUnpinnedItemsLocked(std::vector<Item *> *evicted) {
+    for (;;) {
+      Item *item;
+      {
+        MutexLock policy_lock(&policy_mutex_);
+        if (size_ <= max_size_) {
+          return;
+        }
+        item = static_cast<Item *>(policy_->Victim());
+        if (item == NULL) {
+          return;
+        }
+      }
+
+      // The policy lock is taken after the shard lock everywhere else, so it
+      // was released above. The item cannot be deleted meanwhile, since only
+      // this thread evicts, but it may have been pinned again; it then goes
+      // back to the policy when unpinned.
+      Shard &shard = ShardFor(item->hash);
+      {
+        MutexLock lock(&shard.mutex);
+        if (item->use_count > 0) {
+          continue;
+        }
+        Remove(&shard, item);
+
+        // It may also have been pinned and unpinned again, which handed it
+        // back to the policy.
+        MutexLock policy_lock(&policy_mutex_);
+        policy_->Pinned(item);
+        policy_->Evicted(item);
+        size_ -= item->size;
+        statistics_.evictions++;
+        statistics_.evicted_size += item->size;
+      }
+      evicted->push_back(item);
+    }
+  }
+
+  Hash hash_;
+  Shard *shards_;
+  int num_shards_;
+
+  // Guards the policy, the sizes and the statistics. Taken after a shard
+  // lock, never before.
+  mutable Mutex policy_mutex_;
+  EvictionPolicy *policy_;
+  int64_t max_size_;
+  int64_t size_;
+  CacheStatistics statistics_;
+
+  Mutex eviction_mutex_;
+
+  ConcurrentCache(const ConcurrentCache &);
+  void operator=(const ConcurrentCache &);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_IMAGE_CONCURRENT_CACHE_H_
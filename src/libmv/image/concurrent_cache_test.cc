@@ -0,0 +1,405 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <vector>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/concurrent_cache.h"
+#include "testing/testing.h"
+
+namespace {
+
+using libmv::CacheEntry;
+using libmv::CacheLoader;
+using libmv::CacheStatistics;
+using libmv::EvictionPolicy;
+using libmv::Mutex;
+using libmv::MutexLock;
+using libmv::Thread;
+
+typedef libmv::ConcurrentCache<int, int> TestCache;
+
+TEST(ConcurrentCache, NullOnEmptyKey) {
+  TestCache cache(10);
+  int *ptr = NULL;
+  EXPECT_FALSE(cache.FetchAndPin(4, &ptr));
+  EXPECT_TRUE(cache.Fetch(4).empty());
+}
+
+TEST(ConcurrentCache, StoreAndRetreiveOneItem) {
+  TestCache cache(10);
+  int *ptr = NULL;
+  cache.StoreAndPin(4, new int(40));
+  EXPECT_TRUE(cache.FetchAndPin(4, &ptr));
+  EXPECT_EQ(40, *ptr);
+  EXPECT_EQ(40, *cache.Fetch(4));
+}
+
+TEST(ConcurrentCache, SizeIncreasesWithAddedItems) {
+  TestCache cache(10);
+  EXPECT_EQ(0, cache.Size());
+  cache.StoreAndPin(4, new int(40));
+  EXPECT_EQ(1, cache.Size());
+  cache.StoreAndPin(5, new int(40));
+  EXPECT_EQ(2, cache.Size());
+  cache.StoreAndPinSized(10, new int(40), 10);
+  EXPECT_EQ(12, cache.Size());
+}
+
+TEST(ConcurrentCache, SizesDoNotOverflowPast2GB) {
+  TestCache cache(int64_t(8) << 30);
+  cache.StoreAndPinSized(1, new int(10), int64_t(3) << 30);
+  cache.StoreAndPinSized(2, new int(20), int64_t(3) << 30);
+  EXPECT_EQ(int64_t(6) << 30, cache.Size());
+  cache.MassUnpin();
+  cache.StoreAndPinSized(3, new int(30), int64_t(3) << 30);
+  EXPECT_EQ(int64_t(6) << 30, cache.Size());
+  EXPECT_FALSE(cache.ContainsKey(1));
+}
+
+TEST(ConcurrentCache, MaxSizeExceededWhenItemsPinned) {
+  TestCache cache(3);
+  for (int i = 4; i < 8; ++i) {
+    cache.StoreAndPin(i, new int(10 * i));
+  }
+  EXPECT_EQ(4, cache.Size());
+}
+
+TEST(ConcurrentCache, EvictsLeastRecentlyUnpinned) {
+  TestCache cache(3);
+  for (int i = 0; i < 3; ++i) {
+    cache.StoreAndPin(i, new int(10 * i));
+  }
+  cache.Unpin(1);
+  cache.Unpin(0);
+  cache.Unpin(2);
+  cache.StoreAndPin(3, new int(30));
+  EXPECT_EQ(3, cache.Size());
+  EXPECT_FALSE(cache.ContainsKey(1));
+  EXPECT_TRUE(cache.ContainsKey(0));
+
+  cache.MassUnpin();
+  cache.SetMaxSize(1);
+  EXPECT_EQ(1, cache.Size());
+  EXPECT_TRUE(cache.ContainsKey(3));
+}
+
+TEST(ConcurrentCache, HandlesPinUntilTheLastCopyIsGone) {
+  TestCache cache(1);
+  cache.StoreAndPin(1, new int(10));
+  TestCache::Handle handle = cache.Fetch(1);
+  cache.Unpin(1);
+  {
+    TestCache::Handle copy = handle;
+    handle.Reset();
+    cache.StoreAndPin(2, new int(20));
+    cache.Unpin(2);
+    EXPECT_TRUE(cache.ContainsKey(1));
+    EXPECT_EQ(10, *copy);
+  }
+  cache.StoreAndPin(3, new int(30));
+  EXPECT_FALSE(cache.ContainsKey(1));
+}
+
+TEST(ConcurrentCache, MassUnpinLeavesHandlePins) {
+  TestCache cache(1);
+  cache.StoreAndPin(1, new int(10));
+  cache.StoreAndPin(1, new int(11));
+  TestCache::Handle handle = cache.Fetch(1);
+  TestCache::Handle copy = handle;
+
+  // Neither MassUnpin() nor unpinning by key may release the handles' pins.
+  cache.MassUnpin();
+  cache.Unpin(1);
+  cache.StoreAndPin(2, new int(20));
+  cache.Unpin(2);
+  EXPECT_TRUE(cache.ContainsKey(1));
+  EXPECT_FALSE(cache.ContainsKey(2));
+  EXPECT_EQ(11, *handle);
+
+  handle.Reset();
+  EXPECT_EQ(11, *copy);
+  copy.Reset();
+  cache.StoreAndPin(3, new int(30));
+  EXPECT_FALSE(cache.ContainsKey(1));
+  EXPECT_EQ(1, cache.Size());
+}
+
+TEST(ConcurrentCache, ReplacedValuesStayValidWhilePinned) {
+  TestCache cache(10);
+  int *old_value;
+  cache.StoreAndPin(1, new int(10));
+  ASSERT_TRUE(cache.FetchAndPin(1, &old_value));
+  cache.StoreAndPinSized(1, new int(20), 2);
+  EXPECT_EQ(10, *old_value);
+  EXPECT_EQ(3, cache.Size());
+  EXPECT_EQ(20, *cache.Fetch(1));
+
+  cache.MassUnpin();
+  EXPECT_EQ(2, cache.Size());
+}
+
+TEST(ConcurrentCache, CountsHitsMissesAndEvictions) {
+  TestCache cache(2);
+  int *ptr;
+  EXPECT_FALSE(cache.FetchAndPin(1, &ptr));
+  cache.StoreAndPin(1, new int(10));
+  cache.StoreAndPinSized(2, new int(20), 2);
+  EXPECT_TRUE(cache.FetchAndPin(1, &ptr));
+  EXPECT_TRUE(cache.Fetch(3).empty());
+  cache.Unpin(2);
+
+  CacheStatistics statistics = cache.Statistics();
+  EXPECT_EQ(1, statistics.hits);
+  EXPECT_EQ(2, statistics.misses);
+  EXPECT_EQ(1, statistics.evictions);
+  EXPECT_EQ(2, statistics.evicted_size);
+
+  cache.ResetStatistics();
+  EXPECT_EQ(0, cache.Statistics().hits);
+}
+
+// Four hot keys, used again after eviction from the FIFO, then a long scan of
+// keys used once.
+void HotKeysThenScan(TestCache *cache) {
+  for (int i = 0; i < 12; ++i) {
+    cache->StoreAndPin(i, new int(i));
+    cache->Unpin(i);
+  }
+  for (int i = 0; i < 4; ++i) {
+    cache->StoreAndPin(i, new int(i));
+    cache->Unpin(i);
+  }
+  for (int i = 100; i < 120; ++i) {
+    cache->StoreAndPin(i, new int(i));
+    cache->Unpin(i);
+  }
+}
+
+TEST(ConcurrentCache, TwoQueueKeepsHotKeysThroughAScan) {
+  TestCache cache(8, libmv::NewTwoQueueEvictionPolicy(0.25));
+  HotKeysThenScan(&cache);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_TRUE(cache.ContainsKey(i));
+  }
+  EXPECT_EQ(8, cache.Size());
+
+  TestCache lru_cache(8);
+  HotKeysThenScan(&lru_cache);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_FALSE(lru_cache.ContainsKey(i));
+  }
+}
+
+// Victim() may be called off by the cache when the entry gets pinned again;
+// only evictions that happen may leave a ghost that promotes the key.
+TEST(ConcurrentCache, TwoQueueOnlyRemembersCompletedEvictions) {
+  EvictionPolicy *policy = libmv::NewTwoQueueEvictionPolicy();
+  policy->SetMaxSize(100);
+  CacheEntry entry;
+  entry.hash = 1;
+  entry.size = 10;
+  policy->Inserted(&entry);
+  policy->Unpinned(&entry);
+  EXPECT_EQ(&entry, policy->Victim());
+  policy->Unpinned(&entry);
+
+  CacheEntry fresh;
+  fresh.hash = 2;
+  policy->Inserted(&fresh);
+  CacheEntry same_key;
+  same_key.hash = 1;
+  policy->Inserted(&same_key);
+  EXPECT_EQ(fresh.queue, same_key.queue);
+
+  EXPECT_EQ(&entry, policy->Victim());
+  policy->Evicted(&entry);
+  CacheEntry returning;
+  returning.hash = 1;
+  policy->Inserted(&returning);
+  EXPECT_NE(fresh.queue, returning.queue);
+  delete policy;
+}
+
+TEST(ConcurrentCache, SequenceWindowEvictsFramesAwayFromThePlayhead) {
+  TestCache cache(3, libmv::NewSequenceWindowEvictionPolicy(1));
+  cache.StoreAndPin(4, new int(40));
+  cache.StoreAndPin(9, new int(90));
+  cache.StoreAndPin(3, new int(30));
+  cache.Unpin(4);
+  cache.Unpin(9);
+  cache.Unpin(3);
+
+  // Frame 4 is the least recently used, but next to the playhead.
+  cache.StoreAndPin(5, new int(50));
+  EXPECT_TRUE(cache.ContainsKey(4));
+  EXPECT_FALSE(cache.ContainsKey(9));
+}
+
+TEST(ConcurrentCache, SequenceWindowEvictsTheFarthestFrameInTheWindow) {
+  TestCache cache(2, libmv::NewSequenceWindowEvictionPolicy(10));
+  cache.StoreAndPin(5, new int(50));
+  cache.Unpin(5);
+  cache.StoreAndPin(0, new int(0));
+  cache.Unpin(0);
+  cache.StoreAndPin(4, new int(40));
+  EXPECT_TRUE(cache.ContainsKey(5));
+  EXPECT_FALSE(cache.ContainsKey(0));
+}
+
+class CountingLoader : public CacheLoader<int> {
+ public:
+  CountingLoader(int value, Mutex *mutex, int *num_loads)
+      : value_(value), mutex_(mutex), num_loads_(num_loads) {}
+
+  virtual int *Load(int64_t *size) {
+    {
+      MutexLock lock(mutex_);
+      ++*num_loads_;
+    }
+    *size = 1;
+    return value_ < 0 ? NULL : new int(value_);
+  }
+
+ private:
+  int value_;
+  Mutex *mutex_;
+  int *num_loads_;
+};
+
+TEST(ConcurrentCache, PrefetchIsNeitherAHitNorAMiss) {
+  TestCache cache(10);
+  Mutex mutex;
+  int num_loads = 0;
+  CountingLoader loader(7, &mutex, &num_loads);
+  cache.Prefetch(1, &loader);
+  cache.Prefetch(1, &loader);
+  EXPECT_EQ(1, num_loads);
+  EXPECT_TRUE(cache.ContainsKey(1));
+
+  CacheStatistics statistics = cache.Statistics();
+  EXPECT_EQ(0, statistics.hits);
+  EXPECT_EQ(0, statistics.misses);
+  EXPECT_EQ(1, statistics.prefetches);
+
+  // Prefetched values are left unpinned.
+  cache.SetMaxSize(0);
+  EXPECT_FALSE(cache.ContainsKey(1));
+
+  CountingLoader failing_loader(-1, &mutex, &num_loads);
+  cache.SetMaxSize(10);
+  cache.Prefetch(2, &failing_loader);
+  EXPECT_FALSE(cache.ContainsKey(2));
+}
+
+TEST(ConcurrentCache, PrefetchesDoNotMoveThePlayhead) {
+  EvictionPolicy *policy = libmv::NewSequenceWindowEvictionPolicy(1);
+  CacheEntry far;
+  far.frame = 0;
+  policy->Inserted(&far);
+  policy->Unpinned(&far);
+  CacheEntry playhead;
+  playhead.frame = 10;
+  policy->Inserted(&playhead);
+  policy->Unpinned(&playhead);
+  CacheEntry prefetched;
+  prefetched.frame = 1;
+  policy->Prefetched(&prefetched);
+  policy->Unpinned(&prefetched);
+
+  // Frames 0 and 1 are away from the playhead at 10; 0 is older.
+  EXPECT_EQ(&far, policy->Victim());
+  delete policy;
+}
+
+TEST(ConcurrentCache, FetchOrLoadOnlyLoadsMissingValues) {
+  TestCache cache(10);
+  Mutex mutex;
+  int num_loads = 0;
+  CountingLoader loader(7, &mutex, &num_loads);
+  EXPECT_EQ(7, *cache.FetchOrLoadAndPin(1, &loader));
+  EXPECT_EQ(7, *cache.FetchOrLoad(1, &loader));
+  EXPECT_EQ(1, num_loads);
+
+  CountingLoader failing_loader(-1, &mutex, &num_loads);
+  EXPECT_TRUE(cache.FetchOrLoadAndPin(2, &failing_loader) == NULL);
+  EXPECT_FALSE(cache.ContainsKey(2));
+}
+
+// Many threads fetching overlapping keys through a cache too small to hold
+// them all: values are never mixed up or freed while in use, and the cache
+// gets back under its size once everything is unpinned.
+class FetchingThread : public Thread {
+ public:
+  FetchingThread(TestCache *cache, int seed, Mutex *mutex, int *num_loads)
+      : cache_(cache), seed_(seed), mutex_(mutex), num_loads_(num_loads),
+        num_errors_(0) {}
+
+  int num_errors() const { return num_errors_; }
+
+ protected:
+  virtual void Run() {
+    for (int i = 0; i < 2000; ++i) {
+      int key = (seed_ * 7 + i * 13) % 64;
+      CountingLoader loader(key * 10, mutex_, num_loads_);
+      if (i % 2 == 0) {
+        TestCache::Handle handle = cache_->FetchOrLoad(key, &loader);
+        num_errors_ += *handle != key * 10;
+      } else {
+        int *value = cache_->FetchOrLoadAndPin(key, &loader);
+        num_errors_ += *value != key * 10;
+        cache_->Unpin(key);
+      }
+    }
+  }
+
+ private:
+  TestCache *cache_;
+  int seed_;
+  Mutex *mutex_;
+  int *num_loads_;
+  int num_errors_;
+};
+
+void FetchConcurrently(EvictionPolicy *policy) {
+  TestCache cache(32, policy, 4);
+  Mutex mutex;
+  int num_loads = 0;
+  std::vector<FetchingThread *> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.push_back(new FetchingThread(&cache, t, &mutex, &num_loads));
+    ASSERT_TRUE(threads.back()->Start());
+  }
+  for (int t = 0; t < 8; ++t) {
+    threads[t]->Join();
+    EXPECT_EQ(0, threads[t]->num_errors());
+    delete threads[t];
+  }
+  EXPECT_GE(num_loads, 64);
+  EXPECT_LE(cache.Size(), 32);
+}
+
+TEST(ConcurrentCache, ConcurrentFetchOrLoad) {
+  FetchConcurrently(libmv::NewLruEvictionPolicy());
+  FetchConcurrently(libmv::NewTwoQueueEvictionPolicy());
+  FetchConcurrently(libmv::NewSequenceWindowEvictionPolicy(8));
+}
+
+}  // namespace
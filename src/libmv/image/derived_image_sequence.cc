@@ -0,0 +1,119 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/image/derived_image_sequence.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+
+DerivedImageSequence::DerivedImageSequence(ImageSequence *source,
+                                           ImageCache *cache)
+    : CachedImageSequence(cache != NULL ? cache : source->Cache()),
+      source_(source) {
+  CHECK(Cache() != NULL) << "Derived image sequences need an image cache.";
+}
+
+int DerivedImageSequence::Length() {
+  return source_->Length();
+}
+
+cv::Mat DerivedImageSequence::LoadImage(int i) {
+  bool shared;
+  return LoadImageForCache(i, &shared);
+}
+
+cv::Mat DerivedImageSequence::LoadImageForCache(int i, bool *shared) {
+  *shared = false;
+  cv::Mat image = source_->GetImage(i);
+  if (image.empty()) {
+    return cv::Mat();
+  }
+  cv::Mat derived = Derive(image);
+  // A frame passed through is already charged to the source's entry.
+  *shared = derived.datastart == image.datastart;
+  source_->Unpin(i);
+  return derived;
+}
+
+cv::Mat GrayscaleImageSequence::Derive(const cv::Mat &image) {
+  cv::Mat gray;
+  if (image.channels() == 3) {
+    cv::cvtColor(image, gray, CV_BGR2GRAY);
+  } else if (image.channels() == 4) {
+    cv::cvtColor(image, gray, CV_BGRA2GRAY);
+  } else {
+    gray = image;
+  }
+  return gray;
+}
+
+cv::Mat FloatImageSequence::Derive(const cv::Mat &image) {
+  double scale = scale_;
+  if (scale == 0) {
+    if (image.depth() == CV_8U) {
+      scale = 1.0 / 255.0;
+    } else if (image.depth() == CV_16U) {
+      scale = 1.0 / 65535.0;
+    } else {
+      scale = 1.0;
+    }
+  }
+  if (image.depth() == CV_32F && scale == 1.0) {
+    return image;
+  }
+  cv::Mat result;
+  image.convertTo(result, CV_32F, scale);
+  return result;
+}
+
+cv::Mat DownsampledImageSequence::Derive(const cv::Mat &image) {
+  if (factor_ <= 1) {
+    return image;
+  }
+  cv::Size size(std::max(1, image.cols / factor_),
+                std::max(1, image.rows / factor_));
+  cv::Mat result;
+  cv::resize(image, result, size, 0, 0, cv::INTER_AREA);
+  return result;
+}
+
+cv::Mat CroppedImageSequence::LoadImageForCache(int i, bool *shared) {
+  *shared = false;
+  cv::Mat region = source()->GetRegion(i, roi_);
+  if (region.empty()) {
+    return cv::Mat();
+  }
+  // A copy, so the crop does not keep the whole source frame alive.
+  cv::Mat cropped = region.clone();
+  source()->UnpinRegion(i, roi_);
+  return cropped;
+}
+
+cv::Mat CroppedImageSequence::Derive(const cv::Mat &image) {
+  cv::Rect clipped = roi_ & cv::Rect(0, 0, image.cols, image.rows);
+  return image(clipped).clone();
+}
+
+}  // namespace libmv
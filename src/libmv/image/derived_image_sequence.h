@@ -0,0 +1,129 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Image sequences computed frame by frame from another sequence, such as a
+// grayscale or downsampled version of the footage. The frames are derived on
+// first use and kept in the shared ImageCache like any loaded frame, so a
+// derived product is computed once per frame for every consumer that shares
+// the adapter. Adapters compose: a Crop of a Downsample of a Grayscale works.
+
+#ifndef LIBMV_IMAGE_DERIVED_IMAGE_SEQUENCE_H_
+#define LIBMV_IMAGE_DERIVED_IMAGE_SEQUENCE_H_
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/image/cached_image_sequence.h"
+
+namespace libmv {
+
+// Subclasses implement Derive(), or LoadImageForCache() to fetch the source
+// frames differently. The source is not owned, and must outlive the adapter.
+// Frames are cached in cache, or in the cache of the source if cache is NULL;
+// one of them must exist.
+class DerivedImageSequence : public CachedImageSequence {
+ public:
+  explicit DerivedImageSequence(ImageSequence *source,
+                                ImageCache *cache = NULL);
+  virtual ~DerivedImageSequence() {}
+
+  virtual int Length();
+  virtual cv::Mat LoadImage(int i);
+
+ protected:
+  virtual cv::Mat LoadImageForCache(int i, bool *shared);
+
+  // Compute a frame from the source frame. Returning the source frame itself,
+  // or a view into it, is fine. Such a frame is cached under both keys but
+  // only charged to the source's entry; if that is evicted first, the data
+  // stays alive uncounted until the derived entry goes too.
+  virtual cv::Mat Derive(const cv::Mat &image) = 0;
+
+  ImageSequence *source() { return source_; }
+
+ private:
+  ImageSequence *source_;
+};
+
+// Color frames converted to one channel, in the same depth. Frames already
+// in one channel are passed through.
+class GrayscaleImageSequence : public DerivedImageSequence {
+ public:
+  explicit GrayscaleImageSequence(ImageSequence *source,
+                                  ImageCache *cache = NULL)
+      : DerivedImageSequence(source, cache) {}
+
+ protected:
+  virtual cv::Mat Derive(const cv::Mat &image);
+};
+
+// Frames converted to float with the same channels. A scale of zero maps the
+// full range of integer frames to [0, 1], and leaves float frames as they
+// are.
+class FloatImageSequence : public DerivedImageSequence {
+ public:
+  explicit FloatImageSequence(ImageSequence *source,
+                              double scale = 0,
+                              ImageCache *cache = NULL)
+      : DerivedImageSequence(source, cache), scale_(scale) {}
+
+ protected:
+  virtual cv::Mat Derive(const cv::Mat &image);
+
+ private:
+  double scale_;
+};
+
+// Frames shrunk by an integer factor, averaging each factor x factor block
+// of pixels, e.g. for proxies.
+class DownsampledImageSequence : public DerivedImageSequence {
+ public:
+  DownsampledImageSequence(ImageSequence *source,
+                           int factor,
+                           ImageCache *cache = NULL)
+      : DerivedImageSequence(source, cache), factor_(factor) {}
+
+ protected:
+  virtual cv::Mat Derive(const cv::Mat &image);
+
+ private:
+  int factor_;
+};
+
+// The part of the frames inside a rectangle, clipped to the frames. It is
+// fetched with GetRegion(), so sources that decode by regions only load the
+// part needed.
+class CroppedImageSequence : public DerivedImageSequence {
+ public:
+  CroppedImageSequence(ImageSequence *source,
+                       const cv::Rect &roi,
+                       ImageCache *cache = NULL)
+      : DerivedImageSequence(source, cache), roi_(roi) {}
+
+ protected:
+  virtual cv::Mat LoadImageForCache(int i, bool *shared);
+  virtual cv::Mat Derive(const cv::Mat &image);
+
+ private:
+  cv::Rect roi_;
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_IMAGE_DERIVED_IMAGE_SEQUENCE_H_
@@ -0,0 +1,125 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/image/derived_image_sequence.h"
+#include "testing/testing.h"
+
+namespace {
+
+using libmv::CachedImageSequence;
+using libmv::CroppedImageSequence;
+using libmv::DownsampledImageSequence;
+using libmv::FloatImageSequence;
+using libmv::GrayscaleImageSequence;
+using libmv::ImageCache;
+
+// Gray BGR frames of 8 x 6 pixels; pixel (r, c) of frame i is 10 * i + c.
+class ColorSequence : public CachedImageSequence {
+ public:
+  explicit ColorSequence(ImageCache *cache)
+      : CachedImageSequence(cache), num_loads(0) {}
+
+  virtual int Length() { return 3; }
+
+  virtual cv::Mat LoadImage(int i) {
+    ++num_loads;
+    cv::Mat_<cv::Vec3b> image(6, 8);
+    for (int r = 0; r < image.rows; ++r) {
+      for (int c = 0; c < image.cols; ++c) {
+        unsigned char value = 10 * i + c;
+        image(r, c) = cv::Vec3b(value, value, value);
+      }
+    }
+    return image;
+  }
+
+  int num_loads;
+};
+
+TEST(DerivedImageSequence, ComposedAdapters) {
+  ImageCache cache;
+  ColorSequence color(&cache);
+  GrayscaleImageSequence gray(&color);
+  FloatImageSequence floats(&gray);
+  DownsampledImageSequence proxy(&floats, 2);
+  CroppedImageSequence crop(&floats, cv::Rect(2, 1, 3, 2));
+  EXPECT_EQ(3, proxy.Length());
+
+  cv::Mat image = gray.GetImage(1);
+  ASSERT_EQ(CV_8UC1, image.type());
+  EXPECT_EQ(13, image.at<unsigned char>(4, 3));
+  gray.Unpin(1);
+
+  image = floats.GetImage(1);
+  ASSERT_EQ(CV_32FC1, image.type());
+  EXPECT_FLOAT_EQ(13 / 255.0, image.at<float>(4, 3));
+  floats.Unpin(1);
+
+  image = proxy.GetImage(1);
+  ASSERT_EQ(CV_32FC1, image.type());
+  EXPECT_EQ(4, image.cols);
+  EXPECT_EQ(3, image.rows);
+  EXPECT_FLOAT_EQ(12.5 / 255.0, image.at<float>(2, 1));
+  proxy.Unpin(1);
+
+  image = crop.GetImage(1);
+  EXPECT_EQ(3, image.cols);
+  EXPECT_EQ(2, image.rows);
+  EXPECT_FLOAT_EQ(12 / 255.0, image.at<float>(0, 0));
+  crop.Unpin(1);
+
+  // Each product was computed once, from a single load of the source; the
+  // hits are the adapters fetching their source frames.
+  EXPECT_EQ(1, color.num_loads);
+  EXPECT_EQ(3, cache.Statistics().hits);
+}
+
+TEST(DerivedImageSequence, PassedThroughFramesAreChargedOnce) {
+  ImageCache cache;
+  ColorSequence color(&cache);
+  GrayscaleImageSequence gray(&color);
+  GrayscaleImageSequence still_gray(&gray);
+
+  cv::Mat image = gray.GetImage(0);
+  gray.Unpin(0);
+  const int64_t gray_size = image.rows * image.cols;
+  EXPECT_EQ(3 * gray_size + gray_size, cache.Size());
+
+  // One channel frames are passed through, sharing the gray frame's data.
+  cv::Mat passed = still_gray.GetImage(0);
+  EXPECT_EQ(image.data, passed.data);
+  still_gray.Unpin(0);
+  EXPECT_EQ(3 * gray_size + gray_size, cache.Size());
+}
+
+TEST(DerivedImageSequence, CropIsClippedToTheFrames) {
+  ImageCache cache;
+  ColorSequence color(&cache);
+  CroppedImageSequence crop(&color, cv::Rect(6, 4, 10, 10));
+
+  cv::Mat image = crop.GetImage(0);
+  EXPECT_EQ(2, image.cols);
+  EXPECT_EQ(2, image.rows);
+  crop.Unpin(0);
+}
+
+}  // namespace
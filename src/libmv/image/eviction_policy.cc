@@ -0,0 +1,256 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/image/eviction_policy.h"
+
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <utility>
+
+namespace libmv {
+namespace {
+
+bool IsLinked(const CacheEntry *entry) {
+  return entry->next != NULL;
+}
+
+class LruEvictionPolicy : public EvictionPolicy {
+ public:
+  virtual void Inserted(CacheEntry *) {}
+  virtual void Hit(CacheEntry *) {}
+
+  virtual void Unpinned(CacheEntry *entry) {
+    unpinned_.PushBack(entry);
+  }
+
+  virtual void Pinned(CacheEntry *entry) {
+    if (IsLinked(entry)) {
+      unpinned_.Remove(entry);
+    }
+  }
+
+  virtual CacheEntry *Victim() {
+    CacheEntry *entry = unpinned_.front();
+    if (entry != NULL) {
+      unpinned_.Remove(entry);
+    }
+    return entry;
+  }
+
+ private:
+  CacheEntryList unpinned_;
+};
+
+// Full 2Q: A1in is the FIFO of entries seen once, Am the LRU queue of the
+// entries that proved useful, and A1out remembers the hashes of entries
+// recently evicted from A1in. Fetching an entry again while it is still in
+// A1in does not promote it, since such hits are usually correlated (e.g. a
+// tracker fetching the same frame several times in a row); coming back after
+// eviction from A1in does.
+class TwoQueueEvictionPolicy : public EvictionPolicy {
+ public:
+  explicit TwoQueueEvictionPolicy(double in_fraction)
+      : in_fraction_(in_fraction),
+        max_in_size_(0),
+        max_ghost_size_(0),
+        ghost_size_(0) {}
+
+  virtual void SetMaxSize(int64_t max_size) {
+    max_in_size_ = static_cast<int64_t>(in_fraction_ * max_size);
+    max_ghost_size_ = max_size / 2;
+    TrimGhosts();
+  }
+
+  virtual void Inserted(CacheEntry *entry) {
+    entry->queue = ForgetGhost(entry->hash) ? kMain : kIn;
+  }
+
+  // Loading a key ahead of use says nothing about its reuse; it goes through
+  // A1in, and keeps its ghost until it is really asked for.
+  virtual void Prefetched(CacheEntry *entry) {
+    entry->queue = kPrefetched;
+  }
+
+  // The first fetch of a prefetched entry is what Inserted() would have
+  // seen without the prefetch.
+  virtual void Hit(CacheEntry *entry) {
+    if (entry->queue == kPrefetched) {
+      Inserted(entry);
+    }
+  }
+
+  virtual void Unpinned(CacheEntry *entry) {
+    Queue(entry->queue)->PushBack(entry);
+  }
+
+  virtual void Pinned(CacheEntry *entry) {
+    if (IsLinked(entry)) {
+      Queue(entry->queue)->Remove(entry);
+    }
+  }
+
+  virtual CacheEntry *Victim() {
+    // Only the unpinned entries of A1in count against its share, since the
+    // pinned ones could not be evicted anyway.
+    if (!in_.empty() && (in_.size() > max_in_size_ || main_.empty())) {
+      CacheEntry *entry = in_.front();
+      in_.Remove(entry);
+      return entry;
+    }
+    CacheEntry *entry = main_.front();
+    if (entry != NULL) {
+      main_.Remove(entry);
+    }
+    return entry;
+  }
+
+  // Only entries that really left A1in become ghosts; one whose eviction was
+  // called off is still resident, in its old queue. Prefetched entries that
+  // were never used leave no ghost.
+  virtual void Evicted(CacheEntry *entry) {
+    if (entry->queue == kIn) {
+      RememberGhost(entry);
+    }
+  }
+
+ private:
+  // Prefetched entries sit in A1in until used.
+  enum { kIn, kMain, kPrefetched };
+
+  // Hashes of evicted entries with their sizes, oldest first.
+  typedef std::list<std::pair<size_t, int64_t> > GhostList;
+
+  CacheEntryList *Queue(int queue) {
+    return queue == kMain ? &main_ : &in_;
+  }
+
+  // Returns whether there was a ghost for hash.
+  bool ForgetGhost(size_t hash) {
+    std::map<size_t, GhostList::iterator>::iterator ghost = ghosts_.find(hash);
+    if (ghost == ghosts_.end()) {
+      return false;
+    }
+    ghost_size_ -= ghost->second->second;
+    ghost_order_.erase(ghost->second);
+    ghosts_.erase(ghost);
+    return true;
+  }
+
+  void RememberGhost(const CacheEntry *entry) {
+    if (ghosts_.count(entry->hash)) {
+      return;
+    }
+    ghost_order_.push_back(std::make_pair(entry->hash, entry->size));
+    ghosts_[entry->hash] = --ghost_order_.end();
+    ghost_size_ += entry->size;
+    TrimGhosts();
+  }
+
+  // A1out remembers about half the budget worth of entries.
+  void TrimGhosts() {
+    while (ghost_size_ > max_ghost_size_ && !ghost_order_.empty()) {
+      ghost_size_ -= ghost_order_.front().second;
+      ghosts_.erase(ghost_order_.front().first);
+      ghost_order_.pop_front();
+    }
+  }
+
+  double in_fraction_;
+  int64_t max_in_size_;
+  CacheEntryList in_;
+  CacheEntryList main_;
+
+  GhostList ghost_order_;
+  std::map<size_t, GhostList::iterator> ghosts_;
+  int64_t max_ghost_size_;
+  int64_t ghost_size_;
+};
+
+// Picking a victim walks the unpinned entries, which is fine for the few
+// hundred frames an image cache holds.
+class SequenceWindowEvictionPolicy : public EvictionPolicy {
+ public:
+  explicit SequenceWindowEvictionPolicy(int half_window)
+      : half_window_(half_window), playhead_(0) {}
+
+  virtual void Inserted(CacheEntry *entry) {
+    playhead_ = entry->frame;
+  }
+
+  virtual void Prefetched(CacheEntry *) {}
+
+  virtual void Hit(CacheEntry *entry) {
+    playhead_ = entry->frame;
+  }
+
+  virtual void Unpinned(CacheEntry *entry) {
+    unpinned_.PushBack(entry);
+  }
+
+  virtual void Pinned(CacheEntry *entry) {
+    if (IsLinked(entry)) {
+      unpinned_.Remove(entry);
+    }
+  }
+
+  virtual CacheEntry *Victim() {
+    CacheEntry *farthest = NULL;
+    int farthest_distance = -1;
+    for (CacheEntry *entry = unpinned_.front();
+         entry != NULL;
+         entry = unpinned_.Next(entry)) {
+      int distance = std::abs(entry->frame - playhead_);
+      if (distance > half_window_) {
+        farthest = entry;
+        break;
+      }
+      if (distance > farthest_distance) {
+        farthest = entry;
+        farthest_distance = distance;
+      }
+    }
+    if (farthest != NULL) {
+      unpinned_.Remove(farthest);
+    }
+    return farthest;
+  }
+
+ private:
+  int half_window_;
+  int playhead_;
+  CacheEntryList unpinned_;
+};
+
+}  // namespace
+
+EvictionPolicy *NewLruEvictionPolicy() {
+  return new LruEvictionPolicy;
+}
+
+EvictionPolicy *NewTwoQueueEvictionPolicy(double in_fraction) {
+  return new TwoQueueEvictionPolicy(in_fraction);
+}
+
+EvictionPolicy *NewSequenceWindowEvictionPolicy(int half_window) {
+  return new SequenceWindowEvictionPolicy(half_window);
+}
+
+}  // namespace libmv
@@ -0,0 +1,147 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Eviction policies for ConcurrentCache. A policy only sees the cache entries
+// through CacheEntry and decides which unpinned entry to evict next.
+
+#ifndef LIBMV_IMAGE_EVICTION_POLICY_H_
+#define LIBMV_IMAGE_EVICTION_POLICY_H_
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace libmv {
+
+// The part of a cache item that eviction policies work with.
+struct CacheEntry {
+  CacheEntry()
+      : previous(NULL), next(NULL), hash(0), size(0), frame(0), queue(0) {}
+
+  // Links in the policy list holding the entry while it is unpinned; NULL
+  // while it is pinned.
+  CacheEntry *previous;
+  CacheEntry *next;
+
+  // Hash of the key, size in bytes, and the frame number of the key if it
+  // has one (see CacheKeyFrame()). Set by the cache.
+  size_t hash;
+  int64_t size;
+  int frame;
+
+  // Free for the policy to use; the cache does not touch it.
+  int queue;
+};
+
+// A doubly linked list of entries, front to back.
+class CacheEntryList {
+ public:
+  CacheEntryList() : size_(0) {
+    head_.previous = head_.next = &head_;
+  }
+
+  bool empty() const { return head_.next == &head_; }
+  CacheEntry *front() const { return empty() ? NULL : head_.next; }
+
+  // Null at the end of the list.
+  CacheEntry *Next(const CacheEntry *entry) const {
+    return entry->next == &head_ ? NULL : entry->next;
+  }
+
+  void PushBack(CacheEntry *entry) {
+    entry->previous = head_.previous;
+    entry->next = &head_;
+    head_.previous->next = entry;
+    head_.previous = entry;
+    size_ += entry->size;
+  }
+
+  void Remove(CacheEntry *entry) {
+    entry->previous->next = entry->next;
+    entry->next->previous = entry->previous;
+    entry->previous = entry->next = NULL;
+    size_ -= entry->size;
+  }
+
+  // Total size of the entries in the list.
+  int64_t size() const { return size_; }
+
+ private:
+  CacheEntry head_;
+  int64_t size_;
+};
+
+// The cache serializes all calls. Entries only ever get evicted while
+// unpinned; which unpinned entry goes first is up to the policy.
+class EvictionPolicy {
+ public:
+  virtual ~EvictionPolicy() {}
+
+  // The cache budget in bytes; called before any entry is added.
+  virtual void SetMaxSize(int64_t max_size) { (void) max_size; }
+
+  // A new entry was stored; it starts out pinned.
+  virtual void Inserted(CacheEntry *entry) = 0;
+
+  // A new entry was loaded ahead of use (see ConcurrentCache::Prefetch()).
+  // It starts out pinned like an inserted one, but nobody asked for it yet.
+  virtual void Prefetched(CacheEntry *entry) { Inserted(entry); }
+
+  // An entry already in the cache was fetched.
+  virtual void Hit(CacheEntry *entry) = 0;
+
+  // The entry is no longer pinned, and can be evicted.
+  virtual void Unpinned(CacheEntry *entry) = 0;
+
+  // The entry got pinned, or is leaving the cache; forget it if it is among
+  // the evictable entries. Does nothing for an entry that is not.
+  virtual void Pinned(CacheEntry *entry) = 0;
+
+  // Pick the next entry to evict among the unpinned ones, and forget it.
+  // Returns NULL if there is none.
+  virtual CacheEntry *Victim() = 0;
+
+  // The entry last returned by Victim() has left the cache. This does not
+  // always follow Victim(): an entry pinned again before the cache could
+  // remove it stays, and comes back through Unpinned() instead.
+  virtual void Evicted(CacheEntry *entry) { (void) entry; }
+};
+
+// Least recently unpinned first.
+EvictionPolicy *NewLruEvictionPolicy();
+
+// The "2Q" policy of Johnson and Shasha: entries seen once go through a FIFO
+// that gets at most in_fraction of the budget, and only entries fetched again
+// while there, or shortly after being evicted from it, reach the main LRU
+// queue. One pass over many frames then cannot flush the frames that are
+// used over and over.
+EvictionPolicy *NewTwoQueueEvictionPolicy(double in_fraction = 0.25);
+
+// For frames of image sequences. Keeps the frames within half_window frames
+// of the playhead (the last frame stored or fetched; prefetches don't move
+// it) and evicts the others in LRU order first; if all unpinned frames are
+// in the window, the one farthest from the playhead goes. Suits scrubbing
+// back and forth, and trackers that walk a sliding window of frames. All
+// keys share a single playhead.
+EvictionPolicy *NewSequenceWindowEvictionPolicy(int half_window);
+
+}  // namespace libmv
+
+#endif  // LIBMV_IMAGE_EVICTION_POLICY_H_
@@ -0,0 +1,284 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/image/frame_spill_file.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+namespace {
+
+struct RecordHeader {
+  int32_t rows;
+  int32_t cols;
+  int32_t type;
+  int32_t reserved;
+  int64_t stride;
+};
+
+// Records start on cache line boundaries, and so do their pixels.
+const int64_t kRecordAlignment = 64;
+const int64_t kDataOffset = 64;
+
+int64_t RoundUp(int64_t size) {
+  return (size + kRecordAlignment - 1) / kRecordAlignment * kRecordAlignment;
+}
+
+#ifndef _WIN32
+bool WriteAt(int fd, const void *data, int64_t size, int64_t offset) {
+  const char *bytes = static_cast<const char *>(data);
+  while (size > 0) {
+    ssize_t written = pwrite(fd, bytes, size, offset);
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= written;
+    offset += written;
+  }
+  return true;
+}
+
+bool ReadAt(int fd, void *data, int64_t size, int64_t offset) {
+  char *bytes = static_cast<char *>(data);
+  while (size > 0) {
+    ssize_t num_read = pread(fd, bytes, size, offset);
+    if (num_read <= 0) {
+      return false;
+    }
+    bytes += num_read;
+    size -= num_read;
+    offset += num_read;
+  }
+  return true;
+}
+
+// The reference count of a loaded frame, and the mapping it keeps alive. The
+// count comes first, since the Mat only holds a pointer to it.
+struct Mapping {
+  int refcount;
+  void *address;
+  size_t length;
+};
+
+// Unmaps loaded frames when their last Mat is released. Should such a Mat be
+// re-created at another size, it gets plain heap memory instead.
+class MappingAllocator : public cv::MatAllocator {
+ public:
+  virtual void allocate(int dims, const int *sizes, int type, int *&refcount,
+                        uchar *&datastart, uchar *&data, size_t *step) {
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i) {
+      if (step) {
+        step[i] = total;
+      }
+      total *= sizes[i];
+    }
+    Mapping *mapping = new Mapping;
+    mapping->refcount = 1;
+    mapping->address = cv::fastMalloc(total);
+    mapping->length = 0;
+    refcount = &mapping->refcount;
+    datastart = data = static_cast<uchar *>(mapping->address);
+  }
+
+  virtual void deallocate(int *refcount, uchar *datastart, uchar *data) {
+    (void) datastart;
+    (void) data;
+    Mapping *mapping = reinterpret_cast<Mapping *>(refcount);
+    if (mapping->length > 0) {
+      munmap(mapping->address, mapping->length);
+    } else {
+      cv::fastFree(mapping->address);
+    }
+    delete mapping;
+  }
+};
+
+MappingAllocator mapping_allocator;
+#endif
+
+}  // namespace
+
+FrameSpillFile::FrameSpillFile(int64_t max_size,
+                               const std::string &directory)
+    : max_size_(max_size),
+      fd_(-1),
+      size_(0) {
+#ifndef _WIN32
+  std::string path = directory;
+  if (path.empty()) {
+    const char *tmpdir = getenv("TMPDIR");
+    path = tmpdir ? tmpdir : "/tmp";
+  }
+  path += "/libmv_frames_XXXXXX";
+  std::vector<char> name(path.begin(), path.end());
+  name.push_back('\0');
+  fd_ = mkstemp(&name[0]);
+  if (fd_ < 0) {
+    LOG(WARNING) << "Could not create a frame spill file in " << path;
+    return;
+  }
+  // Nothing else needs the name, and this way the file also goes away if
+  // the process dies.
+  unlink(&name[0]);
+#else
+  (void) directory;
+#endif
+}
+
+FrameSpillFile::~FrameSpillFile() {
+#ifndef _WIN32
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+#endif
+}
+
+bool FrameSpillFile::IsOpen() const {
+  return fd_ >= 0;
+}
+
+bool FrameSpillFile::Store(const void *sequence, int frame,
+                           const cv::Mat &image) {
+#ifndef _WIN32
+  if (fd_ < 0 || image.empty()) {
+    return false;
+  }
+  Key key(sequence, frame);
+  int64_t row_size = image.cols * image.elemSize();
+  int64_t record_size = RoundUp(kDataOffset + row_size * image.rows);
+  int64_t offset;
+  {
+    MutexLock lock(&mutex_);
+    if (offsets_.count(key)) {
+      return true;
+    }
+    if (size_ + record_size > max_size_) {
+      return false;
+    }
+    // Reserve the space, and write without holding the lock.
+    offset = size_;
+    size_ += record_size;
+  }
+
+  char header_block[kDataOffset];
+  memset(header_block, 0, sizeof(header_block));
+  RecordHeader header = { image.rows, image.cols, image.type(), 0, row_size };
+  memcpy(header_block, &header, sizeof(header));
+  bool ok = WriteAt(fd_, header_block, kDataOffset, offset);
+  if (image.isContinuous()) {
+    ok = ok && WriteAt(fd_, image.data, row_size * image.rows,
+                       offset + kDataOffset);
+  } else {
+    for (int r = 0; ok && r < image.rows; ++r) {
+      ok = WriteAt(fd_, image.ptr(r), row_size,
+                   offset + kDataOffset + r * row_size);
+    }
+  }
+  if (!ok) {
+    // The reserved space is lost; likely the disk is full anyway.
+    LOG(WARNING) << "Could not write frame " << frame << " to the spill file.";
+    return false;
+  }
+
+  MutexLock lock(&mutex_);
+  offsets_[key] = offset;
+  return true;
+#else
+  (void) sequence;
+  (void) frame;
+  (void) image;
+  return false;
+#endif
+}
+
+bool FrameSpillFile::Load(const void *sequence, int frame, cv::Mat *image) {
+#ifndef _WIN32
+  int64_t offset;
+  {
+    MutexLock lock(&mutex_);
+    std::map<Key, int64_t>::const_iterator it =
+        offsets_.find(Key(sequence, frame));
+    if (it == offsets_.end()) {
+      return false;
+    }
+    offset = it->second;
+  }
+  RecordHeader header;
+  if (!ReadAt(fd_, &header, sizeof(header), offset)) {
+    return false;
+  }
+  // Map the record privately: pages that are only read come straight from
+  // the page cache, and a caller writing into the frame, as it could into a
+  // decoded one, gets its own copies of the pages it touches. Records are
+  // never rewritten, so the mapping always sees what Store() wrote.
+  static const int64_t page_size = sysconf(_SC_PAGESIZE);
+  int64_t map_offset = offset / page_size * page_size;
+  int64_t data_offset = offset - map_offset + kDataOffset;
+  size_t length = data_offset + header.stride * header.rows;
+  void *address = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                       fd_, map_offset);
+  if (address == MAP_FAILED) {
+    LOG(WARNING) << "Could not map frame " << frame
+                 << " from the spill file.";
+    return false;
+  }
+  Mapping *mapping = new Mapping;
+  mapping->refcount = 1;
+  mapping->address = address;
+  mapping->length = length;
+  cv::Mat loaded(header.rows, header.cols, header.type,
+                 static_cast<char *>(address) + data_offset,
+                 header.stride);
+  loaded.refcount = &mapping->refcount;
+  loaded.allocator = &mapping_allocator;
+  *image = loaded;
+  return true;
+#else
+  (void) sequence;
+  (void) frame;
+  (void) image;
+  return false;
+#endif
+}
+
+void FrameSpillFile::Forget(const void *sequence) {
+  MutexLock lock(&mutex_);
+  offsets_.erase(offsets_.lower_bound(Key(sequence, INT_MIN)),
+                 offsets_.upper_bound(Key(sequence, INT_MAX)));
+}
+
+int64_t FrameSpillFile::Size() {
+  MutexLock lock(&mutex_);
+  return size_;
+}
+
+}  // namespace libmv
@@ -0,0 +1,92 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_IMAGE_FRAME_SPILL_FILE_H_
+#define LIBMV_IMAGE_FRAME_SPILL_FILE_H_
+
+#include <stdint.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/base/thread.h"
+
+namespace libmv {
+
+// A scratch file of decoded frames, as a second tier below an ImageCache (see
+// ImageCache::SetSpillFile()). Reading a frame back maps it from the page
+// cache instead of decoding it.
+//
+// Each frame is a raw record: a header with the rows, columns, OpenCV type
+// and row stride, then the pixel rows. Records are only appended; once
+// max_size bytes are used, further frames are not stored. The file is
+// deleted when closed, and closed on destruction. Not available on Windows,
+// where the file never opens.
+class FrameSpillFile {
+ public:
+  // Create the file in directory, or in $TMPDIR (else /tmp) if empty.
+  explicit FrameSpillFile(int64_t max_size,
+                          const std::string &directory = "");
+  ~FrameSpillFile();
+
+  // False if the file could not be created; nothing gets stored.
+  bool IsOpen() const;
+
+  // Write a frame, unless it is already stored or does not fit. Returns
+  // whether the frame is stored. The sequence is an opaque tag, as in
+  // TaggedImageKey.
+  bool Store(const void *sequence, int frame, const cv::Mat &image);
+
+  // Map a stored frame into *image without copying it. The mapping is
+  // private, so the caller may modify the frame without changing the file,
+  // and it is unmapped with the last Mat referring to it, which may outlive
+  // the file. Returns false if the frame is not stored or could not be
+  // mapped.
+  bool Load(const void *sequence, int frame, cv::Mat *image);
+
+  // Drop the frames stored for sequence, so that a new sequence at the same
+  // address does not find them. Their space in the file is not reused.
+  void Forget(const void *sequence);
+
+  // Bytes used in the file, and the limit.
+  int64_t Size();
+  int64_t MaxSize() const { return max_size_; }
+
+ private:
+  typedef std::pair<const void *, int> Key;
+
+  int64_t max_size_;
+  int fd_;
+
+  // Guards the offsets and the size.
+  Mutex mutex_;
+  std::map<Key, int64_t> offsets_;
+  int64_t size_;
+
+  FrameSpillFile(const FrameSpillFile &);
+  void operator=(const FrameSpillFile &);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_IMAGE_FRAME_SPILL_FILE_H_
@@ -0,0 +1,192 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/image/cached_image_sequence.h"
+#include "libmv/image/frame_spill_file.h"
+#include "testing/testing.h"
+
+namespace {
+
+using libmv::CachedImageSequence;
+using libmv::FrameSpillFile;
+using libmv::ImageCache;
+
+cv::Mat_<float> Ramp(int rows, int cols) {
+  cv::Mat_<float> image(rows, cols);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      image(r, c) = 100 * r + c;
+    }
+  }
+  return image;
+}
+
+TEST(FrameSpillFile, StoresAndLoadsFrames) {
+  FrameSpillFile spill_file(1 << 20);
+  ASSERT_TRUE(spill_file.IsOpen());
+
+  cv::Mat_<float> image = Ramp(3, 4);
+  int tag;
+  EXPECT_TRUE(spill_file.Store(&tag, 7, image));
+  EXPECT_TRUE(spill_file.Store(&tag, 7, image));
+
+  // Not continuous.
+  cv::Mat_<float> window = image(cv::Rect(1, 1, 2, 2));
+  EXPECT_TRUE(spill_file.Store(&tag, 8, window));
+
+  cv::Mat loaded;
+  EXPECT_FALSE(spill_file.Load(&tag, 9, &loaded));
+  ASSERT_TRUE(spill_file.Load(&tag, 7, &loaded));
+  ASSERT_EQ(CV_32F, loaded.type());
+  ASSERT_EQ(3, loaded.rows);
+  ASSERT_EQ(4, loaded.cols);
+  cv::Mat_<float> loaded_image = loaded;
+  for (int r = 0; r < 3; ++r) {
+    for (int c = 0; c < 4; ++c) {
+      EXPECT_EQ(image(r, c), loaded_image(r, c));
+    }
+  }
+
+  ASSERT_TRUE(spill_file.Load(&tag, 8, &loaded));
+  loaded_image = loaded;
+  EXPECT_EQ(101, loaded_image(0, 0));
+  EXPECT_EQ(202, loaded_image(1, 1));
+}
+
+TEST(FrameSpillFile, LoadedFramesAreWritableCopies) {
+  FrameSpillFile spill_file(1 << 20);
+  ASSERT_TRUE(spill_file.IsOpen());
+  int tag;
+  EXPECT_TRUE(spill_file.Store(&tag, 0, Ramp(2, 2)));
+
+  cv::Mat written, loaded;
+  ASSERT_TRUE(spill_file.Load(&tag, 0, &written));
+  written.setTo(-1);
+  ASSERT_TRUE(spill_file.Load(&tag, 0, &loaded));
+  cv::Mat_<float> loaded_image = loaded;
+  EXPECT_EQ(101, loaded_image(1, 1));
+  cv::Mat_<float> written_image = written;
+  EXPECT_EQ(-1, written_image(1, 1));
+}
+
+TEST(FrameSpillFile, LoadedFramesOutliveTheFile) {
+  cv::Mat loaded;
+  {
+    FrameSpillFile spill_file(1 << 20);
+    ASSERT_TRUE(spill_file.IsOpen());
+    int tags[2];
+    // The second record does not start on a page boundary.
+    EXPECT_TRUE(spill_file.Store(&tags[0], 0, Ramp(2, 2)));
+    EXPECT_TRUE(spill_file.Store(&tags[1], 0, Ramp(3, 3)));
+    ASSERT_TRUE(spill_file.Load(&tags[1], 0, &loaded));
+  }
+  cv::Mat_<float> loaded_image = loaded;
+  ASSERT_EQ(3, loaded_image.rows);
+  EXPECT_EQ(101, loaded_image(1, 1));
+  EXPECT_EQ(202, loaded_image(2, 2));
+}
+
+TEST(FrameSpillFile, ForgetsTheFramesOfASequence) {
+  FrameSpillFile spill_file(1 << 20);
+  ASSERT_TRUE(spill_file.IsOpen());
+  int tags[2];
+  EXPECT_TRUE(spill_file.Store(&tags[0], 0, Ramp(2, 2)));
+  EXPECT_TRUE(spill_file.Store(&tags[0], 5, Ramp(2, 2)));
+  EXPECT_TRUE(spill_file.Store(&tags[1], 0, Ramp(2, 2)));
+
+  spill_file.Forget(&tags[0]);
+  cv::Mat loaded;
+  EXPECT_FALSE(spill_file.Load(&tags[0], 0, &loaded));
+  EXPECT_FALSE(spill_file.Load(&tags[0], 5, &loaded));
+  EXPECT_TRUE(spill_file.Load(&tags[1], 0, &loaded));
+}
+
+TEST(FrameSpillFile, DoesNotGrowPastMaxSize) {
+  FrameSpillFile spill_file(1024);
+  ASSERT_TRUE(spill_file.IsOpen());
+  int tag;
+  EXPECT_FALSE(spill_file.Store(&tag, 0, Ramp(20, 20)));
+  EXPECT_TRUE(spill_file.Store(&tag, 1, Ramp(4, 4)));
+  EXPECT_LE(spill_file.Size(), 1024);
+}
+
+class CountingSequence : public CachedImageSequence {
+ public:
+  explicit CountingSequence(ImageCache *cache)
+      : CachedImageSequence(cache), num_loads(0) {}
+
+  virtual int Length() { return 10; }
+
+  virtual cv::Mat LoadImage(int i) {
+    ++num_loads;
+    cv::Mat_<float> image = Ramp(8, 8);
+    image(0, 0) = i;
+    return image;
+  }
+
+  int num_loads;
+};
+
+TEST(FrameSpillFile, ImageCacheReadsEvictedFramesBack) {
+  FrameSpillFile spill_file(1 << 20);
+  ASSERT_TRUE(spill_file.IsOpen());
+  // Room for a single frame.
+  ImageCache cache(8 * 8 * sizeof(float));
+  cache.SetSpillFile(&spill_file);
+  CountingSequence sequence(&cache);
+
+  for (int i = 0; i < 3; ++i) {
+    sequence.GetImage(i);
+    sequence.Unpin(i);
+  }
+  EXPECT_EQ(3, sequence.num_loads);
+  EXPECT_EQ(2, cache.Statistics().evictions);
+
+  cv::Mat_<float> image = sequence.GetImage(0);
+  EXPECT_EQ(3, sequence.num_loads);
+  EXPECT_EQ(0, image(0, 0));
+  EXPECT_EQ(707, image(7, 7));
+  sequence.Unpin(0);
+}
+
+TEST(FrameSpillFile, DestroyedSequencesAreForgotten) {
+  FrameSpillFile spill_file(1 << 20);
+  ASSERT_TRUE(spill_file.IsOpen());
+  ImageCache cache(8 * 8 * sizeof(float));
+  cache.SetSpillFile(&spill_file);
+
+  const void *tag;
+  {
+    CountingSequence sequence(&cache);
+    tag = &sequence;
+    for (int i = 0; i < 2; ++i) {
+      sequence.GetImage(i);
+      sequence.Unpin(i);
+    }
+    cv::Mat loaded;
+    EXPECT_TRUE(spill_file.Load(tag, 0, &loaded));
+  }
+  cv::Mat loaded;
+  EXPECT_FALSE(spill_file.Load(tag, 0, &loaded));
+}
+
+}  // namespace
@@ -28,6 +28,30 @@ namespace libmv {
 
 ImageSequence::~ImageSequence() {}
 
+cv::Mat ImageSequence::GetRegion(int i, const cv::Rect &roi) {
+  cv::Mat image = GetImage(i);
+  if (image.empty()) {
+    return image;
+  }
+  cv::Rect clipped = roi & cv::Rect(0, 0, image.cols, image.rows);
+  if (clipped.area() == 0) {
+    Unpin(i);
+    return cv::Mat();
+  }
+  return image(clipped);
+}
+
+void ImageSequence::UnpinRegion(int i, const cv::Rect &roi) {
+  (void) roi;
+  Unpin(i);
+}
+
+void ImageSequence::Prefetch(int i) {
+  if (!GetImage(i).empty()) {
+    Unpin(i);
+  }
+}
+
 ImageCache *ImageSequence::Cache() {
   return NULL;
 }
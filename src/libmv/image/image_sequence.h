@@ -41,6 +41,20 @@ class ImageSequence {
   // which was retrieved with GetImage() or GetFloatImage().
   virtual void Unpin(int i) = 0;
 
+  // Retrieve the part of image i inside roi, clipped to the image; empty if
+  // nothing is left. Trackers only need a window around each marker, which
+  // sequences that can decode parts of frames load without the rest (see
+  // CachedImageSequence). By default, this is a view into GetImage(i).
+  // Callers must UnpinRegion() non-empty regions, with the same roi.
+  virtual cv::Mat GetRegion(int i, const cv::Rect &roi);
+  virtual void UnpinRegion(int i, const cv::Rect &roi);
+
+  // Load image i ahead of use, leaving it unpinned in the cache. Unlike
+  // GetImage(), this is not a use of the frame as far as the cache's
+  // statistics and eviction policy are concerned (see
+  // ConcurrentCache::Prefetch()). By default, this gets and unpins the image.
+  virtual void Prefetch(int i);
+
   // Number of frames in the sequence.
   virtual int Length() = 0;
 
@@ -18,14 +18,118 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <map>
+
 #include <opencv2/highgui/highgui.hpp>
 
+#include "libmv/base/thread.h"
 #include "libmv/image/image_sequence_io.h"
 #include "libmv/image/cached_image_sequence.h"
+#include "libmv/logging/logging.h"
 
 namespace libmv {
+namespace {
+
+// Binary PGM and PPM files store raw rows after a short text header, so any
+// part of the image can be read without decoding the rest.
+struct PnmHeader {
+  int width;
+  int height;
+  int channels;
+  int bytes_per_sample;
+  long data_offset;
+};
+
+// Skip whitespace and comments, then read a number and the single whitespace
+// character after it.
+bool ReadPnmNumber(FILE *file, int *number) {
+  int c = fgetc(file);
+  while (c == '#' || isspace(c)) {
+    if (c == '#') {
+      while (c != EOF && c != '\n') {
+        c = fgetc(file);
+      }
+    }
+    c = fgetc(file);
+  }
+  if (!isdigit(c)) {
+    return false;
+  }
+  *number = 0;
+  while (isdigit(c)) {
+    *number = 10 * *number + (c - '0');
+    c = fgetc(file);
+  }
+  return isspace(c);
+}
 
-// An image sequence loaded from disk with caching behaviour.
+bool ReadPnmHeader(FILE *file, PnmHeader *header) {
+  char magic[2];
+  if (fread(magic, 1, 2, file) != 2 ||
+      magic[0] != 'P' || (magic[1] != '5' && magic[1] != '6')) {
+    return false;
+  }
+  int max_value;
+  if (!ReadPnmNumber(file, &header->width) ||
+      !ReadPnmNumber(file, &header->height) ||
+      !ReadPnmNumber(file, &max_value) ||
+      header->width <= 0 || header->height <= 0 ||
+      max_value <= 0 || max_value > 65535) {
+    return false;
+  }
+  header->channels = magic[1] == '5' ? 1 : 3;
+  header->bytes_per_sample = max_value < 256 ? 1 : 2;
+  header->data_offset = ftell(file);
+  return true;
+}
+
+bool HasPnmExtension(const std::string &filename) {
+  if (filename.size() < 4) {
+    return false;
+  }
+  std::string extension = filename.substr(filename.size() - 4);
+  std::transform(extension.begin(), extension.end(), extension.begin(),
+                 ::tolower);
+  return extension == ".pgm" || extension == ".ppm" || extension == ".pnm";
+}
+
+// Turn the samples as stored in the file into what cv::imread() returns:
+// native endian, and BGR rather than RGB.
+void ConvertPnmSamples(const PnmHeader &header, cv::Mat *image) {
+  const uint16_t one = 1;
+  bool little_endian = *reinterpret_cast<const char *>(&one) == 1;
+  for (int r = 0; r < image->rows; ++r) {
+    if (header.bytes_per_sample == 2) {
+      uint16_t *row = image->ptr<uint16_t>(r);
+      int num_samples = image->cols * header.channels;
+      if (little_endian) {
+        for (int i = 0; i < num_samples; ++i) {
+          row[i] = static_cast<uint16_t>((row[i] >> 8) | (row[i] << 8));
+        }
+      }
+      if (header.channels == 3) {
+        for (int c = 0; c < image->cols; ++c) {
+          std::swap(row[3 * c], row[3 * c + 2]);
+        }
+      }
+    } else if (header.channels == 3) {
+      uint8_t *row = image->ptr<uint8_t>(r);
+      for (int c = 0; c < image->cols; ++c) {
+        std::swap(row[3 * c], row[3 * c + 2]);
+      }
+    }
+  }
+}
+
+}  // namespace
+
+// An image sequence loaded from disk with caching behaviour. If all the files
+// are PGM or PPM, regions are read without loading whole frames.
 class LazyImageSequenceFromFiles : public CachedImageSequence {
  public:
   virtual ~LazyImageSequenceFromFiles() {}
@@ -33,7 +137,12 @@ class LazyImageSequenceFromFiles : public CachedImageSequence {
   LazyImageSequenceFromFiles(const std::vector<std::string> &image_filenames,
                         ImageCache *cache)
       : CachedImageSequence(cache),
-        filenames_(image_filenames) {}
+        filenames_(image_filenames),
+        all_pnm_(true) {
+    for (size_t i = 0; i < filenames_.size(); ++i) {
+      all_pnm_ = all_pnm_ && HasPnmExtension(filenames_[i]);
+    }
+  }
 
   virtual int Length() {
     return filenames_.size();
@@ -49,8 +158,76 @@ class LazyImageSequenceFromFiles : public CachedImageSequence {
       return image;
     }
 
+  virtual int RegionTileSize() {
+    return all_pnm_ ? 256 : 0;
+  }
+
+  // Empty if the file is not a binary PGM or PPM (e.g. the ASCII variants),
+  // in which case whole frames are loaded.
+  virtual cv::Size ImageSize(int i) {
+    {
+      MutexLock lock(&mutex_);
+      std::map<int, cv::Size>::const_iterator it = image_sizes_.find(i);
+      if (it != image_sizes_.end()) {
+        return it->second;
+      }
+    }
+    cv::Size size;
+    FILE *file = fopen(filenames_[i].c_str(), "rb");
+    if (file != NULL) {
+      PnmHeader header;
+      if (ReadPnmHeader(file, &header)) {
+        size = cv::Size(header.width, header.height);
+      }
+      fclose(file);
+    }
+    MutexLock lock(&mutex_);
+    image_sizes_[i] = size;
+    return size;
+  }
+
+  virtual cv::Mat LoadRegion(int i, const cv::Rect &region) {
+    FILE *file = fopen(filenames_[i].c_str(), "rb");
+    if (file == NULL) {
+      fprintf(stderr, "Failed loading image %d: %s\n", i, filenames_[i].c_str());
+      return cv::Mat();
+    }
+    PnmHeader header;
+    cv::Mat image;
+    if (ReadPnmHeader(file, &header) &&
+        (region & cv::Rect(0, 0, header.width, header.height)) == region) {
+      int depth = header.bytes_per_sample == 1 ? CV_8U : CV_16U;
+      image.create(region.height, region.width,
+                   CV_MAKETYPE(depth, header.channels));
+      long pixel_size = header.channels * header.bytes_per_sample;
+      for (int r = 0; r < region.height; ++r) {
+        long offset = header.data_offset +
+            (static_cast<long>(region.y + r) * header.width + region.x) *
+            pixel_size;
+        if (fseek(file, offset, SEEK_SET) != 0 ||
+            fread(image.ptr(r), pixel_size, region.width, file) !=
+                static_cast<size_t>(region.width)) {
+          image.release();
+          break;
+        }
+      }
+    }
+    fclose(file);
+    if (image.empty()) {
+      fprintf(stderr, "Failed loading a region of image %d: %s\n",
+              i, filenames_[i].c_str());
+      return cv::Mat();
+    }
+    ConvertPnmSamples(header, &image);
+    return image;
+  }
+
  private:
   std::vector<std::string> filenames_;
+  bool all_pnm_;
+
+  Mutex mutex_;
+  std::map<int, cv::Size> image_sizes_;
 };
 
 ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
@@ -58,4 +235,146 @@ ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
   return new LazyImageSequenceFromFiles(filenames, cache);
 }
 
+// Frames of a video file. The capture can decode only one frame at a time, so
+// loads are serialized; decoded frames go to the cache like any other.
+class VideoImageSequence : public CachedImageSequence {
+ public:
+  VideoImageSequence(const std::string &filename,
+                     ImageCache *cache,
+                     int keyframe_interval)
+      : CachedImageSequence(cache),
+        filename_(filename),
+        keyframe_interval_(std::max(1, keyframe_interval)),
+        length_(0),
+        exact_seeks_(true),
+        position_(0) {}
+
+  virtual ~VideoImageSequence() {}
+
+  // The frame count the container reports is often off by a few frames, or
+  // missing. A count that can be seeked to the end of is extended by the
+  // frames that follow; otherwise all frames are counted with grab(), which
+  // decodes but skips the conversion of retrieve().
+  bool Open() {
+    if (!capture_.open(filename_)) {
+      return false;
+    }
+    int reported = static_cast<int>(capture_.get(CV_CAP_PROP_FRAME_COUNT));
+    length_ = reported;
+    if (reported > 0 && SeekExactly(reported - 1) && capture_.grab()) {
+      while (capture_.grab()) {
+        ++length_;
+      }
+    } else {
+      LG << "Counting the frames of " << filename_ << ", which reports "
+         << reported << ".";
+      length_ = 0;
+      if (!capture_.open(filename_)) {
+        return false;
+      }
+      while (capture_.grab()) {
+        ++length_;
+      }
+    }
+    return length_ > 0 && Seek(0);
+  }
+
+  virtual int Length() {
+    return length_;
+  }
+
+  virtual cv::Mat LoadImage(int i) {
+    MutexLock lock(&mutex_);
+    if (i < 0 || i >= length_) {
+      return cv::Mat();
+    }
+    // Decoding forward is cheaper than seeking when the frame is at most a
+    // group of pictures ahead. Seeking is also the only way to go back. Once
+    // a seek has missed, seeks only rewind, so they are not used to go ahead.
+    if (i < position_ ||
+        (exact_seeks_ && i - position_ > keyframe_interval_)) {
+      if (!Seek(i)) {
+        fprintf(stderr, "Failed seeking to frame %d of %s\n",
+                i, filename_.c_str());
+        return cv::Mat();
+      }
+    }
+    for (; position_ < i; ++position_) {
+      if (!capture_.grab()) {
+        break;
+      }
+    }
+    cv::Mat frame;
+    if (position_ != i || !capture_.read(frame) || frame.empty()) {
+      fprintf(stderr, "Failed decoding frame %d of %s\n",
+              i, filename_.c_str());
+      // Start over from a seek point on the next load.
+      position_ = length_;
+      return cv::Mat();
+    }
+    ++position_;
+    // The frame belongs to the capture and is overwritten by the next read.
+    return frame.clone();
+  }
+
+ private:
+  // The backend seeks to the keyframe before the frame and decodes forward to
+  // it. Some backends land elsewhere for some containers without failing,
+  // typically for codecs with inter frames, so the position is checked; a
+  // frame read after a wrong seek would silently be another one.
+  bool SeekExactly(int frame) {
+    position_ = length_;
+    if (!capture_.set(CV_CAP_PROP_POS_FRAMES, frame)) {
+      return false;
+    }
+    int landed = static_cast<int>(capture_.get(CV_CAP_PROP_POS_FRAMES));
+    if (landed != frame) {
+      LG << "Seeking to frame " << frame << " of " << filename_
+         << " landed on frame " << landed << ".";
+      return false;
+    }
+    position_ = frame;
+    return true;
+  }
+
+  // Seek to frame if the backend can, else reopen the video so that frames
+  // are decoded forward from the first one. After a missed seek, the
+  // position the backend reports cannot be trusted to decode forward from.
+  bool Seek(int frame) {
+    if (exact_seeks_ && SeekExactly(frame)) {
+      return true;
+    }
+    exact_seeks_ = false;
+    if (!capture_.open(filename_)) {
+      return false;
+    }
+    position_ = 0;
+    return true;
+  }
+
+  std::string filename_;
+  int keyframe_interval_;
+  int length_;
+  // Cleared once a seek has missed; later ones reopen the video.
+  bool exact_seeks_;
+
+  Mutex mutex_;
+  cv::VideoCapture capture_;
+  // The next frame that read() returns.
+  int position_;
+};
+
+ImageSequence *ImageSequenceFromVideo(const std::string &filename,
+                                      ImageCache *cache,
+                                      int keyframe_interval) {
+  VideoImageSequence *sequence =
+      new VideoImageSequence(filename, cache, keyframe_interval);
+  if (!sequence->Open()) {
+    fprintf(stderr, "Failed opening video: %s\n", filename.c_str());
+    delete sequence;
+    return NULL;
+  }
+  return sequence;
+}
+
 }  // namespace libmv
@@ -33,7 +33,17 @@ class ImageCache;
 ImageSequence *ImageSequenceFromFiles(const std::vector<std::string> &filenames,
                                       ImageCache *cache);
 
-// TODO(keir): Add a from AVI or from MOV here.
+// An image sequence decoded from a video file with cv::VideoCapture, as
+// 8-bit BGR frames. The frame count comes from the container, checked by
+// decoding the last frames; only if that fails are all frames decoded to
+// count them. Frames up to keyframe_interval ahead of the last one decoded
+// are reached by decoding forward, which is cheaper than a seek within a
+// group of pictures; set it to about the GOP length of the file. Other frames
+// are seeked to, and a seek that does not land on the frame fails the load.
+// Returns NULL if the file cannot be opened.
+ImageSequence *ImageSequenceFromVideo(const std::string &filename,
+                                      ImageCache *cache,
+                                      int keyframe_interval = 30);
 
 }  // namespace libmv
 
@@ -25,11 +25,13 @@
 
 #include "libmv/image/cached_image_sequence.h"
 #include "libmv/image/image_sequence_io.h"
+#include "libmv/logging/logging.h"
 #include "testing/testing.h"
 
 using libmv::ImageCache;
 using libmv::ImageSequence;
 using libmv::ImageSequenceFromFiles;
+using libmv::ImageSequenceFromVideo;
 using std::string;
 
 namespace {
@@ -77,4 +79,119 @@ TEST(ImageSequenceIO, FromFiles) {
   unlink(image2_fn.c_str());
 }
 
+TEST(ImageSequenceIO, RegionsOfPnmFiles) {
+  cv::Mat_<unsigned char> gray(300, 520);
+  cv::Mat_<cv::Vec3w> color(300, 520);
+  for (int r = 0; r < gray.rows; ++r) {
+    for (int c = 0; c < gray.cols; ++c) {
+      gray(r, c) = (7 * r + 3 * c) % 256;
+      color(r, c) = cv::Vec3w(r, c, 1000 * (r % 50) + c);
+    }
+  }
+  std::vector<std::string> files;
+  files.push_back(string(THIS_SOURCE_DIR) + "/gray.pgm");
+  files.push_back(string(THIS_SOURCE_DIR) + "/color.ppm");
+  cv::imwrite(files[0], gray);
+  cv::imwrite(files[1], color);
+
+  // Within one tile, across tiles, and clipped to the image.
+  std::vector<cv::Rect> regions;
+  regions.push_back(cv::Rect(10, 10, 20, 20));
+  regions.push_back(cv::Rect(240, 250, 40, 30));
+  regions.push_back(cv::Rect(500, 280, 100, 100));
+
+  ImageCache cache(64 * 1024 * 1024);
+  ImageSequence *sequence = ImageSequenceFromFiles(files, &cache);
+  for (int i = 0; i < 2; ++i) {
+    cv::Mat image = cv::imread(files[i], -1);
+    for (size_t j = 0; j < regions.size(); ++j) {
+      cv::Mat region = sequence->GetRegion(i, regions[j]);
+      cv::Rect clipped = regions[j] & cv::Rect(0, 0, image.cols, image.rows);
+      ASSERT_EQ(image.type(), region.type());
+      ASSERT_EQ(clipped.size(), region.size());
+      cv::Mat expected = image(clipped);
+      for (int r = 0; r < region.rows; ++r) {
+        EXPECT_EQ(0, memcmp(expected.ptr(r), region.ptr(r),
+                            region.cols * region.elemSize()));
+      }
+      sequence->UnpinRegion(i, regions[j]);
+    }
+  }
+
+  // Only the five tiles under the regions were loaded, in one and six bytes
+  // per pixel: two whole ones, and three cut by the edges of the image.
+  const int kTilePixels = 2 * 256 * 256 + 2 * 256 * 44 + 8 * 44;
+  EXPECT_EQ(kTilePixels * (1 + 6), cache.Size());
+  delete sequence;
+
+  unlink(files[0].c_str());
+  unlink(files[1].c_str());
+}
+
+// Flat frames, each with its own gray level, which survives compression.
+const int kNumFrames = 40;
+
+bool WriteVideo(const string &filename, int fourcc) {
+  cv::VideoWriter writer(filename, fourcc, 25, cv::Size(64, 48));
+  if (!writer.isOpened()) {
+    return false;
+  }
+  for (int i = 0; i < kNumFrames; ++i) {
+    writer << cv::Mat(48, 64, CV_8UC3, cv::Scalar::all(6 * i));
+  }
+  return true;
+}
+
+void ExpectFrames(ImageSequence *sequence) {
+  // Forward, then seeking back and ahead from between seek points.
+  const int kFrames[] = { 0, 1, 2, 3, 12, 13, 35, 5, 20, 21, 39, 17 };
+  for (size_t j = 0; j < sizeof(kFrames) / sizeof(kFrames[0]); ++j) {
+    int i = kFrames[j];
+    cv::Mat image = sequence->GetImage(i);
+    ASSERT_FALSE(image.empty()) << "frame " << i;
+    EXPECT_EQ(64, image.cols);
+    EXPECT_EQ(48, image.rows);
+    EXPECT_EQ(CV_8UC3, image.type());
+    EXPECT_NEAR(6 * i, cv::mean(image)[0], 2.0) << "frame " << i;
+    sequence->Unpin(i);
+  }
+}
+
+TEST(ImageSequenceIO, FromVideo) {
+  string video_fn = string(THIS_SOURCE_DIR) + "/video.avi";
+  if (!WriteVideo(video_fn, CV_FOURCC('M', 'J', 'P', 'G'))) {
+    LOG(INFO) << "No video encoder available, skipping.";
+    return;
+  }
+
+  ImageCache cache;
+  ImageSequence *sequence = ImageSequenceFromVideo(video_fn, &cache, 8);
+  ASSERT_TRUE(sequence != NULL);
+  EXPECT_EQ(kNumFrames, sequence->Length());
+  ExpectFrames(sequence);
+  delete sequence;
+
+  EXPECT_TRUE(ImageSequenceFromVideo(video_fn + ".missing", &cache) == NULL);
+  unlink(video_fn.c_str());
+}
+
+// With inter frames, seeking by frame number often lands on another frame.
+// The sequence then decodes forward from the start, and must still return
+// the frames asked for.
+TEST(ImageSequenceIO, FromVideoWithInterFrames) {
+  string video_fn = string(THIS_SOURCE_DIR) + "/inter_video.avi";
+  if (!WriteVideo(video_fn, CV_FOURCC('X', 'V', 'I', 'D'))) {
+    LOG(INFO) << "No MPEG-4 encoder available, skipping.";
+    return;
+  }
+
+  ImageCache cache;
+  ImageSequence *sequence = ImageSequenceFromVideo(video_fn, &cache, 8);
+  ASSERT_TRUE(sequence != NULL);
+  EXPECT_EQ(kNumFrames, sequence->Length());
+  ExpectFrames(sequence);
+  delete sequence;
+  unlink(video_fn.c_str());
+}
+
 }  // namespace
@@ -25,6 +25,8 @@
 #ifndef LIBMV_IMAGE_LRU_CACHE_H_
 #define LIBMV_IMAGE_LRU_CACHE_H_
 
+#include <stdint.h>
+
 #include <map>
 #include <list>
 #include <cassert>
@@ -96,7 +98,7 @@ template<typename K, typename V>
 class LRUCache : public Cache<K, V> {
  public:
   // O(1)
-  LRUCache(int max_size)
+  LRUCache(int64_t max_size)
     : max_size_(max_size),
       size_(0) {}
   // O(n log n)
@@ -133,7 +135,8 @@ class LRUCache : public Cache<K, V> {
     return true;
   }
   // O(n log n)
-  virtual void StoreAndPinSized(const K &key, V *value, const int size) {
+  virtual void StoreAndPinSized(const K &key, V *value,
+                                const int64_t size) {
     size_ += size;
     CachedItem new_item;
     new_item.ptr = value;
@@ -147,15 +150,15 @@ class LRUCache : public Cache<K, V> {
     return items_.find(key) != items_.end();
   }
   // O(1)
-  virtual int MaxSize() const {
+  virtual int64_t MaxSize() const {
     return max_size_;
   }
   // O(1)
-  virtual int Size() const {
+  virtual int64_t Size() const {
     return size_;
   }
   // O(n log n)
-  virtual void SetMaxSize(const int max_size) {
+  virtual void SetMaxSize(const int64_t max_size) {
     max_size_ = max_size;
     DeleteUnpinnedItemsIfNecessary();
   }
@@ -185,7 +188,7 @@ class LRUCache : public Cache<K, V> {
   struct CachedItem {
     V *ptr;
     int use_count;
-    int size;
+    int64_t size;
     CachedItem() : ptr(NULL) {}
   };
   // O(log n)
@@ -220,8 +223,8 @@ class LRUCache : public Cache<K, V> {
   typedef map<const K, CachedItem> CacheMap;
   CacheMap items_;
 
-  int max_size_;
-  int size_;
+  int64_t max_size_;
+  int64_t size_;
 };
 
 }  // namespace libmv
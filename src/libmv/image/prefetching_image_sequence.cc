@@ -0,0 +1,178 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/image/prefetching_image_sequence.h"
+
+#include <algorithm>
+
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+
+PrefetchOptions::PrefetchOptions()
+    : num_threads(2),
+      num_ahead(8),
+      num_behind(2) {}
+
+class PrefetchingImageSequence::Decoder : public Thread {
+ public:
+  explicit Decoder(PrefetchingImageSequence *sequence)
+      : sequence_(sequence) {}
+
+ protected:
+  virtual void Run() {
+    sequence_->DecodeLoop();
+  }
+
+ private:
+  PrefetchingImageSequence *sequence_;
+};
+
+PrefetchingImageSequence::PrefetchingImageSequence(
+    ImageSequence *sequence,
+    const PrefetchOptions &options)
+    : sequence_(sequence),
+      options_(options),
+      length_(sequence->Length()),
+      playhead_(-1),
+      num_decoding_(0),
+      stop_(false) {
+  if (sequence->Cache() == NULL) {
+    LG << "Not prefetching frames of an uncached image sequence.";
+    return;
+  }
+  for (int t = 0; t < options.num_threads; ++t) {
+    Decoder *decoder = new Decoder(this);
+    if (!decoder->Start()) {
+      LOG(WARNING) << "Could not start a frame decoder thread.";
+      delete decoder;
+      break;
+    }
+    decoders_.push_back(decoder);
+  }
+}
+
+PrefetchingImageSequence::~PrefetchingImageSequence() {
+  {
+    MutexLock lock(&mutex_);
+    stop_ = true;
+    queue_.clear();
+    queued_.Broadcast();
+  }
+  for (size_t t = 0; t < decoders_.size(); ++t) {
+    decoders_[t]->Join();
+    delete decoders_[t];
+  }
+}
+
+cv::Mat PrefetchingImageSequence::GetImage(int i) {
+  Schedule(i);
+  return sequence_->GetImage(i);
+}
+
+void PrefetchingImageSequence::Unpin(int i) {
+  sequence_->Unpin(i);
+}
+
+cv::Mat PrefetchingImageSequence::GetRegion(int i, const cv::Rect &roi) {
+  return sequence_->GetRegion(i, roi);
+}
+
+void PrefetchingImageSequence::UnpinRegion(int i, const cv::Rect &roi) {
+  sequence_->UnpinRegion(i, roi);
+}
+
+void PrefetchingImageSequence::Prefetch(int i) {
+  sequence_->Prefetch(i);
+}
+
+int PrefetchingImageSequence::Length() {
+  return length_;
+}
+
+ImageCache *PrefetchingImageSequence::Cache() {
+  return sequence_->Cache();
+}
+
+void PrefetchingImageSequence::WaitForPrefetches() {
+  MutexLock lock(&mutex_);
+  while (!queue_.empty() || num_decoding_ > 0) {
+    idle_.Wait(&mutex_);
+  }
+}
+
+void PrefetchingImageSequence::Schedule(int i) {
+  if (decoders_.empty()) {
+    return;
+  }
+  MutexLock lock(&mutex_);
+  if (i == playhead_) {
+    return;
+  }
+  playhead_ = i;
+
+  // Nearest first, alternating between ahead and behind. The requested frame
+  // itself is loaded by the caller.
+  queue_.clear();
+  int max_distance = std::max(options_.num_ahead, options_.num_behind);
+  for (int distance = 1; distance <= max_distance; ++distance) {
+    if (distance <= options_.num_ahead && i + distance < length_) {
+      queue_.push_back(i + distance);
+    }
+    if (distance <= options_.num_behind && i - distance >= 0) {
+      queue_.push_back(i - distance);
+    }
+  }
+  queued_.Broadcast();
+}
+
+void PrefetchingImageSequence::DecodeLoop() {
+  for (;;) {
+    int frame;
+    {
+      MutexLock lock(&mutex_);
+      while (!stop_ && queue_.empty()) {
+        queued_.Wait(&mutex_);
+      }
+      if (stop_) {
+        return;
+      }
+      frame = queue_.front();
+      queue_.pop_front();
+      ++num_decoding_;
+    }
+
+    // Loading goes through the cache, which keeps the frame, and makes
+    // GetImage() wait for this decode instead of repeating it. It is not a
+    // use of the frame, so neither the hit counts nor the playhead of the
+    // eviction policy see it; only GetImage() moves those.
+    sequence_->Prefetch(frame);
+
+    {
+      MutexLock lock(&mutex_);
+      --num_decoding_;
+      if (queue_.empty() && num_decoding_ == 0) {
+        idle_.Broadcast();
+      }
+    }
+  }
+}
+
+}  // namespace libmv
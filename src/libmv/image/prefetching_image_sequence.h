@@ -0,0 +1,104 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_IMAGE_PREFETCHING_IMAGE_SEQUENCE_H_
+#define LIBMV_IMAGE_PREFETCHING_IMAGE_SEQUENCE_H_
+
+#include <deque>
+#include <vector>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/image_sequence.h"
+
+namespace libmv {
+
+struct PrefetchOptions {
+  PrefetchOptions();
+
+  // Number of background threads decoding frames. Zero disables prefetching.
+  int num_threads;
+
+  // How many frames after and before the last requested one to prefetch.
+  int num_ahead;
+  int num_behind;
+};
+
+// Decodes frames of a cached sequence (e.g. from ImageSequenceFromFiles())
+// in the background, around the frame last passed to GetImage(), and leaves
+// them in its ImageCache. GetImage() then only waits when the frame is not
+// decoded yet; if a decoder is already working on it, it waits for that
+// decode rather than starting another. The frames nearest to the requested
+// one are decoded first, and moving on to another frame drops the prefetches
+// that have not started.
+//
+// Prefetched frames are not pinned, so the cache should have room for
+// num_ahead + num_behind frames besides the ones in use. The wrapped sequence
+// must be safe to read from several threads, which CachedImageSequence is as
+// long as its LoadImage() is; it is not owned. Sequences without a cache are
+// passed through without prefetching.
+class PrefetchingImageSequence : public ImageSequence {
+ public:
+  PrefetchingImageSequence(ImageSequence *sequence,
+                           const PrefetchOptions &options);
+  virtual ~PrefetchingImageSequence();
+
+  virtual cv::Mat GetImage(int i);
+  virtual void Unpin(int i);
+
+  // Passed through without prefetching, since whole frames around a region
+  // are likely not wanted.
+  virtual cv::Mat GetRegion(int i, const cv::Rect &roi);
+  virtual void UnpinRegion(int i, const cv::Rect &roi);
+
+  virtual void Prefetch(int i);
+
+  virtual int Length();
+  virtual ImageCache *Cache();
+
+  // Block until the decoders are done with the frames scheduled so far.
+  void WaitForPrefetches();
+
+ private:
+  class Decoder;
+
+  void Schedule(int i);
+  void DecodeLoop();
+
+  ImageSequence *sequence_;
+  PrefetchOptions options_;
+  int length_;
+  std::vector<Decoder *> decoders_;
+
+  // Guards everything below.
+  Mutex mutex_;
+  ConditionVariable queued_;
+  ConditionVariable idle_;
+  std::deque<int> queue_;
+  int playhead_;
+  int num_decoding_;
+  bool stop_;
+
+  PrefetchingImageSequence(const PrefetchingImageSequence &);
+  void operator=(const PrefetchingImageSequence &);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_IMAGE_PREFETCHING_IMAGE_SEQUENCE_H_
@@ -0,0 +1,133 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/cached_image_sequence.h"
+#include "libmv/image/prefetching_image_sequence.h"
+#include "testing/testing.h"
+
+namespace {
+
+using libmv::CacheStatistics;
+using libmv::CachedImageSequence;
+using libmv::ImageCache;
+using libmv::Mutex;
+using libmv::MutexLock;
+using libmv::PrefetchOptions;
+using libmv::PrefetchingImageSequence;
+using libmv::TaggedImageKey;
+
+// Frame i is a single pixel of value i.
+class CountingSequence : public CachedImageSequence {
+ public:
+  explicit CountingSequence(ImageCache *cache)
+      : CachedImageSequence(cache), num_loads_(0) {}
+
+  virtual int Length() { return 20; }
+
+  virtual cv::Mat LoadImage(int i) {
+    {
+      MutexLock lock(&mutex_);
+      ++num_loads_;
+    }
+    cv::Mat_<float> image(1, 1);
+    image(0, 0) = i;
+    return image;
+  }
+
+  int num_loads() {
+    MutexLock lock(&mutex_);
+    return num_loads_;
+  }
+
+  bool IsCached(int i) {
+    return Cache()->ContainsKey(TaggedImageKey(this, i));
+  }
+
+ private:
+  Mutex mutex_;
+  int num_loads_;
+};
+
+TEST(PrefetchingImageSequence, PrefetchesAroundTheRequestedFrame) {
+  ImageCache cache;
+  CountingSequence frames(&cache);
+  PrefetchOptions options;
+  options.num_ahead = 3;
+  options.num_behind = 1;
+  PrefetchingImageSequence sequence(&frames, options);
+  EXPECT_EQ(20, sequence.Length());
+
+  cv::Mat_<float> image = sequence.GetImage(5);
+  EXPECT_EQ(5, image(0, 0));
+  sequence.WaitForPrefetches();
+  EXPECT_EQ(5, frames.num_loads());
+  for (int i = 4; i <= 8; ++i) {
+    EXPECT_TRUE(frames.IsCached(i));
+  }
+  EXPECT_FALSE(frames.IsCached(3));
+  EXPECT_FALSE(frames.IsCached(9));
+  sequence.Unpin(5);
+
+  // Prefetched frames are not decoded again. Only the requested frames count
+  // as uses of the cache.
+  image = sequence.GetImage(6);
+  EXPECT_EQ(6, image(0, 0));
+  sequence.WaitForPrefetches();
+  EXPECT_EQ(6, frames.num_loads());
+  sequence.Unpin(6);
+  CacheStatistics statistics = cache.Statistics();
+  EXPECT_EQ(1, statistics.hits);
+  EXPECT_EQ(1, statistics.misses);
+  EXPECT_EQ(5, statistics.prefetches);
+}
+
+TEST(PrefetchingImageSequence, StopsAtTheEndsOfTheSequence) {
+  ImageCache cache;
+  CountingSequence frames(&cache);
+  PrefetchOptions options;
+  options.num_ahead = 5;
+  options.num_behind = 5;
+  PrefetchingImageSequence sequence(&frames, options);
+
+  sequence.GetImage(18);
+  sequence.WaitForPrefetches();
+  EXPECT_EQ(7, frames.num_loads());
+  EXPECT_TRUE(frames.IsCached(13));
+  EXPECT_TRUE(frames.IsCached(19));
+  sequence.Unpin(18);
+}
+
+TEST(PrefetchingImageSequence, NoThreadsLoadsOnlyTheRequestedFrame) {
+  ImageCache cache;
+  CountingSequence frames(&cache);
+  PrefetchOptions options;
+  options.num_threads = 0;
+  PrefetchingImageSequence sequence(&frames, options);
+
+  sequence.GetImage(5);
+  sequence.WaitForPrefetches();
+  EXPECT_EQ(1, frames.num_loads());
+  sequence.Unpin(5);
+}
+
+}  // namespace
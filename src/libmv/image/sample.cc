@@ -0,0 +1,207 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/image/sample.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// GCC and Clang can compile individual functions for AVX2 and check the CPU
+// at run time, so the rest of libmv does not need to be built with -mavx2.
+#define LIBMV_SAMPLE_HAVE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace libmv {
+namespace {
+
+// The reference implementation, also used for the tails of the rows in the
+// vectorized versions.
+void SampleLinearRowScalar(const cv::Mat_<cv::Vec3f> &image,
+                           const float *xs, const float *ys,
+                           int num_samples,
+                           cv::Vec3f *samples) {
+  for (int i = 0; i < num_samples; ++i) {
+    SampleLinear(image, ys[i], xs[i], &samples[i][0]);
+  }
+}
+
+#ifdef __SSE2__
+
+// Load the three channels of a pixel. Loading exactly three floats (instead of
+// a full unaligned packet) makes it safe to read the last pixel of the image.
+inline __m128 LoadPixelSSE2(const cv::Vec3f &pixel) {
+  const float *p = &pixel[0];
+  __m128 xy = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(p)));
+  return _mm_movelh_ps(xy, _mm_load_ss(p + 2));
+}
+
+inline void StorePixelSSE2(__m128 value, cv::Vec3f *pixel) {
+  float *p = &(*pixel)[0];
+  _mm_storel_pi(reinterpret_cast<__m64 *>(p), value);
+  _mm_store_ss(p + 2, _mm_movehl_ps(value, value));
+}
+
+// Vectorized across the channels: one sample per iteration.
+void SampleLinearRowSSE2(const cv::Mat_<cv::Vec3f> &image,
+                         const float *xs, const float *ys,
+                         int num_samples,
+                         cv::Vec3f *samples) {
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (int i = 0; i < num_samples; ++i) {
+    int x1, y1, x2, y2;
+    float dx, dy;
+    LinearInitAxis(ys[i] - 0.5f, image.rows, &y1, &y2, &dy);
+    LinearInitAxis(xs[i] - 0.5f, image.cols, &x1, &x2, &dx);
+
+    const __m128 im11 = LoadPixelSSE2(image(y1, x1));
+    const __m128 im12 = LoadPixelSSE2(image(y1, x2));
+    const __m128 im21 = LoadPixelSSE2(image(y2, x1));
+    const __m128 im22 = LoadPixelSSE2(image(y2, x2));
+
+    const __m128 wx = _mm_set1_ps(dx);
+    const __m128 wy = _mm_set1_ps(dy);
+    const __m128 top = _mm_add_ps(_mm_mul_ps(wx, im11),
+                                  _mm_mul_ps(_mm_sub_ps(one, wx), im12));
+    const __m128 bottom = _mm_add_ps(_mm_mul_ps(wx, im21),
+                                     _mm_mul_ps(_mm_sub_ps(one, wx), im22));
+    StorePixelSSE2(_mm_add_ps(_mm_mul_ps(wy, top),
+                              _mm_mul_ps(_mm_sub_ps(one, wy), bottom)),
+                   samples + i);
+  }
+}
+
+#endif  // __SSE2__
+
+#ifdef LIBMV_SAMPLE_HAVE_AVX2
+
+// Branch-free version of LinearInitAxis() for eight coordinates.
+__attribute__((target("avx2")))
+inline void LinearInitAxisAVX2(__m256 x, int size,
+                               __m256i *x1, __m256i *x2,
+                               __m256 *dx) {
+  const __m256i ix = _mm256_cvttps_epi32(x);
+  const __m256i ix_plus_one = _mm256_add_epi32(ix, _mm256_set1_epi32(1));
+  const __m256i below = _mm256_cmpgt_epi32(_mm256_setzero_si256(), ix);
+  const __m256i above = _mm256_cmpgt_epi32(ix, _mm256_set1_epi32(size - 2));
+  const __m256i clamped = _mm256_or_si256(below, above);
+
+  // Zero for the coordinates below the image, size - 1 for those above.
+  const __m256i edge = _mm256_and_si256(above, _mm256_set1_epi32(size - 1));
+  *x1 = _mm256_blendv_epi8(ix, edge, clamped);
+  *x2 = _mm256_blendv_epi8(ix_plus_one, edge, clamped);
+  *dx = _mm256_blendv_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(ix_plus_one), x),
+                         _mm256_set1_ps(1.0f),
+                         _mm256_castsi256_ps(clamped));
+}
+
+// Vectorized across the samples: eight samples per iteration, using gathers
+// to fetch the four neighbours of each channel.
+__attribute__((target("avx2")))
+void SampleLinearRowAVX2(const cv::Mat_<cv::Vec3f> &image,
+                         const float *xs, const float *ys,
+                         int num_samples,
+                         cv::Vec3f *samples) {
+  const float *data = reinterpret_cast<const float *>(image.data);
+  const __m256i row_stride = _mm256_set1_epi32(image.step1());
+  const __m256i pixel_stride = _mm256_set1_epi32(3);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 one = _mm256_set1_ps(1.0f);
+
+  int i = 0;
+  for (; i + 8 <= num_samples; i += 8) {
+    __m256i x1, x2, y1, y2;
+    __m256 dx, dy;
+    LinearInitAxisAVX2(_mm256_sub_ps(_mm256_loadu_ps(ys + i), half),
+                       image.rows, &y1, &y2, &dy);
+    LinearInitAxisAVX2(_mm256_sub_ps(_mm256_loadu_ps(xs + i), half),
+                       image.cols, &x1, &x2, &dx);
+
+    // Offsets, in floats, of the first channel of the four neighbours.
+    const __m256i row1 = _mm256_mullo_epi32(y1, row_stride);
+    const __m256i row2 = _mm256_mullo_epi32(y2, row_stride);
+    const __m256i column1 = _mm256_mullo_epi32(x1, pixel_stride);
+    const __m256i column2 = _mm256_mullo_epi32(x2, pixel_stride);
+    const __m256i offset11 = _mm256_add_epi32(row1, column1);
+    const __m256i offset12 = _mm256_add_epi32(row1, column2);
+    const __m256i offset21 = _mm256_add_epi32(row2, column1);
+    const __m256i offset22 = _mm256_add_epi32(row2, column2);
+
+    const __m256 one_minus_dx = _mm256_sub_ps(one, dx);
+    const __m256 one_minus_dy = _mm256_sub_ps(one, dy);
+
+    float result[3][8];
+    for (int channel = 0; channel < 3; ++channel) {
+      const float *base = data + channel;
+      const __m256 im11 = _mm256_i32gather_ps(base, offset11, 4);
+      const __m256 im12 = _mm256_i32gather_ps(base, offset12, 4);
+      const __m256 im21 = _mm256_i32gather_ps(base, offset21, 4);
+      const __m256 im22 = _mm256_i32gather_ps(base, offset22, 4);
+
+      const __m256 top = _mm256_add_ps(_mm256_mul_ps(dx, im11),
+                                       _mm256_mul_ps(one_minus_dx, im12));
+      const __m256 bottom = _mm256_add_ps(_mm256_mul_ps(dx, im21),
+                                          _mm256_mul_ps(one_minus_dx, im22));
+      _mm256_storeu_ps(result[channel],
+                       _mm256_add_ps(_mm256_mul_ps(dy, top),
+                                     _mm256_mul_ps(one_minus_dy, bottom)));
+    }
+
+    // Interleave the channels back into pixels.
+    for (int j = 0; j < 8; ++j) {
+      samples[i + j] = cv::Vec3f(result[0][j], result[1][j], result[2][j]);
+    }
+  }
+  SampleLinearRowScalar(image, xs + i, ys + i, num_samples - i, samples + i);
+}
+
+#endif  // LIBMV_SAMPLE_HAVE_AVX2
+
+typedef void (*SampleLinearRowFunction)(const cv::Mat_<cv::Vec3f> &,
+                                        const float *, const float *,
+                                        int,
+                                        cv::Vec3f *);
+
+SampleLinearRowFunction SelectSampleLinearRow() {
+#ifdef LIBMV_SAMPLE_HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return SampleLinearRowAVX2;
+  }
+#endif
+#ifdef __SSE2__
+  return SampleLinearRowSSE2;
+#else
+  return SampleLinearRowScalar;
+#endif
+}
+
+}  // namespace
+
+void SampleLinearRow(const cv::Mat_<cv::Vec3f> &image,
+                     const float *xs, const float *ys,
+                     int num_samples,
+                     cv::Vec3f *samples) {
+  static const SampleLinearRowFunction sample_linear_row =
+      SelectSampleLinearRow();
+  sample_linear_row(image, xs, ys, num_samples, samples);
+}
+
+}  // namespace libmv
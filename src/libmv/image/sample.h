@@ -21,6 +21,9 @@
 #ifndef LIBMV_IMAGE_SAMPLE_H_
 #define LIBMV_IMAGE_SAMPLE_H_
 
+#include <algorithm>
+#include <vector>
+
 #include <opencv2/core/core.hpp>
 
 namespace libmv {
@@ -91,6 +94,16 @@ inline void SampleLinear(const cv::Mat_<cv::Vec<T, 3> > &image, float y, float x
   }
 }
 
+/// Linear interpolation of all channels at num_samples positions at once,
+/// typically a row of a (warped) patch. The result matches SampleLinear() up
+/// to floating point rounding, since the vectorized paths work in single
+/// precision. Uses AVX2 or SSE2 when the CPU supports them, decided at run
+/// time, and plain C++ otherwise.
+void SampleLinearRow(const cv::Mat_<cv::Vec3f> &image,
+                     const float *xs, const float *ys,
+                     int num_samples,
+                     cv::Vec3f *samples);
+
 // Sample a region centered at x,y in image with size extending by half_width
 // from x,y. Channels specifies the number of channels to sample from.
 inline void SamplePattern(const cv::Mat_<cv::Vec3f> &image,
@@ -98,12 +111,20 @@ inline void SamplePattern(const cv::Mat_<cv::Vec3f> &image,
                    int half_width,
                    int channels,
                    cv::Mat_<cv::Vec3f> *sampled) {
-  sampled->create(2 * half_width + 1, 2 * half_width + 1);
+  const int width = 2 * half_width + 1;
+  sampled->create(width, width);
+
+  std::vector<float> xs(width), ys(width);
+  std::vector<cv::Vec3f> row(width);
+  for (int c = -half_width; c <= half_width; ++c) {
+    xs[c + half_width] = x + c;
+  }
   for (int r = -half_width; r <= half_width; ++r) {
-    for (int c = -half_width; c <= half_width; ++c) {
+    std::fill(ys.begin(), ys.end(), float(y + r));
+    SampleLinearRow(image, &xs[0], &ys[0], width, &row[0]);
+    for (int c = 0; c < width; ++c) {
       for (int i = 0; i < channels; ++i) {
-        (*sampled)(r + half_width, c + half_width)[i] =
-            SampleLinear(image, y + r, x + c, i);
+        (*sampled)(r + half_width, c)[i] = row[c][i];
       }
     }
   }
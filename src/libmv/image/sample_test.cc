@@ -18,6 +18,8 @@
 // FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
 // IN THE SOFTWARE.
 
+#include <vector>
+
 #include "libmv/image/sample.h"
 #include "testing/testing.h"
 
@@ -34,4 +36,54 @@ TEST(Image, Linear) {
   EXPECT_EQ(1.5, SampleLinear(image, 0.5,0.5));
 }
 
+// The row sampler may use SIMD; the scalar SampleLinear() is the reference.
+TEST(Image, SampleLinearRowMatchesSampleLinear) {
+  cv::Mat_<cv::Vec3f> image(13, 17);
+  for (int r = 0; r < image.rows; ++r) {
+    for (int c = 0; c < image.cols; ++c) {
+      image(r, c) = cv::Vec3f(r * c % 7, 0.5 * r, -0.25 * c);
+    }
+  }
+
+  // Include positions outside the image to exercise the border clamping, and
+  // enough of them to cover both the vectorized body and the scalar tail.
+  const int num_samples = 43;
+  std::vector<float> xs(num_samples), ys(num_samples);
+  for (int i = 0; i < num_samples; ++i) {
+    xs[i] = -2.0f + 0.53f * i;
+    ys[i] = 15.0f - 0.41f * i;
+  }
+  std::vector<cv::Vec3f> samples(num_samples);
+  SampleLinearRow(image, &xs[0], &ys[0], num_samples, &samples[0]);
+
+  for (int i = 0; i < num_samples; ++i) {
+    float expected[3];
+    SampleLinear(image, ys[i], xs[i], expected);
+    for (int j = 0; j < 3; ++j) {
+      EXPECT_NEAR(expected[j], samples[i][j], 1e-5) << "i=" << i;
+    }
+  }
+}
+
+TEST(Image, SamplePatternMatchesSampleLinear) {
+  cv::Mat_<cv::Vec3f> image(20, 20);
+  for (int r = 0; r < image.rows; ++r) {
+    for (int c = 0; c < image.cols; ++c) {
+      image(r, c) = cv::Vec3f(r + c, r - c, r * c);
+    }
+  }
+  cv::Mat_<cv::Vec3f> pattern;
+  SamplePattern(image, 9.3, 10.6, 3, 3, &pattern);
+  ASSERT_EQ(7, pattern.rows);
+  ASSERT_EQ(7, pattern.cols);
+  for (int r = -3; r <= 3; ++r) {
+    for (int c = -3; c <= 3; ++c) {
+      for (int i = 0; i < 3; ++i) {
+        EXPECT_NEAR(SampleLinear(image, 10.6 + r, 9.3 + c, i),
+                    pattern(r + 3, c + 3)[i], 1e-4);
+      }
+    }
+  }
+}
+
 }  // namespace
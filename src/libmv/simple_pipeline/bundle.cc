@@ -22,6 +22,9 @@
 
 #include <map>
 
+#include "ceres/ceres.h"
+#include "ceres/rotation.h"
+
 #include "libmv/base/vector.h"
 #include "libmv/logging/logging.h"
 #include "libmv/multiview/fundamental.h"
@@ -38,21 +41,22 @@
 
 namespace libmv {
 
-void EuclideanBundle(const Tracks &tracks,
-                     EuclideanReconstruction *reconstruction) {
-  CameraIntrinsics intrinsics;
-  EuclideanBundleCommonIntrinsics(tracks,
-                                  BUNDLE_NO_INTRINSICS,
-                                  reconstruction,
-                                  &intrinsics);
-}
+BundleOptions::BundleOptions()
+    : solver(SSBA),
+      max_iterations(500),
+      num_threads(1) {}
 
-void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
-                                     int bundle_intrinsics,
-                                     EuclideanReconstruction *reconstruction,
-                                     CameraIntrinsics *intrinsics) {
-  LG << "Original intrinsics: " << *intrinsics;
-  vector<Marker> markers = tracks.AllMarkers();
+BundleSummary::BundleSummary()
+    : solver(BundleOptions::SSBA) {}
+
+namespace {
+
+void SsbaBundle(const Tracks &tracks,
+                int bundle_intrinsics,
+                int max_iterations,
+                EuclideanReconstruction *reconstruction,
+                CameraIntrinsics *intrinsics) {
+  MarkerView markers = tracks.AllMarkersView();
 
   // "index" in this context is the index that V3D's optimizer will see. The
   // V3D index must be dense in that the cameras are numbered 0...n-1, which is
@@ -204,7 +208,7 @@ void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
                                                 v3d_measurements,
                                                 v3d_camera_for_measurement,
                                                 v3d_point_for_measurement);
-  opt.maxIterations = 500;
+  opt.maxIterations = max_iterations;
   opt.minimize();
   if (opt.status == V3D::LEVENBERG_OPTIMIZER_TIMEOUT) {
     LG << "Bundle status: Timed out.";
@@ -244,6 +248,260 @@ void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
       index_to_point[k]->X(i) = v3d_points[k][i];
     }
   }
+}
+
+// The parameter block of the intrinsics in the Ceres bundle. The aspect ratio
+// and skew of K are held fixed, as SSBA does.
+enum {
+  OFFSET_FOCAL_LENGTH,
+  OFFSET_PRINCIPAL_POINT_X,
+  OFFSET_PRINCIPAL_POINT_Y,
+  OFFSET_K1,
+  OFFSET_K2,
+  OFFSET_K3,
+  OFFSET_P1,
+  OFFSET_P2,
+  NUM_INTRINSICS,
+};
+
+// Reprojection error of a marker, with the camera as an angle-axis rotation
+// followed by a translation, and the distortion model of
+// CameraIntrinsics::ApplyIntrinsics().
+struct ReprojectionError {
+  ReprojectionError(double observed_x, double observed_y,
+                    double aspect_ratio, double skew)
+      : observed_x(observed_x), observed_y(observed_y),
+        aspect_ratio(aspect_ratio), skew(skew) {}
+
+  template <typename T>
+  bool operator()(const T *intrinsics,
+                  const T *R_t,
+                  const T *X,
+                  T *residuals) const {
+    T x[3];
+    ceres::AngleAxisRotatePoint(R_t, X, x);
+    x[0] += R_t[3];
+    x[1] += R_t[4];
+    x[2] += R_t[5];
+    T xn = x[0] / x[2];
+    T yn = x[1] / x[2];
+
+    const T &k1 = intrinsics[OFFSET_K1];
+    const T &k2 = intrinsics[OFFSET_K2];
+    const T &k3 = intrinsics[OFFSET_K3];
+    const T &p1 = intrinsics[OFFSET_P1];
+    const T &p2 = intrinsics[OFFSET_P2];
+    T r2 = xn*xn + yn*yn;
+    T r4 = r2 * r2;
+    T r6 = r4 * r2;
+    T r_coeff = T(1) + k1*r2 + k2*r4 + k3*r6;
+    T xd = xn * r_coeff + T(2)*p1*xn*yn + p2*(r2 + T(2)*xn*xn);
+    T yd = yn * r_coeff + T(2)*p2*xn*yn + p1*(r2 + T(2)*yn*yn);
+
+    const T &focal_length = intrinsics[OFFSET_FOCAL_LENGTH];
+    residuals[0] = focal_length * xd + T(skew) * yd
+                 + intrinsics[OFFSET_PRINCIPAL_POINT_X] - T(observed_x);
+    residuals[1] = focal_length * T(aspect_ratio) * yd
+                 + intrinsics[OFFSET_PRINCIPAL_POINT_Y] - T(observed_y);
+    return true;
+  }
+
+  double observed_x, observed_y;
+  double aspect_ratio, skew;
+};
+
+// Returns the solver used.
+BundleOptions::Solver CeresBundle(const Tracks &tracks,
+                                  int bundle_intrinsics,
+                                  const BundleOptions &options,
+                                  EuclideanReconstruction *reconstruction,
+                                  CameraIntrinsics *intrinsics) {
+  MarkerView markers = tracks.AllMarkersView();
+
+  const Mat3 &K = intrinsics->K();
+  double ceres_intrinsics[NUM_INTRINSICS];
+  ceres_intrinsics[OFFSET_FOCAL_LENGTH]      = K(0, 0);
+  ceres_intrinsics[OFFSET_PRINCIPAL_POINT_X] = K(0, 2);
+  ceres_intrinsics[OFFSET_PRINCIPAL_POINT_Y] = K(1, 2);
+  ceres_intrinsics[OFFSET_K1]                = intrinsics->k1();
+  ceres_intrinsics[OFFSET_K2]                = intrinsics->k2();
+  ceres_intrinsics[OFFSET_K3]                = intrinsics->k3();
+  ceres_intrinsics[OFFSET_P1]                = intrinsics->p1();
+  ceres_intrinsics[OFFSET_P2]                = intrinsics->p2();
+  const double aspect_ratio = K(1, 1) / K(0, 0);
+  const double skew = K(0, 1);
+
+  // Ceres optimizes the point coordinates in place, but needs the cameras as
+  // an angle-axis rotation and a translation.
+  std::map<EuclideanCamera *, int> camera_to_index;
+  vector<EuclideanCamera *> index_to_camera;
+  int num_residuals = 0;
+  for (int i = 0; i < markers.size(); ++i) {
+    const Marker &marker = markers[i];
+    EuclideanCamera *camera = reconstruction->CameraForImage(marker.image);
+    EuclideanPoint *point = reconstruction->PointForTrack(marker.track);
+    if (!camera || !point) {
+      continue;
+    }
+    if (camera_to_index.find(camera) == camera_to_index.end()) {
+      camera_to_index[camera] = index_to_camera.size();
+      index_to_camera.push_back(camera);
+    }
+    num_residuals++;
+  }
+  LG << "Number of cameras: " << index_to_camera.size();
+  LG << "Number of residuals: " << num_residuals;
+  if (num_residuals == 0) {
+    return options.solver;
+  }
+
+  // Filled before adding residuals, since the blocks must not move.
+  std::vector<double> cameras_R_t(6 * index_to_camera.size());
+  for (int k = 0; k < index_to_camera.size(); ++k) {
+    double *R_t = &cameras_R_t[6 * k];
+    ceres::RotationMatrixToAngleAxis(&index_to_camera[k]->R(0, 0), R_t);
+    for (int i = 0; i < 3; ++i) {
+      R_t[3 + i] = index_to_camera[k]->t(i);
+    }
+  }
+
+  ceres::Problem problem;
+  for (int i = 0; i < markers.size(); ++i) {
+    const Marker &marker = markers[i];
+    EuclideanCamera *camera = reconstruction->CameraForImage(marker.image);
+    EuclideanPoint *point = reconstruction->PointForTrack(marker.track);
+    if (!camera || !point) {
+      continue;
+    }
+    problem.AddResidualBlock(
+        new ceres::AutoDiffCostFunction<ReprojectionError, 2,
+                                        NUM_INTRINSICS, 6, 3>(
+            new ReprojectionError(marker.x, marker.y, aspect_ratio, skew)),
+        NULL,
+        ceres_intrinsics,
+        &cameras_R_t[6 * camera_to_index[camera]],
+        &point->X(0));
+  }
+
+  // Hold the intrinsics which are not bundled constant. k3 is always held,
+  // since there is no flag for it.
+  std::vector<int> constant_intrinsics;
+  if (!(bundle_intrinsics & BUNDLE_FOCAL_LENGTH)) {
+    constant_intrinsics.push_back(OFFSET_FOCAL_LENGTH);
+  }
+  if (!(bundle_intrinsics & BUNDLE_PRINCIPAL_POINT)) {
+    constant_intrinsics.push_back(OFFSET_PRINCIPAL_POINT_X);
+    constant_intrinsics.push_back(OFFSET_PRINCIPAL_POINT_Y);
+  }
+  if (!(bundle_intrinsics & BUNDLE_RADIAL_K1)) {
+    constant_intrinsics.push_back(OFFSET_K1);
+  }
+  if (!(bundle_intrinsics & BUNDLE_RADIAL_K2)) {
+    constant_intrinsics.push_back(OFFSET_K2);
+  }
+  constant_intrinsics.push_back(OFFSET_K3);
+  if (!(bundle_intrinsics & BUNDLE_TANGENTIAL_P1)) {
+    constant_intrinsics.push_back(OFFSET_P1);
+  }
+  if (!(bundle_intrinsics & BUNDLE_TANGENTIAL_P2)) {
+    constant_intrinsics.push_back(OFFSET_P2);
+  }
+  if (constant_intrinsics.size() == NUM_INTRINSICS) {
+    LG << "Bundling only camera positions.";
+    problem.SetParameterBlockConstant(ceres_intrinsics);
+  } else {
+    LG << "Bundling " << NUM_INTRINSICS - constant_intrinsics.size()
+       << " intrinsics.";
+    problem.SetParameterization(ceres_intrinsics,
+        new ceres::SubsetParameterization(NUM_INTRINSICS,
+                                          constant_intrinsics));
+  }
+
+  ceres::Solver::Options solver_options;
+  solver_options.linear_solver_type =
+      options.solver == BundleOptions::CERES_SPARSE_SCHUR
+          ? ceres::SPARSE_SCHUR : ceres::ITERATIVE_SCHUR;
+  solver_options.preconditioner_type = ceres::JACOBI;
+  solver_options.ordering_type = ceres::SCHUR;
+  solver_options.max_num_iterations = options.max_iterations;
+  solver_options.num_threads = options.num_threads;
+  solver_options.num_linear_solver_threads = options.num_threads;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+  BundleOptions::Solver solver = options.solver;
+  if (summary.termination_type == ceres::DID_NOT_RUN &&
+      solver_options.linear_solver_type == ceres::SPARSE_SCHUR) {
+    LOG(WARNING) << "Sparse Schur bundle adjustment is not available ("
+                 << summary.error << "); using the iterative Schur solver.";
+    solver_options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+    solver = BundleOptions::CERES_ITERATIVE_SCHUR;
+    ceres::Solve(solver_options, &problem, &summary);
+  }
+  LG << "Bundle status: " << summary.BriefReport();
+
+  Mat3 new_K = K;
+  new_K(0, 0) = ceres_intrinsics[OFFSET_FOCAL_LENGTH];
+  new_K(1, 1) = ceres_intrinsics[OFFSET_FOCAL_LENGTH] * aspect_ratio;
+  new_K(0, 2) = ceres_intrinsics[OFFSET_PRINCIPAL_POINT_X];
+  new_K(1, 2) = ceres_intrinsics[OFFSET_PRINCIPAL_POINT_Y];
+  intrinsics->SetK(new_K);
+  intrinsics->SetRadialDistortion(ceres_intrinsics[OFFSET_K1],
+                                  ceres_intrinsics[OFFSET_K2],
+                                  ceres_intrinsics[OFFSET_K3]);
+  intrinsics->SetTangentialDistortion(ceres_intrinsics[OFFSET_P1],
+                                      ceres_intrinsics[OFFSET_P2]);
+
+  for (int k = 0; k < index_to_camera.size(); ++k) {
+    const double *R_t = &cameras_R_t[6 * k];
+    ceres::AngleAxisToRotationMatrix(R_t, &index_to_camera[k]->R(0, 0));
+    for (int i = 0; i < 3; ++i) {
+      index_to_camera[k]->t(i) = R_t[3 + i];
+    }
+  }
+  return solver;
+}
+
+}  // namespace
+
+void EuclideanBundle(const Tracks &tracks,
+                     EuclideanReconstruction *reconstruction) {
+  CameraIntrinsics intrinsics;
+  EuclideanBundleCommonIntrinsics(tracks,
+                                  BUNDLE_NO_INTRINSICS,
+                                  reconstruction,
+                                  &intrinsics);
+}
+
+void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
+                                     int bundle_intrinsics,
+                                     EuclideanReconstruction *reconstruction,
+                                     CameraIntrinsics *intrinsics) {
+  EuclideanBundleCommonIntrinsics(tracks,
+                                  bundle_intrinsics,
+                                  BundleOptions(),
+                                  reconstruction,
+                                  intrinsics);
+}
+
+void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
+                                     int bundle_intrinsics,
+                                     const BundleOptions &options,
+                                     EuclideanReconstruction *reconstruction,
+                                     CameraIntrinsics *intrinsics,
+                                     BundleSummary *summary) {
+  LG << "Original intrinsics: " << *intrinsics;
+  BundleOptions::Solver solver = options.solver;
+  if (options.solver == BundleOptions::SSBA) {
+    SsbaBundle(tracks, bundle_intrinsics, options.max_iterations,
+               reconstruction, intrinsics);
+  } else {
+    solver = CeresBundle(tracks, bundle_intrinsics, options,
+                         reconstruction, intrinsics);
+  }
+  if (summary != NULL) {
+    summary->solver = solver;
+  }
   LG << "Final intrinsics: " << *intrinsics;
 }
 
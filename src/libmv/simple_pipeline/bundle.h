@@ -60,7 +60,8 @@ void EuclideanBundle(const Tracks &tracks,
 
     The cameras, bundles, and intrinsics are refined in-place.
 
-    The only supported combinations of bundle parameters are:
+    With the SSBA solver, the only supported combinations of bundle parameters
+    are:
 
     BUNDLE_NO_INTRINSICS
     BUNDLE_FOCAL_LENGTH
@@ -68,6 +69,8 @@ void EuclideanBundle(const Tracks &tracks,
     BUNDLE_FOCAL_LENGTH | BUNDLE_PRINCIPAL_POINT | BUNDLE_RADIAL
     BUNDLE_FOCAL_LENGTH | BUNDLE_PRINCIPAL_POINT | BUNDLE_RADIAL | BUNDLE_TANGENTIAL
 
+    The Ceres solvers accept any combination. See BundleOptions.
+
     \note This assumes an outlier-free set of markers.
 
     \sa EuclideanResect, EuclideanIntersect, EuclideanReconstructTwoFrames
@@ -83,11 +86,65 @@ enum BundleIntrinsics {
   BUNDLE_TANGENTIAL_P2 = 32,
   BUNDLE_TANGENTIAL = 48,
 };
+
+/*!
+    Selects and configures the optimizer behind
+    EuclideanBundleCommonIntrinsics().
+
+    The Ceres solvers eliminate the points with the Schur complement, so the
+    linear system they solve is only as large as the cameras. They evaluate the
+    residuals and Jacobians on num_threads threads (if Ceres was built with
+    OpenMP).
+*/
+struct BundleOptions {
+  BundleOptions();
+
+  enum Solver {
+    // SSBA's Levenberg-Marquardt with a sparse Cholesky factorization. It is
+    // single threaded and supports only some combinations of intrinsics.
+    SSBA,
+
+    // Ceres with a sparse Cholesky factorization of the Schur complement.
+    // This needs Ceres built with SuiteSparse or CXSparse; without them, the
+    // solve falls back to CERES_ITERATIVE_SCHUR with a warning (see
+    // BundleSummary).
+    CERES_SPARSE_SCHUR,
+
+    // Ceres with Jacobi preconditioned conjugate gradients on the Schur
+    // complement. This needs no sparse factorization, and uses less memory on
+    // very large problems.
+    CERES_ITERATIVE_SCHUR,
+  };
+  Solver solver;
+
+  int max_iterations;
+
+  // Ignored by SSBA.
+  int num_threads;
+};
+
 void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
                                      int bundle_intrinsics,
                                      EuclideanReconstruction *reconstruction,
                                      CameraIntrinsics *intrinsics);
 
+// What EuclideanBundleCommonIntrinsics() did.
+struct BundleSummary {
+  BundleSummary();
+
+  // The solver that ran, which differs from the requested one when
+  // CERES_SPARSE_SCHUR is not available.
+  BundleOptions::Solver solver;
+};
+
+// If summary is not NULL, it is filled in.
+void EuclideanBundleCommonIntrinsics(const Tracks &tracks,
+                                     int bundle_intrinsics,
+                                     const BundleOptions &options,
+                                     EuclideanReconstruction *reconstruction,
+                                     CameraIntrinsics *intrinsics,
+                                     BundleSummary *summary = NULL);
+
 /*!
     Refine camera poses and 3D coordinates using bundle adjustment.
 
@@ -0,0 +1,145 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cmath>
+#include <cstdlib>
+
+#include "libmv/numeric/numeric.h"
+#include "libmv/simple_pipeline/bundle.h"
+#include "libmv/simple_pipeline/camera_intrinsics.h"
+#include "libmv/simple_pipeline/pipeline.h"
+#include "libmv/simple_pipeline/reconstruction.h"
+#include "libmv/simple_pipeline/tracks.h"
+#include "testing/testing.h"
+
+namespace {
+using namespace libmv;
+
+double RandomUniform(double min, double max) {
+  return min + (max - min) * rand() / static_cast<double>(RAND_MAX);
+}
+
+// Cameras on a half circle around a cloud of points, with exact markers. The
+// reconstruction gets perturbed cameras and points.
+void MakeScene(const CameraIntrinsics &intrinsics,
+               Tracks *tracks,
+               EuclideanReconstruction *reconstruction) {
+  srand(1);
+  const int kNumCameras = 10;
+  const int kNumPoints = 100;
+  std::vector<Vec3> points(kNumPoints);
+  for (int j = 0; j < kNumPoints; ++j) {
+    points[j] << RandomUniform(-2, 2), RandomUniform(-2, 2),
+                 RandomUniform(-2, 2);
+    Vec3 noise(RandomUniform(-0.02, 0.02), RandomUniform(-0.02, 0.02),
+               RandomUniform(-0.02, 0.02));
+    reconstruction->InsertPoint(j, points[j] + noise);
+  }
+  for (int i = 0; i < kNumCameras; ++i) {
+    double angle = M_PI / 2 * i / kNumCameras;
+    Mat3 R = RotationAroundY(angle);
+    Vec3 t = -R * Vec3(10 * sin(angle), 0, -10 * cos(angle));
+    for (int j = 0; j < kNumPoints; ++j) {
+      Vec3 x = R * points[j] + t;
+      double image_x, image_y;
+      intrinsics.ApplyIntrinsics(x(0) / x(2), x(1) / x(2),
+                                 &image_x, &image_y);
+      tracks->Insert(i, j, image_x, image_y);
+    }
+    Vec3 dt(RandomUniform(-0.02, 0.02), RandomUniform(-0.02, 0.02),
+            RandomUniform(-0.02, 0.02));
+    reconstruction->InsertCamera(i, RotationAroundX(0.002) * R, t + dt);
+  }
+}
+
+void SetIntrinsics(double focal_length, double k1, double k2,
+                   CameraIntrinsics *intrinsics) {
+  intrinsics->SetFocalLength(focal_length, focal_length);
+  intrinsics->SetPrincipalPoint(640, 360);
+  intrinsics->SetRadialDistortion(k1, k2);
+}
+
+void ExpectBundleConverges(BundleOptions::Solver solver) {
+  CameraIntrinsics true_intrinsics;
+  SetIntrinsics(1000, 0, 0, &true_intrinsics);
+  Tracks tracks;
+  EuclideanReconstruction reconstruction;
+  MakeScene(true_intrinsics, &tracks, &reconstruction);
+
+  CameraIntrinsics intrinsics;
+  SetIntrinsics(1010, 0, 0, &intrinsics);
+  double initial_error =
+      EuclideanReprojectionError(tracks, reconstruction, intrinsics);
+
+  BundleOptions options;
+  options.solver = solver;
+  options.num_threads = 2;
+  BundleSummary summary;
+  EuclideanBundleCommonIntrinsics(tracks, BUNDLE_FOCAL_LENGTH, options,
+                                  &reconstruction, &intrinsics, &summary);
+  if (solver == BundleOptions::CERES_SPARSE_SCHUR &&
+      summary.solver != solver) {
+    // Ceres has no sparse factorization.
+    EXPECT_EQ(BundleOptions::CERES_ITERATIVE_SCHUR, summary.solver);
+  } else {
+    EXPECT_EQ(solver, summary.solver);
+  }
+  double final_error =
+      EuclideanReprojectionError(tracks, reconstruction, intrinsics);
+  EXPECT_GT(initial_error, 1.0);
+  EXPECT_LT(final_error, 1e-3);
+  EXPECT_NEAR(1000, intrinsics.focal_length(), 0.5);
+  EXPECT_NEAR(640, intrinsics.principal_point_x(), 1e-8);
+}
+
+TEST(Bundle, SSBA) {
+  ExpectBundleConverges(BundleOptions::SSBA);
+}
+
+TEST(Bundle, CeresSparseSchur) {
+  ExpectBundleConverges(BundleOptions::CERES_SPARSE_SCHUR);
+}
+
+TEST(Bundle, CeresIterativeSchur) {
+  ExpectBundleConverges(BundleOptions::CERES_ITERATIVE_SCHUR);
+}
+
+// SSBA does not support bundling only some of the distortion.
+TEST(Bundle, CeresAnyIntrinsics) {
+  CameraIntrinsics true_intrinsics;
+  SetIntrinsics(1000, 0, -0.02, &true_intrinsics);
+  Tracks tracks;
+  EuclideanReconstruction reconstruction;
+  MakeScene(true_intrinsics, &tracks, &reconstruction);
+
+  CameraIntrinsics intrinsics;
+  SetIntrinsics(1000, 0, 0, &intrinsics);
+  BundleOptions options;
+  options.solver = BundleOptions::CERES_ITERATIVE_SCHUR;
+  EuclideanBundleCommonIntrinsics(tracks, BUNDLE_RADIAL_K2, options,
+                                  &reconstruction, &intrinsics);
+  EXPECT_LT(EuclideanReprojectionError(tracks, reconstruction, intrinsics),
+            1e-3);
+  EXPECT_NEAR(-0.02, intrinsics.k2(), 1e-4);
+  EXPECT_EQ(0, intrinsics.k1());
+  EXPECT_EQ(1000, intrinsics.focal_length());
+}
+
+}  // namespace
@@ -279,11 +279,10 @@ void CameraIntrinsics::CheckDistortLookupGrid(int width, int height, double over
   if(!distort_->offset) {
       distort_->offset = new Offset[width*height];
       ComputeLookupGrid<InvertIntrinsicsFunction>(distort_,width,height,overscan);
+      distort_->width = width;
+      distort_->height = height;
+      distort_->overscan = overscan;
   }
-
-  distort_->width = width;
-  distort_->height = height;
-  distort_->overscan = overscan;
 }
 
 void CameraIntrinsics::CheckUndistortLookupGrid(int width, int height, double overscan)
@@ -298,14 +297,15 @@ void CameraIntrinsics::CheckUndistortLookupGrid(int width, int height, double ov
     undistort_->offset = NULL;
   }
 
+  // A grid that matches is only read, so that warps with it may run
+  // concurrently.
   if(!undistort_->offset) {
       undistort_->offset = new Offset[width*height];
       ComputeLookupGrid<ApplyIntrinsicsFunction>(undistort_,width,height,overscan);
+      undistort_->width = width;
+      undistort_->height = height;
+      undistort_->overscan = overscan;
   }
-
-  undistort_->width = width;
-  undistort_->height = height;
-  undistort_->overscan = overscan;
 }
 
 void CameraIntrinsics::Distort(const float* src, float* dst, int width, int height, double overscan, int channels) {
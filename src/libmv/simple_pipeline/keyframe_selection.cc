@@ -274,16 +274,16 @@ void SelectkeyframesBasedOnGRIC(Tracks &tracks,
          candidate_image <= max_image;
          candidate_image++)
     {
-      // Conjunction of all markers from both keyframes
-      vector<Marker> all_markers = tracks.MarkersInBothImages(current_keyframe, candidate_image);
+      // Number of markers from both keyframes
+      int num_all_markers =
+          tracks.MarkersInImageView(current_keyframe).size() +
+          tracks.MarkersInImageView(candidate_image).size();
 
-      // Match keypoints between frames current_keyframe and candidate_image
-      vector<Marker> tracked_markers = tracks.MarkersForTracksInBothImages(current_keyframe, candidate_image);
-
-      // Correspondences in normalized space
+      // Match keypoints between frames current_keyframe and candidate_image,
+      // as correspondences in normalized space
       Mat x1, x2;
-      CoordinatesForMarkersInImage(tracked_markers, current_keyframe, &x1);
-      CoordinatesForMarkersInImage(tracked_markers, candidate_image, &x2);
+      CoordinatesForTracksInBothImages(tracks, current_keyframe,
+                                       candidate_image, &x1, &x2);
 
       LG << "Found " << x1.cols() << " correspondences between " << current_keyframe
          << " and " << candidate_image;
@@ -293,8 +293,8 @@ void SelectkeyframesBasedOnGRIC(Tracks &tracks,
         continue;
 
       // Correspondence ratio constraint
-      int Tc = tracked_markers.size();
-      int Tf = all_markers.size();
+      int Tc = 2 * x1.cols();
+      int Tf = num_all_markers;
       double Rc = (double) Tc / (double) Tf;
 
       LG << "Correspondence between " << current_keyframe << " and " << candidate_image
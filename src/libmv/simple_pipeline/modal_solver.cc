@@ -62,7 +62,7 @@ void ModalSolver(Tracks &tracks,
   Mat3 R = Mat3::Identity();
 
   for (int image = 0; image <= max_image; ++image) {
-    vector<Marker> all_markers = tracks.MarkersInImage(image);
+    MarkerView all_markers = tracks.MarkersInImageView(image);
 
     ModalSolverLogProress(update_callback, (float) image / max_image);
 
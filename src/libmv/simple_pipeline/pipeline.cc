@@ -158,7 +158,7 @@ void InternalCompleteReconstruction(
         LG << "Skipping point: " << track;
         continue;
       }
-      vector<Marker> all_markers = tracks.MarkersForTrack(track);
+      MarkerView all_markers = tracks.MarkersForTrackView(track);
       LG << "Got " << all_markers.size() << " markers for track " << track;
 
       vector<Marker> reconstructed_markers;
@@ -193,7 +193,7 @@ void InternalCompleteReconstruction(
         LG << "Skipping frame: " << image;
         continue;
       }
-      vector<Marker> all_markers = tracks.MarkersInImage(image);
+      MarkerView all_markers = tracks.MarkersInImageView(image);
       LG << "Got " << all_markers.size() << " markers for image " << image;
 
       vector<Marker> reconstructed_markers;
@@ -232,7 +232,7 @@ void InternalCompleteReconstruction(
       LG << "Skipping frame: " << image;
       continue;
     }
-    vector<Marker> all_markers = tracks.MarkersInImage(image);
+    MarkerView all_markers = tracks.MarkersInImageView(image);
 
     vector<Marker> reconstructed_markers;
     for (int i = 0; i < all_markers.size(); ++i) {
@@ -266,7 +266,7 @@ double InternalReprojectionError(const Tracks &image_tracks,
   int num_skipped = 0;
   int num_reprojected = 0;
   double total_error = 0.0;
-  vector<Marker> markers = image_tracks.AllMarkers();
+  MarkerView markers = image_tracks.AllMarkersView();
   for (int i = 0; i < markers.size(); ++i) {
     const typename PipelineRoutines::Camera *camera =
         reconstruction.CameraForImage(markers[i].image);
@@ -349,14 +349,15 @@ void ProjectiveCompleteReconstruction(const ReconstructionOptions &options,
 void InvertIntrinsicsForTracks(const Tracks &raw_tracks,
                                const CameraIntrinsics &camera_intrinsics,
                                Tracks *calibrated_tracks) {
-  vector<Marker> markers = raw_tracks.AllMarkers();
+  // Replacing the coordinates of the markers in the copy keeps its indices,
+  // and the view of raw_tracks valid even if it is the same object.
+  *calibrated_tracks = raw_tracks;
+  MarkerView markers = raw_tracks.AllMarkersView();
   for (int i = 0; i < markers.size(); ++i) {
-    camera_intrinsics.InvertIntrinsics(markers[i].x,
-                                       markers[i].y,
-                                       &(markers[i].x),
-                                       &(markers[i].y));
+    double x, y;
+    camera_intrinsics.InvertIntrinsics(markers[i].x, markers[i].y, &x, &y);
+    calibrated_tracks->Insert(markers[i].image, markers[i].track, x, y);
   }
-  *calibrated_tracks = Tracks(markers);
 }
 
 }  // namespace libmv
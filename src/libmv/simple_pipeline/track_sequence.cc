@@ -0,0 +1,278 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/image_sequence.h"
+#include "libmv/logging/logging.h"
+#include "libmv/simple_pipeline/track_sequence.h"
+#include "libmv/simple_pipeline/tracks.h"
+#include "libmv/tracking/region_tracker.h"
+
+namespace libmv {
+
+TrackSequenceOptions::TrackSequenceOptions()
+    : first_image(0),
+      last_image(-1),
+      num_threads(0),
+      num_prefetch_frames(2),
+      half_search_size(0) {
+}
+
+namespace {
+
+// The region trackers work on single channel float images in [0, 1].
+cv::Mat_<float> ToFloatGray(const cv::Mat &image) {
+  cv::Mat gray = image;
+  if (image.channels() == 3) {
+    cv::cvtColor(image, gray, CV_BGR2GRAY);
+  } else if (image.channels() == 4) {
+    cv::cvtColor(image, gray, CV_BGRA2GRAY);
+  }
+  double scale = 1.0;
+  if (gray.depth() == CV_8U) {
+    scale = 1.0 / 255.0;
+  } else if (gray.depth() == CV_16U) {
+    scale = 1.0 / 65535.0;
+  }
+  cv::Mat_<float> result;
+  gray.convertTo(result, CV_32F, scale);
+  return result;
+}
+
+// Loads the frames in tracking order on its own thread, at most
+// num_prefetch frames past the last one asked for. Each frame is converted
+// and unpinned right away, so the sequence never holds more than one pin.
+class FramePrefetcher : public Thread {
+ public:
+  FramePrefetcher(ImageSequence *sequence,
+                  const std::vector<int> &frames,
+                  int num_prefetch)
+      : sequence_(sequence),
+        frames_(frames),
+        num_prefetch_(std::max(0, num_prefetch)),
+        needed_(0),
+        stop_(false) {}
+
+  // Returns the k-th frame of the tracking order, waiting for it to load.
+  // The result is empty if the sequence failed to produce the image.
+  cv::Mat_<float> Get(int k) {
+    MutexLock lock(&mutex_);
+    if (k > needed_) {
+      needed_ = k;
+      wanted_.Signal();
+    }
+    std::map<int, cv::Mat_<float> >::iterator it;
+    while ((it = loaded_.find(k)) == loaded_.end()) {
+      loaded_condition_.Wait(&mutex_);
+    }
+    return it->second;
+  }
+
+  // Drops the k-th frame; it must not be asked for again.
+  void Release(int k) {
+    MutexLock lock(&mutex_);
+    loaded_.erase(k);
+  }
+
+  void Stop() {
+    {
+      MutexLock lock(&mutex_);
+      stop_ = true;
+      wanted_.Signal();
+    }
+    Join();
+  }
+
+ protected:
+  virtual void Run() {
+    for (int k = 0; k < static_cast<int>(frames_.size()); ++k) {
+      {
+        MutexLock lock(&mutex_);
+        while (k > needed_ + num_prefetch_ && !stop_) {
+          wanted_.Wait(&mutex_);
+        }
+        if (stop_) {
+          return;
+        }
+      }
+      cv::Mat image = sequence_->GetImage(frames_[k]);
+      cv::Mat_<float> frame;
+      if (!image.empty()) {
+        frame = ToFloatGray(image);
+      }
+      sequence_->Unpin(frames_[k]);
+
+      MutexLock lock(&mutex_);
+      loaded_[k] = frame;
+      loaded_condition_.Broadcast();
+    }
+  }
+
+ private:
+  ImageSequence *sequence_;
+  std::vector<int> frames_;
+  int num_prefetch_;
+
+  Mutex mutex_;
+  ConditionVariable wanted_;
+  ConditionVariable loaded_condition_;
+  std::map<int, cv::Mat_<float> > loaded_;
+  int needed_;
+  bool stop_;
+};
+
+// Track a marker from image1 into image2, in place.
+bool TrackMarker(const RegionTracker &tracker,
+                 const cv::Mat_<float> &image1,
+                 const cv::Mat_<float> &image2,
+                 int half_search_size,
+                 Marker *marker) {
+  int x0 = 0, y0 = 0;
+  cv::Mat_<float> window1 = image1;
+  cv::Mat_<float> window2 = image2;
+  if (half_search_size > 0) {
+    // Copy the windows out; not all trackers handle non-continuous images.
+    int size = 2 * half_search_size + 1;
+    x0 = static_cast<int>(marker->x) - half_search_size;
+    y0 = static_cast<int>(marker->y) - half_search_size;
+    if (x0 < 0 || y0 < 0 ||
+        x0 + size > image1.cols || y0 + size > image1.rows ||
+        x0 + size > image2.cols || y0 + size > image2.rows) {
+      return false;
+    }
+    cv::Rect window(x0, y0, size, size);
+    image1(window).copyTo(window1);
+    image2(window).copyTo(window2);
+  }
+  double x1 = marker->x - x0;
+  double y1 = marker->y - y0;
+  double x2 = x1, y2 = y1;
+  if (!tracker.Track(window1, window2, x1, y1, &x2, &y2)) {
+    return false;
+  }
+  marker->x = x2 + x0;
+  marker->y = y2 + y0;
+  return true;
+}
+
+}  // namespace
+
+void TrackSequence(ImageSequence *sequence,
+                   const RegionTrackerFactory &factory,
+                   const TrackSequenceOptions &options,
+                   Tracks *tracks) {
+  int length = sequence->Length();
+  int first_image = options.first_image;
+  int last_image = options.last_image < 0 ? length - 1 : options.last_image;
+  if (first_image < 0 || first_image >= length || last_image >= length) {
+    LOG(ERROR) << "Frames " << first_image << " to " << last_image
+               << " are not in a sequence of " << length << " frames.";
+    return;
+  }
+  int step = last_image >= first_image ? 1 : -1;
+  std::vector<int> frames;
+  for (int i = first_image; i != last_image + step; i += step) {
+    frames.push_back(i);
+  }
+  if (frames.size() < 2) {
+    return;
+  }
+
+  FramePrefetcher prefetcher(sequence, frames, options.num_prefetch_frames);
+  if (!prefetcher.Start()) {
+    LOG(ERROR) << "Couldn't start the frame loading thread.";
+    return;
+  }
+
+#ifdef _OPENMP
+  int num_threads = options.num_threads > 0 ? options.num_threads
+                                             : omp_get_max_threads();
+#endif
+
+  for (int k = 0; k + 1 < static_cast<int>(frames.size()); ++k) {
+    cv::Mat_<float> image1 = prefetcher.Get(k);
+    cv::Mat_<float> image2 = prefetcher.Get(k + 1);
+    if (image1.empty() || image2.empty()) {
+      LOG(ERROR) << "Couldn't load frame "
+                 << (image1.empty() ? frames[k] : frames[k + 1])
+                 << "; stopping.";
+      break;
+    }
+
+    // Only carry over tracks that have no marker in the next frame yet. The
+    // views are sorted by track, and used up before tracks is modified.
+    MarkerView next_markers = tracks->MarkersInImageView(frames[k + 1]);
+    std::vector<int> next_tracks;
+    for (int i = 0; i < next_markers.size(); ++i) {
+      next_tracks.push_back(next_markers[i].track);
+    }
+
+    MarkerView markers = tracks->MarkersInImageView(frames[k]);
+    std::vector<Marker> to_track;
+    for (int i = 0; i < markers.size(); ++i) {
+      if (!std::binary_search(next_tracks.begin(), next_tracks.end(),
+                              markers[i].track)) {
+        to_track.push_back(markers[i]);
+      }
+    }
+    int num_markers = to_track.size();
+
+    // Markers can take very different times to track, so hand them out one
+    // at a time to whichever thread is free.
+    std::vector<char> tracked(num_markers, 0);
+#pragma omp parallel num_threads(num_threads)
+    {
+      cv::Ptr<RegionTracker> tracker(factory.Create());
+#pragma omp for schedule(dynamic)
+      for (int i = 0; i < num_markers; ++i) {
+        tracked[i] = TrackMarker(*tracker, image1, image2,
+                                 options.half_search_size,
+                                 &to_track[i]);
+      }
+    }
+
+    int num_tracked = 0;
+    for (int i = 0; i < num_markers; ++i) {
+      if (tracked[i]) {
+        tracks->Insert(frames[k + 1], to_track[i].track,
+                       to_track[i].x, to_track[i].y);
+        ++num_tracked;
+      }
+    }
+    VLOG(1) << "Tracked " << num_tracked << " of " << num_markers
+            << " markers from frame " << frames[k]
+            << " to " << frames[k + 1] << ".";
+    prefetcher.Release(k);
+  }
+  prefetcher.Stop();
+}
+
+}  // namespace libmv
@@ -0,0 +1,77 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_SIMPLE_PIPELINE_TRACK_SEQUENCE_H_
+#define LIBMV_SIMPLE_PIPELINE_TRACK_SEQUENCE_H_
+
+namespace libmv {
+
+class ImageSequence;
+class RegionTracker;
+class Tracks;
+
+// Makes the region trackers for TrackSequence(). Each worker thread gets its
+// own tracker, so trackers that keep state between calls are fine.
+class RegionTrackerFactory {
+ public:
+  virtual ~RegionTrackerFactory() {}
+  virtual RegionTracker *Create() const = 0;
+};
+
+struct TrackSequenceOptions {
+  TrackSequenceOptions();
+
+  // The frames to track from and to, inclusive. If last_image is before
+  // first_image, the sequence is tracked backwards. A negative last_image
+  // means the end of the sequence.
+  int first_image;
+  int last_image;
+
+  // Number of threads tracking markers. Zero means one per core.
+  int num_threads;
+
+  // How many frames past the pair being tracked to load ahead of time. The
+  // loading happens on a separate thread, which is the only one to touch the
+  // image sequence.
+  int num_prefetch_frames;
+
+  // If positive, each marker is tracked within a window of twice this size
+  // around its position instead of within the whole frame. Markers whose
+  // window leaves the frame are not tracked.
+  int half_search_size;
+};
+
+// Track the markers of each frame into the next one, from first_image to
+// last_image, and insert the results into tracks. A marker is only tracked
+// into a frame where its track has no marker yet, so markers placed by hand
+// are kept; a track stops at the first frame it fails to track into.
+//
+// The markers of a frame are spread over a pool of threads with dynamic
+// scheduling, and the frames are converted to grayscale floats in [0, 1]
+// before tracking. The image sequence must not be used by anyone else until
+// this returns.
+void TrackSequence(ImageSequence *sequence,
+                   const RegionTrackerFactory &factory,
+                   const TrackSequenceOptions &options,
+                   Tracks *tracks);
+
+}  // namespace libmv
+
+#endif  // LIBMV_SIMPLE_PIPELINE_TRACK_SEQUENCE_H_
@@ -0,0 +1,148 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cmath>
+#include <vector>
+
+#include "libmv/image/image_sequence.h"
+#include "libmv/simple_pipeline/track_sequence.h"
+#include "libmv/simple_pipeline/tracks.h"
+#include "libmv/tracking/klt_region_tracker.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+// A sequence of 8-bit frames with smooth blobs moving by (dx, dy) per frame.
+class MovingBlobsSequence : public ImageSequence {
+ public:
+  MovingBlobsSequence(int length, double dx, double dy)
+      : length_(length), dx_(dx), dy_(dy), num_pinned_(0) {}
+
+  virtual cv::Mat GetImage(int i) {
+    ++num_pinned_;
+    cv::Mat_<unsigned char> image(100, 100);
+    for (int r = 0; r < image.rows; ++r) {
+      for (int c = 0; c < image.cols; ++c) {
+        double value = 0.0;
+        for (int b = 0; b < 4; ++b) {
+          double x = c - (BlobX(b) + i * dx_);
+          double y = r - (BlobY(b) + i * dy_);
+          value += exp(-(x * x + y * y) / (2 * 3.0 * 3.0));
+        }
+        image(r, c) = static_cast<unsigned char>(255 * std::min(1.0, value));
+      }
+    }
+    return image;
+  }
+
+  virtual void Unpin(int) { --num_pinned_; }
+  virtual int Length() { return length_; }
+
+  static double BlobX(int b) { return 25 + 40 * (b % 2); }
+  static double BlobY(int b) { return 25 + 40 * (b / 2); }
+
+  int num_pinned() const { return num_pinned_; }
+
+ private:
+  int length_;
+  double dx_, dy_;
+  int num_pinned_;
+};
+
+class KltFactory : public RegionTrackerFactory {
+ public:
+  virtual RegionTracker *Create() const {
+    KltRegionTracker *tracker = new KltRegionTracker;
+    tracker->half_window_size = 6;
+    return tracker;
+  }
+};
+
+TEST(TrackSequence, TracksAllMarkersThroughTheSequence) {
+  const int kLength = 6;
+  const double dx = 1.0, dy = 0.5;
+  MovingBlobsSequence sequence(kLength, dx, dy);
+
+  Tracks tracks;
+  for (int b = 0; b < 4; ++b) {
+    tracks.Insert(0, b, MovingBlobsSequence::BlobX(b),
+                        MovingBlobsSequence::BlobY(b));
+  }
+  // A marker placed by hand must be kept. It moves track 0 onto blob 3,
+  // well inside the frame so that its search window fits.
+  const double hand_x = MovingBlobsSequence::BlobX(3) + 3 * dx;
+  const double hand_y = MovingBlobsSequence::BlobY(3) + 3 * dy;
+  tracks.Insert(3, 0, hand_x, hand_y);
+
+  TrackSequenceOptions options;
+  options.num_prefetch_frames = 2;
+  options.half_search_size = 12;
+  TrackSequence(&sequence, KltFactory(), options, &tracks);
+
+  EXPECT_EQ(0, sequence.num_pinned());
+  EXPECT_EQ(4 * kLength, tracks.NumMarkers());
+  for (int i = 1; i < kLength; ++i) {
+    for (int b = 0; b < 4; ++b) {
+      Marker marker = tracks.MarkerInImageForTrack(i, b);
+      ASSERT_EQ(i, marker.image);
+      if (b == 0 && i == 3) {
+        EXPECT_EQ(hand_x, marker.x);
+        EXPECT_EQ(hand_y, marker.y);
+        continue;
+      }
+      // Tracking continues from the hand placed marker.
+      int blob = (b == 0 && i > 3) ? 3 : b;
+      EXPECT_NEAR(MovingBlobsSequence::BlobX(blob) + i * dx, marker.x, 0.1);
+      EXPECT_NEAR(MovingBlobsSequence::BlobY(blob) + i * dy, marker.y, 0.1);
+    }
+  }
+}
+
+// Tracking backwards from the last frame finds the same motion.
+TEST(TrackSequence, TracksBackwards) {
+  const int kLength = 4;
+  const double dx = -0.7, dy = 1.2;
+  MovingBlobsSequence sequence(kLength, dx, dy);
+
+  Tracks tracks;
+  for (int b = 0; b < 4; ++b) {
+    tracks.Insert(kLength - 1, b,
+                  MovingBlobsSequence::BlobX(b) + (kLength - 1) * dx,
+                  MovingBlobsSequence::BlobY(b) + (kLength - 1) * dy);
+  }
+
+  TrackSequenceOptions options;
+  options.first_image = kLength - 1;
+  options.last_image = 0;
+  options.num_threads = 2;
+  options.half_search_size = 12;
+  TrackSequence(&sequence, KltFactory(), options, &tracks);
+
+  EXPECT_EQ(4 * kLength, tracks.NumMarkers());
+  for (int b = 0; b < 4; ++b) {
+    Marker marker = tracks.MarkerInImageForTrack(0, b);
+    EXPECT_NEAR(MovingBlobsSequence::BlobX(b), marker.x, 0.1);
+    EXPECT_NEAR(MovingBlobsSequence::BlobY(b), marker.y, 0.1);
+  }
+}
+
+}  // namespace
+}  // namespace libmv
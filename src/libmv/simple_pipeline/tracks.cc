@@ -22,30 +22,137 @@
 #include <vector>
 #include <iterator>
 
+#include "libmv/logging/logging.h"
 #include "libmv/numeric/numeric.h"
 #include "libmv/simple_pipeline/tracks.h"
 
 namespace libmv {
+namespace {
 
-Tracks::Tracks(const Tracks &other) {
-  markers_ = other.markers_;
+typedef std::vector<int> Bucket;
+
+// Compares positions in a marker array by one of the marker fields, for
+// searching the buckets of the indices.
+struct FieldLess {
+  FieldLess(const vector<Marker> &markers, int Marker::*field)
+      : markers(markers), field(field) {}
+  bool operator()(int position, int key) const {
+    return markers[position].*field < key;
+  }
+  const vector<Marker> &markers;
+  int Marker::*field;
+};
+
+// Returns where the marker with the given key is, or would go, in a bucket
+// sorted by field. Markers usually arrive in order, so check the end first.
+Bucket::iterator Position(Bucket *bucket,
+                          const vector<Marker> &markers,
+                          int Marker::*field,
+                          int key) {
+  if (bucket->empty() || markers[bucket->back()].*field < key) {
+    return bucket->end();
+  }
+  return std::lower_bound(bucket->begin(), bucket->end(), key,
+                          FieldLess(markers, field));
 }
 
-Tracks::Tracks(const vector<Marker> &markers) : markers_(markers) {}
+// The index of the marker with the given key in a bucket sorted by field, or
+// -1.
+int FindInBucket(const Bucket &bucket,
+                 const vector<Marker> &markers,
+                 int Marker::*field,
+                 int key) {
+  Bucket::const_iterator it =
+      std::lower_bound(bucket.begin(), bucket.end(), key,
+                       FieldLess(markers, field));
+  if (it == bucket.end() || markers[*it].*field != key) {
+    return -1;
+  }
+  return *it;
+}
 
-void Tracks::Insert(int image, int track, double x, double y) {
-  // TODO(keir): Wow, this is quadratic for repeated insertions. Fix this by
-  // adding a smarter data structure like a set<>.
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].image == image &&
-        markers_[i].track == track) {
-      markers_[i].x = x;
-      markers_[i].y = y;
-      return;
+Bucket *GetBucket(std::vector<Bucket> *buckets, int id) {
+  if (id >= buckets->size()) {
+    buckets->resize(id + 1);
+  }
+  return &(*buckets)[id];
+}
+
+void TrimEmptyBuckets(std::vector<Bucket> *buckets) {
+  while (!buckets->empty() && buckets->back().empty()) {
+    buckets->pop_back();
+  }
+}
+
+MarkerView ViewOfBucket(const vector<Marker> &markers,
+                        const std::vector<Bucket> &buckets,
+                        int id) {
+  if (id < 0 || id >= buckets.size() || buckets[id].empty()) {
+    return MarkerView();
+  }
+  return MarkerView(markers.begin(), &buckets[id][0], buckets[id].size());
+}
+
+vector<Marker> ToVector(const MarkerView &view) {
+  vector<Marker> markers;
+  markers.reserve(view.size());
+  for (int i = 0; i < view.size(); ++i) {
+    markers.push_back(view[i]);
+  }
+  return markers;
+}
+
+// Finds the markers of two views sorted by track that have a common track,
+// and returns their indices in each view.
+void CommonTracks(const MarkerView &markers1,
+                  const MarkerView &markers2,
+                  std::vector<int> *common1,
+                  std::vector<int> *common2) {
+  for (int i = 0, j = 0; i < markers1.size() && j < markers2.size();) {
+    if (markers1[i].track < markers2[j].track) {
+      ++i;
+    } else if (markers2[j].track < markers1[i].track) {
+      ++j;
+    } else {
+      common1->push_back(i++);
+      common2->push_back(j++);
     }
   }
+}
+
+}  // namespace
+
+Tracks::Tracks(const Tracks &other)
+    : markers_(other.markers_),
+      image_markers_(other.image_markers_),
+      track_markers_(other.track_markers_) {}
+
+Tracks::Tracks(const vector<Marker> &markers) {
+  markers_.reserve(markers.size());
+  for (int i = 0; i < markers.size(); ++i) {
+    Insert(markers[i].image, markers[i].track, markers[i].x, markers[i].y);
+  }
+}
+
+void Tracks::Insert(int image, int track, double x, double y) {
+  CHECK_GE(image, 0);
+  CHECK_GE(track, 0);
+  Bucket *track_bucket = GetBucket(&track_markers_, track);
+  Bucket::iterator in_track =
+      Position(track_bucket, markers_, &Marker::image, image);
+  if (in_track != track_bucket->end() && markers_[*in_track].image == image) {
+    markers_[*in_track].x = x;
+    markers_[*in_track].y = y;
+    return;
+  }
+  int index = markers_.size();
   Marker marker = { image, track, x, y };
   markers_.push_back(marker);
+  track_bucket->insert(in_track, index);
+
+  Bucket *image_bucket = GetBucket(&image_markers_, image);
+  image_bucket->insert(Position(image_bucket, markers_, &Marker::track, track),
+                       index);
 }
 
 vector<Marker> Tracks::AllMarkers() const {
@@ -53,113 +160,126 @@ vector<Marker> Tracks::AllMarkers() const {
 }
 
 vector<Marker> Tracks::MarkersInImage(int image) const {
-  vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (image == markers_[i].image) {
-      markers.push_back(markers_[i]);
-    }
-  }
-  return markers;
+  return ToVector(MarkersInImageView(image));
 }
 
 vector<Marker> Tracks::MarkersForTrack(int track) const {
-  vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (track == markers_[i].track) {
-      markers.push_back(markers_[i]);
-    }
-  }
-  return markers;
+  return ToVector(MarkersForTrackView(track));
+}
+
+MarkerView Tracks::AllMarkersView() const {
+  return MarkerView(markers_.begin(), markers_.size());
+}
+
+MarkerView Tracks::MarkersInImageView(int image) const {
+  return ViewOfBucket(markers_, image_markers_, image);
+}
+
+MarkerView Tracks::MarkersForTrackView(int track) const {
+  return ViewOfBucket(markers_, track_markers_, track);
 }
 
 vector<Marker> Tracks::MarkersInBothImages(int image1, int image2) const {
-  vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    int image = markers_[i].image;
-    if (image == image1 || image == image2)
-      markers.push_back(markers_[i]);
+  vector<Marker> markers = MarkersInImage(image1);
+  if (image2 != image1) {
+    MarkerView markers2 = MarkersInImageView(image2);
+    for (int i = 0; i < markers2.size(); ++i) {
+      markers.push_back(markers2[i]);
+    }
   }
   return markers;
 }
 
 vector<Marker> Tracks::MarkersForTracksInBothImages(int image1, int image2) const {
-  std::vector<int> image1_tracks;
-  std::vector<int> image2_tracks;
-
-  for (int i = 0; i < markers_.size(); ++i) {
-    int image = markers_[i].image;
-    if (image == image1) {
-      image1_tracks.push_back(markers_[i].track);
-    } else if (image == image2) {
-      image2_tracks.push_back(markers_[i].track);
-    }
-  }
-
-  std::sort(image1_tracks.begin(), image1_tracks.end());
-  std::sort(image2_tracks.begin(), image2_tracks.end());
-
-  std::vector<int> intersection;
-  std::set_intersection(image1_tracks.begin(), image1_tracks.end(),
-                        image2_tracks.begin(), image2_tracks.end(),
-                        std::back_inserter(intersection));
+  MarkerView markers1 = MarkersInImageView(image1);
+  MarkerView markers2 = MarkersInImageView(image2);
+  std::vector<int> common1, common2;
+  CommonTracks(markers1, markers2, &common1, &common2);
 
   vector<Marker> markers;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if ((markers_[i].image == image1 || markers_[i].image == image2) &&
-        std::binary_search(intersection.begin(),intersection.end(),
-                           markers_[i].track)) {
-      markers.push_back(markers_[i]);
+  markers.reserve(common1.size() + common2.size());
+  for (int i = 0; i < common1.size(); ++i) {
+    markers.push_back(markers1[common1[i]]);
+  }
+  if (image2 != image1) {
+    for (int i = 0; i < common2.size(); ++i) {
+      markers.push_back(markers2[common2[i]]);
     }
   }
   return markers;
 }
 
+int Tracks::Find(int image, int track) const {
+  if (image < 0 || image >= image_markers_.size() ||
+      track < 0 || track >= track_markers_.size()) {
+    return -1;
+  }
+  // Search the smaller of the two buckets.
+  const Bucket &image_bucket = image_markers_[image];
+  const Bucket &track_bucket = track_markers_[track];
+  if (track_bucket.size() <= image_bucket.size()) {
+    return FindInBucket(track_bucket, markers_, &Marker::image, image);
+  }
+  return FindInBucket(image_bucket, markers_, &Marker::track, track);
+}
+
 Marker Tracks::MarkerInImageForTrack(int image, int track) const {
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].image == image && markers_[i].track == track) {
-      return markers_[i];
-    }
+  int index = Find(image, track);
+  if (index >= 0) {
+    return markers_[index];
   }
   Marker null = { -1, -1, -1, -1 };
   return null;
 }
 
+void Tracks::RemoveAt(int index) {
+  const Marker &marker = markers_[index];
+  Bucket &image_bucket = image_markers_[marker.image];
+  image_bucket.erase(Position(&image_bucket, markers_, &Marker::track,
+                              marker.track));
+  Bucket &track_bucket = track_markers_[marker.track];
+  track_bucket.erase(Position(&track_bucket, markers_, &Marker::image,
+                              marker.image));
+
+  // Move the last marker into the hole, and point its entries at it.
+  int last = markers_.size() - 1;
+  if (index != last) {
+    const Marker &moved = markers_[last];
+    *Position(&image_markers_[moved.image], markers_, &Marker::track,
+              moved.track) = index;
+    *Position(&track_markers_[moved.track], markers_, &Marker::image,
+              moved.image) = index;
+    markers_[index] = moved;
+  }
+  markers_.pop_back();
+}
+
 void Tracks::RemoveMarkersForTrack(int track) {
-  int size = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].track != track) {
-      markers_[size++] = markers_[i];
-    }
+  if (track < 0 || track >= track_markers_.size()) {
+    return;
   }
-  markers_.resize(size);
+  while (!track_markers_[track].empty()) {
+    RemoveAt(track_markers_[track].back());
+  }
+  TrimEmptyBuckets(&image_markers_);
+  TrimEmptyBuckets(&track_markers_);
 }
 
 void Tracks::RemoveMarker(int image, int track) {
-  int size = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    if (markers_[i].image != image || markers_[i].track != track) {
-      markers_[size++] = markers_[i];
-    }
+  int index = Find(image, track);
+  if (index >= 0) {
+    RemoveAt(index);
+    TrimEmptyBuckets(&image_markers_);
+    TrimEmptyBuckets(&track_markers_);
   }
-  markers_.resize(size);
 }
 
 int Tracks::MaxImage() const {
-  // TODO(MatthiasF): maintain a max_image_ member (updated on Insert)
-  int max_image = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    max_image = std::max(markers_[i].image, max_image);
-  }
-  return max_image;
+  return std::max(0, static_cast<int>(image_markers_.size()) - 1);
 }
 
 int Tracks::MaxTrack() const {
-  // TODO(MatthiasF): maintain a max_track_ member (updated on Insert)
-  int max_track = 0;
-  for (int i = 0; i < markers_.size(); ++i) {
-    max_track = std::max(markers_[i].track, max_track);
-  }
-  return max_track;
+  return std::max(0, static_cast<int>(track_markers_.size()) - 1);
 }
 
 int Tracks::NumMarkers() const {
@@ -182,4 +302,24 @@ void CoordinatesForMarkersInImage(const vector<Marker> &markers,
   }
 }
 
+void CoordinatesForTracksInBothImages(const Tracks &tracks,
+                                      int image1,
+                                      int image2,
+                                      Mat *coordinates1,
+                                      Mat *coordinates2) {
+  MarkerView markers1 = tracks.MarkersInImageView(image1);
+  MarkerView markers2 = tracks.MarkersInImageView(image2);
+  std::vector<int> common1, common2;
+  CommonTracks(markers1, markers2, &common1, &common2);
+
+  coordinates1->resize(2, common1.size());
+  coordinates2->resize(2, common2.size());
+  for (int i = 0; i < common1.size(); ++i) {
+    const Marker &marker1 = markers1[common1[i]];
+    const Marker &marker2 = markers2[common2[i]];
+    coordinates1->col(i) << marker1.x, marker1.y;
+    coordinates2->col(i) << marker2.x, marker2.y;
+  }
+}
+
 }  // namespace libmv
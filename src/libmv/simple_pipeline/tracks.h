@@ -21,6 +21,10 @@
 #ifndef LIBMV_SIMPLE_PIPELINE_TRACKS_H_
 #define LIBMV_SIMPLE_PIPELINE_TRACKS_H_
 
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
 #include "libmv/base/vector.h"
 #include "libmv/numeric/numeric.h"
 
@@ -43,6 +47,106 @@ struct Marker {
   double x, y;
 };
 
+/*!
+    A read-only view of some of the markers of a \l Tracks object, which refers
+    to the markers where they are stored instead of copying them.
+
+    A view stays valid until the Tracks object it came from is destroyed or
+    modified, except that replacing the coordinates of an existing marker with
+    \l Tracks::Insert() leaves views valid. Views are cheap to copy.
+
+    \sa Tracks
+*/
+class MarkerView {
+ public:
+  class const_iterator {
+   public:
+    typedef std::random_access_iterator_tag iterator_category;
+    typedef Marker value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Marker *pointer;
+    typedef const Marker &reference;
+
+    const_iterator() : markers_(NULL), positions_(NULL), i_(0) {}
+    const_iterator(const Marker *markers, const int *positions, int i)
+        : markers_(markers), positions_(positions), i_(i) {}
+
+    reference operator*() const { return (*this)[0]; }
+    pointer operator->() const { return &(*this)[0]; }
+    reference operator[](difference_type n) const {
+      return positions_ ? markers_[positions_[i_ + n]] : markers_[i_ + n];
+    }
+
+    const_iterator &operator++() { ++i_; return *this; }
+    const_iterator operator++(int) {
+      const_iterator old = *this;
+      ++i_;
+      return old;
+    }
+    const_iterator &operator--() { --i_; return *this; }
+    const_iterator operator--(int) {
+      const_iterator old = *this;
+      --i_;
+      return old;
+    }
+    const_iterator &operator+=(difference_type n) { i_ += n; return *this; }
+    const_iterator &operator-=(difference_type n) { i_ -= n; return *this; }
+    const_iterator operator+(difference_type n) const {
+      return const_iterator(markers_, positions_, i_ + n);
+    }
+    const_iterator operator-(difference_type n) const {
+      return const_iterator(markers_, positions_, i_ - n);
+    }
+    difference_type operator-(const const_iterator &other) const {
+      return i_ - other.i_;
+    }
+
+    bool operator==(const const_iterator &other) const {
+      return i_ == other.i_;
+    }
+    bool operator!=(const const_iterator &other) const {
+      return i_ != other.i_;
+    }
+    bool operator<(const const_iterator &other) const {
+      return i_ < other.i_;
+    }
+
+   private:
+    const Marker *markers_;
+    const int *positions_;
+    int i_;
+  };
+
+  MarkerView() : markers_(NULL), positions_(NULL), size_(0) {}
+
+  /// A view of \a size consecutive markers.
+  MarkerView(const Marker *markers, int size)
+      : markers_(markers), positions_(NULL), size_(size) {}
+
+  /// A view of the markers at \a positions in \a markers.
+  MarkerView(const Marker *markers, const int *positions, int size)
+      : markers_(markers), positions_(positions), size_(size) {}
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const Marker &operator[](int i) const {
+    return positions_ ? markers_[positions_[i]] : markers_[i];
+  }
+
+  const_iterator begin() const {
+    return const_iterator(markers_, positions_, 0);
+  }
+  const_iterator end() const {
+    return const_iterator(markers_, positions_, size_);
+  }
+
+ private:
+  const Marker *markers_;
+  const int *positions_;
+  int size_;
+};
+
 /*!
     The Tracks class stores \link Marker reconstruction markers \endlink.
 
@@ -51,6 +155,14 @@ struct Marker {
 
     The container has several fast lookups for queries typically needed for
     structure from motion algorithms, such as \l MarkersForTracksInBothImages().
+    The markers are indexed both per image (sorted by track) and per track
+    (sorted by image), so the per-image and per-track queries cost in
+    proportion to their result rather than to the number of markers. Inserting
+    the markers of a track in increasing image order, or those of an image in
+    increasing track order, is amortized constant time.
+
+    Image and track identifiers must not be negative. The indices are dense
+    arrays over the identifiers, so keep them reasonably compact.
 
     \sa Marker
 */
@@ -76,15 +188,23 @@ class Tracks {
   */
   void Insert(int image, int track, double x, double y);
 
-  /// Returns all the markers.
+  /// Returns all the markers, in no particular order.
   vector<Marker> AllMarkers() const;
 
-  /// Returns all the markers belonging to a track.
+  /// Returns all the markers belonging to a track, sorted by image.
   vector<Marker> MarkersForTrack(int track) const;
 
-  /// Returns all the markers visible in \a image.
+  /// Returns all the markers visible in \a image, sorted by track.
   vector<Marker> MarkersInImage(int image) const;
 
+  /*!
+      Same as \l AllMarkers(), \l MarkersForTrack() and \l MarkersInImage(),
+      but the markers are not copied; see \l MarkerView.
+  */
+  MarkerView AllMarkersView() const;
+  MarkerView MarkersForTrackView(int track) const;
+  MarkerView MarkersInImageView(int image) const;
+
   /// Returns all the markers visible in \a image1 and \a image2.
   vector<Marker> MarkersInBothImages(int image1, int image2) const;
 
@@ -92,11 +212,16 @@ class Tracks {
       Returns the markers in \a image1 and \a image2 which have a common track.
 
       This is not the same as the union of the markers in \a image1 and \a
-      image2; each marker is for a track that appears in both images.
+      image2; each marker is for a track that appears in both images. The
+      markers of each image are sorted by track, so those of \a image1 and \a
+      image2 correspond one to one, in order.
   */
   vector<Marker> MarkersForTracksInBothImages(int image1, int image2) const;
 
-  /// Returns the marker in \a image belonging to \a track.
+  /*!
+      Returns the marker in \a image belonging to \a track, or a marker with
+      all fields set to -1 if there is none.
+  */
   Marker MarkerInImageForTrack(int image, int track) const;
 
   /// Removes all the markers belonging to \a track.
@@ -115,13 +240,42 @@ class Tracks {
   int NumMarkers() const;
 
  private:
+  // Returns the index in markers_ of the marker, or -1.
+  int Find(int image, int track) const;
+
+  // Removes markers_[index] from the indices and fills its slot with the last
+  // marker.
+  void RemoveAt(int index);
+
+  // The markers are stored in no particular order; the indices below hold
+  // positions in it.
   vector<Marker> markers_;
+
+  // For each image, the positions of its markers sorted by track; for each
+  // track, the positions of its markers sorted by image. Neither has trailing
+  // empty buckets, so their sizes give MaxImage() and MaxTrack().
+  std::vector<std::vector<int> > image_markers_;
+  std::vector<std::vector<int> > track_markers_;
 };
 
 void CoordinatesForMarkersInImage(const vector<Marker> &markers,
                                   int image,
                                   Mat *coordinates);
 
+/*!
+    Returns the coordinates of the markers in \a image1 and \a image2 which
+    have a common track, as the columns of \a coordinates1 and \a
+    coordinates2 in the same order. This is the same as
+    \l CoordinatesForMarkersInImage() of \l
+    Tracks::MarkersForTracksInBothImages() for each image, without copying the
+    markers.
+*/
+void CoordinatesForTracksInBothImages(const Tracks &tracks,
+                                      int image1,
+                                      int image2,
+                                      Mat *coordinates1,
+                                      Mat *coordinates2);
+
 }  // namespace libmv
 
 #endif  // LIBMV_SIMPLE_PIPELINE_MARKERS_H_
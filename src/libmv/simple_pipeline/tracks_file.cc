@@ -0,0 +1,59 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/simple_pipeline/tracks_file.h"
+
+namespace libmv {
+
+bool SaveTracks(const Tracks &tracks,
+                const std::string &filename,
+                bool image_index) {
+  MarkerView view = tracks.AllMarkersView();
+  MarkerColumns markers;
+  markers.Reserve(view.size());
+  for (int i = 0; i < view.size(); ++i) {
+    markers.PushBack(view[i].image, view[i].track, view[i].x, view[i].y);
+  }
+  return WriteMarkerFile(filename, markers, image_index);
+}
+
+void MarkerFileToTracks(const MarkerFile &file, Tracks *tracks) {
+  // The file is sorted by image then track, so every insertion appends to
+  // the indices of tracks.
+  *tracks = Tracks();
+  const int32_t *images = file.images();
+  const int32_t *track_ids = file.tracks();
+  const double *xs = file.xs();
+  const double *ys = file.ys();
+  for (int i = 0; i < file.num_markers(); ++i) {
+    tracks->Insert(images[i], track_ids[i], xs[i], ys[i]);
+  }
+}
+
+bool LoadTracks(const std::string &filename, Tracks *tracks) {
+  MarkerFile file;
+  if (!file.Open(filename)) {
+    return false;
+  }
+  MarkerFileToTracks(file, tracks);
+  return true;
+}
+
+}  // namespace libmv
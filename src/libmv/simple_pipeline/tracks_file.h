@@ -0,0 +1,47 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_SIMPLE_PIPELINE_TRACKS_FILE_H_
+#define LIBMV_SIMPLE_PIPELINE_TRACKS_FILE_H_
+
+#include <string>
+
+#include "libmv/correspondence/marker_file.h"
+#include "libmv/simple_pipeline/tracks.h"
+
+namespace libmv {
+
+// Saves the markers of tracks as a marker file (see marker_file.h), which
+// loads without parsing. Returns false on error.
+bool SaveTracks(const Tracks &tracks,
+                const std::string &filename,
+                bool image_index = true);
+
+// Replaces *tracks with the markers of a marker file. Returns false, leaving
+// tracks alone, if the file cannot be read.
+bool LoadTracks(const std::string &filename, Tracks *tracks);
+
+// Fills tracks from the columns of a mapped marker file. MarkerFile::Open()
+// has checked the ids and the order of the markers.
+void MarkerFileToTracks(const MarkerFile &file, Tracks *tracks);
+
+}  // namespace libmv
+
+#endif  // LIBMV_SIMPLE_PIPELINE_TRACKS_FILE_H_
@@ -0,0 +1,276 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+
+#include "libmv/simple_pipeline/tracks.h"
+#include "libmv/simple_pipeline/tracks_file.h"
+#include "testing/testing.h"
+
+namespace {
+using namespace libmv;
+
+typedef std::map<std::pair<int, int>, std::pair<double, double> > MarkerMap;
+
+// The markers of tracks, sorted by image then track.
+MarkerMap ToMap(const vector<Marker> &markers) {
+  MarkerMap map;
+  for (int i = 0; i < markers.size(); ++i) {
+    std::pair<int, int> key(markers[i].image, markers[i].track);
+    EXPECT_EQ(0, map.count(key));
+    map[key] = std::make_pair(markers[i].x, markers[i].y);
+  }
+  return map;
+}
+
+TEST(Tracks, InsertReplacesAndQueriesAreSorted) {
+  Tracks tracks;
+  tracks.Insert(1, 5, 1.0, 2.0);
+  tracks.Insert(1, 2, 3.0, 4.0);
+  tracks.Insert(0, 5, 5.0, 6.0);
+  tracks.Insert(2, 2, 7.0, 8.0);
+  tracks.Insert(1, 5, 9.0, 10.0);
+  EXPECT_EQ(4, tracks.NumMarkers());
+  EXPECT_EQ(2, tracks.MaxImage());
+  EXPECT_EQ(5, tracks.MaxTrack());
+
+  Marker marker = tracks.MarkerInImageForTrack(1, 5);
+  EXPECT_EQ(9.0, marker.x);
+  EXPECT_EQ(10.0, marker.y);
+  EXPECT_EQ(-1, tracks.MarkerInImageForTrack(0, 2).image);
+  EXPECT_EQ(-1, tracks.MarkerInImageForTrack(7, 5).image);
+
+  vector<Marker> in_image = tracks.MarkersInImage(1);
+  ASSERT_EQ(2, in_image.size());
+  EXPECT_EQ(2, in_image[0].track);
+  EXPECT_EQ(5, in_image[1].track);
+
+  vector<Marker> for_track = tracks.MarkersForTrack(5);
+  ASSERT_EQ(2, for_track.size());
+  EXPECT_EQ(0, for_track[0].image);
+  EXPECT_EQ(1, for_track[1].image);
+
+  EXPECT_EQ(0, tracks.MarkersForTrack(3).size());
+  EXPECT_EQ(0, tracks.MarkersInImage(9).size());
+}
+
+TEST(Tracks, MarkersForTracksInBothImagesCorrespond) {
+  Tracks tracks;
+  // Tracks inserted in a different order in each image.
+  tracks.Insert(0, 3, 0, 0);
+  tracks.Insert(0, 1, 0, 0);
+  tracks.Insert(0, 2, 0, 0);
+  tracks.Insert(1, 2, 0, 0);
+  tracks.Insert(1, 4, 0, 0);
+  tracks.Insert(1, 3, 0, 0);
+
+  vector<Marker> markers = tracks.MarkersForTracksInBothImages(0, 1);
+  ASSERT_EQ(4, markers.size());
+  EXPECT_EQ(0, markers[0].image);
+  EXPECT_EQ(2, markers[0].track);
+  EXPECT_EQ(0, markers[1].image);
+  EXPECT_EQ(3, markers[1].track);
+  EXPECT_EQ(1, markers[2].image);
+  EXPECT_EQ(2, markers[2].track);
+  EXPECT_EQ(1, markers[3].image);
+  EXPECT_EQ(3, markers[3].track);
+
+  EXPECT_EQ(6, tracks.MarkersInBothImages(0, 1).size());
+  EXPECT_EQ(3, tracks.MarkersForTracksInBothImages(0, 0).size());
+}
+
+TEST(Tracks, RemoveMarkers) {
+  Tracks tracks;
+  for (int image = 0; image < 4; ++image) {
+    for (int track = 0; track < 3; ++track) {
+      tracks.Insert(image, track, image, track);
+    }
+  }
+  tracks.RemoveMarker(0, 0);
+  tracks.RemoveMarker(0, 0);
+  EXPECT_EQ(11, tracks.NumMarkers());
+  EXPECT_EQ(-1, tracks.MarkerInImageForTrack(0, 0).image);
+
+  tracks.RemoveMarkersForTrack(2);
+  EXPECT_EQ(7, tracks.NumMarkers());
+  EXPECT_EQ(1, tracks.MaxTrack());
+  EXPECT_EQ(0, tracks.MarkersForTrack(2).size());
+  EXPECT_EQ(1, tracks.MarkersInImage(0).size());
+
+  // The markers that moved to fill the holes are still found.
+  for (int image = 0; image < 4; ++image) {
+    for (int track = 0; track < 2; ++track) {
+      if (image != 0 || track != 0) {
+        Marker marker = tracks.MarkerInImageForTrack(image, track);
+        EXPECT_EQ(image, marker.x);
+        EXPECT_EQ(track, marker.y);
+      }
+    }
+  }
+
+  tracks.RemoveMarker(3, 0);
+  tracks.RemoveMarker(3, 1);
+  EXPECT_EQ(2, tracks.MaxImage());
+}
+
+TEST(Tracks, ViewsMatchTheCopies) {
+  Tracks tracks;
+  for (int image = 0; image < 5; ++image) {
+    for (int track = image % 2; track < 8; track += 2) {
+      tracks.Insert(image, track, image, track);
+    }
+  }
+  MarkerView all = tracks.AllMarkersView();
+  vector<Marker> all_copy = tracks.AllMarkers();
+  ASSERT_EQ(all_copy.size(), all.size());
+  for (int i = 0; i < all.size(); ++i) {
+    EXPECT_EQ(all_copy[i].image, all[i].image);
+    EXPECT_EQ(all_copy[i].track, all[i].track);
+  }
+
+  MarkerView in_image = tracks.MarkersInImageView(2);
+  vector<Marker> in_image_copy = tracks.MarkersInImage(2);
+  ASSERT_EQ(4, in_image.size());
+  int i = 0;
+  for (MarkerView::const_iterator it = in_image.begin();
+       it != in_image.end(); ++it, ++i) {
+    EXPECT_EQ(in_image_copy[i].track, it->track);
+  }
+  EXPECT_EQ(4, in_image.end() - in_image.begin());
+  EXPECT_EQ(6, (in_image.begin() + 3)->track);
+
+  // Replacing coordinates shows through the views.
+  tracks.Insert(2, 4, 10, 20);
+  EXPECT_EQ(10, in_image[2].x);
+  EXPECT_EQ(20, tracks.MarkersForTrackView(4)[1].y);
+
+  EXPECT_TRUE(tracks.MarkersForTrackView(9).empty());
+  EXPECT_TRUE(tracks.MarkersInImageView(-1).empty());
+}
+
+TEST(Tracks, CoordinatesForTracksInBothImages) {
+  Tracks tracks;
+  tracks.Insert(0, 3, 3, 30);
+  tracks.Insert(0, 1, 1, 10);
+  tracks.Insert(0, 2, 2, 20);
+  tracks.Insert(1, 2, 4, 40);
+  tracks.Insert(1, 4, 5, 50);
+  tracks.Insert(1, 3, 6, 60);
+
+  Mat x1, x2;
+  CoordinatesForTracksInBothImages(tracks, 0, 1, &x1, &x2);
+  ASSERT_EQ(2, x1.cols());
+  ASSERT_EQ(2, x2.cols());
+
+  vector<Marker> markers = tracks.MarkersForTracksInBothImages(0, 1);
+  Mat expected1, expected2;
+  CoordinatesForMarkersInImage(markers, 0, &expected1);
+  CoordinatesForMarkersInImage(markers, 1, &expected2);
+  EXPECT_MATRIX_EQ(expected1, x1);
+  EXPECT_MATRIX_EQ(expected2, x2);
+  EXPECT_EQ(2, x1(0, 0));
+  EXPECT_EQ(60, x2(1, 1));
+}
+
+TEST(Tracks, SaveAndLoad) {
+  Tracks tracks;
+  tracks.Insert(2, 1, 0.25, 1.5);
+  tracks.Insert(0, 3, -7, 1e-12);
+  tracks.Insert(2, 0, 3, 4);
+  const char *directory = getenv("TMPDIR");
+  std::string filename =
+      std::string(directory ? directory : "/tmp") + "/tracks.bin";
+  ASSERT_TRUE(SaveTracks(tracks, filename));
+
+  Tracks loaded;
+  loaded.Insert(9, 9, 9, 9);
+  ASSERT_TRUE(LoadTracks(filename, &loaded));
+  EXPECT_TRUE(ToMap(tracks.AllMarkers()) == ToMap(loaded.AllMarkers()));
+  EXPECT_EQ(2, loaded.MaxImage());
+  EXPECT_EQ(3, loaded.MaxTrack());
+  remove(filename.c_str());
+
+  EXPECT_FALSE(LoadTracks(filename, &loaded));
+  EXPECT_EQ(3, loaded.NumMarkers());
+
+  // A negative track would trip the checks of Insert(); the file is refused
+  // instead.
+  ASSERT_TRUE(SaveTracks(tracks, filename));
+  MarkerFileHeader header;
+  FILE *file = fopen(filename.c_str(), "r+b");
+  ASSERT_EQ(1, fread(&header, sizeof(header), 1, file));
+  int32_t track = -1;
+  fseek(file, header.tracks_offset, SEEK_SET);
+  fwrite(&track, sizeof(track), 1, file);
+  fclose(file);
+  EXPECT_FALSE(LoadTracks(filename, &loaded));
+  EXPECT_EQ(3, loaded.NumMarkers());
+  remove(filename.c_str());
+}
+
+// Random inserts and removals, checked against a map.
+TEST(Tracks, MatchesAMapUnderRandomEdits) {
+  srand(5);
+  Tracks tracks;
+  MarkerMap expected;
+  for (int k = 0; k < 5000; ++k) {
+    int image = rand() % 20;
+    int track = rand() % 30;
+    int what = rand() % 10;
+    if (what < 7) {
+      tracks.Insert(image, track, k, -k);
+      expected[std::make_pair(image, track)] = std::make_pair(k, -k);
+    } else if (what < 9) {
+      tracks.RemoveMarker(image, track);
+      expected.erase(std::make_pair(image, track));
+    } else {
+      tracks.RemoveMarkersForTrack(track);
+      for (int i = 0; i < 20; ++i) {
+        expected.erase(std::make_pair(i, track));
+      }
+    }
+  }
+  EXPECT_EQ(expected.size(), tracks.NumMarkers());
+  EXPECT_TRUE(expected == ToMap(tracks.AllMarkers()));
+
+  Tracks copy(tracks.AllMarkers());
+  for (int image = 0; image < 20; ++image) {
+    vector<Marker> markers = tracks.MarkersInImage(image);
+    EXPECT_EQ(markers.size(), copy.MarkersInImage(image).size());
+    for (int i = 0; i < markers.size(); ++i) {
+      EXPECT_EQ(image, markers[i].image);
+      EXPECT_TRUE(i == 0 || markers[i - 1].track < markers[i].track);
+      EXPECT_EQ(1, expected.count(std::make_pair(image, markers[i].track)));
+    }
+  }
+  for (int track = 0; track < 30; ++track) {
+    vector<Marker> markers = tracks.MarkersForTrack(track);
+    for (int i = 0; i < markers.size(); ++i) {
+      EXPECT_EQ(track, markers[i].track);
+      EXPECT_TRUE(i == 0 || markers[i - 1].image < markers[i].image);
+    }
+  }
+}
+
+}  // namespace
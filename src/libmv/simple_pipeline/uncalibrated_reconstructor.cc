@@ -51,14 +51,14 @@ Mat3 NormalizerMatrix(int width, int height) {
 // Normalizes a set of tracks according to the normalizer matrix.
 void TransformTracks(Mat3 transform, const Tracks &tracks,
                      Tracks *normalized_tracks) {
-  vector<Marker> markers = tracks.AllMarkers();
+  *normalized_tracks = tracks;
+  MarkerView markers = tracks.AllMarkersView();
   for (int i = 0; i < markers.size(); ++i) {
     Vec3 a = Vec3(markers[i].x, markers[i].y, 1.0);
     Vec3 b = transform * a;
-    markers[i].x = a(0) / a(2);
-    markers[i].y = a(1) / a(2);
+    normalized_tracks->Insert(markers[i].image, markers[i].track,
+                              a(0) / a(2), a(1) / a(2));
   }
-  *normalized_tracks = Tracks(markers);
 }
 
 UncalibratedReconstructor::UncalibratedReconstructor(int width,
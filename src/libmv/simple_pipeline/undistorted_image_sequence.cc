@@ -0,0 +1,72 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/simple_pipeline/undistorted_image_sequence.h"
+
+namespace libmv {
+namespace {
+
+void Undistort(CameraIntrinsics *intrinsics, const cv::Mat &source,
+               double overscan, cv::Mat *undistorted) {
+  if (source.depth() == CV_8U) {
+    intrinsics->Undistort(source.ptr<unsigned char>(),
+                          undistorted->ptr<unsigned char>(),
+                          source.cols, source.rows, overscan,
+                          source.channels());
+  } else {
+    intrinsics->Undistort(source.ptr<float>(),
+                          undistorted->ptr<float>(),
+                          source.cols, source.rows, overscan,
+                          source.channels());
+  }
+}
+
+}  // namespace
+
+cv::Mat UndistortedImageSequence::Derive(const cv::Mat &image) {
+  cv::Mat source;
+  if (image.depth() == CV_8U) {
+    source = image.isContinuous() ? image : image.clone();
+  } else {
+    image.convertTo(source, CV_32F);
+  }
+  cv::Mat undistorted(source.rows, source.cols, source.type());
+
+  // The first frame of a size builds the lookup grid of its intrinsics while
+  // holding the lock. Later frames of that size only read the grid, so they
+  // are undistorted outside the lock.
+  CameraIntrinsics *intrinsics;
+  {
+    MutexLock lock(&mutex_);
+    std::pair<int, int> size(source.cols, source.rows);
+    std::map<std::pair<int, int>, CameraIntrinsics>::iterator it =
+        intrinsics_by_size_.find(size);
+    if (it == intrinsics_by_size_.end()) {
+      it = intrinsics_by_size_.insert(std::make_pair(size, intrinsics_)).first;
+      Undistort(&it->second, source, overscan_, &undistorted);
+      return undistorted;
+    }
+    intrinsics = &it->second;
+  }
+  Undistort(intrinsics, source, overscan_, &undistorted);
+  return undistorted;
+}
+
+}  // namespace libmv
@@ -0,0 +1,62 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_SIMPLE_PIPELINE_UNDISTORTED_IMAGE_SEQUENCE_H_
+#define LIBMV_SIMPLE_PIPELINE_UNDISTORTED_IMAGE_SEQUENCE_H_
+
+#include <map>
+#include <utility>
+
+#include "libmv/base/thread.h"
+#include "libmv/image/derived_image_sequence.h"
+#include "libmv/simple_pipeline/camera_intrinsics.h"
+
+namespace libmv {
+
+// Frames with the lens distortion of the intrinsics removed, by
+// CameraIntrinsics::Undistort() with the given overscan. 8-bit frames stay
+// 8-bit; others are undistorted as float.
+class UndistortedImageSequence : public DerivedImageSequence {
+ public:
+  UndistortedImageSequence(ImageSequence *source,
+                           const CameraIntrinsics &intrinsics,
+                           double overscan = 0,
+                           ImageCache *cache = NULL)
+      : DerivedImageSequence(source, cache),
+        intrinsics_(intrinsics),
+        overscan_(overscan) {}
+
+ protected:
+  virtual cv::Mat Derive(const cv::Mat &image);
+
+ private:
+  CameraIntrinsics intrinsics_;
+  double overscan_;
+
+  // Intrinsics build their lookup grid on first use, and rebuild it when the
+  // frame size changes, so each frame size gets its own copy. Guards the map;
+  // entries are never removed, so a grid stays valid once built.
+  Mutex mutex_;
+  std::map<std::pair<int, int>, CameraIntrinsics> intrinsics_by_size_;
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_SIMPLE_PIPELINE_UNDISTORTED_IMAGE_SEQUENCE_H_
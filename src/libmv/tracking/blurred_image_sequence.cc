@@ -0,0 +1,39 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/tracking/blurred_image_sequence.h"
+
+#include "libmv/logging/logging.h"
+#include "libmv/tracking/region_tracker.h"
+
+namespace libmv {
+
+cv::Mat BlurredAndDerivativesImageSequence::Derive(const cv::Mat &image) {
+  if (image.type() != CV_32FC1) {
+    LOG(ERROR) << "Blurring needs single channel float frames.";
+    return cv::Mat();
+  }
+  cv::Mat_<float> gray = image;
+  cv::Mat_<cv::Vec3f> blurred_and_derivatives;
+  BlurredImageAndDerivativesChannels(gray, blurred_and_derivatives, sigma_);
+  return blurred_and_derivatives;
+}
+
+}  // namespace libmv
@@ -0,0 +1,48 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_TRACKING_BLURRED_IMAGE_SEQUENCE_H_
+#define LIBMV_TRACKING_BLURRED_IMAGE_SEQUENCE_H_
+
+#include "libmv/image/derived_image_sequence.h"
+
+namespace libmv {
+
+// The output of BlurredImageAndDerivativesChannels() for each frame, as taken
+// by TrackRegionWithGradients(). The source must have single channel float
+// frames, e.g. a FloatImageSequence of a GrayscaleImageSequence; other frames
+// load as empty images.
+class BlurredAndDerivativesImageSequence : public DerivedImageSequence {
+ public:
+  explicit BlurredAndDerivativesImageSequence(ImageSequence *source,
+                                              double sigma = 0,
+                                              ImageCache *cache = NULL)
+      : DerivedImageSequence(source, cache), sigma_(sigma) {}
+
+ protected:
+  virtual cv::Mat Derive(const cv::Mat &image);
+
+ private:
+  double sigma_;
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_TRACKING_BLURRED_IMAGE_SEQUENCE_H_
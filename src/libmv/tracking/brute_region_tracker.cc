@@ -20,7 +20,17 @@
 
 #include "libmv/tracking/brute_region_tracker.h"
 
-#ifdef __SSE2__
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+// GCC and Clang can compile individual functions for AVX2 and check the CPU
+// at run time, so the rest of libmv does not need to be built with -mavx2.
+#define LIBMV_BRUTE_HAVE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__)
 #include <emmintrin.h>
 #endif
 
@@ -202,6 +212,146 @@ int SumOfAbsoluteDifferencesContiguousImage(
 #endif
 }
 
+// The partial SAD is compared against the bound once per this many rows;
+// reducing the SIMD accumulators to a scalar is not free.
+const int kRowsPerBoundCheck = 4;
+
+// Same as SumOfAbsoluteDifferencesContiguousImage(), but gives up once the
+// partial sum reaches bound, in which case the return value is at least bound
+// but otherwise meaningless. Same alignment and padding requirements.
+typedef int (*BoundedSumOfAbsoluteDifferencesFunction)(
+    const unsigned char *pattern,
+    int pattern_width,
+    int pattern_height,
+    int pattern_stride,
+    const unsigned char *image,
+    int image_stride,
+    int bound);
+
+int BoundedSumOfAbsoluteDifferencesScalar(const unsigned char *pattern,
+                                          int pattern_width,
+                                          int pattern_height,
+                                          int pattern_stride,
+                                          const unsigned char *image,
+                                          int image_stride,
+                                          int bound) {
+  int sad = 0;
+  for (int r = 0; r < pattern_height; ++r) {
+    for (int c = 0; c < pattern_width; ++c) {
+      sad += abs(pattern[pattern_stride * r + c] - image[image_stride * r + c]);
+    }
+    if (sad >= bound) {
+      return sad;
+    }
+  }
+  return sad;
+}
+
+#ifdef __SSE2__
+
+// Sum the SAD accumulator lanes; see SumOfAbsoluteDifferencesContiguousSSE().
+inline static int HorizontalSumSSE(__m128i sad) {
+  return _mm_cvtsi128_si32(
+             _mm_add_epi32(sad,
+                 _mm_shuffle_epi32(sad, _MM_SHUFFLE(3, 0, 1, 2))));
+}
+
+int BoundedSumOfAbsoluteDifferencesSSE2(const unsigned char *pattern,
+                                        int pattern_width,
+                                        int pattern_height,
+                                        int pattern_stride,
+                                        const unsigned char *image,
+                                        int image_stride,
+                                        int bound) {
+  __m128i sad = _mm_setzero_si128();
+  for (int r = 0; r < pattern_height; ++r) {
+    sad = SumOfAbsoluteDifferencesContiguousSSE(&pattern[pattern_stride * r],
+                                                &image[image_stride * r],
+                                                pattern_width,
+                                                sad);
+    if ((r + 1) % kRowsPerBoundCheck == 0 && HorizontalSumSSE(sad) >= bound) {
+      return HorizontalSumSSE(sad);
+    }
+  }
+  return HorizontalSumSSE(sad);
+}
+
+#endif  // __SSE2__
+
+#ifdef LIBMV_BRUTE_HAVE_AVX2
+
+// Processes 32 pixels per instruction, with the remainder of each row (which
+// for typical pattern sizes is most of it) handled 16 pixels at a time as in
+// the SSE2 version. The 32-pixel loads are unaligned since the pattern rows
+// are only 16-byte aligned.
+__attribute__((target("avx2")))
+int BoundedSumOfAbsoluteDifferencesAVX2(const unsigned char *pattern,
+                                        int pattern_width,
+                                        int pattern_height,
+                                        int pattern_stride,
+                                        const unsigned char *image,
+                                        int image_stride,
+                                        int bound) {
+  const int num_wide_blocks = pattern_width / 32;
+  const int remainder = pattern_width % 32;
+  __m256i wide_sad = _mm256_setzero_si256();
+  __m128i sad = _mm_setzero_si128();
+  for (int r = 0; r < pattern_height; ++r) {
+    const unsigned char *a = &pattern[pattern_stride * r];
+    const unsigned char *b = &image[image_stride * r];
+    for (int j = 0; j < num_wide_blocks; ++j) {
+      wide_sad = _mm256_add_epi32(wide_sad, _mm256_sad_epu8(
+          _mm256_loadu_si256((const __m256i *)(a + 32 * j)),
+          _mm256_loadu_si256((const __m256i *)(b + 32 * j))));
+    }
+    if (remainder) {
+      sad = SumOfAbsoluteDifferencesContiguousSSE(a + 32 * num_wide_blocks,
+                                                  b + 32 * num_wide_blocks,
+                                                  remainder,
+                                                  sad);
+    }
+    if ((r + 1) % kRowsPerBoundCheck == 0 || r + 1 == pattern_height) {
+      int partial = HorizontalSumSSE(_mm_add_epi32(sad, _mm_add_epi32(
+          _mm256_castsi256_si128(wide_sad),
+          _mm256_extracti128_si256(wide_sad, 1))));
+      if (partial >= bound || r + 1 == pattern_height) {
+        return partial;
+      }
+    }
+  }
+  return 0;  // Only reached for empty patterns.
+}
+
+#endif  // LIBMV_BRUTE_HAVE_AVX2
+
+BoundedSumOfAbsoluteDifferencesFunction
+SelectBoundedSumOfAbsoluteDifferences() {
+#ifdef LIBMV_BRUTE_HAVE_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return BoundedSumOfAbsoluteDifferencesAVX2;
+  }
+#endif
+#ifdef __SSE2__
+  return BoundedSumOfAbsoluteDifferencesSSE2;
+#else
+  return BoundedSumOfAbsoluteDifferencesScalar;
+#endif
+}
+
+int BoundedSumOfAbsoluteDifferences(const unsigned char *pattern,
+                                    int pattern_width,
+                                    int pattern_height,
+                                    int pattern_stride,
+                                    const unsigned char *image,
+                                    int image_stride,
+                                    int bound) {
+  static const BoundedSumOfAbsoluteDifferencesFunction function =
+      SelectBoundedSumOfAbsoluteDifferences();
+  return function(pattern, pattern_width, pattern_height, pattern_stride,
+                  image, image_stride, bound);
+}
+
 // Sample a region of size width, height centered at x,y in image, converting
 // from float to byte in the process. Samples from the first channel. Puts
 // result into *pattern.
@@ -272,6 +422,78 @@ void FloatArrayToByteArrayWithPadding(const cv::Mat_<cv::Vec3f> &float_image,
   }
 }
 
+// Average factor x factor blocks of the width x height byte array src into
+// *dst, which gets rows padded and aligned like SampleSquarePattern() so it can
+// serve both as a pattern and as a search area.
+//
+// NOTE: Caller must free *dst with aligned_malloc() from above.
+void DecimateByteArray(const unsigned char *src,
+                       int src_stride,
+                       int width,
+                       int height,
+                       int factor,
+                       unsigned char **dst,
+                       int *dst_stride) {
+  int dst_width = width / factor;
+  int dst_height = height / factor;
+  *dst_stride = PadToAlignment(dst_width + 16, 16);
+  *dst = static_cast<unsigned char *>(
+      aligned_malloc(*dst_stride * std::max(dst_height, 1), 16));
+  int area = factor * factor;
+  for (int i = 0; i < dst_height; ++i) {
+    for (int j = 0; j < dst_width; ++j) {
+      int sum = 0;
+      for (int r = 0; r < factor; ++r) {
+        const unsigned char *row = src + src_stride * (factor * i + r);
+        for (int c = 0; c < factor; ++c) {
+          sum += row[factor * j + c];
+        }
+      }
+      (*dst)[*dst_stride * i + j] = (sum + area / 2) / area;
+    }
+  }
+}
+
+// A placement of the pattern's top left corner in the search area.
+struct Match {
+  Match(int sad, int i, int j) : sad(sad), i(i), j(j) {}
+  bool operator<(const Match &other) const { return sad < other.sad; }
+  int sad, i, j;
+};
+
+// Try every top left corner in rows [min_i, max_i) and columns [min_j, max_j)
+// of the search area, keeping the num_best lowest SADs in *best, sorted. Any
+// placement that cannot make it into *best is abandoned early.
+void BoundedSearch(const unsigned char *pattern,
+                   int pattern_width,
+                   int pattern_stride,
+                   const unsigned char *search_area,
+                   int search_area_stride,
+                   int min_i, int max_i,
+                   int min_j, int max_j,
+                   int num_best,
+                   std::vector<Match> *best) {
+  for (int i = min_i; i < max_i; ++i) {
+    for (int j = min_j; j < max_j; ++j) {
+      int bound = static_cast<int>(best->size()) < num_best ?
+                  INT_MAX : best->back().sad;
+      int sad = BoundedSumOfAbsoluteDifferences(
+          pattern, pattern_width, pattern_width, pattern_stride,
+          search_area + search_area_stride * i + j, search_area_stride,
+          bound);
+      if (sad >= bound) {
+        continue;
+      }
+      Match match(sad, i, j);
+      best->insert(std::upper_bound(best->begin(), best->end(), match),
+                   match);
+      if (static_cast<int>(best->size()) > num_best) {
+        best->pop_back();
+      }
+    }
+  }
+}
+
 }  // namespace
 
 // TODO(keir): Compare the "sharpness" of the peak around the best pixel. It's
@@ -307,21 +529,112 @@ bool BruteRegionTracker::Track(const cv::Mat_<float> &image1,
   int search_area_stride;
   FloatArrayToByteArrayWithPadding(image_and_gradient2, &search_area, &search_area_stride);
 
-  // Try all possible locations inside the search area. Yes, everywhere.
+  // The top left corners of the pattern to consider are rows [min_i, max_i)
+  // and columns [min_j, max_j) of the search area.
+  int min_i = 0, max_i = image2.rows - pattern_width;
+  int min_j = 0, max_j = image2.cols - pattern_width;
+  if (search_radius > 0) {
+    int center_i = static_cast<int>(floor(y1 + 0.5)) - half_window_size;
+    int center_j = static_cast<int>(floor(x1 + 0.5)) - half_window_size;
+    min_i = std::max(min_i, center_i - search_radius);
+    max_i = std::min(max_i, center_i + search_radius + 1);
+    min_j = std::max(min_j, center_j - search_radius);
+    max_j = std::min(max_j, center_j + search_radius + 1);
+  }
+  if (min_i >= max_i || min_j >= max_j) {
+    LG << "Empty search area; failing.";
+    aligned_free(pattern);
+    aligned_free(search_area);
+    return false;
+  }
+
   int best_i = -1, best_j = -1, best_sad = INT_MAX;
-  for (int i = 0; i < image2.rows - pattern_width; ++i) {
-    for (int j = 0; j < image2.cols - pattern_width; ++j) {
-      int sad = SumOfAbsoluteDifferencesContiguousImage(pattern,
-                                                        pattern_width,
-                                                        pattern_width,
-                                                        pattern_stride,
-                                                        search_area + search_area_stride * i + j,
-                                                        search_area_stride);
-      if (sad < best_sad) {
-        best_i = i;
-        best_j = j;
-        best_sad = sad;
+  if (search_mode == EXHAUSTIVE) {
+    // Try all possible locations inside the search area. Yes, everywhere.
+    for (int i = min_i; i < max_i; ++i) {
+      for (int j = min_j; j < max_j; ++j) {
+        int sad = SumOfAbsoluteDifferencesContiguousImage(pattern,
+                                                          pattern_width,
+                                                          pattern_width,
+                                                          pattern_stride,
+                                                          search_area + search_area_stride * i + j,
+                                                          search_area_stride);
+        if (sad < best_sad) {
+          best_i = i;
+          best_j = j;
+          best_sad = sad;
+        }
+      }
+    }
+  } else {
+    // Don't decimate the pattern to fewer than this many pixels across; the
+    // coarse matches become meaningless.
+    const int kMinimumCoarsePatternWidth = 4;
+    int factor = std::min(decimation,
+                          pattern_width / kMinimumCoarsePatternWidth);
+
+    std::vector<Match> candidates;
+    if (factor > 1) {
+      // Search the decimated images for the most promising placements. The
+      // decimated search area starts at (min_i, min_j), so coarse placement
+      // (i, j) corresponds to (min_i + factor * i, min_j + factor * j).
+      unsigned char *coarse_pattern;
+      int coarse_pattern_stride;
+      DecimateByteArray(pattern, pattern_stride,
+                        pattern_width, pattern_width,
+                        factor,
+                        &coarse_pattern, &coarse_pattern_stride);
+      unsigned char *coarse_search_area;
+      int coarse_search_area_stride;
+      DecimateByteArray(search_area + search_area_stride * min_i + min_j,
+                        search_area_stride,
+                        max_j - min_j - 1 + pattern_width,
+                        max_i - min_i - 1 + pattern_width,
+                        factor,
+                        &coarse_search_area, &coarse_search_area_stride);
+
+      int coarse_pattern_width = pattern_width / factor;
+      std::vector<Match> coarse_matches;
+      BoundedSearch(coarse_pattern,
+                    coarse_pattern_width,
+                    coarse_pattern_stride,
+                    coarse_search_area,
+                    coarse_search_area_stride,
+                    0, (max_i - min_i - 1) / factor + 1,
+                    0, (max_j - min_j - 1) / factor + 1,
+                    std::max(num_candidates, 1),
+                    &coarse_matches);
+      aligned_free(coarse_pattern);
+      aligned_free(coarse_search_area);
+
+      // Refine each coarse match over the full resolution placements it
+      // stands for, plus a margin for the blur of the decimation.
+      for (int k = 0; k < static_cast<int>(coarse_matches.size()); ++k) {
+        int i = min_i + factor * coarse_matches[k].i;
+        int j = min_j + factor * coarse_matches[k].j;
+        BoundedSearch(pattern, pattern_width, pattern_stride,
+                      search_area, search_area_stride,
+                      std::max(min_i, i - factor),
+                      std::min(max_i, i + 2 * factor),
+                      std::max(min_j, j - factor),
+                      std::min(max_j, j + 2 * factor),
+                      1,
+                      &candidates);
       }
+    } else {
+      // The pattern is too small to decimate; search at full resolution,
+      // still with early termination.
+      BoundedSearch(pattern, pattern_width, pattern_stride,
+                    search_area, search_area_stride,
+                    min_i, max_i,
+                    min_j, max_j,
+                    1,
+                    &candidates);
+    }
+    if (!candidates.empty()) {
+      best_i = candidates[0].i;
+      best_j = candidates[0].j;
+      best_sad = candidates[0].sad;
     }
   }
 
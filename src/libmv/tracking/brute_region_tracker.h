@@ -26,9 +26,26 @@
 namespace libmv {
 
 struct BruteRegionTracker : public RegionTracker {
+  enum SearchMode {
+    // Compute the SAD at every placement of the pattern in the search area.
+    // This is the default, and the reference for COARSE_TO_FINE.
+    EXHAUSTIVE,
+
+    // Search a decimated copy of the pattern and search area first, then
+    // refine the best few placements at full resolution. Placements that
+    // cannot beat the best SAD found so far are abandoned part way through.
+    // Much faster on large search areas, but a match that only stands out at
+    // full resolution can be missed, so callers have to ask for it.
+    COARSE_TO_FINE,
+  };
+
   BruteRegionTracker()
       : half_window_size(4),
-      minimum_correlation(0.78) {}
+      minimum_correlation(0.78),
+      search_mode(EXHAUSTIVE),
+      search_radius(0),
+      decimation(4),
+      num_candidates(16) {}
   
   virtual ~BruteRegionTracker() {}
 
@@ -41,6 +58,23 @@ struct BruteRegionTracker : public RegionTracker {
   // No point in creating getters or setters.
   int half_window_size;
   double minimum_correlation;
+
+  SearchMode search_mode;
+
+  // If positive, only consider matches at most this many pixels away from
+  // (x1, y1) in x and y. Otherwise search all of image2.
+  int search_radius;
+
+  // How much COARSE_TO_FINE shrinks the images for the first stage. It is
+  // reduced for small patterns, so that the decimated pattern keeps some
+  // detail; with half_window_size below 4 there is no coarse stage at all.
+  int decimation;
+
+  // How many of the best coarse matches COARSE_TO_FINE refines. The decimated
+  // pattern rarely lines up with the decimated search area, so the true match
+  // need not have one of the very best coarse SADs; too few candidates and
+  // weakly textured patterns lock onto the wrong place.
+  int num_candidates;
 };
 
 }  // namespace libmv
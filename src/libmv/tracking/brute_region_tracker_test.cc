@@ -0,0 +1,89 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <algorithm>
+#include <cmath>
+
+#include "libmv/tracking/brute_region_tracker.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+// Scatter smooth blobs so that every pattern has some unique texture.
+void DrawTexture(double dx, double dy, cv::Mat_<float> *image) {
+  const double kSigma = 3.0;
+  for (int k = 0; k < 40; ++k) {
+    double x = (k * 37) % 190 + 5 + dx;
+    double y = (k * 53) % 150 + 5 + dy;
+    double amplitude = 0.3 + 0.4 * ((k * 13) % 7) / 7.0;
+    for (int r = 0; r < image->rows; ++r) {
+      for (int c = 0; c < image->cols; ++c) {
+        double d2 = (c - x) * (c - x) + (r - y) * (r - y);
+        (*image)(r, c) = std::max((*image)(r, c),
+            static_cast<float>(amplitude * exp(-d2 / (2 * kSigma * kSigma))));
+      }
+    }
+  }
+}
+
+void ExpectTracksLargeMotion(BruteRegionTracker::SearchMode search_mode,
+                             int search_radius) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(160, 200);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(160, 200);
+  const int dx = 37, dy = -23;
+  DrawTexture(0, 0, &image1);
+  DrawTexture(dx, dy, &image2);
+
+  BruteRegionTracker tracker;
+  tracker.half_window_size = 10;
+  tracker.minimum_correlation = 0.0;
+  tracker.search_mode = search_mode;
+  tracker.search_radius = search_radius;
+
+  // Track the centre of pixel (80, 90); the pattern is sampled there, but the
+  // match comes back as the pixel's integer coordinates.
+  const int c1 = 80, r1 = 90;
+  const double x1 = c1 + 0.5, y1 = r1 + 0.5;
+  double x2 = x1, y2 = y1;
+  EXPECT_TRUE(tracker.Track(image1, image2, x1, y1, &x2, &y2));
+  EXPECT_NEAR(c1 + dx, x2, 0.001) << "mode=" << search_mode;
+  EXPECT_NEAR(r1 + dy, y2, 0.001) << "mode=" << search_mode;
+}
+
+TEST(BruteRegionTracker, DefaultsToExhaustiveSearch) {
+  BruteRegionTracker tracker;
+  EXPECT_EQ(BruteRegionTracker::EXHAUSTIVE, tracker.search_mode);
+}
+
+TEST(BruteRegionTracker, ExhaustiveSearch) {
+  ExpectTracksLargeMotion(BruteRegionTracker::EXHAUSTIVE, 0);
+}
+
+TEST(BruteRegionTracker, CoarseToFineSearch) {
+  ExpectTracksLargeMotion(BruteRegionTracker::COARSE_TO_FINE, 0);
+}
+
+TEST(BruteRegionTracker, CoarseToFineSearchWithinRadius) {
+  ExpectTracksLargeMotion(BruteRegionTracker::COARSE_TO_FINE, 50);
+}
+
+}  // namespace
+}  // namespace libmv
@@ -0,0 +1,204 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/tracking/inverse_compositional_region_tracker.h"
+
+#include "libmv/image/correlation.h"
+#include "libmv/image/sample.h"
+#include "libmv/logging/logging.h"
+
+namespace libmv {
+
+// TODO(keir): Reduce duplication between here and the other region trackers.
+static bool RegionIsInBounds(const cv::Mat_<float> &image1,
+                             double x, double y,
+                             int half_window_size) {
+  // Check the minimum coordinates.
+  int min_x = floor(x) - half_window_size - 1;
+  int min_y = floor(y) - half_window_size - 1;
+  if (min_x < 0.0 ||
+      min_y < 0.0) {
+    return false;
+  }
+
+  // Check the maximum coordinates.
+  int max_x = ceil(x) + half_window_size + 1;
+  int max_y = ceil(y) + half_window_size + 1;
+  if (max_x > image1.cols ||
+      max_y > image1.rows) {
+    return false;
+  }
+
+  // Ok, we're good.
+  return true;
+}
+
+void InverseCompositionalRegionTracker::PrepareTemplate(
+    const cv::Mat_<float> &image1,
+    double x1, double y1,
+    Template *result) const {
+  cv::Mat_<cv::Vec3f> image_and_gradient1;
+  BlurredImageAndDerivativesChannels(image1, image_and_gradient1, sigma);
+
+  // Steps 3 to 5 of the algorithm: the template gradient, the Jacobian of the
+  // warp (the identity for translation) and their product, the steepest
+  // descent images. For translation those are all the template gradient.
+  SamplePattern(image_and_gradient1, x1, y1, half_window_size, 3,
+                &result->pattern);
+  result->half_window_size = half_window_size;
+  result->sigma = sigma;
+
+  // Step 6: the Gauss-Newton Hessian of the template.
+  int width = 2 * half_window_size + 1;
+  Mat2 H = Mat2::Zero();
+  for (int r = 0; r < width; ++r) {
+    for (int c = 0; c < width; ++c) {
+      Vec2 g(result->pattern(r, c)[1], result->pattern(r, c)[2]);
+      H += g * g.transpose();
+    }
+  }
+  result->is_trackable = H.determinant() >= min_determinant;
+  if (result->is_trackable) {
+    result->hessian_inverse = H.inverse();
+  } else {
+    LG << "Template Hessian determinant below " << min_determinant
+       << "; the pattern is too flat to track.";
+  }
+}
+
+bool InverseCompositionalRegionTracker::Track(const cv::Mat_<float> &image1,
+                                              const cv::Mat_<float> &image2,
+                                              double  x1, double  y1,
+                                              double *x2, double *y2) const {
+  if (!RegionIsInBounds(image1, x1, y1, half_window_size)) {
+    LG << "Fell out of image1's window with x1=" << x1 << ", y1=" << y1
+       << ", hw=" << half_window_size << ".";
+    return false;
+  }
+  Template reference;
+  PrepareTemplate(image1, x1, y1, &reference);
+  return TrackTemplate(reference, image2, x2, y2);
+}
+
+bool InverseCompositionalRegionTracker::SetReference(
+    const cv::Mat_<float> &image1,
+    double x1, double y1) {
+  reference_ = Template();
+  if (!RegionIsInBounds(image1, x1, y1, half_window_size)) {
+    LG << "Fell out of image1's window with x1=" << x1 << ", y1=" << y1
+       << ", hw=" << half_window_size << ".";
+    return false;
+  }
+  PrepareTemplate(image1, x1, y1, &reference_);
+  return reference_.is_trackable;
+}
+
+bool InverseCompositionalRegionTracker::TrackFromReference(
+    const cv::Mat_<float> &image2,
+    double *x2, double *y2) const {
+  return TrackTemplate(reference_, image2, x2, y2);
+}
+
+bool InverseCompositionalRegionTracker::TrackTemplate(
+    const Template &reference,
+    const cv::Mat_<float> &image2,
+    double *x2, double *y2) const {
+  if (!reference.is_trackable) {
+    return false;
+  }
+  // The window and blur are the ones the template was sampled with.
+  const cv::Mat_<cv::Vec3f> &pattern = reference.pattern;
+  int half_size = reference.half_window_size;
+
+  cv::Mat_<cv::Vec3f> image_and_gradient2;
+  BlurredImageAndDerivativesChannels(image2, image_and_gradient2,
+                                     reference.sigma);
+
+  int width = 2 * half_size + 1;
+  cv::Mat_<cv::Vec3f> warped;
+  for (int i = 0; i < max_iterations; ++i) {
+    // Check that the entire image patch is within the bounds of the images.
+    if (!RegionIsInBounds(image2, *x2, *y2, half_size)) {
+      LG << "Fell out of image2's window with x2=" << *x2 << ", y2=" << *y2
+         << ", hw=" << half_size << ".";
+      return false;
+    }
+
+    // Step 1: Warp I with W(x; p) to compute I(W(x; p)). Only the intensity
+    // is needed; the gradients of image2 are never used.
+    SamplePattern(image_and_gradient2, *x2, *y2, half_size, 1, &warped);
+
+    // Steps 2, 7: the error image, and its projection on the steepest descent
+    // images.
+    Vec2 b = Vec2::Zero();
+    for (int r = 0; r < width; ++r) {
+      for (int c = 0; c < width; ++c) {
+        double e = warped(r, c)[0] - pattern(r, c)[0];
+        b(0) += pattern(r, c)[1] * e;
+        b(1) += pattern(r, c)[2] * e;
+      }
+    }
+
+    // Step 8: dp = H^-1 b, with the precomputed Hessian.
+    Vec2 dp = reference.hessian_inverse * b;
+
+    // Step 9: W(x; p) <-- W(x; p) compose W(x; dp)^-1, which for translation
+    // is a subtraction.
+    *x2 -= dp[0];
+    *y2 -= dp[1];
+    LG << "x=" << *x2 << ", y=" << *y2 << ", dx=" << dp[0]
+       << ", dy=" << dp[1];
+
+    if (dp.squaredNorm() < min_update_squared_distance) {
+      if (minimum_correlation <= 0) {
+        LG << "Successful track in " << (i + 1) << " iterations.";
+        return true;
+      }
+      if (!RegionIsInBounds(image2, *x2, *y2, half_size)) {
+        LG << "Fell out of image2's window with x2=" << *x2
+           << ", y2=" << *y2 << ", hw=" << half_size << ".";
+        return false;
+      }
+      SamplePattern(image_and_gradient2, *x2, *y2, half_size, 1,
+                    &warped);
+
+      // Compute the Pearson product-moment correlation coefficient to check
+      // for sanity.
+      double correlation = PearsonProductMomentCorrelation(pattern, warped,
+                                                           width);
+      LG << "Final correlation: " << correlation;
+
+      // Note: Do the comparison here to handle nan's correctly (since all
+      // comparisons with nan are false).
+      if (minimum_correlation < correlation) {
+        LG << "Successful track in " << (i + 1) << " iterations.";
+        return true;
+      }
+      LG << "Correlation " << correlation << " less than "
+         << minimum_correlation << " or is nan; bailing.";
+      return false;
+    }
+  }
+  // Getting here means we hit max iterations, so tracking failed.
+  LG << "Too many iterations; max is set to " << max_iterations << ".";
+  return false;
+}
+
+}  // namespace libmv
@@ -0,0 +1,108 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_REGION_TRACKING_INVERSE_COMPOSITIONAL_REGION_TRACKER_H_
+#define LIBMV_REGION_TRACKING_INVERSE_COMPOSITIONAL_REGION_TRACKER_H_
+
+#include "libmv/numeric/numeric.h"
+#include "libmv/tracking/region_tracker.h"
+
+namespace libmv {
+
+/*!
+    A translation-only inverse compositional tracker.
+
+    Based on "Lucas-Kanade 20 Years On: A Unifying Framework", section 3.2.
+    Unlike the forward additive trackers (KLT, ESM), the linearization is done
+    on the template instead of on image2, so the steepest descent images and
+    the Gauss-Newton Hessian depend only on the pattern. They are computed once
+    per pattern rather than once per iteration, and each iteration only has to
+    sample the intensities of image2.
+
+    Track() keeps no state between calls. To track from a fixed reference
+    frame into many frames, call SetReference() once and TrackFromReference()
+    for each frame; that skips the blur and sampling of the reference.
+*/
+struct InverseCompositionalRegionTracker : public RegionTracker {
+  InverseCompositionalRegionTracker()
+      : half_window_size(4),
+        max_iterations(16),
+        min_determinant(1e-6),
+        min_update_squared_distance(1e-6),
+        sigma(0.9),
+        minimum_correlation(0.78) {}
+
+  virtual ~InverseCompositionalRegionTracker() {}
+
+  // Tracker interface.
+  virtual bool Track(const cv::Mat_<float> &image1,
+                     const cv::Mat_<float> &image2,
+                     double  x1, double  y1,
+                     double *x2, double *y2) const;
+
+  // Sample the template at (x1, y1) in image1 with the current
+  // half_window_size and sigma, and keep it for TrackFromReference(). The
+  // template is copied out, so image1 may be reused afterwards. Returns false
+  // if the template has too little texture to track.
+  bool SetReference(const cv::Mat_<float> &image1, double x1, double y1);
+
+  // Same as Track() from the image and position given to the last
+  // SetReference(). Does not modify the tracker, so threads may share it.
+  bool TrackFromReference(const cv::Mat_<float> &image2,
+                          double *x2, double *y2) const;
+
+  // No point in creating getters or setters.
+  int half_window_size;
+  int max_iterations;
+  double min_determinant;
+  double min_update_squared_distance;
+  double sigma;
+  double minimum_correlation;
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  // The pattern and its gradient, sampled around a point, and the inverse of
+  // its Gauss-Newton Hessian.
+  struct Template {
+    Template() : half_window_size(-1), sigma(0), is_trackable(false) {}
+
+    int half_window_size;
+    double sigma;
+    cv::Mat_<cv::Vec3f> pattern;
+    Mat2 hessian_inverse;
+    bool is_trackable;
+
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+  };
+
+  void PrepareTemplate(const cv::Mat_<float> &image1,
+                       double x1, double y1,
+                       Template *result) const;
+  bool TrackTemplate(const Template &reference,
+                     const cv::Mat_<float> &image2,
+                     double *x2, double *y2) const;
+
+  Template reference_;
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_REGION_TRACKING_INVERSE_COMPOSITIONAL_REGION_TRACKER_H_
@@ -0,0 +1,113 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cmath>
+
+#include "libmv/tracking/inverse_compositional_region_tracker.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+void DrawBlob(double x, double y, cv::Mat_<float> *image) {
+  const double kSigma = 2.5;
+  for (int r = 0; r < image->rows; ++r) {
+    for (int c = 0; c < image->cols; ++c) {
+      double d2 = (c - x) * (c - x) + (r - y) * (r - y);
+      (*image)(r, c) = exp(-d2 / (2 * kSigma * kSigma));
+    }
+  }
+}
+
+TEST(InverseCompositionalRegionTracker, Track) {
+  cv::Mat_<float> image1(51, 51);
+  cv::Mat_<float> image2(51, 51);
+
+  double x0 = 25, y0 = 25;
+  double dx = 1.6, dy = -1.2;
+  DrawBlob(x0, y0, &image1);
+  DrawBlob(x0 + dx, y0 + dy, &image2);
+
+  double x1 = x0;
+  double y1 = y0;
+
+  InverseCompositionalRegionTracker tracker;
+  tracker.half_window_size = 6;
+  EXPECT_TRUE(tracker.Track(image1, image2, x0, y0, &x1, &y1));
+
+  EXPECT_NEAR(x1, x0 + dx, 0.01);
+  EXPECT_NEAR(y1, y0 + dy, 0.01);
+}
+
+// Refilling the same image buffers in place between calls must not change
+// the results; Track() keeps nothing from earlier calls.
+TEST(InverseCompositionalRegionTracker, TrackBuffersRefilledInPlace) {
+  cv::Mat_<float> image1(51, 51);
+  cv::Mat_<float> image2(51, 51);
+  const unsigned char *data1 = image1.data;
+
+  InverseCompositionalRegionTracker tracker;
+  tracker.half_window_size = 6;
+  for (int i = 0; i < 3; ++i) {
+    double x0 = 22 + 3 * i, y0 = 27 - 2 * i;
+    double dx = 0.5 + 0.3 * i, dy = -0.4 * i;
+    DrawBlob(x0, y0, &image1);
+    DrawBlob(x0 + dx, y0 + dy, &image2);
+    ASSERT_EQ(data1, image1.data);
+
+    double x1 = x0;
+    double y1 = y0;
+    EXPECT_TRUE(tracker.Track(image1, image2, x0, y0, &x1, &y1));
+    EXPECT_NEAR(x1, x0 + dx, 0.01) << "frame " << i;
+    EXPECT_NEAR(y1, y0 + dy, 0.01) << "frame " << i;
+  }
+}
+
+// The reference set with SetReference() is copied out of the image, so the
+// image can be refilled with other frames while tracking from it.
+TEST(InverseCompositionalRegionTracker, TrackFromReference) {
+  cv::Mat_<float> image(51, 51);
+  double x0 = 25, y0 = 25;
+  DrawBlob(x0, y0, &image);
+
+  InverseCompositionalRegionTracker tracker;
+  tracker.half_window_size = 6;
+  ASSERT_TRUE(tracker.SetReference(image, x0, y0));
+  for (int i = 0; i < 3; ++i) {
+    double dx = 0.5 * i, dy = -0.4 * i;
+    DrawBlob(x0 + dx, y0 + dy, &image);
+
+    double x1 = x0;
+    double y1 = y0;
+    EXPECT_TRUE(tracker.TrackFromReference(image, &x1, &y1));
+    EXPECT_NEAR(x1, x0 + dx, 0.01) << "frame " << i;
+    EXPECT_NEAR(y1, y0 + dy, 0.01) << "frame " << i;
+  }
+
+  // A flat reference can't be tracked from.
+  image.setTo(0.5);
+  EXPECT_FALSE(tracker.SetReference(image, x0, y0));
+  double x1 = x0;
+  double y1 = y0;
+  EXPECT_FALSE(tracker.TrackFromReference(image, &x1, &y1));
+}
+
+}  // namespace
+}  // namespace libmv
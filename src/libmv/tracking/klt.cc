@@ -28,6 +28,7 @@
 
 #include "libmv/numeric/numeric.h"
 #include "libmv/image/sample.h"
+#include "libmv/tracking/pyramid_cache.h"
 #include "libmv/tracking/region_tracker.h"
 
 namespace libmv {
@@ -44,10 +45,30 @@ Tracker::Tracker(const cv::Mat_<float> &image1, float x, float y, int half_patte
   sigma(0.9),
   lambda(0.05),
   x1(x),
-  y1(y) {
+  y1(y),
+  cache(NULL),
+  sequence(NULL) {
   MakePyramid(image1, pyramid1);
 }
 
+Tracker::Tracker(PyramidCache *cache, const void *sequence, int frame1, const cv::Mat_<float> &image1, float x, float y, int half_pattern_size, int search_width, int search_height, int num_levels) :
+  half_pattern_size(half_pattern_size),
+  search_width(search_width),
+  search_height(search_height),
+  num_levels(num_levels),
+  max_iterations(16),
+  tolerance(0.2),
+  min_determinant(1e-6),
+  min_update_squared_distance(1e-6),
+  sigma(0.9),
+  lambda(0.05),
+  x1(x),
+  y1(y),
+  cache(cache),
+  sequence(sequence) {
+  MakePyramid(frame1, image1, pyramid1);
+}
+
 void Tracker::MakePyramid(const cv::Mat_<float> &image, std::vector<cv::Mat_<cv::Vec3f> > & pyramid) const {
   pyramid.resize(num_levels);
   BlurredImageAndDerivativesChannels(image, pyramid[0]);
@@ -60,12 +81,31 @@ void Tracker::MakePyramid(const cv::Mat_<float> &image, std::vector<cv::Mat_<cv:
   }
 }
 
+// Same levels as above, built at most once per frame by the cache.
+void Tracker::MakePyramid(int frame, const cv::Mat_<float> &image, std::vector<cv::Mat_<cv::Vec3f> > & pyramid) const {
+  if (!cache) {
+    MakePyramid(image, pyramid);
+    return;
+  }
+  cache->BlurredAndDerivativesLevels(sequence, frame, image, num_levels, 0.0, &pyramid);
+}
+
 bool Tracker::Track(const cv::Mat_<float> &image2, float *x2, float *y2) {
   // Create all the levels of the pyramid, since tracking has to happen from
   // the coarsest to finest levels, which means holding on to all levels of the
   // pyramid at once.
   std::vector<cv::Mat_<cv::Vec3f> > pyramid2;
   MakePyramid(image2, pyramid2);
+  return TrackPyramid(pyramid2, x2, y2);
+}
+
+bool Tracker::Track(int frame2, const cv::Mat_<float> &image2, float *x2, float *y2) {
+  std::vector<cv::Mat_<cv::Vec3f> > pyramid2;
+  MakePyramid(frame2, image2, pyramid2);
+  return TrackPyramid(pyramid2, x2, y2);
+}
+
+bool Tracker::TrackPyramid(const std::vector<cv::Mat_<cv::Vec3f> > &pyramid2, float *x2, float *y2) {
 
   // Shrink the guessed x and y location to match the coarsest level + 1 (which
   // when gets corrected in the loop).
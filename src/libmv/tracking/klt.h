@@ -31,9 +31,11 @@
 
 namespace libmv {
 
+class PyramidCache;
+
 class Tracker {
 public:
-  Tracker() {}
+  Tracker() : cache(NULL), sequence(NULL) {}
   /*!
       Construct a tracker to track the pattern centered in \a image1.
 
@@ -43,6 +45,16 @@ public:
   */
   Tracker(const cv::Mat_<float> &image1, float x, float y, int half_pattern_size,
           int search_width, int search_height, int num_levels);
+  /*!
+      Same as above, but the gradient pyramids are taken from \a cache, keyed
+      as frames of \a sequence; \a image1 is frame \a frame1.
+
+      Use this when tracking many patterns on the same frames, so that the
+      pyramids are built once per frame rather than once per pattern.
+  */
+  Tracker(PyramidCache *cache, const void *sequence, int frame1,
+          const cv::Mat_<float> &image1, float x, float y, int half_pattern_size,
+          int search_width, int search_height, int num_levels);
   /*!
       Track a point from last image to \a image2.
 
@@ -53,9 +65,16 @@ public:
       \a image2 become the "last image" of this tracker.
   */
   bool Track(const cv::Mat_<float> &image2, float *x2, float *y2);
+  /*!
+      Same as above, for trackers constructed with a cache. \a image2 is frame
+      \a frame2 of the sequence given at construction.
+  */
+  bool Track(int frame2, const cv::Mat_<float> &image2, float *x2, float *y2);
 
 private:
   void MakePyramid(const cv::Mat_<float> &image, std::vector<cv::Mat_<cv::Vec3f> > & pyramid) const;
+  void MakePyramid(int frame, const cv::Mat_<float> &image, std::vector<cv::Mat_<cv::Vec3f> > & pyramid) const;
+  bool TrackPyramid(const std::vector<cv::Mat_<cv::Vec3f> > &pyramid2, float *x2, float *y2);
   bool TrackImage(const float* image1, const float* image2, int size, int half_pattern_size,
                   float x1, float y1, float *x2, float *y2) const;
 
@@ -71,6 +90,8 @@ private:
   float lambda;
   std::vector<cv::Mat_<cv::Vec3f> > pyramid1;
   float x1,y1;
+  PyramidCache *cache;
+  const void *sequence;
 };
 
 }  // namespace libmv
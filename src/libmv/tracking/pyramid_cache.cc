@@ -0,0 +1,121 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/tracking/pyramid_cache.h"
+
+#include <functional>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "libmv/tracking/region_tracker.h"
+
+namespace libmv {
+namespace {
+
+int64_t SizeInBytes(const cv::Mat &image) {
+  return image.total() * image.elemSize();
+}
+
+}  // namespace
+
+bool PyramidLevelKey::operator<(const PyramidLevelKey &other) const {
+  if (sequence != other.sequence) {
+    return std::less<const void *>()(sequence, other.sequence);
+  }
+  if (frame != other.frame) {
+    return frame < other.frame;
+  }
+  if (level != other.level) {
+    return level < other.level;
+  }
+  if (channels != other.channels) {
+    return channels < other.channels;
+  }
+  return sigma < other.sigma;
+}
+
+cv::Mat_<float> PyramidCache::Level(const void *sequence, int frame,
+                                    const cv::Mat_<float> &image,
+                                    int level) {
+  if (level == 0) {
+    // Not cached: the caller owns the image and may refill it in place, which
+    // would change a cached reference behind the cache's back.
+    return image;
+  }
+  PyramidLevelKey key(sequence, frame, level, PyramidLevelKey::IMAGE, 0.0);
+  cv::Mat *cached;
+  if (!FetchAndPin(key, &cached)) {
+    // Same reduction as cv::buildPyramid(), one level at a time so that the
+    // coarser levels of a frame reuse the finer ones.
+    cv::Mat_<float> finer = Level(sequence, frame, image, level - 1);
+    cached = new cv::Mat;
+    cv::pyrDown(finer, *cached);
+    StoreAndPinSized(key, cached, SizeInBytes(*cached));
+  }
+  cv::Mat_<float> result = *cached;
+  Unpin(key);
+  return result;
+}
+
+cv::Mat_<cv::Vec3f> PyramidCache::BlurredAndDerivatives(
+    const void *sequence, int frame,
+    const cv::Mat_<float> &image,
+    int level,
+    double sigma) {
+  PyramidLevelKey key(sequence, frame, level,
+                      PyramidLevelKey::BLURRED_AND_DERIVATIVES, sigma);
+  cv::Mat *cached;
+  if (!FetchAndPin(key, &cached)) {
+    cv::Mat_<float> image_level = Level(sequence, frame, image, level);
+    cv::Mat_<cv::Vec3f> blurred_and_derivatives;
+    BlurredImageAndDerivativesChannels(image_level,
+                                       blurred_and_derivatives,
+                                       sigma);
+    cached = new cv::Mat(blurred_and_derivatives);
+    StoreAndPinSized(key, cached, SizeInBytes(*cached));
+  }
+  cv::Mat_<cv::Vec3f> result = *cached;
+  Unpin(key);
+  return result;
+}
+
+void PyramidCache::Levels(const void *sequence, int frame,
+                          const cv::Mat_<float> &image,
+                          int num_levels,
+                          std::vector<cv::Mat_<float> > *levels) {
+  levels->resize(num_levels);
+  for (int i = 0; i < num_levels; ++i) {
+    (*levels)[i] = Level(sequence, frame, image, i);
+  }
+}
+
+void PyramidCache::BlurredAndDerivativesLevels(
+    const void *sequence, int frame,
+    const cv::Mat_<float> &image,
+    int num_levels,
+    double sigma,
+    std::vector<cv::Mat_<cv::Vec3f> > *levels) {
+  levels->resize(num_levels);
+  for (int i = 0; i < num_levels; ++i) {
+    (*levels)[i] = BlurredAndDerivatives(sequence, frame, image, i, sigma);
+  }
+}
+
+}  // namespace libmv
@@ -0,0 +1,109 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_TRACKING_PYRAMID_CACHE_H_
+#define LIBMV_TRACKING_PYRAMID_CACHE_H_
+
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/image/lru_cache.h"
+
+namespace libmv {
+
+// Key for one level of the pyramid of one frame. The sequence is an opaque tag
+// identifying where the frames come from, typically the ImageSequence pointer,
+// as in TaggedImageKey.
+struct PyramidLevelKey {
+  enum Channels {
+    // The plain image level, as produced by cv::buildPyramid().
+    IMAGE,
+
+    // The blurred image level and its derivatives, as produced by
+    // BlurredImageAndDerivativesChannels() with the key's sigma.
+    BLURRED_AND_DERIVATIVES,
+  };
+
+  // LRUCache needs to default construct keys.
+  PyramidLevelKey()
+      : sequence(NULL), frame(0), level(0), channels(IMAGE), sigma(0) {}
+
+  PyramidLevelKey(const void *sequence, int frame, int level,
+                  Channels channels, double sigma)
+      : sequence(sequence), frame(frame), level(level),
+        channels(channels), sigma(sigma) {}
+
+  bool operator<(const PyramidLevelKey &other) const;
+
+  const void *sequence;
+  int frame;
+  int level;
+  Channels channels;
+  double sigma;
+};
+
+// Cache of image pyramids and their derivative channels, shared among the
+// trackers working on the same frames. Without it, every tracked point builds
+// the pyramids of both of its frames again.
+//
+// The returned matrices share their data with the cached ones (cv::Mat is
+// reference counted), so they stay valid after the entry is evicted. Entries
+// are only pinned while they are needed to build the next level.
+//
+// Like LRUCache, this is not thread safe.
+class PyramidCache : public LRUCache<PyramidLevelKey, cv::Mat> {
+ public:
+  typedef LRUCache<PyramidLevelKey, cv::Mat> Base;
+  PyramidCache() : Base(64*1024*1024) {}
+  PyramidCache(int64_t max_cache_size_in_bytes) : Base(max_cache_size_in_bytes) {}
+
+  // Return level "level" of the pyramid of image, which is frame "frame" of
+  // "sequence". Level 0 is image itself, and is never cached. Missing levels
+  // are built from the next finer one with cv::pyrDown().
+  cv::Mat_<float> Level(const void *sequence, int frame,
+                        const cv::Mat_<float> &image,
+                        int level);
+
+  // Return the blurred image and derivatives of level "level" of the pyramid
+  // of image. See BlurredImageAndDerivativesChannels() for sigma.
+  cv::Mat_<cv::Vec3f> BlurredAndDerivatives(const void *sequence, int frame,
+                                            const cv::Mat_<float> &image,
+                                            int level,
+                                            double sigma);
+
+  // Fill levels with the first num_levels levels of the pyramid of image.
+  void Levels(const void *sequence, int frame,
+              const cv::Mat_<float> &image,
+              int num_levels,
+              std::vector<cv::Mat_<float> > *levels);
+
+  // Fill levels with the blurred image and derivatives of the first
+  // num_levels levels of the pyramid of image.
+  void BlurredAndDerivativesLevels(const void *sequence, int frame,
+                                   const cv::Mat_<float> &image,
+                                   int num_levels,
+                                   double sigma,
+                                   std::vector<cv::Mat_<cv::Vec3f> > *levels);
+};
+
+}  // namespace libmv
+
+#endif  // LIBMV_TRACKING_PYRAMID_CACHE_H_
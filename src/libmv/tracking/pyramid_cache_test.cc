@@ -0,0 +1,105 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "libmv/tracking/pyramid_cache.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+cv::Mat_<float> MakeRampImage(int rows, int cols) {
+  cv::Mat_<float> image(rows, cols);
+  for (int r = 0; r < rows; ++r) {
+    for (int c = 0; c < cols; ++c) {
+      image(r, c) = (r * cols + c) / float(rows * cols);
+    }
+  }
+  return image;
+}
+
+TEST(PyramidCache, LevelsMatchBuildPyramid) {
+  cv::Mat_<float> image = MakeRampImage(64, 48);
+  std::vector<cv::Mat_<float> > expected(3);
+  cv::buildPyramid(image, expected, 2);
+
+  PyramidCache cache;
+  int sequence;
+  std::vector<cv::Mat_<float> > levels;
+  cache.Levels(&sequence, 0, image, 3, &levels);
+  ASSERT_EQ(3, levels.size());
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_EQ(expected[i].rows, levels[i].rows);
+    ASSERT_EQ(expected[i].cols, levels[i].cols);
+    EXPECT_EQ(0, cv::norm(expected[i], levels[i], cv::NORM_INF));
+  }
+}
+
+TEST(PyramidCache, LevelsAreBuiltOncePerFrame) {
+  cv::Mat_<float> image1 = MakeRampImage(32, 32);
+  cv::Mat_<float> image2 = MakeRampImage(32, 32);
+
+  PyramidCache cache;
+  int sequence;
+  cv::Mat_<cv::Vec3f> a = cache.BlurredAndDerivatives(&sequence, 0, image1,
+                                                      1, 0.0);
+  cv::Mat_<cv::Vec3f> b = cache.BlurredAndDerivatives(&sequence, 0, image1,
+                                                      1, 0.0);
+  cv::Mat_<cv::Vec3f> c = cache.BlurredAndDerivatives(&sequence, 1, image2,
+                                                      1, 0.0);
+  cv::Mat_<cv::Vec3f> d = cache.BlurredAndDerivatives(&sequence, 0, image1,
+                                                      1, 1.5);
+
+  // The second fetch of the same key shares the data of the first.
+  EXPECT_EQ(a.data, b.data);
+  EXPECT_NE(a.data, c.data);
+  EXPECT_NE(a.data, d.data);
+  EXPECT_TRUE(cache.ContainsKey(PyramidLevelKey(
+      &sequence, 0, 1, PyramidLevelKey::IMAGE, 0.0)));
+}
+
+TEST(PyramidCache, LevelZeroIsNotCached) {
+  cv::Mat_<float> image = MakeRampImage(32, 32);
+
+  PyramidCache cache;
+  const PyramidCache &const_cache = cache;
+  int sequence;
+  cv::Mat_<float> level0 = cache.Level(&sequence, 0, image, 0);
+  EXPECT_EQ(image.data, level0.data);
+  EXPECT_FALSE(cache.ContainsKey(PyramidLevelKey(
+      &sequence, 0, 0, PyramidLevelKey::IMAGE, 0.0)));
+  EXPECT_EQ(0, const_cache.Size());
+
+  // Only the level built by the cache counts.
+  cv::Mat_<float> level1 = cache.Level(&sequence, 0, image, 1);
+  EXPECT_EQ(int64_t(level1.total() * level1.elemSize()), const_cache.Size());
+
+  // Refilling the caller's image does not reach into the cached levels.
+  cv::Mat_<float> level1_before = level1.clone();
+  image.setTo(0.0f);
+  cv::Mat_<float> level1_after = cache.Level(&sequence, 0, image, 1);
+  EXPECT_EQ(0, cv::norm(level1_before, level1_after, cv::NORM_INF));
+}
+
+}  // namespace
+}  // namespace libmv
@@ -23,6 +23,7 @@
 #include <opencv2/imgproc/imgproc.hpp>
 
 #include "libmv/logging/logging.h"
+#include "libmv/tracking/pyramid_cache.h"
 #include "libmv/tracking/pyramid_region_tracker.h"
 
 namespace libmv {
@@ -31,11 +32,6 @@ bool PyramidRegionTracker::Track(const cv::Mat_<float> &image1,
                                  const cv::Mat_<float> &image2,
                                  double  x1, double  y1,
                                  double *x2, double *y2) const {
-  // Shrink the guessed x and y location to match the coarsest level + 1 (which
-  // then gets corrected in the loop).
-  *x2 /= pow(2., num_levels_);
-  *y2 /= pow(2., num_levels_);
-
   // Create all the levels of the pyramid, since tracking has to happen from
   // the coarsest to finest levels, which means holding on to all levels of the
   // pyramid at once.
@@ -44,6 +40,35 @@ bool PyramidRegionTracker::Track(const cv::Mat_<float> &image1,
   cv::buildPyramid(image1, pyramid1, num_levels_ - 1);
   cv::buildPyramid(image2, pyramid2, num_levels_ - 1);
 
+  return TrackPyramids(pyramid1, pyramid2, x1, y1, x2, y2);
+}
+
+bool PyramidRegionTracker::TrackWithCache(PyramidCache *cache,
+                                          const void *sequence,
+                                          int frame1,
+                                          const cv::Mat_<float> &image1,
+                                          int frame2,
+                                          const cv::Mat_<float> &image2,
+                                          double  x1, double  y1,
+                                          double *x2, double *y2) const {
+  std::vector<cv::Mat_<float> > pyramid1;
+  std::vector<cv::Mat_<float> > pyramid2;
+  cache->Levels(sequence, frame1, image1, num_levels_, &pyramid1);
+  cache->Levels(sequence, frame2, image2, num_levels_, &pyramid2);
+
+  return TrackPyramids(pyramid1, pyramid2, x1, y1, x2, y2);
+}
+
+bool PyramidRegionTracker::TrackPyramids(
+    const std::vector<cv::Mat_<float> > &pyramid1,
+    const std::vector<cv::Mat_<float> > &pyramid2,
+    double  x1, double  y1,
+    double *x2, double *y2) const {
+  // Shrink the guessed x and y location to match the coarsest level + 1 (which
+  // then gets corrected in the loop).
+  *x2 /= pow(2., num_levels_);
+  *y2 /= pow(2., num_levels_);
+
   for (int i = num_levels_ - 1; i >= 0; --i) {
     // Position in the first image at pyramid level i.
     double xx = x1 / pow(2., i);
@@ -21,10 +21,14 @@
 #ifndef LIBMV_CORRESPONDENCE_PYRAMID_TRACKER_H_
 #define LIBMV_CORRESPONDENCE_PYRAMID_TRACKER_H_
 
+#include <vector>
+
 #include "libmv/tracking/region_tracker.h"
 
 namespace libmv {
 
+class PyramidCache;
+
 class PyramidRegionTracker : public RegionTracker {
  public:
   PyramidRegionTracker(RegionTracker *tracker, int num_levels)
@@ -34,7 +38,23 @@ class PyramidRegionTracker : public RegionTracker {
                      const cv::Mat_<float> &image2,
                      double  x1, double  y1,
                      double *x2, double *y2) const;
+
+  // Same as Track(), but the pyramids of image1 and image2 are taken from
+  // cache, where they are keyed as frame1 and frame2 of sequence. Use this
+  // when tracking many points between the same frames, so that the pyramids
+  // are built once per frame rather than once per tracked point.
+  bool TrackWithCache(PyramidCache *cache, const void *sequence,
+                      int frame1, const cv::Mat_<float> &image1,
+                      int frame2, const cv::Mat_<float> &image2,
+                      double  x1, double  y1,
+                      double *x2, double *y2) const;
+
  private:
+  bool TrackPyramids(const std::vector<cv::Mat_<float> > &pyramid1,
+                     const std::vector<cv::Mat_<float> > &pyramid2,
+                     double  x1, double  y1,
+                     double *x2, double *y2) const;
+
   cv::Ptr<RegionTracker> tracker_;
   int num_levels_;
 };
@@ -44,16 +44,18 @@ class RegionTracker {
                      double *x2, double *y2) const = 0;
 };
 
-// Compute the gaussian blur of an image and the derivatives of the blurred
-// image, and store the results in three channels. Since the blurred value and
-// gradients are closer in memory, this leads to better performance if all
-// three values are needed at the same time.
+// Blur the image with a 5x5 Gaussian kernel of the given sigma and store the
+// blurred image and its x and y derivatives as the three channels of
+// blurred_and_gradxy. Since the blurred value and gradients are closer in
+// memory, this leads to better performance if all three values are needed at
+// the same time. A sigma of zero lets OpenCV derive it from the kernel size.
 inline void BlurredImageAndDerivativesChannels(const cv::Mat_<cv::Vec3f> &in,
-                                        cv::Mat_<cv::Vec3f> &blurred_and_gradxy) {
+                                        cv::Mat_<cv::Vec3f> &blurred_and_gradxy,
+                                        double sigma = 0) {
   CV_Assert(in.channels() == 1);
 
   std::vector<cv::Mat> channels(3);
-  cv::GaussianBlur(in, channels[0], cv::Size(5,5), 0, 0);
+  cv::GaussianBlur(in, channels[0], cv::Size(5,5), sigma, sigma);
   cv::Sobel(channels[0], channels[1], CV_32F, 1, 0, 3, 1.0/(1 << (3*2-1-0-2)));
   cv::Sobel(channels[0], channels[2], CV_32F, 0, 1, 3, 1.0/(1 << (3*2-0-1-2)));
 
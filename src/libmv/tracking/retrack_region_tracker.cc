@@ -19,11 +19,134 @@
 // IN THE SOFTWARE.
 
 #include <cmath>
+#include <deque>
+#include <map>
 #include <vector>
 
+#include "libmv/base/thread.h"
+#include "libmv/logging/logging.h"
 #include "libmv/tracking/retrack_region_tracker.h"
 
 namespace libmv {
+namespace {
+
+// Track (x2, y2) backward, to get xx1 and yy1 which, if the track is good,
+// should match x1 and y1 (but may not if the track is bad).
+bool TracksBackward(const RegionTracker &tracker,
+                    const cv::Mat_<float> &image1,
+                    const cv::Mat_<float> &image2,
+                    double x1, double y1,
+                    double x2, double y2,
+                    double tolerance) {
+  double xx1 = x2, yy1 = y2;
+  if (!tracker.Track(image2, image1, x2, y2, &xx1, &yy1)) {
+    return false;
+  }
+  double dx = xx1 - x1;
+  double dy = yy1 - y1;
+  return sqrt(dx * dx + dy * dy) < tolerance;
+}
+
+struct BackwardCheck {
+  int ticket;
+  cv::Mat_<float> image1;
+  cv::Mat_<float> image2;
+  double x1, y1;
+  double x2, y2;
+};
+
+}  // namespace
+
+// Runs the queued backward checks in order, and keeps their verdicts until
+// they are collected.
+class RetrackWorker : public Thread {
+ public:
+  RetrackWorker(const RegionTracker *tracker, double tolerance)
+      : tracker_(tracker),
+        tolerance_(tolerance),
+        next_ticket_(1),
+        stop_(false) {}
+
+  int Push(BackwardCheck *check) {
+    MutexLock lock(&mutex_);
+    check->ticket = next_ticket_++;
+    queue_.push_back(*check);
+    work_.Signal();
+    return check->ticket;
+  }
+
+  bool Wait(int ticket) {
+    MutexLock lock(&mutex_);
+    CHECK(ticket > 0 && ticket < next_ticket_)
+        << "Unknown retrack ticket " << ticket;
+    std::map<int, bool>::iterator it;
+    while ((it = verdicts_.find(ticket)) == verdicts_.end()) {
+      done_.Wait(&mutex_);
+    }
+    bool verdict = it->second;
+    verdicts_.erase(it);
+    return verdict;
+  }
+
+  // Pending checks are dropped.
+  void Stop() {
+    {
+      MutexLock lock(&mutex_);
+      stop_ = true;
+      work_.Signal();
+    }
+    Join();
+  }
+
+ protected:
+  virtual void Run() {
+    for (;;) {
+      BackwardCheck check;
+      {
+        MutexLock lock(&mutex_);
+        while (queue_.empty() && !stop_) {
+          work_.Wait(&mutex_);
+        }
+        if (stop_) {
+          return;
+        }
+        check = queue_.front();
+        queue_.pop_front();
+      }
+      bool verdict = TracksBackward(*tracker_,
+                                    check.image1, check.image2,
+                                    check.x1, check.y1,
+                                    check.x2, check.y2,
+                                    tolerance_);
+      MutexLock lock(&mutex_);
+      verdicts_[check.ticket] = verdict;
+      done_.Broadcast();
+    }
+  }
+
+ private:
+  const RegionTracker *tracker_;
+  double tolerance_;
+
+  Mutex mutex_;
+  ConditionVariable work_;
+  ConditionVariable done_;
+  std::deque<BackwardCheck> queue_;
+  std::map<int, bool> verdicts_;
+  int next_ticket_;
+  bool stop_;
+};
+
+RetrackRegionTracker::RetrackRegionTracker(RegionTracker *tracker,
+                                           double tolerance)
+    : tracker_(tracker), tolerance_(tolerance), worker_(NULL) {}
+
+RetrackRegionTracker::~RetrackRegionTracker() {
+  if (worker_ != NULL) {
+    worker_->Stop();
+    delete worker_;
+  }
+}
 
 bool RetrackRegionTracker::Track(const cv::Mat_<float> &image1,
                                  const cv::Mat_<float> &image2,
@@ -33,15 +156,36 @@ bool RetrackRegionTracker::Track(const cv::Mat_<float> &image1,
   if (!tracker_->Track(image1, image2, x1, y1, x2, y2)) {
     return false;
   }
-  // Now track x2 and y2 backward, to get xx1 and yy1 which, if the track is
-  // good, should match x1 and y1 (but may not if the track is bad).
-  double xx1 = *x2, yy1 = *x2;
-  if (!tracker_->Track(image2, image1, *x2, *y2, &xx1, &yy1)) {
-    return false;
+  return TracksBackward(*tracker_, image1, image2, x1, y1, *x2, *y2,
+                        tolerance_);
+}
+
+int RetrackRegionTracker::TrackForward(const cv::Mat_<float> &image1,
+                                       const cv::Mat_<float> &image2,
+                                       double  x1, double  y1,
+                                       double *x2, double *y2) {
+  if (!tracker_->Track(image1, image2, x1, y1, x2, y2)) {
+    return 0;
   }
-  double dx = xx1 - x1;
-  double dy = yy1 - y1;
-  return sqrt(dx * dx + dy * dy) < tolerance_;
+  if (worker_ == NULL) {
+    worker_ = new RetrackWorker(tracker_, tolerance_);
+    if (!worker_->Start()) {
+      LOG(FATAL) << "Couldn't start the retrack worker thread.";
+    }
+  }
+  BackwardCheck check;
+  check.image1 = image1;
+  check.image2 = image2;
+  check.x1 = x1;
+  check.y1 = y1;
+  check.x2 = *x2;
+  check.y2 = *y2;
+  return worker_->Push(&check);
+}
+
+bool RetrackRegionTracker::Verify(int ticket) {
+  CHECK(worker_ != NULL) << "Verify() without TrackForward().";
+  return worker_->Wait(ticket);
 }
 
 }  // namespace libmv
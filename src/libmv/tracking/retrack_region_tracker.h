@@ -25,20 +25,47 @@
 
 namespace libmv {
 
+class RetrackWorker;
+
 // A region tracker that tries tracking backwards and forwards, rejecting a
 // track that doesn't track backwards to the starting point.
+//
+// Track() runs the two passes one after the other. For interactive tracking,
+// TrackForward() returns as soon as the forward pass is done and leaves the
+// backward pass to a worker thread, so that the check costs throughput but not
+// latency; the worker is only started on the first TrackForward(). The wrapped
+// tracker is then called from two threads at once, so its Track() must be
+// safe to call concurrently.
 class RetrackRegionTracker : public RegionTracker {
  public:
-  RetrackRegionTracker(RegionTracker *tracker, double tolerance)
-      : tracker_(tracker), tolerance_(tolerance) {}
+  RetrackRegionTracker(RegionTracker *tracker, double tolerance);
+  virtual ~RetrackRegionTracker();
 
   virtual bool Track(const cv::Mat_<float> &image1,
                      const cv::Mat_<float> &image2,
                      double  x1, double  y1,
                      double *x2, double *y2) const;
+
+  // Track forward into x2, y2 and queue the backward check. Returns a ticket
+  // to pass to Verify(), or 0 if the forward pass failed already. The images
+  // are shared with the worker rather than copied, so they must not be
+  // modified in place until the ticket is verified.
+  int TrackForward(const cv::Mat_<float> &image1,
+                   const cv::Mat_<float> &image2,
+                   double  x1, double  y1,
+                   double *x2, double *y2);
+
+  // Wait for the backward check of a ticket; returns what Track() would have.
+  // Each ticket can be verified once.
+  bool Verify(int ticket);
+
  private:
   cv::Ptr<RegionTracker> tracker_;
   double tolerance_;
+  RetrackWorker *worker_;
+
+  RetrackRegionTracker(const RetrackRegionTracker &);
+  void operator=(const RetrackRegionTracker &);
 };
 
 }  // namespace libmv
@@ -0,0 +1,79 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <cmath>
+
+#include "libmv/tracking/klt_region_tracker.h"
+#include "libmv/tracking/retrack_region_tracker.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+void DrawBlob(double x, double y, double sigma, cv::Mat_<float> *image) {
+  for (int r = 0; r < image->rows; ++r) {
+    for (int c = 0; c < image->cols; ++c) {
+      double dx = c - x;
+      double dy = r - y;
+      (*image)(r, c) += exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+    }
+  }
+}
+
+// The pipelined passes must give the same positions and verdicts as Track(),
+// whatever order the tickets are verified in.
+TEST(RetrackRegionTracker, TrackForwardMatchesTrack) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(80, 80);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(80, 80);
+
+  const double dx = 1.5, dy = -1.0;
+  const double centers[3][2] = { { 20, 25 }, { 55, 30 }, { 40, 60 } };
+  for (int i = 0; i < 3; ++i) {
+    DrawBlob(centers[i][0],      centers[i][1],      2.5, &image1);
+    DrawBlob(centers[i][0] + dx, centers[i][1] + dy, 2.5, &image2);
+  }
+
+  RetrackRegionTracker tracker(new KltRegionTracker, 0.2);
+
+  int tickets[3];
+  double x2[3], y2[3];
+  for (int i = 0; i < 3; ++i) {
+    x2[i] = centers[i][0];
+    y2[i] = centers[i][1];
+    tickets[i] = tracker.TrackForward(image1, image2,
+                                      centers[i][0], centers[i][1],
+                                      &x2[i], &y2[i]);
+  }
+  for (int i = 2; i >= 0; --i) {
+    double x2_expected = centers[i][0];
+    double y2_expected = centers[i][1];
+    bool expected = tracker.Track(image1, image2,
+                                  centers[i][0], centers[i][1],
+                                  &x2_expected, &y2_expected);
+    EXPECT_TRUE(expected);
+    EXPECT_EQ(x2_expected, x2[i]);
+    EXPECT_EQ(y2_expected, y2[i]);
+    ASSERT_NE(0, tickets[i]);
+    EXPECT_EQ(expected, tracker.Verify(tickets[i]));
+  }
+}
+
+}  // namespace
+}  // namespace libmv
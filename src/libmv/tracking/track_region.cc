@@ -32,6 +32,7 @@
 
 #include <Eigen/SVD>
 #include <Eigen/QR>
+#include <algorithm>
 #include <iostream>
 #include "ceres/ceres.h"
 #include "libmv/logging/logging.h"
@@ -131,13 +132,25 @@ TrackRegionOptions::TrackRegionOptions()
       use_esm(true),
       use_brute_initialization(true),
       use_normalized_intensities(false),
+      use_analytic_jacobians(false),
       sigma(0.9),
+      num_pyramid_levels(1),
+      num_sparse_samples(0),
+      sparse_sample_grid_size(1),
       num_extra_points(0),
       regularization_coefficient(0.0),
       minimum_corner_shift_tolerance_pixels(0.005),
       image1_mask(NULL) {
 }
 
+TrackRegionResult::TrackRegionResult()
+    : termination(DID_NOT_RUN),
+      num_iterations(0),
+      num_residual_samples(0),
+      correlation(0),
+      used_brute_translation_initialization(false) {
+}
+
 namespace {
 
 // TODO(keir): Consider adding padding.
@@ -185,6 +198,39 @@ static T SampleWithDerivative(const cv::Mat_<cv::Vec3f> &image_and_gradient,
   return Chain<float, 2, T>::Rule(sample[0], sample + 1, xy);
 }
 
+// Sample a summed-area table, as computed by cv::integral(), at position
+// (x, y), propagating derivatives like SampleWithDerivative(). With pixel
+// centers at +0.5 as in SampleLinear(), entry (r, c) of the table is the
+// integral of the (piecewise constant) image over [0, c] x [0, r], and
+// bilinear interpolation of the table is exact in between.
+template<typename T>
+static T SampleIntegralImage(const cv::Mat_<double> &integral_image,
+                             const T &x,
+                             const T &y) {
+  double scalar_x = std::min(std::max(JetOps<T>::GetScalar(x), 0.0),
+                             integral_image.cols - 1.0);
+  double scalar_y = std::min(std::max(JetOps<T>::GetScalar(y), 0.0),
+                             integral_image.rows - 1.0);
+  int c = std::min(static_cast<int>(scalar_x), integral_image.cols - 2);
+  int r = std::min(static_cast<int>(scalar_y), integral_image.rows - 2);
+  double u = scalar_x - c;
+  double v = scalar_y - r;
+
+  double s00 = integral_image(r, c);
+  double s01 = integral_image(r, c + 1);
+  double s10 = integral_image(r + 1, c);
+  double s11 = integral_image(r + 1, c + 1);
+
+  double sample = (1 - v) * ((1 - u) * s00 + u * s01) +
+                       v  * ((1 - u) * s10 + u * s11);
+  double gradient[2] = {
+    (1 - v) * (s01 - s00) + v * (s11 - s10),
+    (1 - u) * (s10 - s00) + u * (s11 - s01),
+  };
+  T xy[2] = { x, y };
+  return Chain<double, 2, T>::Rule(sample, gradient, xy);
+}
+
 template<typename Warp>
 class TerminationCheckingCallback : public ceres::IterationCallback {
  public:
@@ -263,6 +309,27 @@ class TerminationCheckingCallback : public ceres::IterationCallback {
   double y2_last_successful_[4];
 };
 
+// The number of residuals PixelDifferenceCostFunctor produces for a pattern
+// sampled on a num_samples_x by num_samples_y grid.
+int NumPixelResiduals(const TrackRegionOptions &options,
+                      int num_samples_x,
+                      int num_samples_y) {
+  const int num_pixels = num_samples_x * num_samples_y;
+  if (options.num_sparse_samples <= 0) {
+    return num_pixels;
+  }
+  return std::min(options.num_sparse_samples, num_pixels);
+}
+
+// Orders sample indices by decreasing score.
+struct HigherScore {
+  explicit HigherScore(const std::vector<double> &scores) : scores(&scores) {}
+  bool operator()(int a, int b) const {
+    return (*scores)[a] > (*scores)[b];
+  }
+  const std::vector<double> *scores;
+};
+
 template<typename Warp>
 class PixelDifferenceCostFunctor {
  public:
@@ -272,18 +339,67 @@ class PixelDifferenceCostFunctor {
                              const Mat3 &canonical_to_image1,
                              int num_samples_x,
                              int num_samples_y,
-                             const Warp &warp)
-      : options_(options),
-        image_and_gradient1_(image_and_gradient1),       
-        image_and_gradient2_(image_and_gradient2),       
-        canonical_to_image1_(canonical_to_image1),
-        num_samples_x_(num_samples_x),
+                             const Warp &warp,
+                             const cv::Mat_<double> *integral_image2)
+      : num_samples_x_(num_samples_x),
         num_samples_y_(num_samples_y),
-        warp_(warp),
+        warp_(&warp),
         pattern_and_gradient_(num_samples_y_, num_samples_x_),
         pattern_positions_(num_samples_y_, num_samples_x_),
         pattern_mask_(num_samples_y_, num_samples_x_) {
+    Reset(options,
+          image_and_gradient1,
+          image_and_gradient2,
+          canonical_to_image1,
+          integral_image2);
+  }
+
+  // Switch to a new pattern of the same size, keeping the warp and the
+  // pattern buffers. This lets TrackRegionContext reuse the functor.
+  void Reset(const TrackRegionOptions &options,
+             const cv::Mat_<cv::Vec3f> &image_and_gradient1,
+             const cv::Mat_<cv::Vec3f> &image_and_gradient2,
+             const Mat3 &canonical_to_image1,
+             const cv::Mat_<double> *integral_image2) {
+    options_ = &options;
+    image_and_gradient1_ = &image_and_gradient1;
+    image_and_gradient2_ = &image_and_gradient2;
+    canonical_to_image1_ = canonical_to_image1;
+    integral_image2_ = NULL;
     ComputeCanonicalPatchAndNormalizer();
+    if (options_->use_normalized_intensities && integral_image2 != NULL) {
+      SetupIntegralNormalizer(integral_image2);
+    }
+  }
+
+  // When the pattern samples form an axis-aligned grid in image1 and the warp
+  // keeps it axis-aligned in image2, the mean of the destination samples is
+  // (up to interpolation) the mean over a box, which is four lookups in the
+  // summed-area table instead of a pass over all the samples per evaluation.
+  // Masks weight each sample differently, so they use the sampled mean.
+  void SetupIntegralNormalizer(const cv::Mat_<double> *integral_image2) {
+    if (!Warp::PRESERVES_AXIS_ALIGNED_BOXES ||
+        options_->image1_mask != NULL) {
+      return;
+    }
+    const Mat3 &H = canonical_to_image1_;
+    const double kTolerance = 1e-8 * H.norm();
+    if (std::abs(H(0, 1)) > kTolerance || std::abs(H(1, 0)) > kTolerance ||
+        std::abs(H(2, 0)) > kTolerance || std::abs(H(2, 1)) > kTolerance) {
+      return;
+    }
+    // The samples sit at integer canonical coordinates; the box covers the
+    // half-sample border around them.
+    Vec3 top_left = H * Vec3(-0.5, -0.5, 1.0);
+    Vec3 bottom_right = H * Vec3(num_samples_x_ - 0.5,
+                                 num_samples_y_ - 0.5,
+                                 1.0);
+    box_x0_ = top_left(0) / top_left(2);
+    box_y0_ = top_left(1) / top_left(2);
+    box_x1_ = bottom_right(0) / bottom_right(2);
+    box_y1_ = bottom_right(1) / bottom_right(2);
+    integral_image2_ = integral_image2;
+    src_mean_ = dense_src_mean_;
   }
 
   void ComputeCanonicalPatchAndNormalizer() {
@@ -294,22 +410,22 @@ class PixelDifferenceCostFunctor {
         // Compute the position; cache it.
         Vec3 image_position = canonical_to_image1_ * Vec3(c, r, 1);
         image_position /= image_position(2);
-        pattern_positions_(r, c, 0) = image_position(0);
-        pattern_positions_(r, c, 1) = image_position(1);
+        pattern_positions_(r, c)[0] = image_position(0);
+        pattern_positions_(r, c)[1] = image_position(1);
 
         // Sample the pattern and gradients.
-        SampleLinear(image_and_gradient1_,
+        SampleLinear(*image_and_gradient1_,
                      image_position(1),  // SampleLinear is r, c.
                      image_position(0),
                      &pattern_and_gradient_(r, c)[0]);
 
         // Sample sample the mask.
         double mask_value = 1.0;
-        if (options_.image1_mask != NULL) {
-          SampleLinear(*options_.image1_mask,
-                       image_position(1),  // SampleLinear is r, c.
-                       image_position(0),
-                       &pattern_mask_(r, c));
+        if (options_->image1_mask != NULL) {
+          pattern_mask_(r, c) = SampleLinear(*options_->image1_mask,
+                                             image_position(1),  // r, c.
+                                             image_position(0),
+                                             0);
           mask_value = pattern_mask_(r, c);
         }
         src_mean_ += pattern_and_gradient_(r, c)[0] * mask_value;
@@ -317,11 +433,117 @@ class PixelDifferenceCostFunctor {
       }
     }
     src_mean_ /= num_samples;
+    dense_src_mean_ = src_mean_;
+
+    SelectSamples();
+  }
+
+  // Pick the pattern samples that get a residual. In dense mode that is all
+  // of them, in raster order. In sparse mode it is the num_sparse_samples
+  // with the largest (masked) gradient magnitude, since flat pixels add
+  // nothing to the Jacobian; with a sparse_sample_grid_size above one, each
+  // cell of the grid gets an equal share first so that one strong edge
+  // cannot take all the samples.
+  void SelectSamples() {
+    const int num_pixels = num_samples_x_ * num_samples_y_;
+    const int num_residuals = NumPixelResiduals(*options_,
+                                                num_samples_x_,
+                                                num_samples_y_);
+    samples_.resize(num_pixels);
+    for (int i = 0; i < num_pixels; ++i) {
+      samples_[i] = i;
+    }
+    if (num_residuals == num_pixels) {
+      return;
+    }
+
+    scores_.resize(num_pixels);
+    for (int r = 0; r < num_samples_y_; ++r) {
+      for (int c = 0; c < num_samples_x_; ++c) {
+        const cv::Vec3f &sample = pattern_and_gradient_(r, c);
+        double score = sample[1] * sample[1] + sample[2] * sample[2];
+        if (options_->image1_mask != NULL) {
+          score *= pattern_mask_(r, c);
+        }
+        scores_[r * num_samples_x_ + c] = score;
+      }
+    }
+    HigherScore higher_score(scores_);
+
+    std::vector<int> selected;
+    selected.reserve(num_residuals);
+    is_selected_.assign(num_pixels, false);
+    const int grid_size =
+        std::max(1, std::min(options_->sparse_sample_grid_size,
+                             std::min(num_samples_x_, num_samples_y_)));
+    if (grid_size > 1) {
+      const int quota = num_residuals / (grid_size * grid_size);
+      std::vector<int> cell;
+      for (int cell_y = 0; cell_y < grid_size; ++cell_y) {
+        for (int cell_x = 0; cell_x < grid_size; ++cell_x) {
+          cell.clear();
+          for (int r = cell_y * num_samples_y_ / grid_size;
+               r < (cell_y + 1) * num_samples_y_ / grid_size; ++r) {
+            for (int c = cell_x * num_samples_x_ / grid_size;
+                 c < (cell_x + 1) * num_samples_x_ / grid_size; ++c) {
+              cell.push_back(r * num_samples_x_ + c);
+            }
+          }
+          const int take = std::min(quota, static_cast<int>(cell.size()));
+          std::partial_sort(cell.begin(), cell.begin() + take, cell.end(),
+                            higher_score);
+          for (int i = 0; i < take; ++i) {
+            selected.push_back(cell[i]);
+            is_selected_[cell[i]] = true;
+          }
+        }
+      }
+    }
+
+    // Fill the rest (all of it, without a grid) from the global ranking.
+    const int remaining = num_residuals - static_cast<int>(selected.size());
+    if (remaining > 0) {
+      std::vector<int> candidates;
+      candidates.reserve(num_pixels);
+      for (int i = 0; i < num_pixels; ++i) {
+        if (!is_selected_[i]) {
+          candidates.push_back(i);
+        }
+      }
+      std::partial_sort(candidates.begin(),
+                        candidates.begin() + remaining,
+                        candidates.end(),
+                        higher_score);
+      selected.insert(selected.end(),
+                      candidates.begin(),
+                      candidates.begin() + remaining);
+    }
+
+    // Raster order keeps the image2 accesses roughly sequential.
+    std::sort(selected.begin(), selected.end());
+    samples_.swap(selected);
+
+    // The sampled destination mean only covers the selected samples, so the
+    // source mean has to as well. The summed-area normalizer covers the whole
+    // pattern and keeps the dense source mean; see Reset().
+    double num_samples = 0.0;
+    src_mean_ = 0.0;
+    for (size_t i = 0; i < samples_.size(); ++i) {
+      const int r = samples_[i] / num_samples_x_;
+      const int c = samples_[i] % num_samples_x_;
+      double mask_value = 1.0;
+      if (options_->image1_mask != NULL) {
+        mask_value = pattern_mask_(r, c);
+      }
+      src_mean_ += pattern_and_gradient_(r, c)[0] * mask_value;
+      num_samples += mask_value;
+    }
+    src_mean_ /= num_samples;
   }
 
   template<typename T>
   bool operator()(const T *warp_parameters, T *residuals) const {
-    if (options_.image1_mask != NULL) {
+    if (options_->image1_mask != NULL) {
       VLOG(2) << "Using a mask.";
     }
     for (int i = 0; i < Warp::NUM_PARAMETERS; ++i) {
@@ -329,102 +551,102 @@ class PixelDifferenceCostFunctor {
     }
 
     T dst_mean = T(1.0);
-    if (options_.use_normalized_intensities) {
+    if (options_->use_normalized_intensities) {
       ComputeNormalizingCoefficient(warp_parameters,
                                     &dst_mean);
     }
 
     int cursor = 0;
-    for (int r = 0; r < num_samples_y_; ++r) {
-      for (int c = 0; c < num_samples_x_; ++c) {
-        // Use the pre-computed image1 position.
-        Vec2 image1_position(pattern_positions_(r, c)[0],
-                             pattern_positions_(r, c)[1]);
-
-        // Sample the mask early; if it's zero, this pixel has no effect. This
-        // allows early bailout from the expensive sampling that happens below.
-        //
-        // Note that partial masks are not short circuited. To see why short
-        // circuiting produces bitwise-exact same results, consider that the
-        // residual for each pixel is 
-        //
-        //    residual = mask * (src - dst)  ,
-        //
-        // and for jets, multiplying by a scalar multiplies the derivative
-        // components by the scalar as well. Therefore, if the mask is exactly
-        // zero, then so too will the final residual and derivatives.
-        double mask_value = 1.0;
-        if (options_.image1_mask != NULL) {
-          mask_value = pattern_mask_(r, c);
-          if (mask_value == 0.0) {
-            residuals[cursor++] = T(0.0);
-            continue;
-          }
+    for (size_t i = 0; i < samples_.size(); ++i) {
+      const int r = samples_[i] / num_samples_x_;
+      const int c = samples_[i] % num_samples_x_;
+      // Use the pre-computed image1 position.
+      Vec2 image1_position(pattern_positions_(r, c)[0],
+                           pattern_positions_(r, c)[1]);
+
+      // Sample the mask early; if it's zero, this pixel has no effect. This
+      // allows early bailout from the expensive sampling that happens below.
+      //
+      // Note that partial masks are not short circuited. To see why short
+      // circuiting produces bitwise-exact same results, consider that the
+      // residual for each pixel is 
+      //
+      //    residual = mask * (src - dst)  ,
+      //
+      // and for jets, multiplying by a scalar multiplies the derivative
+      // components by the scalar as well. Therefore, if the mask is exactly
+      // zero, then so too will the final residual and derivatives.
+      double mask_value = 1.0;
+      if (options_->image1_mask != NULL) {
+        mask_value = pattern_mask_(r, c);
+        if (mask_value == 0.0) {
+          residuals[cursor++] = T(0.0);
+          continue;
         }
+      }
 
-        // Compute the location of the destination pixel.
-        T image2_position[2];
-        warp_.Forward(warp_parameters,
-                      T(image1_position[0]),
-                      T(image1_position[1]),
-                      &image2_position[0],
-                      &image2_position[1]);
+      // Compute the location of the destination pixel.
+      T image2_position[2];
+      warp_->Forward(warp_parameters,
+                    T(image1_position[0]),
+                    T(image1_position[1]),
+                    &image2_position[0],
+                    &image2_position[1]);
 
-        // Sample the destination, propagating derivatives.
-        T dst_sample = SampleWithDerivative(image_and_gradient2_,
-                                            image2_position[0],
-                                            image2_position[1]);
-
-        // Sample the source. This is made complicated by ESM mode.
-        T src_sample;
-        if (options_.use_esm && !JetOps<T>::IsScalar()) {
-          // In ESM mode, the derivative of the source is also taken into
-          // account. This changes the linearization in a way that causes
-          // better convergence. Copy the derivative of the warp parameters
-          // onto the jets for the image1 position. This is the ESM hack.
-          T image1_position_jet[2] = {
-            image2_position[0],  // Order is x, y. This matches the
-            image2_position[1]   // derivative order in the patch.
-          };
-          JetOps<T>::SetScalar(image1_position[0], image1_position_jet + 0);
-          JetOps<T>::SetScalar(image1_position[1], image1_position_jet + 1);
-
-          // Now that the image1 positions have the jets applied from the
-          // image2 position (the ESM hack), chain the image gradients to
-          // obtain a sample with the derivative with respect to the warp
-          // parameters attached.
-          src_sample = Chain<float, 2, T>::Rule(pattern_and_gradient_(r, c)[0],
-                                                &pattern_and_gradient_(r, c)[1],
-                                                image1_position_jet);
-
-          // The jacobians for these should be averaged. Due to the subtraction
-          // below, flip the sign of the src derivative so that the effect
-          // after subtraction of the jets is that they are averaged.
-          JetOps<T>::ScaleDerivative(-0.5, &src_sample);
-          JetOps<T>::ScaleDerivative(0.5, &dst_sample);
-        } else {
-          // This is the traditional, forward-mode KLT solution.
-          src_sample = T(pattern_and_gradient_(r, c)[0]);
-        }
+      // Sample the destination, propagating derivatives.
+      T dst_sample = SampleWithDerivative(*image_and_gradient2_,
+                                          image2_position[0],
+                                          image2_position[1]);
+
+      // Sample the source. This is made complicated by ESM mode.
+      T src_sample;
+      if (options_->use_esm && !JetOps<T>::IsScalar()) {
+        // In ESM mode, the derivative of the source is also taken into
+        // account. This changes the linearization in a way that causes
+        // better convergence. Copy the derivative of the warp parameters
+        // onto the jets for the image1 position. This is the ESM hack.
+        T image1_position_jet[2] = {
+          image2_position[0],  // Order is x, y. This matches the
+          image2_position[1]   // derivative order in the patch.
+        };
+        JetOps<T>::SetScalar(image1_position[0], image1_position_jet + 0);
+        JetOps<T>::SetScalar(image1_position[1], image1_position_jet + 1);
+
+        // Now that the image1 positions have the jets applied from the
+        // image2 position (the ESM hack), chain the image gradients to
+        // obtain a sample with the derivative with respect to the warp
+        // parameters attached.
+        src_sample = Chain<float, 2, T>::Rule(pattern_and_gradient_(r, c)[0],
+                                              &pattern_and_gradient_(r, c)[1],
+                                              image1_position_jet);
+
+        // The jacobians for these should be averaged. Due to the subtraction
+        // below, flip the sign of the src derivative so that the effect
+        // after subtraction of the jets is that they are averaged.
+        JetOps<T>::ScaleDerivative(-0.5, &src_sample);
+        JetOps<T>::ScaleDerivative(0.5, &dst_sample);
+      } else {
+        // This is the traditional, forward-mode KLT solution.
+        src_sample = T(pattern_and_gradient_(r, c)[0]);
+      }
 
-        // Normalize the samples by the mean values of each signal. The typical
-        // light model assumes multiplicative intensity changes with changing
-        // light, so this is a reasonable choice. Note that dst_mean has
-        // derivative information attached thanks to autodiff.
-        if (options_.use_normalized_intensities) {
-          src_sample /= T(src_mean_);
-          dst_sample /= dst_mean;
-        }
+      // Normalize the samples by the mean values of each signal. The typical
+      // light model assumes multiplicative intensity changes with changing
+      // light, so this is a reasonable choice. Note that dst_mean has
+      // derivative information attached thanks to autodiff.
+      if (options_->use_normalized_intensities) {
+        src_sample /= T(src_mean_);
+        dst_sample /= dst_mean;
+      }
 
-        // The difference is the error.
-        T error = src_sample - dst_sample;
+      // The difference is the error.
+      T error = src_sample - dst_sample;
 
-        // Weight the error by the mask, if one is present.
-        if (options_.image1_mask != NULL) {
-          error *= T(mask_value);
-        }
-        residuals[cursor++] = error;
+      // Weight the error by the mask, if one is present.
+      if (options_->image1_mask != NULL) {
+        error *= T(mask_value);
       }
+      residuals[cursor++] = error;
     }
     return true;
   }
@@ -433,55 +655,243 @@ class PixelDifferenceCostFunctor {
   template<typename T>
   void ComputeNormalizingCoefficient(const T *warp_parameters,
                                      T *dst_mean) const {
+    if (integral_image2_ != NULL) {
+      ComputeNormalizingCoefficientFromIntegral(warp_parameters, dst_mean);
+      return;
+    }
 
     *dst_mean = T(0.0);
     double num_samples = 0.0;
-    for (int r = 0; r < num_samples_y_; ++r) {
-      for (int c = 0; c < num_samples_x_; ++c) {
-        // Use the pre-computed image1 position.
-        Vec2 image1_position(pattern_positions_(r, c)[0],
-                             pattern_positions_(r, c)[1]);
-        
-        // Sample the mask early; if it's zero, this pixel has no effect. This
-        // allows early bailout from the expensive sampling that happens below.
-        double mask_value = 1.0;
-        if (options_.image1_mask != NULL) {
-          mask_value = pattern_mask_(r, c);
-          if (mask_value == 0.0) {
-            continue;
-          }
+    for (size_t i = 0; i < samples_.size(); ++i) {
+      const int r = samples_[i] / num_samples_x_;
+      const int c = samples_[i] % num_samples_x_;
+      // Use the pre-computed image1 position.
+      Vec2 image1_position(pattern_positions_(r, c)[0],
+                           pattern_positions_(r, c)[1]);
+      
+      // Sample the mask early; if it's zero, this pixel has no effect. This
+      // allows early bailout from the expensive sampling that happens below.
+      double mask_value = 1.0;
+      if (options_->image1_mask != NULL) {
+        mask_value = pattern_mask_(r, c);
+        if (mask_value == 0.0) {
+          continue;
         }
+      }
 
-        // Compute the location of the destination pixel.
-        T image2_position[2];
-        warp_.Forward(warp_parameters,
-                      T(image1_position[0]),
-                      T(image1_position[1]),
-                      &image2_position[0],
-                      &image2_position[1]);
-
+      // Compute the location of the destination pixel.
+      T image2_position[2];
+      warp_->Forward(warp_parameters,
+                    T(image1_position[0]),
+                    T(image1_position[1]),
+                    &image2_position[0],
+                    &image2_position[1]);
 
-        // Sample the destination, propagating derivatives.
-        // TODO(keir): This accumulation can, surprisingly, be done as a
-        // pre-pass by using integral images. This is complicated by the need
-        // to store the jets in the integral image, but it is possible.
-        T dst_sample = SampleWithDerivative(image_and_gradient2_,
-                                            image2_position[0],
-                                            image2_position[1]);
 
-        // Weight the sample by the mask, if one is present.
-        if (options_.image1_mask != NULL) {
-          dst_sample *= T(mask_value);
-        }
+      // Sample the destination, propagating derivatives. For the warps and
+      // patterns where it applies, the integral image pre-pass above avoids
+      // this accumulation entirely.
+      T dst_sample = SampleWithDerivative(*image_and_gradient2_,
+                                          image2_position[0],
+                                          image2_position[1]);
 
-        *dst_mean += dst_sample;
-        num_samples += mask_value;
+      // Weight the sample by the mask, if one is present.
+      if (options_->image1_mask != NULL) {
+        dst_sample *= T(mask_value);
       }
+
+      *dst_mean += dst_sample;
+      num_samples += mask_value;
     }
     *dst_mean /= T(num_samples);
     LG << "Normalization for dst:" << *dst_mean;
   }
 
+  // Mean of image2 over the warped pattern box; see SetupIntegralNormalizer().
+  // The derivatives with respect to the warp come from moving the box edges.
+  template<typename T>
+  void ComputeNormalizingCoefficientFromIntegral(const T *warp_parameters,
+                                                 T *dst_mean) const {
+    T x0, y0, x1, y1;
+    warp_->Forward(warp_parameters, T(box_x0_), T(box_y0_), &x0, &y0);
+    warp_->Forward(warp_parameters, T(box_x1_), T(box_y1_), &x1, &y1);
+    T box_sum = SampleIntegralImage(*integral_image2_, x1, y1) -
+                SampleIntegralImage(*integral_image2_, x0, y1) -
+                SampleIntegralImage(*integral_image2_, x1, y0) +
+                SampleIntegralImage(*integral_image2_, x0, y0);
+    *dst_mean = box_sum / ((x1 - x0) * (y1 - y0));
+  }
+
+  // Same residuals as operator(), but with the derivatives computed from the
+  // warp's analytic Jacobian rather than by carrying jets through every
+  // sample. The jacobian is row major with one row per residual, as Ceres
+  // expects; it may be NULL.
+  bool EvaluateAnalytic(const double *warp_parameters,
+                        double *residuals,
+                        double *jacobian) const {
+    typedef Eigen::Matrix<double, 1, Warp::NUM_PARAMETERS> RowVector;
+    typedef Eigen::Matrix<double, 2, Warp::NUM_PARAMETERS> WarpJacobian;
+
+    double dst_mean = 1.0;
+    RowVector dst_mean_derivative = RowVector::Zero();
+    if (options_->use_normalized_intensities) {
+      ComputeNormalizingCoefficientAnalytic(warp_parameters,
+                                            &dst_mean,
+                                            &dst_mean_derivative);
+    }
+
+    int cursor = 0;
+    for (size_t i = 0; i < samples_.size(); ++i, ++cursor) {
+      const int r = samples_[i] / num_samples_x_;
+      const int c = samples_[i] % num_samples_x_;
+      // Use the pre-computed image1 position.
+      Vec2 image1_position(pattern_positions_(r, c)[0],
+                           pattern_positions_(r, c)[1]);
+
+      // See operator() for why zero masks can be short circuited.
+      double mask_value = 1.0;
+      if (options_->image1_mask != NULL) {
+        mask_value = pattern_mask_(r, c);
+        if (mask_value == 0.0) {
+          residuals[cursor] = 0.0;
+          if (jacobian != NULL) {
+            RowVector::Map(jacobian + cursor * Warp::NUM_PARAMETERS) =
+                RowVector::Zero();
+          }
+          continue;
+        }
+      }
+
+      // Compute the location of the destination pixel.
+      double image2_position[2];
+      warp_->Forward(warp_parameters,
+                    image1_position[0],
+                    image1_position[1],
+                    &image2_position[0],
+                    &image2_position[1]);
+
+      // Sample the destination; with the gradient only if it is needed.
+      float dst_sample[3];
+      if (jacobian == NULL) {
+        dst_sample[0] = SampleLinear(*image_and_gradient2_,
+                                     image2_position[1],  // r, c.
+                                     image2_position[0],
+                                     0);
+      } else {
+        SampleLinear(*image_and_gradient2_,
+                     image2_position[1],  // r, c.
+                     image2_position[0],
+                     dst_sample);
+      }
+      double dst = dst_sample[0];
+      double src = pattern_and_gradient_(r, c)[0];
+
+      RowVector dst_derivative = RowVector::Zero();
+      RowVector src_derivative = RowVector::Zero();
+      if (jacobian != NULL) {
+        // Chain the image gradient with the derivative of the warp.
+        WarpJacobian warp_jacobian;
+        warp_->Jacobian(warp_parameters,
+                       image1_position[0],
+                       image1_position[1],
+                       &warp_jacobian);
+        dst_derivative = Vec2(dst_sample[1], dst_sample[2]).transpose() *
+                         warp_jacobian;
+        if (options_->use_esm) {
+          // The ESM hack; see operator(). The source gradient is chained
+          // with the same warp Jacobian, and the two are averaged.
+          src_derivative = Vec2(pattern_and_gradient_(r, c)[1],
+                                pattern_and_gradient_(r, c)[2]).transpose() *
+                           warp_jacobian;
+          src_derivative *= -0.5;
+          dst_derivative *= 0.5;
+        }
+      }
+
+      // Normalize the samples by the mean values of each signal; the
+      // derivative of dst / dst_mean follows from the quotient rule.
+      if (options_->use_normalized_intensities) {
+        src /= src_mean_;
+        src_derivative /= src_mean_;
+        dst_derivative = dst_derivative / dst_mean -
+            dst * dst_mean_derivative / (dst_mean * dst_mean);
+        dst /= dst_mean;
+      }
+
+      // The difference is the error, weighted by the mask.
+      residuals[cursor] = mask_value * (src - dst);
+      if (jacobian != NULL) {
+        RowVector::Map(jacobian + cursor * Warp::NUM_PARAMETERS) =
+            mask_value * (src_derivative - dst_derivative);
+      }
+    }
+    return true;
+  }
+
+  // Analytic version of ComputeNormalizingCoefficient().
+  void ComputeNormalizingCoefficientAnalytic(
+      const double *warp_parameters,
+      double *dst_mean,
+      Eigen::Matrix<double, 1, Warp::NUM_PARAMETERS> *dst_mean_derivative)
+      const {
+    if (integral_image2_ != NULL) {
+      // Only four table lookups; autodiff is as cheap as anything here.
+      typedef ceres::Jet<double, Warp::NUM_PARAMETERS> JetT;
+      JetT parameters[Warp::NUM_PARAMETERS];
+      for (int i = 0; i < Warp::NUM_PARAMETERS; ++i) {
+        parameters[i] = JetT(warp_parameters[i], i);
+      }
+      JetT mean;
+      ComputeNormalizingCoefficientFromIntegral(parameters, &mean);
+      *dst_mean = mean.a;
+      *dst_mean_derivative = mean.v.transpose();
+      return;
+    }
+
+    Eigen::Matrix<double, 2, Warp::NUM_PARAMETERS> warp_jacobian;
+    *dst_mean = 0.0;
+    dst_mean_derivative->setZero();
+    double num_samples = 0.0;
+    for (size_t i = 0; i < samples_.size(); ++i) {
+      const int r = samples_[i] / num_samples_x_;
+      const int c = samples_[i] % num_samples_x_;
+      Vec2 image1_position(pattern_positions_(r, c)[0],
+                           pattern_positions_(r, c)[1]);
+
+      double mask_value = 1.0;
+      if (options_->image1_mask != NULL) {
+        mask_value = pattern_mask_(r, c);
+        if (mask_value == 0.0) {
+          continue;
+        }
+      }
+
+      double image2_position[2];
+      warp_->Forward(warp_parameters,
+                    image1_position[0],
+                    image1_position[1],
+                    &image2_position[0],
+                    &image2_position[1]);
+
+      float dst_sample[3];
+      SampleLinear(*image_and_gradient2_,
+                   image2_position[1],  // SampleLinear is r, c.
+                   image2_position[0],
+                   dst_sample);
+      warp_->Jacobian(warp_parameters,
+                     image1_position[0],
+                     image1_position[1],
+                     &warp_jacobian);
+
+      *dst_mean += mask_value * dst_sample[0];
+      *dst_mean_derivative += mask_value *
+          Vec2(dst_sample[1], dst_sample[2]).transpose() * warp_jacobian;
+      num_samples += mask_value;
+    }
+    *dst_mean /= num_samples;
+    *dst_mean_derivative /= num_samples;
+  }
+
  // TODO(keir): Consider also computing the cost here.
  double PearsonProductMomentCorrelationCoefficient(
      const double *warp_parameters) const {
@@ -505,7 +915,7 @@ class PixelDifferenceCostFunctor {
                              pattern_positions_(r, c)[1]);
         
         double mask_value = 1.0;
-        if (options_.image1_mask != NULL) {
+        if (options_->image1_mask != NULL) {
           mask_value = pattern_mask_(r, c);
           if (mask_value == 0.0) {
             continue;
@@ -514,19 +924,19 @@ class PixelDifferenceCostFunctor {
 
         // Compute the location of the destination pixel.
         double image2_position[2];
-        warp_.Forward(warp_parameters,
+        warp_->Forward(warp_parameters,
                       image1_position[0],
                       image1_position[1],
                       &image2_position[0],
                       &image2_position[1]);
 
         double x = pattern_and_gradient_(r, c)[0];
-        double y = SampleLinear(image_and_gradient2_,
+        double y = SampleLinear(*image_and_gradient2_,
                                 image2_position[1],  // SampleLinear is r, c.
                                 image2_position[0]);
 
         // Weight the signals by the mask, if one is present.
-        if (options_.image1_mask != NULL) {
+        if (options_->image1_mask != NULL) {
           x *= mask_value;
           y *= mask_value;
           num_samples += mask_value;
@@ -559,15 +969,31 @@ class PixelDifferenceCostFunctor {
   }
 
  private:
-  const TrackRegionOptions &options_;
-  const cv::Mat_<cv::Vec3f> &image_and_gradient1_;
-  const cv::Mat_<cv::Vec3f> &image_and_gradient2_;
-  const Mat3 &canonical_to_image1_;
+  const TrackRegionOptions *options_;
+  const cv::Mat_<cv::Vec3f> *image_and_gradient1_;
+  const cv::Mat_<cv::Vec3f> *image_and_gradient2_;
+  Mat3 canonical_to_image1_;
   int num_samples_x_;
   int num_samples_y_;
-  const Warp &warp_;
+  const Warp *warp_;
   double src_mean_;
-  cv::Mat_<cv::Vec2f> pattern_and_gradient_;
+
+  // Mean over all the pattern samples, whichever ones get residuals.
+  double dense_src_mean_;
+
+  // Indices (r * num_samples_x_ + c) of the samples that get a residual; see
+  // SelectSamples(). The scores and flags are scratch space for it.
+  std::vector<int> samples_;
+  std::vector<double> scores_;
+  std::vector<bool> is_selected_;
+
+  // Summed-area table of the image2 intensities, and the pattern box in
+  // image1, when the normalizer uses them. NULL otherwise.
+  const cv::Mat_<double> *integral_image2_;
+  double box_x0_, box_y0_;
+  double box_x1_, box_y1_;
+
+  cv::Mat_<cv::Vec3f> pattern_and_gradient_;
 
   // This contains the position from where the cached pattern samples were
   // taken from. This is also used to warp from src to dest without going from
@@ -577,6 +1003,35 @@ class PixelDifferenceCostFunctor {
   cv::Mat_<float> pattern_mask_;
 };
 
+// Adapts PixelDifferenceCostFunctor::EvaluateAnalytic() to the Ceres cost
+// function interface. Takes ownership of the functor, like
+// AutoDiffCostFunction does.
+template<typename Warp>
+class AnalyticPixelDifferenceCostFunction : public ceres::CostFunction {
+ public:
+  AnalyticPixelDifferenceCostFunction(PixelDifferenceCostFunctor<Warp> *functor,
+                                      int num_residuals)
+      : functor_(functor) {
+    set_num_residuals(num_residuals);
+    mutable_parameter_block_sizes()->push_back(Warp::NUM_PARAMETERS);
+  }
+
+  virtual ~AnalyticPixelDifferenceCostFunction() {
+    delete functor_;
+  }
+
+  virtual bool Evaluate(double const* const* parameters,
+                        double* residuals,
+                        double** jacobians) const {
+    return functor_->EvaluateAnalytic(parameters[0],
+                                      residuals,
+                                      jacobians ? jacobians[0] : NULL);
+  }
+
+ private:
+  PixelDifferenceCostFunctor<Warp> *functor_;
+};
+
 template<typename Warp>
 class WarpRegularizingCostFunctor {
  public:
@@ -586,12 +1041,22 @@ class WarpRegularizingCostFunctor {
                               const double *x2_original,
                               const double *y2_original,
                               const Warp &warp)
-      : options_(options),
-        x1_(x1),
-        y1_(y1),
-        x2_original_(x2_original),
-        y2_original_(y2_original),
-        warp_(warp) {
+      : warp_(&warp) {
+    Reset(options, x1, y1, x2_original, y2_original);
+  }
+
+  // Switch to a new quad, keeping the warp; see PixelDifferenceCostFunctor.
+  void Reset(const TrackRegionOptions &options,
+             const double *x1,
+             const double *y1,
+             const double *x2_original,
+             const double *y2_original) {
+    options_ = &options;
+    x1_ = x1;
+    y1_ = y1;
+    x2_original_ = x2_original;
+    y2_original_ = y2_original;
+
     // Compute the centroid of the first guess quad.
     // TODO(keir): Use Quad class here.
     original_centroid_[0] = 0.0;
@@ -610,7 +1075,7 @@ class WarpRegularizingCostFunctor {
     for (int i = 0; i < 4; ++i) {
       T image1_position[2] = { T(x1_[i]), T(y1_[i]) };
       T image2_position[2];
-      warp_.Forward(warp_parameters,
+      warp_->Forward(warp_parameters,
                     T(x1_[i]),
                     T(y1_[i]),
                     &image2_position[0],
@@ -635,19 +1100,19 @@ class WarpRegularizingCostFunctor {
 
     // Reweight the residuals.
     for (int i = 0; i < 8; ++i) {
-      residuals[i] *= T(options_.regularization_coefficient);
+      residuals[i] *= T(options_->regularization_coefficient);
     }
 
     return true;
   }
 
-  const TrackRegionOptions &options_;
+  const TrackRegionOptions *options_;
   const double *x1_;
   const double *y1_;
   const double *x2_original_;
   const double *y2_original_;
   double original_centroid_[2];
-  const Warp &warp_;
+  const Warp *warp_;
 };
 
 // Compute the warp from rectangular coordinates, where one corner is the
@@ -721,8 +1186,20 @@ struct TranslationWarp {
     *y2 = y1 + warp_parameters[1];
   }
 
+  // The derivative of the warped point (x2, y2) with respect to the warp
+  // parameters, for use in place of autodiff. See use_analytic_jacobians.
+  void Jacobian(const double *warp_parameters,
+                double x1, double y1,
+                Eigen::Matrix<double, 2, 2> *jacobian) const {
+    *jacobian << 1, 0,
+                 0, 1;
+  }
+
   // Translation x, translation y.
   enum { NUM_PARAMETERS = 2 };
+
+  // Axis-aligned rectangles stay axis-aligned rectangles under this warp.
+  enum { PRESERVES_AXIS_ALIGNED_BOXES = 1 };
   double parameters[NUM_PARAMETERS];
 };
 
@@ -765,8 +1242,20 @@ struct TranslationScaleWarp {
     *y2 = y1_scaled + warp_parameters[1];
   }
 
+  void Jacobian(const double *warp_parameters,
+                double x1, double y1,
+                Eigen::Matrix<double, 2, 3> *jacobian) const {
+    const double x1_origin = x1 - q1.Centroid()(0);
+    const double y1_origin = y1 - q1.Centroid()(1);
+    *jacobian << 1, 0, x1_origin,
+                 0, 1, y1_origin;
+  }
+
   // Translation x, translation y, scale.
   enum { NUM_PARAMETERS = 3 };
+
+  // Axis-aligned rectangles stay axis-aligned rectangles under this warp.
+  enum { PRESERVES_AXIS_ALIGNED_BOXES = 1 };
   double parameters[NUM_PARAMETERS];
 
   Quad q1;
@@ -837,8 +1326,21 @@ struct TranslationRotationWarp {
     *y2 = y1_rotated + warp_parameters[1];
   }
 
+  void Jacobian(const double *warp_parameters,
+                double x1, double y1,
+                Eigen::Matrix<double, 2, 3> *jacobian) const {
+    const double x1_origin = x1 - q1.Centroid()(0);
+    const double y1_origin = y1 - q1.Centroid()(1);
+    const double costheta = cos(warp_parameters[2]);
+    const double sintheta = sin(warp_parameters[2]);
+    *jacobian << 1, 0, -sintheta * x1_origin - costheta * y1_origin,
+                 0, 1,  costheta * x1_origin - sintheta * y1_origin;
+  }
+
   // Translation x, translation y, rotation about the center of Q1 degrees.
   enum { NUM_PARAMETERS = 3 };
+
+  enum { PRESERVES_AXIS_ALIGNED_BOXES = 0 };
   double parameters[NUM_PARAMETERS];
 
   Quad q1;
@@ -910,9 +1412,25 @@ struct TranslationRotationScaleWarp {
     *y2 = y1_rotated_scaled + warp_parameters[1];
   }
 
+  void Jacobian(const double *warp_parameters,
+                double x1, double y1,
+                Eigen::Matrix<double, 2, 4> *jacobian) const {
+    const double x1_origin = x1 - q1.Centroid()(0);
+    const double y1_origin = y1 - q1.Centroid()(1);
+    const double costheta = cos(warp_parameters[3]);
+    const double sintheta = sin(warp_parameters[3]);
+    const double x1_rotated = costheta * x1_origin - sintheta * y1_origin;
+    const double y1_rotated = sintheta * x1_origin + costheta * y1_origin;
+    const double scale = 1.0 + warp_parameters[2];
+    *jacobian << 1, 0, x1_rotated, -scale * y1_rotated,
+                 0, 1, y1_rotated,  scale * x1_rotated;
+  }
+
   // Translation x, translation y, rotation about the center of Q1 degrees,
   // scale.
   enum { NUM_PARAMETERS = 4 };
+
+  enum { PRESERVES_AXIS_ALIGNED_BOXES = 0 };
   double parameters[NUM_PARAMETERS];
 
   Quad q1;
@@ -974,9 +1492,20 @@ struct AffineWarp {
     *y2 = y1_affine + p[1];
   }
 
+  void Jacobian(const double *p,
+                double x1, double y1,
+                Eigen::Matrix<double, 2, 6> *jacobian) const {
+    const double x1_origin = x1 - q1.Centroid()(0);
+    const double y1_origin = y1 - q1.Centroid()(1);
+    *jacobian << 1, 0, x1_origin, y1_origin,         0,         0,
+                 0, 1,         0,         0, x1_origin, y1_origin;
+  }
+
   // Translation x, translation y, rotation about the center of Q1 degrees,
   // scale.
   enum { NUM_PARAMETERS = 6 };
+
+  enum { PRESERVES_AXIS_ALIGNED_BOXES = 0 };
   double parameters[NUM_PARAMETERS];
 
   Quad q1;
@@ -1023,7 +1552,22 @@ struct HomographyWarp {
     *y2 = yy2 / zz2;
   }
 
+  static void Jacobian(const double *p,
+                       double x1, double y1,
+                       Eigen::Matrix<double, 2, 8> *jacobian) {
+    const double xx2 = (1.0 + p[0]) * x1 +     p[1]     * y1 + p[2];
+    const double yy2 =     p[3]     * x1 + (1.0 + p[4]) * y1 + p[5];
+    const double zz2 =     p[6]     * x1 +     p[7]     * y1 + 1.0;
+    const double x2 = xx2 / zz2;
+    const double y2 = yy2 / zz2;
+    *jacobian << x1, y1, 1,  0,  0, 0, -x2 * x1, -x2 * y1,
+                  0,  0, 0, x1, y1, 1, -y2 * x1, -y2 * y1;
+    *jacobian /= zz2;
+  }
+
   enum { NUM_PARAMETERS = 8 };
+
+  enum { PRESERVES_AXIS_ALIGNED_BOXES = 0 };
   double parameters[NUM_PARAMETERS];
 };
 
@@ -1273,13 +1817,198 @@ bool BruteTranslationOnlyInitialize(const cv::Mat_<cv::Vec3f> &image1,
 
 }  // namespace
 
+// The part of a TrackRegionContext for one warp model.
+class TrackRegionSolverBase {
+ public:
+  virtual ~TrackRegionSolverBase() {}
+};
+
+namespace {
+
+// The Ceres problem of TemplatedTrackRegion(), along with the warp whose
+// parameters it optimizes and the cost functions with their pattern buffers.
+// Reset() points all of it at a new marker, and only rebuilds the problem if
+// its shape changed.
+template<typename Warp>
+class TrackRegionSolver : public TrackRegionSolverBase {
+ public:
+  explicit TrackRegionSolver(const Warp &warp)
+      : warp_(warp),
+        num_samples_x_(0),
+        num_samples_y_(0),
+        num_residuals_(0),
+        use_analytic_jacobians_(false),
+        use_regularization_(false),
+        problem_(NULL),
+        pixel_difference_(NULL),
+        pixel_difference_cost_(NULL),
+        regularizing_cost_(NULL),
+        regularizing_(NULL) {}
+
+  virtual ~TrackRegionSolver() {
+    Clear();
+  }
+
+  // Returns the warp to optimize, set to initial_warp.
+  Warp *Reset(const TrackRegionOptions &options,
+              const cv::Mat_<cv::Vec3f> &image_and_gradient1,
+              const cv::Mat_<cv::Vec3f> &image_and_gradient2,
+              const cv::Mat_<double> *integral_image2,
+              const Mat3 &canonical_homography,
+              int num_samples_x,
+              int num_samples_y,
+              const Warp &initial_warp,
+              const double *x1, const double *y1,
+              const double *x2_original, const double *y2_original) {
+    warp_ = initial_warp;
+
+    bool use_regularization = options.regularization_coefficient != 0.0;
+    int num_residuals = NumPixelResiduals(options,
+                                          num_samples_x,
+                                          num_samples_y);
+    if (problem_ != NULL &&
+        num_samples_x == num_samples_x_ &&
+        num_samples_y == num_samples_y_ &&
+        num_residuals == num_residuals_ &&
+        options.use_analytic_jacobians == use_analytic_jacobians_ &&
+        use_regularization == use_regularization_) {
+      pixel_difference_->Reset(options,
+                               image_and_gradient1,
+                               image_and_gradient2,
+                               canonical_homography,
+                               integral_image2);
+      if (regularizing_ != NULL) {
+        regularizing_->Reset(options, x1, y1, x2_original, y2_original);
+      }
+      return &warp_;
+    }
+
+    Clear();
+    num_samples_x_ = num_samples_x;
+    num_samples_y_ = num_samples_y;
+    num_residuals_ = num_residuals;
+    use_analytic_jacobians_ = options.use_analytic_jacobians;
+    use_regularization_ = use_regularization;
+
+    // The problem does not take ownership of the cost functions so they can
+    // outlive it; the cost functions own their functors.
+    ceres::Problem::Options problem_options;
+    problem_options.cost_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+    problem_ = new ceres::Problem(problem_options);
+
+    // Construct the warp cost function.
+    pixel_difference_ =
+        new PixelDifferenceCostFunctor<Warp>(options,
+                                             image_and_gradient1,
+                                             image_and_gradient2,
+                                             canonical_homography,
+                                             num_samples_x,
+                                             num_samples_y,
+                                             warp_,
+                                             integral_image2);
+    if (options.use_analytic_jacobians) {
+      pixel_difference_cost_ =
+          new AnalyticPixelDifferenceCostFunction<Warp>(
+              pixel_difference_,
+              num_residuals);
+    } else {
+      pixel_difference_cost_ =
+          new ceres::AutoDiffCostFunction<
+              PixelDifferenceCostFunctor<Warp>,
+              ceres::DYNAMIC,
+              Warp::NUM_PARAMETERS>(pixel_difference_, num_residuals);
+    }
+    problem_->AddResidualBlock(pixel_difference_cost_, NULL, warp_.parameters);
+
+    // Construct the regularizing cost function
+    if (use_regularization) {
+      regularizing_ = new WarpRegularizingCostFunctor<Warp>(options,
+                                                            x1, y1,
+                                                            x2_original,
+                                                            y2_original,
+                                                            warp_);
+      regularizing_cost_ =
+          new ceres::AutoDiffCostFunction<
+              WarpRegularizingCostFunctor<Warp>,
+              8 /* num_residuals */,
+              Warp::NUM_PARAMETERS>(regularizing_);
+      problem_->AddResidualBlock(regularizing_cost_, NULL, warp_.parameters);
+    }
+    return &warp_;
+  }
+
+  ceres::Problem *problem() { return problem_; }
+  PixelDifferenceCostFunctor<Warp> *pixel_difference() {
+    return pixel_difference_;
+  }
+
+  EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+ private:
+  void Clear() {
+    delete problem_;
+    delete pixel_difference_cost_;
+    delete regularizing_cost_;
+    problem_ = NULL;
+    pixel_difference_ = NULL;
+    pixel_difference_cost_ = NULL;
+    regularizing_ = NULL;
+    regularizing_cost_ = NULL;
+  }
+
+  // The problem refers to the parameters of this warp, so it lives as long as
+  // the solver.
+  Warp warp_;
+
+  // The shape of the current problem.
+  int num_samples_x_;
+  int num_samples_y_;
+  int num_residuals_;
+  bool use_analytic_jacobians_;
+  bool use_regularization_;
+
+  ceres::Problem *problem_;
+  PixelDifferenceCostFunctor<Warp> *pixel_difference_;
+  ceres::CostFunction *pixel_difference_cost_;
+  ceres::CostFunction *regularizing_cost_;
+  WarpRegularizingCostFunctor<Warp> *regularizing_;
+};
+
+}  // namespace
+
+TrackRegionContext::TrackRegionContext() {}
+
+TrackRegionContext::~TrackRegionContext() {
+  for (size_t i = 0; i < solvers_.size(); ++i) {
+    delete solvers_[i];
+  }
+}
+
+TrackRegionSolverBase **TrackRegionContextSolver(
+    TrackRegionContext *context, int level, TrackRegionOptions::Mode mode) {
+  const int kNumModes = TrackRegionOptions::HOMOGRAPHY + 1;
+  size_t index = level * kNumModes + mode;
+  if (index >= context->solvers_.size()) {
+    context->solvers_.resize((level + 1) * kNumModes, NULL);
+  }
+  return &context->solvers_[index];
+}
+
+// The image_and_gradient arguments must be the output of
+// BlurredImageAndDerivativesChannels() for image1 and image2; they are passed
+// in rather than computed here so that TrackRegions() can share them among
+// all the markers of a frame pair.
 template<typename Warp>
 void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
                           const cv::Mat_<cv::Vec3f> &image2,
+                          const cv::Mat_<cv::Vec3f> &image_and_gradient1,
+                          const cv::Mat_<cv::Vec3f> &image_and_gradient2,
+                          const cv::Mat_<double> *integral_image2,
                           const double *x1, const double *y1,
                           const TrackRegionOptions &options,
                           double *x2, double *y2,
-                          TrackRegionResult *result) {
+                          TrackRegionResult *result,
+                          TrackRegionSolverBase **context_solver) {
   for (int i = 0; i < 4; ++i) {
     LG << "P" << i << ": (" << x1[i] << ", " << y1[i] << "); guess ("
        << x2[i] << ", " << y2[i] << "); (dx, dy): (" << (x2[i] - x1[i]) << ", "
@@ -1288,6 +2017,7 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
   if (options.use_normalized_intensities) {
     LG << "Using normalized intensities.";
   }
+  result->used_brute_translation_initialization = false;
 
   // Bail early if the points are already outside.
   if (!AllInBounds(image1, x1, y1)) {
@@ -1308,12 +2038,6 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
     y2_original[i] = y2[i];
   }
 
-  // Prepare the image and gradient.
-  cv::Mat_<cv::Vec3f> image_and_gradient1;
-  cv::Mat_<cv::Vec3f> image_and_gradient2;
-  BlurredImageAndDerivativesChannels(image1, image_and_gradient1);
-  BlurredImageAndDerivativesChannels(image2, image_and_gradient2);
-
   // Possibly do a brute-force translation-only initialization.
   if (SearchAreaTooBigForDescent(image2, x2, y2) &&
       options.use_brute_initialization) {
@@ -1331,6 +2055,7 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
       result->termination = TrackRegionResult::INSUFFICIENT_PATTERN_AREA;
       return;
     }
+    result->used_brute_translation_initialization = true;
     for (int i = 0; i < 4; ++i) {
       LG << "P" << i << ": (" << x1[i] << ", " << y1[i] << "); brute ("
          << x2[i] << ", " << y2[i] << "); (dx, dy): (" << (x2[i] - x1[i])
@@ -1341,7 +2066,7 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
   // Prepare the initial warp parameters from the four correspondences.
   // Note: This must happen after the brute initialization runs, since the
   // brute initialization mutates x2 and y2 in place.
-  Warp warp(x1, y1, x2, y2);
+  Warp initial_warp(x1, y1, x2, y2);
 
   // Decide how many samples to use in the x and y dimensions.
   int num_samples_x;
@@ -1354,43 +2079,27 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
                                                          num_samples_x,
                                                          num_samples_y);
 
-  ceres::Problem problem;
-
-  // Construct the warp cost function. AutoDiffCostFunction takes ownership.
-  PixelDifferenceCostFunctor<Warp> *pixel_difference_cost_function =
-      new PixelDifferenceCostFunctor<Warp>(options,
-                                           image_and_gradient1,
-                                           image_and_gradient2,
-                                           canonical_homography,
-                                           num_samples_x,
-                                           num_samples_y,
-                                           warp);
-   problem.AddResidualBlock(
-       new ceres::AutoDiffCostFunction<
-           PixelDifferenceCostFunctor<Warp>,
-           ceres::DYNAMIC,
-           Warp::NUM_PARAMETERS>(pixel_difference_cost_function,
-                                 num_samples_x * num_samples_y),
-       NULL,
-       warp.parameters);
-
-  // Construct the regularizing cost function
-  if (options.regularization_coefficient != 0.0) {
-    WarpRegularizingCostFunctor<Warp> *regularizing_warp_cost_function =
-        new WarpRegularizingCostFunctor<Warp>(options,
-                                              x1, y2,
-                                              x2_original,
-                                              y2_original,
-                                              warp);
-
-    problem.AddResidualBlock(
-        new ceres::AutoDiffCostFunction<
-            WarpRegularizingCostFunctor<Warp>,
-            8 /* num_residuals */,
-            Warp::NUM_PARAMETERS>(regularizing_warp_cost_function),
-        NULL,
-        warp.parameters);
+  // Set up the problem, reusing the one in the context if there is one.
+  TrackRegionSolver<Warp> local_solver(initial_warp);
+  TrackRegionSolver<Warp> *solver = &local_solver;
+  if (context_solver != NULL) {
+    if (*context_solver == NULL) {
+      *context_solver = new TrackRegionSolver<Warp>(initial_warp);
+    }
+    solver = static_cast<TrackRegionSolver<Warp> *>(*context_solver);
   }
+  Warp &warp = *solver->Reset(options,
+                              image_and_gradient1,
+                              image_and_gradient2,
+                              integral_image2,
+                              canonical_homography,
+                              num_samples_x,
+                              num_samples_y,
+                              initial_warp,
+                              x1, y1,
+                              x2_original, y2_original);
+  PixelDifferenceCostFunctor<Warp> *pixel_difference_cost_function =
+      solver->pixel_difference();
 
   // Configure the solve.
   ceres::Solver::Options solver_options;
@@ -1407,9 +2116,13 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
 
   // Run the solve.
   ceres::Solver::Summary summary;
-  ceres::Solve(solver_options, &problem, &summary);
+  ceres::Solve(solver_options, solver->problem(), &summary);
+  result->num_residual_samples = NumPixelResiduals(options,
+                                                   num_samples_x,
+                                                   num_samples_y);
 
-  LG << "Summary:\n" << summary.FullReport();
+  // The full report is expensive to format, so only build it when asked for.
+  VLOG(1) << "Summary:\n" << summary.FullReport();
 
   // Update the four points with the found solution; if the solver failed, then
   // the warp parameters are the identity (so ignore failure).
@@ -1468,20 +2181,41 @@ void TemplatedTrackRegion(const cv::Mat_<cv::Vec3f> &image1,
 #undef HANDLE_TERMINATION
 };
 
-void TrackRegion(const cv::Mat_<cv::Vec3f> &image1,
-                 const cv::Mat_<cv::Vec3f> &image2,
-                 const double *x1, const double *y1,
-                 const TrackRegionOptions &options,
-                 double *x2, double *y2,
-                 TrackRegionResult *result) {
+namespace {
+
+// TrackRegionWithGradients() on a pyramid level, which picks the solver of the
+// context to reuse.
+void TrackRegionWithGradientsAtLevel(
+    const cv::Mat_<cv::Vec3f> &image1,
+    const cv::Mat_<cv::Vec3f> &image2,
+    const cv::Mat_<cv::Vec3f> &image_and_gradient1,
+    const cv::Mat_<cv::Vec3f> &image_and_gradient2,
+    const double *x1, const double *y1,
+    const TrackRegionOptions &options,
+    double *x2, double *y2,
+    TrackRegionResult *result,
+    const cv::Mat_<double> *integral_image2,
+    int level,
+    TrackRegionContext *context) {
+  TrackRegionSolverBase **context_solver = NULL;
+  if (context != NULL &&
+      options.mode >= TrackRegionOptions::TRANSLATION &&
+      options.mode <= TrackRegionOptions::HOMOGRAPHY) {
+    context_solver = TrackRegionContextSolver(context, level, options.mode);
+  }
+
   // Enum is necessary due to templated nature of autodiff.
 #define HANDLE_MODE(mode_enum, mode_type) \
   if (options.mode == TrackRegionOptions::mode_enum) { \
     TemplatedTrackRegion<mode_type>(image1, image2, \
+                                    image_and_gradient1, \
+                                    image_and_gradient2, \
+                                    integral_image2, \
                                     x1, y1, \
                                     options, \
                                     x2, y2, \
-                                    result); \
+                                    result, \
+                                    context_solver); \
     return; \
   }
   HANDLE_MODE(TRANSLATION,                TranslationWarp);
@@ -1491,6 +2225,301 @@ void TrackRegion(const cv::Mat_<cv::Vec3f> &image1,
   HANDLE_MODE(AFFINE,                     AffineWarp);
   HANDLE_MODE(HOMOGRAPHY,                 HomographyWarp);
 #undef HANDLE_MODE
+  result->termination = TrackRegionResult::CONFIGURATION_ERROR;
+}
+
+}  // namespace
+
+void TrackRegionWithGradients(const cv::Mat_<cv::Vec3f> &image1,
+                              const cv::Mat_<cv::Vec3f> &image2,
+                              const cv::Mat_<cv::Vec3f> &image_and_gradient1,
+                              const cv::Mat_<cv::Vec3f> &image_and_gradient2,
+                              const double *x1, const double *y1,
+                              const TrackRegionOptions &options,
+                              double *x2, double *y2,
+                              TrackRegionResult *result,
+                              const cv::Mat_<double> *integral_image2,
+                              TrackRegionContext *context) {
+  TrackRegionWithGradientsAtLevel(image1, image2,
+                                  image_and_gradient1, image_and_gradient2,
+                                  x1, y1,
+                                  options,
+                                  x2, y2,
+                                  result,
+                                  integral_image2,
+                                  0,
+                                  context);
+}
+
+namespace {
+
+// The images and the blurred images and gradients of one frame, for every
+// pyramid level used by TrackRegion(). Level 0 is the full resolution image.
+// The summed-area tables of the blurred images are only built for the
+// destination frame of normalized tracking, and are empty otherwise.
+struct TrackRegionPyramid {
+  std::vector<cv::Mat_<cv::Vec3f> > images;
+  std::vector<cv::Mat_<cv::Vec3f> > image_and_gradients;
+  std::vector<cv::Mat_<double> > integral_images;
+};
+
+void BuildTrackRegionPyramid(const cv::Mat_<cv::Vec3f> &image,
+                             int num_levels,
+                             bool with_integral_images,
+                             TrackRegionPyramid *pyramid) {
+  pyramid->images.clear();
+  pyramid->images.push_back(image);
+  for (int i = 1; i < num_levels; ++i) {
+    const cv::Mat_<cv::Vec3f> &finer = pyramid->images.back();
+    if (finer.rows < 2 || finer.cols < 2) {
+      break;
+    }
+    cv::Mat_<cv::Vec3f> coarser;
+    cv::pyrDown(finer, coarser);
+    pyramid->images.push_back(coarser);
+  }
+  pyramid->image_and_gradients.resize(pyramid->images.size());
+  for (int i = 0; i < static_cast<int>(pyramid->images.size()); ++i) {
+    BlurredImageAndDerivativesChannels(pyramid->images[i],
+                                       pyramid->image_and_gradients[i]);
+  }
+  pyramid->integral_images.clear();
+  if (with_integral_images) {
+    pyramid->integral_images.resize(pyramid->images.size());
+    for (int i = 0; i < static_cast<int>(pyramid->images.size()); ++i) {
+      cv::Mat blurred;
+      cv::extractChannel(pyramid->image_and_gradients[i], blurred, 0);
+      cv::integral(blurred, pyramid->integral_images[i], CV_64F);
+    }
+  }
+}
+
+const cv::Mat_<double> *IntegralImageOrNull(const TrackRegionPyramid &pyramid,
+                                            int level) {
+  if (pyramid.integral_images.empty()) {
+    return NULL;
+  }
+  return &pyramid.integral_images[level];
+}
+
+// Downsample the pattern mask, if any, alongside image1.
+void BuildMaskPyramid(const TrackRegionOptions &options,
+                      int num_levels,
+                      std::vector<cv::Mat_<cv::Vec3f> > *masks) {
+  masks->clear();
+  if (!options.image1_mask) {
+    return;
+  }
+  masks->push_back(*options.image1_mask);
+  for (int i = 1; i < num_levels; ++i) {
+    cv::Mat_<cv::Vec3f> coarser;
+    cv::pyrDown(masks->back(), coarser);
+    masks->push_back(coarser);
+  }
+}
+
+// Patterns smaller than this many pixels along either side on a coarse level
+// are mostly blur, so such levels are skipped.
+const int kMinimumPyramidPatternSize = 8;
+
+// The sampling code puts pixel centers at +0.5, while pyrDown() keeps pixel
+// index 2i of the finer level at index i of the coarser one.
+double ToPyramidLevel(double coordinate, int level) {
+  return (coordinate - 0.5) / (1 << level) + 0.5;
+}
+
+double FromPyramidLevel(double coordinate, int level) {
+  return (coordinate - 0.5) * (1 << level) + 0.5;
+}
+
+bool CoarseLevelConverged(const TrackRegionResult &result) {
+  return result.termination == TrackRegionResult::PARAMETER_TOLERANCE ||
+         result.termination == TrackRegionResult::FUNCTION_TOLERANCE ||
+         result.termination == TrackRegionResult::GRADIENT_TOLERANCE ||
+         result.termination == TrackRegionResult::NO_CONVERGENCE;
+}
+
+// Track from the coarsest pyramid level to the finest, using the quad found on
+// each level as the initial guess for the next one. Only the four corners are
+// tracked on the coarse levels; the full resolution solve is the one that
+// produces the extra points, the correlation and the reported termination.
+void TrackRegionCoarseToFine(const TrackRegionPyramid &pyramid1,
+                             const TrackRegionPyramid &pyramid2,
+                             const std::vector<cv::Mat_<cv::Vec3f> > &masks,
+                             const double *x1, const double *y1,
+                             const TrackRegionOptions &options,
+                             double *x2, double *y2,
+                             TrackRegionResult *result,
+                             TrackRegionContext *context) {
+  const int num_levels = std::min(pyramid1.images.size(),
+                                  pyramid2.images.size());
+
+  // The correlation check is only meaningful at full resolution, and a
+  // brute-force translation search is only needed on the first level that
+  // converges; the coarser the level, the cheaper it is.
+  TrackRegionOptions level_options = options;
+  level_options.num_extra_points = 0;
+  level_options.minimum_correlation = 0.0;
+  bool used_brute_initialization = false;
+  bool coarse_level_converged = false;
+
+  for (int level = num_levels - 1; level > 0; --level) {
+    double level_x1[4], level_y1[4];
+    double level_x2[4], level_y2[4];
+    for (int i = 0; i < 4; ++i) {
+      level_x1[i] = ToPyramidLevel(x1[i], level);
+      level_y1[i] = ToPyramidLevel(y1[i], level);
+      level_x2[i] = ToPyramidLevel(x2[i], level);
+      level_y2[i] = ToPyramidLevel(y2[i], level);
+    }
+
+    int num_samples_x;
+    int num_samples_y;
+    PickSampling(level_x1, level_y1, level_x2, level_y2,
+                 &num_samples_x, &num_samples_y);
+    if (std::min(num_samples_x, num_samples_y) < kMinimumPyramidPatternSize) {
+      LG << "Skipping pyramid level " << level << ", pattern too small.";
+      continue;
+    }
+
+    cv::Mat_<cv::Vec3f> level_mask;
+    if (!masks.empty()) {
+      level_mask = masks[level];
+      level_options.image1_mask = &level_mask;
+    }
+    level_options.use_brute_initialization =
+        options.use_brute_initialization && !coarse_level_converged;
+
+    TrackRegionResult level_result;
+    TrackRegionWithGradientsAtLevel(pyramid1.images[level],
+                                    pyramid2.images[level],
+                                    pyramid1.image_and_gradients[level],
+                                    pyramid2.image_and_gradients[level],
+                                    level_x1, level_y1,
+                                    level_options,
+                                    level_x2, level_y2,
+                                    &level_result,
+                                    IntegralImageOrNull(pyramid2, level),
+                                    level,
+                                    context);
+
+    // Keep the previous guess if this level failed; a finer level may still
+    // recover.
+    if (!CoarseLevelConverged(level_result)) {
+      LG << "Pyramid level " << level << " failed with termination "
+         << level_result.termination << ", keeping the previous guess.";
+      continue;
+    }
+    for (int i = 0; i < 4; ++i) {
+      x2[i] = FromPyramidLevel(level_x2[i], level);
+      y2[i] = FromPyramidLevel(level_y2[i], level);
+    }
+    used_brute_initialization |=
+        level_result.used_brute_translation_initialization;
+    coarse_level_converged = true;
+  }
+
+  TrackRegionOptions full_resolution_options = options;
+  if (coarse_level_converged) {
+    full_resolution_options.use_brute_initialization = false;
+  }
+  TrackRegionWithGradients(pyramid1.images[0],
+                           pyramid2.images[0],
+                           pyramid1.image_and_gradients[0],
+                           pyramid2.image_and_gradients[0],
+                           x1, y1,
+                           full_resolution_options,
+                           x2, y2,
+                           result,
+                           IntegralImageOrNull(pyramid2, 0),
+                           context);
+  result->used_brute_translation_initialization |= used_brute_initialization;
+}
+
+}  // namespace
+
+void TrackRegion(const cv::Mat_<cv::Vec3f> &image1,
+                 const cv::Mat_<cv::Vec3f> &image2,
+                 const double *x1, const double *y1,
+                 const TrackRegionOptions &options,
+                 double *x2, double *y2,
+                 TrackRegionResult *result,
+                 TrackRegionContext *context) {
+  // Prepare the image and gradient pyramids; with one level this is just the
+  // blurred image and gradient. The summed-area tables are built exactly as
+  // TrackRegions() builds them, so that both normalize alike; a table costs
+  // one more pass over image2, which is already blurred whole.
+  TrackRegionPyramid pyramid1;
+  TrackRegionPyramid pyramid2;
+  BuildTrackRegionPyramid(image1, options.num_pyramid_levels, false,
+                          &pyramid1);
+  BuildTrackRegionPyramid(image2, options.num_pyramid_levels,
+                          options.use_normalized_intensities,
+                          &pyramid2);
+
+  std::vector<cv::Mat_<cv::Vec3f> > masks;
+  BuildMaskPyramid(options, pyramid1.images.size(), &masks);
+
+  TrackRegionCoarseToFine(pyramid1, pyramid2, masks,
+                          x1, y1,
+                          options,
+                          x2, y2,
+                          result,
+                          context);
+}
+
+void TrackRegions(const cv::Mat_<cv::Vec3f> &image1,
+                  const cv::Mat_<cv::Vec3f> &image2,
+                  const TrackRegionOptions &options,
+                  std::vector<TrackRegionQuad> *quads,
+                  std::vector<TrackRegionResult> *results) {
+  results->resize(quads->size());
+  if (quads->empty()) {
+    return;
+  }
+
+  // The blur and gradients are the dominant per-frame cost when there are
+  // many markers, so compute them (and the pyramids, if any) once for the
+  // whole frame pair. Likewise for the summed-area tables that make the
+  // normalizer of normalized tracking a constant-time lookup.
+  TrackRegionPyramid pyramid1;
+  TrackRegionPyramid pyramid2;
+  BuildTrackRegionPyramid(image1, options.num_pyramid_levels, false,
+                          &pyramid1);
+  BuildTrackRegionPyramid(image2, options.num_pyramid_levels,
+                          options.use_normalized_intensities,
+                          &pyramid2);
+
+  std::vector<cv::Mat_<cv::Vec3f> > masks;
+  BuildMaskPyramid(options, pyramid1.images.size(), &masks);
+
+  // Each marker only reads the shared images and writes to its own quad and
+  // result, so the markers can be solved independently. Solve times vary a
+  // lot between markers (brute initialization, early termination), hence the
+  // dynamic schedule. Each thread reuses its own solver storage.
+  const int num_quads = static_cast<int>(quads->size());
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    TrackRegionContext context;
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+    for (int i = 0; i < num_quads; ++i) {
+      TrackRegionQuad &quad = (*quads)[i];
+      CHECK_GE(quad.x1.size(), 4 + options.num_extra_points);
+      CHECK_EQ(quad.x1.size(), quad.y1.size());
+      CHECK_EQ(quad.x1.size(), quad.x2.size());
+      CHECK_EQ(quad.x1.size(), quad.y2.size());
+      TrackRegionCoarseToFine(pyramid1, pyramid2, masks,
+                              &quad.x1[0], &quad.y1[0],
+                              options,
+                              &quad.x2[0], &quad.y2[0],
+                              &(*results)[i],
+                              &context);
+    }
+  }
 }
 
 bool SamplePlanarPatch(const cv::Mat_<cv::Vec3f> &image,
@@ -1505,7 +2534,7 @@ bool SamplePlanarPatch(const cv::Mat_<cv::Vec3f> &image,
   }
 
   // Make the patch have the appropriate size, and match the depth of image.
-  patch->resize(num_samples_y, num_samples_x);
+  patch->create(num_samples_y, num_samples_x);
 
   // Compute the warp from rectangular coordinates.
   Mat3 canonical_homography = ComputeCanonicalHomography(xs, ys,
@@ -1513,18 +2542,23 @@ bool SamplePlanarPatch(const cv::Mat_<cv::Vec3f> &image,
                                                          num_samples_y);
 
   // Walk over the coordinates in the canonical space, sampling from the image
-  // in the original space and copying the result into the patch.
+  // in the original space and copying the result into the patch. The
+  // positions of a whole row are computed first so that the row is sampled
+  // with a single (vectorized) call.
+  std::vector<float> row_xs(num_samples_x);
+  std::vector<float> row_ys(num_samples_x);
   for (int r = 0; r < num_samples_y; ++r) {
     for (int c = 0; c < num_samples_x; ++c) {
       Vec3 image_position = canonical_homography * Vec3(c, r, 1);
       image_position /= image_position(2);
-      SampleLinear(image, image_position(1),
-                   image_position(0),
-                   &(*patch)(r, c)[0]);
-      if (mask) {
-        float mask_value = SampleLinear(*mask, image_position(1),
-                                        image_position(0), 0);
-
+      row_xs[c] = image_position(0);
+      row_ys[c] = image_position(1);
+    }
+    SampleLinearRow(image, &row_xs[0], &row_ys[0], num_samples_x,
+                    &(*patch)(r, 0));
+    if (mask) {
+      for (int c = 0; c < num_samples_x; ++c) {
+        float mask_value = SampleLinear(*mask, row_ys[c], row_xs[c], 0);
         (*patch)(r, c) = (*patch)(r, c) * mask_value;
       }
     }
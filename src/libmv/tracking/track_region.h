@@ -19,10 +19,13 @@
 // IN THE SOFTWARE.
 
 #ifndef LIBMV_TRACKING_TRACK_REGION_H_
+#define LIBMV_TRACKING_TRACK_REGION_H_
 
 // Necessary for M_E when building with MSVC.
 #define _USE_MATH_DEFINES
 
+#include <vector>
+
 #include "libmv/tracking/esm_region_tracker.h"
 
 #include "libmv/image/sample.h"
@@ -61,13 +64,44 @@ struct TrackRegionOptions {
   // increasing light intensity is multiplicative on the pixel intensities.
   //
   // Note: This does nearly double the solving time, so it is not advised to
-  // turn this on all the time.
+  // turn this on all the time. The exception is TrackRegions() with the
+  // translation or translation-scale modes and unmasked, axis-aligned
+  // patterns, where the normalization comes from a summed-area table shared by
+  // all markers and costs about the same as unnormalized tracking.
   bool use_normalized_intensities;
 
+  // If true, the derivatives of the pixel residuals are computed by chaining
+  // the image gradients with hand-written Jacobians of the warp, instead of
+  // with automatic differentiation. The result is the same up to rounding,
+  // but avoids carrying a jet per warp parameter through every sample.
+  bool use_analytic_jacobians;
+
   // The size in pixels of the blur kernel used to both smooth the image and
   // take the image derivative.
   double sigma;
 
+  // If greater than one, track coarse-to-fine on a pyramid with this many
+  // levels, each half the size of the previous one. The quad found on a coarse
+  // level is scaled up and used as the initial guess for the next finer one,
+  // which widens the basin of convergence for large motions. When
+  // use_brute_initialization is set, the brute-force search runs only on the
+  // coarsest level that converges, rather than at full resolution. Levels on
+  // which the pattern would be too small to track are skipped.
+  int num_pyramid_levels;
+
+  // If positive, build residuals for only this many pattern samples instead
+  // of all of them: the ones with the largest image gradient (weighted by
+  // image1_mask, if any), since flat areas contribute little to the solve.
+  // This cuts the per-iteration cost roughly in proportion for large
+  // patterns. The final correlation check still uses every sample.
+  int num_sparse_samples;
+
+  // With num_sparse_samples, split the pattern into a grid of this many cells
+  // per side and give each cell an equal share of the samples before taking
+  // the rest by gradient alone. This keeps the samples from bunching up on a
+  // single strong edge, which would leave motion along it unconstrained.
+  int sparse_sample_grid_size;
+
   // Extra points that should get transformed by the warp. This is useful
   // because the actual warp parameters are not exposed.
   int num_extra_points;
@@ -101,6 +135,8 @@ struct TrackRegionOptions {
 };
 
 struct TrackRegionResult {
+  TrackRegionResult();
+
   enum Termination {
     // Ceres termination types, duplicated; though, not the int values.
     PARAMETER_TOLERANCE,
@@ -121,19 +157,98 @@ struct TrackRegionResult {
   Termination termination;
 
   int num_iterations;
+
+  // The pattern samples that got residuals in the final solve: all of them,
+  // or at most num_sparse_samples.
+  int num_residual_samples;
+
   double correlation;
 
-  // Final parameters?
+  // Whether the brute force translation search ran, on any pyramid level.
   bool used_brute_translation_initialization;
 };
 
-// Always needs 4 correspondences.
+class TrackRegionSolverBase;
+
+// Storage that TrackRegion() can reuse from one call to the next: for each
+// warp model and pyramid level, the Ceres problem and the cost functions with
+// their pattern buffers. Without a context these are allocated and freed on
+// every call.
+//
+// Each level keeps its own, since the number of pattern samples (about the
+// size of the pattern in pixels) differs between levels. They are rebuilt
+// whenever that number, use_analytic_jacobians or the use of regularization
+// changes from one call to the next at the same level, so a context pays off
+// most when tracking similar markers one after the other. Keep one context
+// per thread; a context must not be used by two calls at the same time.
+class TrackRegionContext {
+ public:
+  TrackRegionContext();
+  ~TrackRegionContext();
+
+ private:
+  // Returns the solver slot of a level and mode, which starts out NULL.
+  friend TrackRegionSolverBase **TrackRegionContextSolver(
+      TrackRegionContext *context, int level, TrackRegionOptions::Mode mode);
+
+  // Indexed by level * (TrackRegionOptions::HOMOGRAPHY + 1) + mode, and grown
+  // as deeper levels are used.
+  std::vector<TrackRegionSolverBase *> solvers_;
+
+  TrackRegionContext(const TrackRegionContext &);
+  void operator=(const TrackRegionContext &);
+};
+
+// Always needs 4 correspondences. If context is not NULL, the solver storage
+// in it is reused; see TrackRegionContext.
 void TrackRegion(const cv::Mat_<cv::Vec3f> &image1,
                  const cv::Mat_<cv::Vec3f> &image2,
                  const double *x1, const double *y1,
                  const TrackRegionOptions &options,
                  double *x2, double *y2,
-                 TrackRegionResult *result);
+                 TrackRegionResult *result,
+                 TrackRegionContext *context = NULL);
+
+// Same as TrackRegion(), but takes the output of
+// BlurredImageAndDerivativesChannels() for image1 and image2 rather than
+// computing it. Pass level 0 of PyramidCache::BlurredAndDerivatives() with a
+// sigma of zero to share the gradients among all the trackers of a frame.
+//
+// If integral_image2 is not NULL, it must be the cv::integral() (CV_64F) of
+// channel 0 of image_and_gradient2. Normalized tracking then computes the mean
+// of the warped pattern from it, for the translation and translation-scale
+// modes with an axis-aligned pattern and no mask. The table is worth sharing
+// among all the markers tracked into the same frame.
+void TrackRegionWithGradients(const cv::Mat_<cv::Vec3f> &image1,
+                              const cv::Mat_<cv::Vec3f> &image2,
+                              const cv::Mat_<cv::Vec3f> &image_and_gradient1,
+                              const cv::Mat_<cv::Vec3f> &image_and_gradient2,
+                              const double *x1, const double *y1,
+                              const TrackRegionOptions &options,
+                              double *x2, double *y2,
+                              TrackRegionResult *result,
+                              const cv::Mat_<double> *integral_image2 = NULL,
+                              TrackRegionContext *context = NULL);
+
+// The corners of one marker for TrackRegions(). Each array holds the four
+// corners followed by options.num_extra_points extra points, exactly as the
+// x1, y1, x2, y2 arrays passed to TrackRegion().
+struct TrackRegionQuad {
+  std::vector<double> x1, y1;
+  std::vector<double> x2, y2;
+};
+
+// Track many markers between the same pair of frames. The blurred image and
+// gradients of image1 and image2 are computed once and shared by all markers,
+// which are then solved in parallel (if OpenMP is available), with one
+// TrackRegionContext per thread. The x2 and y2
+// arrays of every quad are updated in place, and results is resized to match
+// quads. The output is identical to calling TrackRegion() on each quad.
+void TrackRegions(const cv::Mat_<cv::Vec3f> &image1,
+                  const cv::Mat_<cv::Vec3f> &image2,
+                  const TrackRegionOptions &options,
+                  std::vector<TrackRegionQuad> *quads,
+                  std::vector<TrackRegionResult> *results);
 
 // Sample a "canonical" version of the passed planar patch, using bilinear
 // sampling. The passed corners must be within the image, and have at least two
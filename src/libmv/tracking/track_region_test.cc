@@ -0,0 +1,403 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include <vector>
+
+#include "libmv/tracking/region_tracker.h"
+#include "libmv/tracking/track_region.h"
+#include "libmv/tracking/track_region_test_data.h"
+#include "testing/testing.h"
+
+namespace libmv {
+namespace {
+
+TEST(TrackRegions, MatchesPerMarkerTrackRegion) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(120, 120);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(120, 120);
+
+  const double dx = 1.5, dy = -1.0;
+  const double centers[3][2] = { { 30, 30 }, { 80, 40 }, { 50, 85 } };
+  for (int i = 0; i < 3; ++i) {
+    DrawBlob(centers[i][0],      centers[i][1],      4.0, &image1);
+    DrawBlob(centers[i][0] + dx, centers[i][1] + dy, 4.0, &image2);
+  }
+
+  TrackRegionOptions options;
+  options.mode = TrackRegionOptions::TRANSLATION;
+  options.use_brute_initialization = false;
+
+  std::vector<TrackRegionQuad> quads(3);
+  for (int i = 0; i < 3; ++i) {
+    MakeSquareQuad(centers[i][0], centers[i][1], 8.0, &quads[i]);
+  }
+  std::vector<TrackRegionQuad> expected_quads = quads;
+
+  std::vector<TrackRegionResult> results;
+  TrackRegions(image1, image2, options, &quads, &results);
+  ASSERT_EQ(3, results.size());
+
+  for (int i = 0; i < 3; ++i) {
+    TrackRegionQuad &expected = expected_quads[i];
+    TrackRegionResult expected_result;
+    TrackRegion(image1, image2,
+                &expected.x1[0], &expected.y1[0],
+                options,
+                &expected.x2[0], &expected.y2[0],
+                &expected_result);
+
+    EXPECT_EQ(expected_result.termination, results[i].termination);
+    for (int j = 0; j < 4; ++j) {
+      // The batched path must be bitwise identical to the per-marker path.
+      EXPECT_EQ(expected.x2[j], quads[i].x2[j]);
+      EXPECT_EQ(expected.y2[j], quads[i].y2[j]);
+      EXPECT_NEAR(quads[i].x1[j] + dx, quads[i].x2[j], 0.05);
+      EXPECT_NEAR(quads[i].y1[j] + dy, quads[i].y2[j], 0.05);
+    }
+  }
+}
+
+// A context carries solver storage from call to call; it must never carry
+// state that changes the results.
+TEST(TrackRegion, ContextDoesNotChangeResults) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(120, 120);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(120, 120);
+
+  const double dx = -1.3, dy = 0.8;
+  const double centers[3][2] = { { 30, 30 }, { 80, 40 }, { 50, 85 } };
+  for (int i = 0; i < 3; ++i) {
+    DrawBlob(centers[i][0],      centers[i][1],      4.0, &image1);
+    DrawBlob(centers[i][0] + dx, centers[i][1] + dy, 4.0, &image2);
+  }
+
+  // Alternate models, pattern sizes and pyramid levels so the context both
+  // reuses and rebuilds its solvers.
+  const TrackRegionOptions::Mode modes[] = {
+    TrackRegionOptions::TRANSLATION,
+    TrackRegionOptions::AFFINE,
+    TrackRegionOptions::TRANSLATION,
+  };
+  const int num_pyramid_levels[] = { 1, 1, 2 };
+  const double half_sizes[] = { 8.0, 8.0, 10.0 };
+
+  TrackRegionContext context;
+  for (int m = 0; m < 3; ++m) {
+    TrackRegionOptions options;
+    options.mode = modes[m];
+    options.num_pyramid_levels = num_pyramid_levels[m];
+    options.use_brute_initialization = false;
+    options.regularization_coefficient = m == 1 ? 0.1 : 0.0;
+    for (int i = 0; i < 3; ++i) {
+      TrackRegionQuad with_context, without_context;
+      MakeSquareQuad(centers[i][0], centers[i][1], half_sizes[i],
+                     &with_context);
+      without_context = with_context;
+
+      TrackRegionResult result_with_context, result_without_context;
+      TrackRegion(image1, image2,
+                  &with_context.x1[0], &with_context.y1[0],
+                  options,
+                  &with_context.x2[0], &with_context.y2[0],
+                  &result_with_context,
+                  &context);
+      TrackRegion(image1, image2,
+                  &without_context.x1[0], &without_context.y1[0],
+                  options,
+                  &without_context.x2[0], &without_context.y2[0],
+                  &result_without_context);
+
+      EXPECT_EQ(result_without_context.termination,
+                result_with_context.termination);
+      for (int j = 0; j < 4; ++j) {
+        EXPECT_EQ(without_context.x2[j], with_context.x2[j]);
+        EXPECT_EQ(without_context.y2[j], with_context.y2[j]);
+      }
+    }
+  }
+}
+
+// Track the same marker with autodiff and with the analytic Jacobians; both
+// must take the same steps (up to rounding) for every warp model.
+void ExpectAnalyticMatchesAutodiff(TrackRegionOptions::Mode mode,
+                                   bool use_esm,
+                                   bool use_normalized_intensities) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(80, 80);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(80, 80);
+  DrawBlob(38, 40, 5.0, &image1);
+  DrawBlob(43, 38, 3.0, &image1);
+  DrawBlob(39.2, 41.1, 5.0, &image2);
+  DrawBlob(44.2, 39.1, 3.0, &image2);
+
+  TrackRegionOptions options;
+  options.mode = mode;
+  options.use_esm = use_esm;
+  options.use_normalized_intensities = use_normalized_intensities;
+  options.use_brute_initialization = false;
+
+  TrackRegionQuad autodiff;
+  MakeSquareQuad(40, 40, 10.0, &autodiff);
+  TrackRegionQuad analytic = autodiff;
+
+  TrackRegionResult autodiff_result, analytic_result;
+  options.use_analytic_jacobians = false;
+  TrackRegion(image1, image2,
+              &autodiff.x1[0], &autodiff.y1[0],
+              options,
+              &autodiff.x2[0], &autodiff.y2[0],
+              &autodiff_result);
+  options.use_analytic_jacobians = true;
+  TrackRegion(image1, image2,
+              &analytic.x1[0], &analytic.y1[0],
+              options,
+              &analytic.x2[0], &analytic.y2[0],
+              &analytic_result);
+
+  EXPECT_EQ(autodiff_result.termination, analytic_result.termination)
+      << "mode=" << mode;
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_NEAR(autodiff.x2[i], analytic.x2[i], 1e-6) << "mode=" << mode;
+    EXPECT_NEAR(autodiff.y2[i], analytic.y2[i], 1e-6) << "mode=" << mode;
+  }
+}
+
+TEST(TrackRegion, AnalyticJacobiansMatchAutodiff) {
+  const TrackRegionOptions::Mode modes[] = {
+    TrackRegionOptions::TRANSLATION,
+    TrackRegionOptions::TRANSLATION_SCALE,
+    TrackRegionOptions::TRANSLATION_ROTATION,
+    TrackRegionOptions::TRANSLATION_ROTATION_SCALE,
+    TrackRegionOptions::AFFINE,
+    TrackRegionOptions::HOMOGRAPHY,
+  };
+  for (int i = 0; i < 6; ++i) {
+    ExpectAnalyticMatchesAutodiff(modes[i], false, false);
+    ExpectAnalyticMatchesAutodiff(modes[i], true,  false);
+    ExpectAnalyticMatchesAutodiff(modes[i], true,  true);
+  }
+}
+
+// A motion several times the blob size is outside the basin of convergence at
+// full resolution, but only a couple of pixels on the coarsest level.
+TEST(TrackRegion, CoarseToFineRecoversLargeMotion) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(160, 160);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(160, 160);
+
+  const double dx = 11.0, dy = -9.0;
+  DrawBlob(70, 80, 5.0, &image1);
+  DrawBlob(86, 76, 3.0, &image1);
+  DrawBlob(70 + dx, 80 + dy, 5.0, &image2);
+  DrawBlob(86 + dx, 76 + dy, 3.0, &image2);
+
+  TrackRegionOptions options;
+  options.mode = TrackRegionOptions::TRANSLATION;
+  options.use_brute_initialization = false;
+  options.num_pyramid_levels = 3;
+
+  TrackRegionQuad quad;
+  MakeSquareQuad(76, 78, 20.0, &quad);
+
+  TrackRegionResult result;
+  TrackRegion(image1, image2,
+              &quad.x1[0], &quad.y1[0],
+              options,
+              &quad.x2[0], &quad.y2[0],
+              &result);
+
+  EXPECT_LE(result.termination, TrackRegionResult::NO_CONVERGENCE);
+  for (int i = 0; i < 4; ++i) {
+    EXPECT_NEAR(quad.x1[i] + dx, quad.x2[i], 0.05);
+    EXPECT_NEAR(quad.y1[i] + dy, quad.y2[i], 0.05);
+  }
+}
+
+// The result says whether the brute translation search ran, on the only level
+// or on any level of a pyramid.
+void ExpectBruteInitializationReported(bool use_brute_initialization,
+                                       int num_pyramid_levels) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(120, 120);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(120, 120);
+  DrawBlob(58, 60, 5.0, &image1);
+  DrawBlob(63, 58, 3.0, &image1);
+  DrawBlob(60, 59, 5.0, &image2);
+  DrawBlob(65, 57, 3.0, &image2);
+
+  TrackRegionOptions options;
+  options.mode = TrackRegionOptions::TRANSLATION;
+  options.use_brute_initialization = use_brute_initialization;
+  options.num_pyramid_levels = num_pyramid_levels;
+
+  TrackRegionQuad quad;
+  MakeSquareQuad(60, 60, 10.0, &quad);
+
+  TrackRegionResult result;
+  TrackRegion(image1, image2,
+              &quad.x1[0], &quad.y1[0],
+              options,
+              &quad.x2[0], &quad.y2[0],
+              &result);
+  EXPECT_EQ(use_brute_initialization,
+            result.used_brute_translation_initialization)
+      << "levels=" << num_pyramid_levels;
+}
+
+TEST(TrackRegion, ReportsBruteInitialization) {
+  ExpectBruteInitializationReported(false, 1);
+  ExpectBruteInitializationReported(true,  1);
+  ExpectBruteInitializationReported(false, 2);
+  ExpectBruteInitializationReported(true,  2);
+}
+
+// With normalized intensities, TrackRegion() and TrackRegions() take the
+// pattern mean from a summed-area table for the translation modes. They must
+// agree exactly, and still undo a global brightness change about as well as
+// the sampled mean does.
+TEST(TrackRegions, IntegralImageNormalizerMatchesSampledNormalizer) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(120, 120);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(120, 120);
+
+  const double dx = 1.2, dy = 0.7;
+  const double centers[2][2] = { { 35, 40 }, { 80, 75 } };
+  for (int i = 0; i < 2; ++i) {
+    DrawBlob(centers[i][0],      centers[i][1],      4.0, &image1);
+    DrawBlob(centers[i][0] + dx, centers[i][1] + dy, 4.0, &image2);
+  }
+  image1 += 0.2;
+  image2 += 0.2;
+  image2 *= 1.5;
+  cv::Mat_<cv::Vec3f> image_and_gradient1, image_and_gradient2;
+  BlurredImageAndDerivativesChannels(image1, image_and_gradient1);
+  BlurredImageAndDerivativesChannels(image2, image_and_gradient2);
+
+  const TrackRegionOptions::Mode modes[] = {
+    TrackRegionOptions::TRANSLATION,
+    TrackRegionOptions::TRANSLATION_SCALE,
+  };
+  for (int m = 0; m < 2; ++m) {
+    TrackRegionOptions options;
+    options.mode = modes[m];
+    options.use_brute_initialization = false;
+    options.use_normalized_intensities = true;
+
+    std::vector<TrackRegionQuad> quads(2);
+    for (int i = 0; i < 2; ++i) {
+      MakeSquareQuad(centers[i][0], centers[i][1], 9.0, &quads[i]);
+    }
+    std::vector<TrackRegionQuad> single_quads = quads;
+    std::vector<TrackRegionQuad> sampled_quads = quads;
+
+    std::vector<TrackRegionResult> results;
+    TrackRegions(image1, image2, options, &quads, &results);
+
+    for (int i = 0; i < 2; ++i) {
+      TrackRegionQuad &single = single_quads[i];
+      TrackRegionResult single_result;
+      TrackRegion(image1, image2,
+                  &single.x1[0], &single.y1[0],
+                  options,
+                  &single.x2[0], &single.y2[0],
+                  &single_result);
+
+      // Without a summed-area table, the mean is sampled.
+      TrackRegionQuad &sampled = sampled_quads[i];
+      TrackRegionResult sampled_result;
+      TrackRegionWithGradients(image1, image2,
+                               image_and_gradient1, image_and_gradient2,
+                               &sampled.x1[0], &sampled.y1[0],
+                               options,
+                               &sampled.x2[0], &sampled.y2[0],
+                               &sampled_result);
+
+      EXPECT_LE(results[i].termination, TrackRegionResult::NO_CONVERGENCE);
+      EXPECT_EQ(single_result.termination, results[i].termination);
+      for (int j = 0; j < 4; ++j) {
+        EXPECT_EQ(single.x2[j], quads[i].x2[j]) << "mode=" << m;
+        EXPECT_EQ(single.y2[j], quads[i].y2[j]) << "mode=" << m;
+        EXPECT_NEAR(sampled.x2[j], quads[i].x2[j], 0.02) << "mode=" << m;
+        EXPECT_NEAR(sampled.y2[j], quads[i].y2[j], 0.02) << "mode=" << m;
+        EXPECT_NEAR(quads[i].x1[j] + dx, quads[i].x2[j], 0.05);
+        EXPECT_NEAR(quads[i].y1[j] + dy, quads[i].y2[j], 0.05);
+      }
+    }
+  }
+}
+
+// Tracking on only the highest-gradient samples should land where dense
+// tracking does, with and without stratifying the samples over a grid.
+TEST(TrackRegion, SparseSamplesMatchDenseSamples) {
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(120, 120);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(120, 120);
+
+  const double dx = 1.4, dy = -0.9;
+  const double centers[2][2] = { { 40, 45 }, { 75, 70 } };
+  for (int i = 0; i < 2; ++i) {
+    DrawBlob(centers[i][0],      centers[i][1],      4.0, &image1);
+    DrawBlob(centers[i][0] + dx, centers[i][1] + dy, 4.0, &image2);
+  }
+
+  const TrackRegionOptions::Mode modes[] = {
+    TrackRegionOptions::TRANSLATION,
+    TrackRegionOptions::AFFINE,
+  };
+  const int grid_sizes[] = { 1, 4 };
+  for (int m = 0; m < 2; ++m) {
+    TrackRegionOptions options;
+    options.mode = modes[m];
+    options.use_brute_initialization = false;
+
+    for (int i = 0; i < 2; ++i) {
+      TrackRegionQuad dense;
+      MakeSquareQuad(centers[i][0], centers[i][1], 10.0, &dense);
+      TrackRegionResult dense_result;
+      TrackRegion(image1, image2,
+                  &dense.x1[0], &dense.y1[0],
+                  options,
+                  &dense.x2[0], &dense.y2[0],
+                  &dense_result);
+      EXPECT_EQ(20 * 20, dense_result.num_residual_samples);
+
+      for (int g = 0; g < 2; ++g) {
+        TrackRegionOptions sparse_options = options;
+        sparse_options.num_sparse_samples = 120;
+        sparse_options.sparse_sample_grid_size = grid_sizes[g];
+
+        TrackRegionQuad sparse;
+        MakeSquareQuad(centers[i][0], centers[i][1], 10.0, &sparse);
+        TrackRegionResult sparse_result;
+        TrackRegion(image1, image2,
+                    &sparse.x1[0], &sparse.y1[0],
+                    sparse_options,
+                    &sparse.x2[0], &sparse.y2[0],
+                    &sparse_result);
+
+        EXPECT_LE(sparse_result.termination,
+                  TrackRegionResult::NO_CONVERGENCE);
+        EXPECT_EQ(120, sparse_result.num_residual_samples);
+        for (int j = 0; j < 4; ++j) {
+          EXPECT_NEAR(dense.x2[j], sparse.x2[j], 0.05) << "mode=" << m;
+          EXPECT_NEAR(dense.y2[j], sparse.y2[j], 0.05) << "mode=" << m;
+          EXPECT_NEAR(sparse.x1[j] + dx, sparse.x2[j], 0.1);
+          EXPECT_NEAR(sparse.y1[j] + dy, sparse.y2[j], 0.1);
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+}  // namespace libmv
@@ -0,0 +1,57 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#include "libmv/tracking/track_region_test_data.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace libmv {
+
+void DrawBlob(double x, double y, double sigma, cv::Mat_<float> *image,
+              double weight) {
+  int radius = static_cast<int>(ceil(6 * sigma));
+  int r0 = std::max(0, static_cast<int>(floor(y)) - radius);
+  int r1 = std::min(image->rows, static_cast<int>(floor(y)) + radius + 1);
+  int c0 = std::max(0, static_cast<int>(floor(x)) - radius);
+  int c1 = std::min(image->cols, static_cast<int>(floor(x)) + radius + 1);
+  for (int r = r0; r < r1; ++r) {
+    for (int c = c0; c < c1; ++c) {
+      double dx = c - x;
+      double dy = r - y;
+      (*image)(r, c) +=
+          weight * exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+    }
+  }
+}
+
+void MakeSquareQuad(double x, double y, double half_size,
+                    TrackRegionQuad *quad) {
+  const double xs[4] = { x - half_size, x + half_size,
+                         x + half_size, x - half_size };
+  const double ys[4] = { y - half_size, y - half_size,
+                         y + half_size, y + half_size };
+  quad->x1.assign(xs, xs + 4);
+  quad->y1.assign(ys, ys + 4);
+  quad->x2 = quad->x1;
+  quad->y2 = quad->y1;
+}
+
+}  // namespace libmv
@@ -0,0 +1,44 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+
+#ifndef LIBMV_TRACKING_TRACK_REGION_TEST_DATA_H_
+#define LIBMV_TRACKING_TRACK_REGION_TEST_DATA_H_
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/tracking/track_region.h"
+
+namespace libmv {
+
+// Synthetic scenes for the TrackRegion() tests and benchmark.
+
+// Add a Gaussian blob centered at (x, y) to image; the tracker needs gradients
+// over the whole pattern area to converge. The blob is cut off at six sigma.
+void DrawBlob(double x, double y, double sigma, cv::Mat_<float> *image,
+              double weight = 1.0);
+
+// Set up a square pattern of half width half_size centered at (x, y), with the
+// image2 guess equal to the image1 position.
+void MakeSquareQuad(double x, double y, double half_size,
+                    TrackRegionQuad *quad);
+
+}  // namespace libmv
+
+#endif  // LIBMV_TRACKING_TRACK_REGION_TEST_DATA_H_
@@ -37,6 +37,7 @@
 
 #include "libmv/simple_pipeline/bundle.h"
 #include "libmv/simple_pipeline/initialize_reconstruction.h"
+#include "libmv/simple_pipeline/pipeline.h"
 
 #include "libmv/simple_pipeline/tracks.h"
 
@@ -58,7 +59,6 @@ libmv_solveReconstruction( const libmv::Tracks &tracks,
                            int refine_intrinsics )
 {
     /* Invert the camera intrinsics. */
-    libmv::vector<libmv::Marker> markers = tracks.AllMarkers();
     libmv::EuclideanReconstruction *reconstruction = &libmv_reconstruction.reconstruction;
     libmv::CameraIntrinsics *intrinsics = &libmv_reconstruction.intrinsics;
 
@@ -66,16 +66,9 @@ libmv_solveReconstruction( const libmv::Tracks &tracks,
     intrinsics->SetPrincipalPoint(principal_x, principal_y);
     intrinsics->SetRadialDistortion(k1, k2, k3);
 
-    cout << "\tNumber of markers: " << markers.size() << endl;
-    for (int i = 0; i < markers.size(); ++i)
-    {
-        intrinsics->InvertIntrinsics(markers[i].x,
-                                     markers[i].y,
-                                     &(markers[i].x),
-                                     &(markers[i].y));
-    }
-
-    libmv::Tracks normalized_tracks(markers);
+    cout << "\tNumber of markers: " << tracks.NumMarkers() << endl;
+    libmv::Tracks normalized_tracks;
+    libmv::InvertIntrinsicsForTracks(tracks, *intrinsics, &normalized_tracks);
 
     cout << "\tframes to init from: " << keyframe1 << " " << keyframe2 << endl;
     libmv::vector<libmv::Marker> keyframe_markers =
@@ -0,0 +1,165 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Compares the SSBA and Ceres backends of EuclideanBundleCommonIntrinsics() on
+// synthetic reconstructions of growing size: cameras on a circle around a
+// cloud of points, with noisy markers and perturbed cameras, points and focal
+// length. Each solver starts from the same perturbed reconstruction.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/logging/logging.h"
+#include "libmv/numeric/numeric.h"
+#include "libmv/simple_pipeline/bundle.h"
+#include "libmv/simple_pipeline/camera_intrinsics.h"
+#include "libmv/simple_pipeline/pipeline.h"
+#include "libmv/simple_pipeline/reconstruction.h"
+#include "libmv/simple_pipeline/tracks.h"
+#include "libmv/tools/tool.h"
+
+DEFINE_int32(num_cameras, 200, "Number of cameras at the largest size.");
+DEFINE_int32(num_points, 20000, "Number of points at the largest size.");
+DEFINE_int32(num_threads, 4, "Threads for the multi-threaded Ceres runs.");
+DEFINE_int32(max_iterations, 100, "Maximum number of iterations.");
+DEFINE_double(noise, 0.5, "Marker noise, in pixels.");
+DEFINE_int32(seed, 1, "Seed for the synthetic scene.");
+
+using namespace libmv;
+
+namespace {
+
+double RandomUniform(double min, double max) {
+  return min + (max - min) * rand() / static_cast<double>(RAND_MAX);
+}
+
+struct Scene {
+  Tracks tracks;
+  EuclideanReconstruction initial;
+  CameraIntrinsics true_intrinsics;
+  CameraIntrinsics initial_intrinsics;
+};
+
+void MakeScene(int num_cameras, int num_points, Scene *scene) {
+  scene->true_intrinsics.SetFocalLength(1000, 1000);
+  scene->true_intrinsics.SetPrincipalPoint(640, 360);
+  scene->true_intrinsics.SetImageSize(1280, 720);
+  scene->initial_intrinsics.SetFocalLength(1030, 1030);
+  scene->initial_intrinsics.SetPrincipalPoint(640, 360);
+  scene->initial_intrinsics.SetImageSize(1280, 720);
+
+  std::vector<Vec3> points(num_points);
+  for (int j = 0; j < num_points; ++j) {
+    points[j] << RandomUniform(-2, 2), RandomUniform(-2, 2),
+                 RandomUniform(-2, 2);
+    Vec3 noise(RandomUniform(-0.05, 0.05), RandomUniform(-0.05, 0.05),
+               RandomUniform(-0.05, 0.05));
+    scene->initial.InsertPoint(j, points[j] + noise);
+  }
+
+  // Cameras on a half circle of radius 10 looking at the origin, each seeing
+  // the points in front of it.
+  for (int i = 0; i < num_cameras; ++i) {
+    double angle = M_PI * i / num_cameras;
+    Mat3 R = RotationAroundY(angle);
+    Vec3 center(10 * sin(angle), 0, -10 * cos(angle));
+    Vec3 t = -R * center;
+    for (int j = 0; j < num_points; ++j) {
+      Vec3 x = R * points[j] + t;
+      double image_x, image_y;
+      scene->true_intrinsics.ApplyIntrinsics(x(0) / x(2), x(1) / x(2),
+                                             &image_x, &image_y);
+      image_x += RandomUniform(-FLAGS_noise, FLAGS_noise);
+      image_y += RandomUniform(-FLAGS_noise, FLAGS_noise);
+      if (image_x >= 0 && image_x < 1280 && image_y >= 0 && image_y < 720 &&
+          rand() % 4 == 0) {
+        scene->tracks.Insert(i, j, image_x, image_y);
+      }
+    }
+    Mat3 dR = RotationAroundX(RandomUniform(-0.01, 0.01)) *
+              RotationAroundY(RandomUniform(-0.01, 0.01));
+    Vec3 dt(RandomUniform(-0.1, 0.1), RandomUniform(-0.1, 0.1),
+            RandomUniform(-0.1, 0.1));
+    scene->initial.InsertCamera(i, dR * R, t + dt);
+  }
+}
+
+const char *SolverName(BundleOptions::Solver solver) {
+  switch (solver) {
+    case BundleOptions::SSBA: return "ssba";
+    case BundleOptions::CERES_SPARSE_SCHUR: return "sparse schur";
+    case BundleOptions::CERES_ITERATIVE_SCHUR: return "iterative schur";
+  }
+  return "unknown";
+}
+
+// The solver that ran is printed too, since Ceres without a sparse
+// factorization runs the iterative solver when asked for the sparse one.
+void Run(const Scene &scene, const char *name, const BundleOptions &options) {
+  EuclideanReconstruction reconstruction(scene.initial);
+  CameraIntrinsics intrinsics(scene.initial_intrinsics);
+  BundleSummary summary;
+  int64 start = cv::getTickCount();
+  EuclideanBundleCommonIntrinsics(scene.tracks, BUNDLE_FOCAL_LENGTH, options,
+                                  &reconstruction, &intrinsics, &summary);
+  double seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+  double error = EuclideanReprojectionError(scene.tracks, reconstruction,
+                                            intrinsics);
+  printf("%-26s %-16s %10.3f %12.4f %10.2f\n",
+         name, SolverName(summary.solver), seconds, error,
+         intrinsics.focal_length());
+  fflush(stdout);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Init("Compare the SSBA and Ceres bundle adjusters.", &argc, &argv);
+
+  for (int scale = 4; scale >= 1; scale /= 2) {
+    srand(FLAGS_seed);
+    Scene scene;
+    MakeScene(FLAGS_num_cameras / scale, FLAGS_num_points / scale, &scene);
+    printf("\n%d cameras, %d points, %d markers\n",
+           FLAGS_num_cameras / scale, FLAGS_num_points / scale,
+           scene.tracks.NumMarkers());
+    printf("%-26s %-16s %10s %12s %10s\n",
+           "requested", "ran", "seconds", "error (px)", "focal");
+
+    BundleOptions options;
+    options.max_iterations = FLAGS_max_iterations;
+    Run(scene, "ssba", options);
+
+    options.solver = BundleOptions::CERES_SPARSE_SCHUR;
+    Run(scene, "ceres sparse schur", options);
+    options.num_threads = FLAGS_num_threads;
+    Run(scene, "ceres sparse schur, mt", options);
+
+    options.solver = BundleOptions::CERES_ITERATIVE_SCHUR;
+    options.num_threads = 1;
+    Run(scene, "ceres iterative schur", options);
+    options.num_threads = FLAGS_num_threads;
+    Run(scene, "ceres iterative schur, mt", options);
+  }
+  return 0;
+}
@@ -0,0 +1,157 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Compares the time to load markers from the text format of
+// ExportMatchesToTxt() and from a binary marker file (see marker_file.h), on
+// synthetic tracks: parsing alone, and loading into Tracks and Matches.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/correspondence/import_matches_txt.h"
+#include "libmv/correspondence/marker_file.h"
+#include "libmv/correspondence/matches_file.h"
+#include "libmv/logging/logging.h"
+#include "libmv/simple_pipeline/tracks_file.h"
+#include "libmv/tools/tool.h"
+
+DEFINE_int32(num_markers, 2000000, "Number of markers.");
+DEFINE_int32(track_length, 50, "Number of images each track spans.");
+DEFINE_bool(matches, false, "Also time loading into Matches, which is slow "
+            "for many markers whatever the format.");
+DEFINE_string(directory, "/tmp", "Where to write the files.");
+DEFINE_int32(seed, 1, "Seed for the synthetic tracks.");
+
+using namespace libmv;
+
+namespace {
+
+double Seconds(int64 start) {
+  return (cv::getTickCount() - start) / cv::getTickFrequency();
+}
+
+void Print(const char *name, double seconds, double baseline) {
+  printf("%-32s %10.3f %8.1fx\n", name, seconds, baseline / seconds);
+}
+
+// How ImportMatchesFromTxt() used to parse: one stream extraction per field.
+void ReadMarkersWithStreams(const std::string &filename,
+                            MarkerColumns *markers) {
+  std::ifstream in(filename.c_str());
+  int image, track;
+  double x, y;
+  while (in >> image >> track >> x >> y) {
+    markers->PushBack(image, track, x, y);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Init("Benchmark loading markers from text and binary files.", &argc, &argv);
+  srand(FLAGS_seed);
+
+  MarkerColumns markers;
+  markers.Reserve(FLAGS_num_markers);
+  for (int track = 0; markers.size() < FLAGS_num_markers; ++track) {
+    int first_image = rand() % 1000;
+    for (int i = 0; i < FLAGS_track_length &&
+                    markers.size() < FLAGS_num_markers; ++i) {
+      markers.PushBack(first_image + i, track,
+                       640.0 * rand() / RAND_MAX, 480.0 * rand() / RAND_MAX);
+    }
+  }
+  std::string txt = FLAGS_directory + "/marker_file_benchmark.txt";
+  std::string binary = FLAGS_directory + "/marker_file_benchmark.bin";
+  CHECK(WriteMarkersToTxt(txt, markers));
+  CHECK(WriteMarkerFile(binary, markers));
+  printf("%d markers; the second run of each format is timed, so both are "
+         "in the page cache.\n", markers.size());
+  printf("%-32s %10s %9s\n", "", "seconds", "speedup");
+
+  MarkerColumns read;
+  ReadMarkersWithStreams(txt, &read);
+  read.Clear();
+  int64 start = cv::getTickCount();
+  ReadMarkersWithStreams(txt, &read);
+  double streams = Seconds(start);
+  Print("text, streams", streams, streams);
+  CHECK_EQ(markers.size(), read.size());
+
+  start = cv::getTickCount();
+  CHECK(ReadMarkersFromTxt(txt, &read));
+  Print("text, ReadMarkersFromTxt()", Seconds(start), streams);
+
+  {
+    MarkerFile file;
+    CHECK(file.Open(binary));
+  }
+  start = cv::getTickCount();
+  MarkerFile file;
+  CHECK(file.Open(binary));
+  // Touch every page, as a reader of the columns would.
+  double sum = 0;
+  for (int i = 0; i < file.num_markers(); ++i) {
+    sum += file.images()[i] + file.tracks()[i] + file.xs()[i] + file.ys()[i];
+  }
+  Print("binary, mapped columns", Seconds(start), streams);
+  CHECK_GT(sum, 0);
+
+  start = cv::getTickCount();
+  file.ToColumns(&read);
+  Print("binary, copied columns", Seconds(start), streams);
+
+  Tracks tracks;
+  start = cv::getTickCount();
+  ReadMarkersFromTxt(txt, &read);
+  for (int i = 0; i < read.size(); ++i) {
+    tracks.Insert(read.images[i], read.tracks[i], read.xs[i], read.ys[i]);
+  }
+  double text_tracks = Seconds(start);
+  Print("text into Tracks", text_tracks, streams);
+
+  start = cv::getTickCount();
+  CHECK(LoadTracks(binary, &tracks));
+  Print("binary into Tracks", Seconds(start), streams);
+  CHECK_EQ(markers.size(), tracks.NumMarkers());
+
+  if (FLAGS_matches) {
+    Matches text_matches;
+    FeatureSet text_features;
+    start = cv::getTickCount();
+    ImportMatchesFromTxt(txt, &text_matches, &text_features);
+    double text_import = Seconds(start);
+    Print("ImportMatchesFromTxt()", text_import, streams);
+
+    Matches binary_matches;
+    FeatureSet binary_features;
+    start = cv::getTickCount();
+    CHECK(ImportMatchesFromBinary(binary, &binary_matches, &binary_features));
+    Print("ImportMatchesFromBinary()", Seconds(start), streams);
+  }
+
+  remove(txt.c_str());
+  remove(binary.c_str());
+  return 0;
+}
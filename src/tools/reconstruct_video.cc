@@ -70,7 +70,10 @@ int main (int argc, char *argv[]) {
   FeatureSet *fs = fg.CreateNewFeatureSet();
   
   VLOG(0) << "Loading Matches file... Got removed so the code will fail" << std::endl;
-  ImportMatchesFromTxt(FLAGS_i, &fg.matches_, fs);
+  if (!ImportMatchesFromTxt(FLAGS_i, &fg.matches_, fs)) {
+    LOG(ERROR) << "Cannot load the matches from " << FLAGS_i << ".";
+    return 1;
+  }
   VLOG(0) << "Loading Matches file...[DONE]." << std::endl;
   
   // Estimates the camera trajectory and 3D structure of the scene
@@ -334,7 +334,10 @@ int main(int argc, char **argv) {
   tracker::FeaturesGraph fg;
   FeatureSet *fs = fg.CreateNewFeatureSet();
   VLOG(0) << "Loading Matches file..." << std::endl;
-  ImportMatchesFromTxt(FLAGS_m, &fg.matches_, fs);
+  if (!ImportMatchesFromTxt(FLAGS_m, &fg.matches_, fs)) {
+    LOG(ERROR) << "Cannot load the matches from " << FLAGS_m << ".";
+    return 1;
+  }
   VLOG(0) << "Loading Matches file...[DONE]." << std::endl;
     
   vector<cv::Matx33d> Hs;
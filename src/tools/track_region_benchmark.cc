@@ -0,0 +1,178 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Compares the speed and accuracy of TrackRegion() with sparse residuals
+// (TrackRegionOptions::num_sparse_samples) against the dense default, on a
+// synthetic image of blobs shifted by a known sub-pixel motion, drawn with the
+// fixtures of the TrackRegion() tests.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/logging/logging.h"
+#include "libmv/tools/tool.h"
+#include "libmv/tracking/track_region.h"
+#include "libmv/tracking/track_region_test_data.h"
+
+DEFINE_int32(num_markers, 50, "Number of markers to track.");
+DEFINE_int32(half_size, 15, "Half the width of the square patterns, in px.");
+DEFINE_string(mode, "affine", "Motion model: translation or affine.");
+DEFINE_int32(grid_size, 4, "Grid size for the stratified sparse runs.");
+DEFINE_int32(seed, 1, "Seed for the synthetic scene.");
+
+using namespace libmv;
+
+namespace {
+
+double RandomUniform(double min, double max) {
+  return min + (max - min) * rand() / static_cast<double>(RAND_MAX);
+}
+
+struct Run {
+  double seconds;
+  double mean_error;     // Against the true motion.
+  double mean_to_dense;  // Against the dense result.
+  int num_failed;
+  // Residual samples per marker, as reported by TrackRegion(); the pattern
+  // sampling, not the pattern size, decides how many there are.
+  double mean_samples;
+};
+
+Run TrackAll(const cv::Mat_<float> &image1,
+             const cv::Mat_<float> &image2,
+             const std::vector<TrackRegionQuad> &initial,
+             const TrackRegionOptions &options,
+             double dx, double dy,
+             const std::vector<TrackRegionQuad> *dense,
+             std::vector<TrackRegionQuad> *quads) {
+  *quads = initial;
+  TrackRegionContext context;
+  Run run;
+  run.num_failed = 0;
+  int64 num_samples = 0;
+  int64 start = cv::getTickCount();
+  for (size_t i = 0; i < quads->size(); ++i) {
+    TrackRegionQuad &quad = (*quads)[i];
+    TrackRegionResult result;
+    TrackRegion(image1, image2,
+                &quad.x1[0], &quad.y1[0],
+                options,
+                &quad.x2[0], &quad.y2[0],
+                &result,
+                &context);
+    if (result.termination > TrackRegionResult::NO_CONVERGENCE) {
+      ++run.num_failed;
+    }
+    num_samples += result.num_residual_samples;
+  }
+  run.seconds = (cv::getTickCount() - start) / cv::getTickFrequency();
+  run.mean_samples = num_samples / static_cast<double>(quads->size());
+
+  run.mean_error = 0.0;
+  run.mean_to_dense = 0.0;
+  for (size_t i = 0; i < quads->size(); ++i) {
+    const TrackRegionQuad &quad = (*quads)[i];
+    for (int j = 0; j < 4; ++j) {
+      run.mean_error += hypot(quad.x2[j] - quad.x1[j] - dx,
+                              quad.y2[j] - quad.y1[j] - dy);
+      if (dense != NULL) {
+        run.mean_to_dense += hypot(quad.x2[j] - (*dense)[i].x2[j],
+                                   quad.y2[j] - (*dense)[i].y2[j]);
+      }
+    }
+  }
+  run.mean_error /= 4 * quads->size();
+  run.mean_to_dense /= 4 * quads->size();
+  return run;
+}
+
+// The time per sample is per marker and per solve, whatever the number of
+// iterations.
+void Print(const char *name, const Run &run, const Run &dense) {
+  double num_samples = run.mean_samples * FLAGS_num_markers;
+  printf("%-12s %8.0f %10.4f %8.2fx %10.1f %12.5f %12.5f %8d\n",
+         name, run.mean_samples, run.seconds, dense.seconds / run.seconds,
+         1e9 * run.seconds / num_samples,
+         run.mean_error, run.mean_to_dense, run.num_failed);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Init("Benchmark sparse against dense TrackRegion() residuals.",
+       &argc, &argv);
+  srand(FLAGS_seed);
+
+  // A textured scene: many blobs of random size and contrast, with the
+  // markers scattered over it.
+  const int kSize = 640;
+  const double dx = 1.37, dy = -0.82;
+  cv::Mat_<float> image1 = cv::Mat_<float>::zeros(kSize, kSize);
+  cv::Mat_<float> image2 = cv::Mat_<float>::zeros(kSize, kSize);
+  for (int i = 0; i < 2000; ++i) {
+    double x = RandomUniform(0, kSize);
+    double y = RandomUniform(0, kSize);
+    double sigma = RandomUniform(1.5, 5.0);
+    double weight = RandomUniform(-1.0, 1.0);
+    DrawBlob(x,      y,      sigma, &image1, weight);
+    DrawBlob(x + dx, y + dy, sigma, &image2, weight);
+  }
+
+  std::vector<TrackRegionQuad> initial(FLAGS_num_markers);
+  const double margin = 3 * FLAGS_half_size;
+  for (int i = 0; i < FLAGS_num_markers; ++i) {
+    double x = RandomUniform(margin, kSize - margin);
+    double y = RandomUniform(margin, kSize - margin);
+    MakeSquareQuad(x, y, FLAGS_half_size, &initial[i]);
+  }
+
+  TrackRegionOptions options;
+  options.mode = FLAGS_mode == "translation" ? TrackRegionOptions::TRANSLATION
+                                             : TrackRegionOptions::AFFINE;
+  options.use_brute_initialization = false;
+
+  std::vector<TrackRegionQuad> dense_quads, quads;
+  Run dense = TrackAll(image1, image2, initial, options, dx, dy,
+                       NULL, &dense_quads);
+
+  printf("%-12s %8s %10s %9s %10s %12s %12s %8s\n",
+         "residuals", "samples", "seconds", "speedup", "ns/sample",
+         "error (px)", "to dense", "failed");
+  Print("dense", dense, dense);
+  for (int fraction = 2; fraction <= 16; fraction *= 2) {
+    TrackRegionOptions sparse_options = options;
+    sparse_options.num_sparse_samples =
+        static_cast<int>(dense.mean_samples) / fraction;
+    Run sparse = TrackAll(image1, image2, initial, sparse_options, dx, dy,
+                          &dense_quads, &quads);
+    Print("top-k", sparse, dense);
+
+    sparse_options.sparse_sample_grid_size = FLAGS_grid_size;
+    Run stratified = TrackAll(image1, image2, initial, sparse_options, dx, dy,
+                              &dense_quads, &quads);
+    Print("stratified", stratified, dense);
+  }
+  return 0;
+}
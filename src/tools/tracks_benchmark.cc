@@ -0,0 +1,143 @@
+// Copyright (c) 2012 libmv authors.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Measures how the cost of inserting into and querying a Tracks container
+// grows with its size, on synthetic tracks that each live for a stretch of
+// consecutive images, inserted image by image as a tracker would. Every
+// operation should take about the same time whatever the size.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+
+#include "libmv/logging/logging.h"
+#include "libmv/simple_pipeline/tracks.h"
+#include "libmv/tools/tool.h"
+
+DEFINE_int32(num_tracks, 10000, "Number of tracks at the largest size.");
+DEFINE_int32(num_images, 2000, "Number of images at the largest size.");
+DEFINE_int32(track_length, 100, "Number of images each track spans.");
+DEFINE_int32(num_lookups, 1000000, "Number of single marker lookups.");
+DEFINE_int32(seed, 1, "Seed for the synthetic tracks.");
+
+using namespace libmv;
+
+namespace {
+
+double Seconds(int64 start) {
+  return (cv::getTickCount() - start) / cv::getTickFrequency();
+}
+
+// Prints the nanoseconds per operation.
+void Print(double seconds, double num_operations) {
+  printf(" %12.1f", 1e9 * seconds / std::max(1.0, num_operations));
+  fflush(stdout);
+}
+
+void Run(int num_tracks, int num_images) {
+  int track_length = std::min(FLAGS_track_length, num_images);
+  std::vector<int> first_image(num_tracks);
+  for (int t = 0; t < num_tracks; ++t) {
+    first_image[t] = rand() % (num_images - track_length + 1);
+  }
+  std::vector<std::vector<int> > tracks_in_image(num_images);
+  for (int t = 0; t < num_tracks; ++t) {
+    for (int i = 0; i < track_length; ++i) {
+      tracks_in_image[first_image[t] + i].push_back(t);
+    }
+  }
+
+  Tracks tracks;
+  int64 start = cv::getTickCount();
+  for (int i = 0; i < num_images; ++i) {
+    for (size_t j = 0; j < tracks_in_image[i].size(); ++j) {
+      tracks.Insert(i, tracks_in_image[i][j], i, j);
+    }
+  }
+  double num_markers = tracks.NumMarkers();
+  printf("%8d %8d %10d", num_tracks, num_images, tracks.NumMarkers());
+  Print(Seconds(start), num_markers);
+
+  // Replacing existing markers.
+  start = cv::getTickCount();
+  for (int i = 0; i < num_images; ++i) {
+    for (size_t j = 0; j < tracks_in_image[i].size(); ++j) {
+      tracks.Insert(i, tracks_in_image[i][j], j, i);
+    }
+  }
+  Print(Seconds(start), num_markers);
+
+  // Per marker returned, for the whole-image and whole-track queries.
+  start = cv::getTickCount();
+  double num_returned = 0;
+  for (int i = 0; i < num_images; ++i) {
+    num_returned += tracks.MarkersInImage(i).size();
+  }
+  Print(Seconds(start), num_returned);
+
+  start = cv::getTickCount();
+  num_returned = 0;
+  for (int t = 0; t < num_tracks; ++t) {
+    num_returned += tracks.MarkersForTrack(t).size();
+  }
+  Print(Seconds(start), num_returned);
+
+  start = cv::getTickCount();
+  num_returned = 0;
+  for (int i = 1; i < num_images; ++i) {
+    num_returned += tracks.MarkersForTracksInBothImages(i - 1, i).size();
+  }
+  Print(Seconds(start), num_returned);
+
+  start = cv::getTickCount();
+  int num_found = 0;
+  for (int k = 0; k < FLAGS_num_lookups; ++k) {
+    int t = rand() % num_tracks;
+    int i = first_image[t] + rand() % track_length;
+    num_found += tracks.MarkerInImageForTrack(i, t).track == t;
+  }
+  CHECK_EQ(FLAGS_num_lookups, num_found);
+  Print(Seconds(start), FLAGS_num_lookups);
+
+  // Remove the first image of every track.
+  start = cv::getTickCount();
+  for (int t = 0; t < num_tracks; ++t) {
+    tracks.RemoveMarker(first_image[t], t);
+  }
+  Print(Seconds(start), num_tracks);
+  printf("\n");
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  Init("Benchmark inserting into and querying Tracks.", &argc, &argv);
+  srand(FLAGS_seed);
+
+  printf("%8s %8s %10s %12s %12s %12s %12s %12s %12s %12s\n",
+         "tracks", "images", "markers", "insert (ns)", "replace",
+         "in image", "for track", "both", "lookup", "remove");
+  for (int fraction = 8; fraction >= 1; fraction /= 2) {
+    Run(FLAGS_num_tracks / fraction, FLAGS_num_images / fraction);
+  }
+  return 0;
+}